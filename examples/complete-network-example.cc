@@ -24,7 +24,7 @@
 #include "ns3/correlated-shadowing-propagation-loss-model.h"
 #include "ns3/building-penetration-loss.h"
 #include "ns3/building-allocator.h"
-#include "ns3/buildings-helper.h"
+#include "ns3/lora-buildings-helper.h"
 #include "ns3/forwarder-helper.h"
 #include <algorithm>
 #include <ctime>
@@ -243,8 +243,10 @@ main (int argc, char *argv[])
       "MinY", DoubleValue (-gridHeight * (yLength + deltaY) / 2 + deltaY / 2));
   BuildingContainer bContainer = gridBuildingAllocator->Create (gridWidth * gridHeight);
 
-  BuildingsHelper::Install (endDevices);
-  BuildingsHelper::Install (gateways);
+  LoraBuildingsHelper buildingsHelper;
+  buildingsHelper.SetBuildings (bContainer);
+  buildingsHelper.Install (endDevices);
+  buildingsHelper.Install (gateways);
 
   // Print the buildings
   if (print)
@@ -35,7 +35,7 @@
 #include "ns3/correlated-shadowing-propagation-loss-model.h"
 #include "ns3/building-penetration-loss.h"
 #include "ns3/building-allocator.h"
-#include "ns3/buildings-helper.h"
+#include "ns3/lora-buildings-helper.h"
 #include "ns3/forwarder-helper.h"
 #include <algorithm>
 #include <ctime>
@@ -76,6 +76,16 @@ uint8_t numberOfTransmissions = 8; // The maximum number of transmissions allowe
 // Output control
 bool print = true; // Save building locations to buildings.txt
 
+// File keeping the link budgets across runs of the same topology, if any
+std::string linkBudgetCache = "";
+
+// File keeping the buildings and where each node is across runs, if any
+std::string buildingCache = "";
+
+// File the progress of the simulation is reported to as JSON lines, if any
+std::string progressFile = "";
+double progressInterval = 3600; // Simulated seconds between progress reports
+
 int
 main (int argc, char *argv[])
 {
@@ -94,6 +104,10 @@ Packet::EnablePrinting ();
   cmd.AddValue("randomPSizeMin", "Minimum size for randomly sized application packets", randomPSizeMin); 
   cmd.AddValue("randomPSizeMax", "Maximum size for randomly sized application packets", randomPSizeMax); 
   cmd.AddValue("desiredNumCongestionCalcs", "How many periodic congestion calculations must be in simulationTime", desiredNumCongestionCalcs);
+  cmd.AddValue ("linkBudgetCache", "File to keep the link budgets in across runs with the same topology and seed", linkBudgetCache);
+  cmd.AddValue ("buildingCache", "File to keep the buildings in across runs with the same topology", buildingCache);
+  cmd.AddValue ("progressFile", "File to report the progress of the simulation to as JSON lines", progressFile);
+  cmd.AddValue ("progressInterval", "Simulated seconds between progress reports", progressInterval);
   cmd.Parse (argc, argv);
 
 
@@ -287,10 +301,31 @@ Packet::EnablePrinting ();
       "MinX", DoubleValue (-gridWidth * (xLength + deltaX) / 2 + deltaX / 2));
   gridBuildingAllocator->SetAttribute (
       "MinY", DoubleValue (-gridHeight * (yLength + deltaY) / 2 + deltaY / 2));
-  BuildingContainer bContainer = gridBuildingAllocator->Create (gridWidth * gridHeight);
 
-  BuildingsHelper::Install (endDevices);
-  BuildingsHelper::Install (gateways);
+  // The cache only holds the buildings of an allocator configured like this one
+  uint64_t buildingKey =
+      LoraBuildingsHelper::GetScenarioKey (gridBuildingAllocator, gridWidth * gridHeight);
+  LoraBuildingsHelper buildingsHelper;
+  BuildingContainer bContainer;
+  if (buildingCache == ""
+      || !buildingsHelper.Load (buildingCache, NodeContainer (endDevices, gateways),
+                                buildingKey))
+    {
+      bContainer = gridBuildingAllocator->Create (gridWidth * gridHeight);
+
+      buildingsHelper.SetBuildings (bContainer);
+      buildingsHelper.Install (endDevices);
+      buildingsHelper.Install (gateways);
+      if (buildingCache != "")
+        {
+          buildingsHelper.Save (buildingCache, NodeContainer (endDevices, gateways),
+                                buildingKey);
+        }
+    }
+  else
+    {
+      bContainer = buildingsHelper.GetBuildings ();
+    }
 
   // Print the buildings
   if (print)
@@ -308,6 +343,12 @@ Packet::EnablePrinting ();
       myfile.close ();
     }
 
+  // Every node and building is in place: link budgets are known from here on
+  if (linkBudgetCache != "")
+    {
+      channel->EnableLinkBudgetCache (linkBudgetCache);
+    }
+
   /**********************************************
    *  Set up the end device's spreading factor  *
    **********************************************/
@@ -366,6 +407,12 @@ Packet::EnablePrinting ();
 
   Simulator::Stop (appStopTime + Seconds(10)); // adding more time so that tracker can calculate overall metric after 3 periods have passed from time frame of interest
 
+  if (progressFile != "")
+    {
+      helper.EnableProgressTelemetry (Seconds (progressInterval),
+                                      appStopTime + Seconds (10), progressFile);
+    }
+
   NS_LOG_INFO( "Congestion is calculated over " << congestionPeriod << " s intervals");
 
 
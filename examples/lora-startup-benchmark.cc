@@ -0,0 +1,155 @@
+/*
+ * This program measures how long it takes to set up a LoRaWAN network of a
+ * given size, phase by phase: creating the nodes, placing them,
+ * installing the LoraNetDevices of end devices and gateways, assigning
+ * spreading factors and installing the applications. Nothing is simulated.
+ *
+ * The output is a header and a line with the wall clock time of each phase in
+ * seconds. Each run sets up a single network: Simulator::Destroy doesn't
+ * empty the NodeList, so networks set up one after the other in the same
+ * process would add up. To compare sizes, run the program once per size.
+ *
+ *  How to run (from the ns-3 directory)
+ * ./waf --run "lora-startup-benchmark --nDevices=10000"
+ * ./waf --run "lora-startup-benchmark --nDevices=100000 --header=0"
+ * ./waf --run "lora-startup-benchmark --nDevices=1000000 --header=0"
+ */
+
+#include "ns3/lora-helper.h"
+#include "ns3/lorawan-mac-helper.h"
+#include "ns3/lora-phy-helper.h"
+#include "ns3/hex-grid-position-allocator.h"
+#include "ns3/periodic-sender-helper.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/position-allocator.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/command-line.h"
+#include "ns3/double.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+using namespace ns3;
+using namespace lorawan;
+
+NS_LOG_COMPONENT_DEFINE ("LoraStartupBenchmark");
+
+/**
+ * Wall clock time elapsed since a point, in seconds.
+ */
+static double
+Elapsed (std::chrono::steady_clock::time_point &since)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
+  double elapsed = std::chrono::duration<double> (now - since).count ();
+  since = now;
+  return elapsed;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nDevices = 10000;
+  double devicesPerGateway = 1000;
+  double density = 500; // Devices per square kilometer
+  bool packetTracking = true;
+  bool header = true;
+
+  CommandLine cmd;
+  cmd.AddValue ("nDevices", "Number of end devices to set up", nDevices);
+  cmd.AddValue ("devicesPerGateway", "Number of end devices per gateway", devicesPerGateway);
+  cmd.AddValue ("density", "Number of end devices per square kilometer", density);
+  cmd.AddValue ("packetTracking", "Whether to connect the packet tracker", packetTracking);
+  cmd.AddValue ("header", "Whether to print the header line", header);
+  cmd.Parse (argc, argv);
+
+  if (header)
+    {
+      std::cout << "nDevices nGateways nodes mobility endDevices gateways "
+        "spreadingFactors applications total" << std::endl;
+    }
+
+  uint32_t nGateways = std::max (1.0, std::ceil (nDevices / devicesPerGateway));
+  double radius = std::sqrt (nDevices / density / M_PI) * 1000;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  std::chrono::steady_clock::time_point since = start;
+
+  // Nodes
+  NodeContainer endDevices;
+  endDevices.Create (nDevices);
+  NodeContainer gateways;
+  gateways.Create (nGateways);
+  double nodesTime = Elapsed (since);
+
+  // Mobility
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::UniformDiscPositionAllocator",
+                                 "rho", DoubleValue (radius),
+                                 "X", DoubleValue (0.0),
+                                 "Y", DoubleValue (0.0));
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.Install (endDevices);
+  // Gateways cover hexagons of the same area
+  double gatewayDistance = std::sqrt (2 * M_PI / std::sqrt (3.0) / nGateways) * radius;
+  Ptr<HexGridPositionAllocator> hexAllocator =
+    CreateObject<HexGridPositionAllocator> (gatewayDistance / 2);
+  mobility.SetPositionAllocator (hexAllocator);
+  mobility.Install (gateways);
+  double mobilityTime = Elapsed (since);
+
+  // Channel and helpers
+  Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel> ();
+  loss->SetPathLossExponent (3.76);
+  loss->SetReference (1, 7.7);
+  Ptr<PropagationDelayModel> delay = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  Ptr<LoraChannel> channel = CreateObject<LoraChannel> (loss, delay);
+
+  LoraPhyHelper phyHelper = LoraPhyHelper ();
+  phyHelper.SetChannel (channel);
+  LorawanMacHelper macHelper = LorawanMacHelper ();
+  LoraHelper helper = LoraHelper ();
+  if (packetTracking)
+    {
+      helper.EnablePacketTracking ();
+    }
+
+  // End devices
+  Ptr<LoraDeviceAddressGenerator> addrGen = CreateObject<LoraDeviceAddressGenerator> (54, 1864);
+  phyHelper.SetDeviceType (LoraPhyHelper::ED);
+  macHelper.SetDeviceType (LorawanMacHelper::ED_A);
+  macHelper.SetAddressGenerator (addrGen);
+  macHelper.SetRegion (LorawanMacHelper::EU);
+  helper.Install (phyHelper, macHelper, endDevices);
+  double endDevicesTime = Elapsed (since);
+
+  // Gateways
+  phyHelper.SetDeviceType (LoraPhyHelper::GW);
+  macHelper.SetDeviceType (LorawanMacHelper::GW);
+  helper.Install (phyHelper, macHelper, gateways);
+  double gatewaysTime = Elapsed (since);
+
+  // Spreading factors
+  LorawanMacHelper::SetSpreadingFactorsUp (endDevices, gateways, channel);
+  double spreadingFactorsTime = Elapsed (since);
+
+  // Applications
+  PeriodicSenderHelper appHelper = PeriodicSenderHelper ();
+  appHelper.SetPeriod (Seconds (600));
+  appHelper.Install (endDevices);
+  double applicationsTime = Elapsed (since);
+
+  std::cout << nDevices << " " << nGateways << std::fixed << std::setprecision (3) <<
+    " " << nodesTime << " " << mobilityTime << " " << endDevicesTime <<
+    " " << gatewaysTime << " " << spreadingFactorsTime <<
+    " " << applicationsTime << " " << Elapsed (start) << std::endl;
+
+  Simulator::Destroy ();
+
+  return 0;
+}
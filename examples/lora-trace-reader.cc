@@ -0,0 +1,214 @@
+/*
+ * This program reads a columnar trace file written by LoraHelper (see
+ * LoraHelper::EnableBinaryTrace) and computes the metrics of
+ * LoraPacketTracker::getPerformanceLegend for a time window and a set of
+ * gateways, in a single pass over the packets of the window.
+ *
+ * The output has one line per gateway: its id, followed by the same fields as
+ * the string returned by CountRetransmissionsPorted, so that the existing
+ * post-processing can parse it.
+ *
+ *  How to run (from the ns-3 directory)
+ * ./waf --run "lora-trace-reader --file=trace.lpt --start=1000 --stop=5000 --gateways=0,1"
+ */
+
+#include "ns3/lora-trace-file.h"
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/command-line.h"
+#include "ns3/log.h"
+#include "ns3/nstime.h"
+
+#include <array>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace ns3;
+using namespace lorawan;
+
+NS_LOG_COMPONENT_DEFINE ("LoraTraceReader");
+
+/**
+ * Everything needed to format the metrics of a set of gateways.
+ */
+struct WindowPerformance
+{
+  RetransmissionAggregate aggregate; //!< Packets sent by the MAC
+  std::map<uint32_t, std::vector<int> > phyCounts; //!< Per-gateway PHY counts
+  double cpsrSent; //!< Confirmed packets whose first attempt is in the window
+  double cpsrReceived; //!< Those that were ACKed
+};
+
+static void
+ComputePerformance (const LoraTraceFileReader &reader, Time start, Time stop,
+                    const std::set<uint32_t> &gateways,
+                    WindowPerformance &performance)
+{
+  performance.aggregate = RetransmissionAggregate ();
+  performance.cpsrSent = 0;
+  performance.cpsrReceived = 0;
+  for (uint32_t gw : gateways)
+    {
+      performance.phyCounts[gw] = std::vector<int> (6, 0);
+    }
+
+  int64_t startStep = start.GetTimeStep ();
+  int64_t stopStep = stop.GetTimeStep ();
+  std::vector<MacReceptionEntry> receptions;
+
+  const std::vector<TraceBlockIndexEntry> &index = reader.GetIndex ();
+  for (uint32_t b = 0; b < index.size (); b++)
+    {
+      if (index[b].magic != PACKET_BLOCK_MAGIC
+          || index[b].maxTime < startStep || index[b].minTime > stopStep)
+        {
+          continue;
+        }
+
+      PacketBlockView view = reader.GetPacketBlock (b);
+
+      // Outcomes and receptions are sorted by packet
+      uint32_t outcome = 0;
+      uint32_t reception = 0;
+      for (uint32_t p = 0; p < view.nPackets; p++)
+        {
+          uint8_t flags = view.flags[p];
+
+          uint32_t firstOutcome = outcome;
+          while (outcome < view.nOutcomes && view.outcomePackets[outcome] == p)
+            {
+              outcome++;
+            }
+          uint32_t firstReception = reception;
+          while (reception < view.nReceptions && view.receptionPackets[reception] == p)
+            {
+              reception++;
+            }
+
+          // PHY outcomes
+          int64_t phySendTime = view.phySendTimes[p];
+          if ((flags & PacketRecord::PHY_SENT)
+              && phySendTime >= startStep && phySendTime <= stopStep)
+            {
+              for (auto &counts : performance.phyCounts)
+                {
+                  counts.second.at (0)++;
+                }
+              for (uint32_t i = firstOutcome; i < outcome; i++)
+                {
+                  auto counts = performance.phyCounts.find (view.outcomeGateways[i]);
+                  if (counts != performance.phyCounts.end ())
+                    {
+                      counts->second.at (view.outcomes[i] - RECEIVED + 1)++;
+                    }
+                }
+            }
+
+          // Retransmission procedure
+          int64_t firstAttempt = view.firstAttempts[p];
+          if ((flags & PacketRecord::RETX_DONE)
+              && firstAttempt >= startStep && firstAttempt <= stopStep)
+            {
+              performance.cpsrSent++;
+              if (flags & PacketRecord::RETX_SUCCESSFUL)
+                {
+                  performance.cpsrReceived++;
+                }
+            }
+
+          // MAC transmission
+          int64_t macSendTime = view.macSendTimes[p];
+          if ((flags & PacketRecord::MAC_SENT)
+              && macSendTime >= startStep && macSendTime <= stopStep)
+            {
+              PacketRecord record = PacketRecord ();
+              record.macSendTime = TimeStep (macSendTime);
+              record.firstAttempt = TimeStep (firstAttempt);
+              record.finishTime = TimeStep (view.finishTimes[p]);
+              record.reTxAttempts = view.reTxAttempts[p];
+              record.flags = flags;
+              record.firstReception = ~0u;
+              receptions.clear ();
+              for (uint32_t i = firstReception; i < reception; i++)
+                {
+                  MacReceptionEntry entry;
+                  entry.next = record.firstReception;
+                  entry.gwId = view.receptionGateways[i];
+                  entry.receptionTime = TimeStep (view.receptionTimes[i]);
+                  record.firstReception = receptions.size ();
+                  receptions.push_back (entry);
+                }
+              LoraPacketTracker::FoldRecord (performance.aggregate, record,
+                                             receptions);
+            }
+        }
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string filename = "trace.lpt";
+  double start = 0;
+  double stop = 1e9;
+  std::string gatewayList = "";
+
+  CommandLine cmd;
+  cmd.AddValue ("file", "The trace file to read", filename);
+  cmd.AddValue ("start", "Start of the window, in seconds", start);
+  cmd.AddValue ("stop", "End of the window, in seconds", stop);
+  cmd.AddValue ("gateways",
+                "Comma-separated ids of the gateways, all of them if empty",
+                gatewayList);
+  cmd.Parse (argc, argv);
+
+  LoraTraceFileReader reader;
+  if (!reader.Open (filename))
+    {
+      std::cerr << "Can't read trace file " << filename << std::endl;
+      return 1;
+    }
+
+  std::set<uint32_t> gateways;
+  std::stringstream list (gatewayList);
+  std::string id;
+  while (std::getline (list, id, ','))
+    {
+      gateways.insert (std::stoul (id));
+    }
+  if (gateways.empty ())
+    {
+      // Every gateway that saw a packet
+      const std::vector<TraceBlockIndexEntry> &index = reader.GetIndex ();
+      for (uint32_t b = 0; b < index.size (); b++)
+        {
+          if (index[b].magic == PACKET_BLOCK_MAGIC)
+            {
+              PacketBlockView view = reader.GetPacketBlock (b);
+              for (uint32_t i = 0; i < view.nOutcomes; i++)
+                {
+                  gateways.insert (view.outcomeGateways[i]);
+                }
+            }
+        }
+    }
+
+  WindowPerformance performance;
+  ComputePerformance (reader, Seconds (start), Seconds (stop), gateways,
+                      performance);
+
+  std::cout << LoraPacketTracker ().getPerformanceLegend () << std::endl;
+  for (uint32_t gw : gateways)
+    {
+      PerformanceSnapshot snapshot =
+        LoraPacketTracker::MakePerformanceSnapshot (performance.aggregate, gw,
+                                                    performance.phyCounts[gw],
+                                                    performance.cpsrSent,
+                                                    performance.cpsrReceived);
+      std::cout << gw << " " << LoraPacketTracker::FormatPerformance (snapshot) <<
+        std::endl;
+    }
+
+  return 0;
+}
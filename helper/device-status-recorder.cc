@@ -0,0 +1,176 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/device-status-recorder.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("DeviceStatusRecorder");
+
+static bool
+IsMoving (Ptr<const MobilityModel> mobility)
+{
+  Vector velocity = mobility->GetVelocity ();
+  return velocity.x != 0 || velocity.y != 0 || velocity.z != 0;
+}
+
+DeviceStatusRecorder::DeviceStatusRecorder (NodeContainer endDevices)
+{
+  NS_LOG_FUNCTION (this << endDevices.GetN ());
+
+  m_devices.reserve (endDevices.GetN ());
+  for (NodeContainer::Iterator j = endDevices.Begin (); j != endDevices.End (); ++j)
+    {
+      Device device;
+      device.nodeId = (*j)->GetId ();
+      device.mobility = (*j)->GetObject<MobilityModel> ();
+      NS_ASSERT (device.mobility != 0);
+      Ptr<LoraNetDevice> loraNetDevice = (*j)->GetDevice (0)->GetObject<LoraNetDevice> ();
+      NS_ASSERT (loraNetDevice != 0);
+      device.mac = loraNetDevice->GetMac ()->GetObject<EndDeviceLorawanMac> ();
+      NS_ASSERT (device.mac != 0);
+
+      uint32_t index = m_devices.size ();
+      device.mac->TraceConnectWithoutContext
+        ("DataRate", MakeBoundCallback (&DeviceStatusRecorder::DataRateChanged, this, index));
+      device.mac->TraceConnectWithoutContext
+        ("TxPower", MakeBoundCallback (&DeviceStatusRecorder::TxPowerChanged, this, index));
+      device.mobility->TraceConnectWithoutContext
+        ("CourseChange", MakeBoundCallback (&DeviceStatusRecorder::CourseChanged, this, index));
+      if (IsMoving (device.mobility))
+        {
+          m_movingDevices.insert (index);
+        }
+      m_devices.push_back (device);
+    }
+  m_changed.assign (m_devices.size (), false);
+}
+
+DeviceStatusRecorder::~DeviceStatusRecorder ()
+{
+  NS_LOG_FUNCTION (this);
+
+  for (uint32_t index = 0; index < m_devices.size (); index++)
+    {
+      const Device &device = m_devices[index];
+      device.mac->TraceDisconnectWithoutContext
+        ("DataRate", MakeBoundCallback (&DeviceStatusRecorder::DataRateChanged, this, index));
+      device.mac->TraceDisconnectWithoutContext
+        ("TxPower", MakeBoundCallback (&DeviceStatusRecorder::TxPowerChanged, this, index));
+      device.mobility->TraceDisconnectWithoutContext
+        ("CourseChange", MakeBoundCallback (&DeviceStatusRecorder::CourseChanged, this, index));
+    }
+}
+
+void
+DeviceStatusRecorder::DataRateChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                                       uint8_t oldValue, uint8_t newValue)
+{
+  recorder->SetChanged (device);
+}
+
+void
+DeviceStatusRecorder::TxPowerChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                                      double oldValue, double newValue)
+{
+  recorder->SetChanged (device);
+}
+
+void
+DeviceStatusRecorder::CourseChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                                     Ptr<const MobilityModel> mobility)
+{
+  recorder->SetChanged (device);
+  if (IsMoving (mobility))
+    {
+      recorder->m_movingDevices.insert (device);
+    }
+  else
+    {
+      recorder->m_movingDevices.erase (device);
+    }
+}
+
+void
+DeviceStatusRecorder::SetChanged (uint32_t device)
+{
+  if (!m_changed[device])
+    {
+      m_changed[device] = true;
+      m_changedDevices.push_back (device);
+    }
+}
+
+DeviceStatusEntry
+DeviceStatusRecorder::GetStatus (uint32_t device) const
+{
+  const Device &d = m_devices[device];
+  Vector pos = d.mobility->GetPosition ();
+  DeviceStatusEntry status;
+  status.time = Simulator::Now ();
+  status.nodeId = d.nodeId;
+  status.x = pos.x;
+  status.y = pos.y;
+  status.dataRate = d.mac->GetDataRate ();
+  status.txPower = d.mac->GetTransmissionPower ();
+  return status;
+}
+
+void
+DeviceStatusRecorder::GetStatuses (std::vector<DeviceStatusEntry> &statuses)
+{
+  NS_LOG_FUNCTION (this);
+
+  statuses.clear ();
+  statuses.reserve (m_devices.size ());
+  for (uint32_t device = 0; device < m_devices.size (); device++)
+    {
+      statuses.push_back (GetStatus (device));
+      m_changed[device] = false;
+    }
+  m_changedDevices.clear ();
+}
+
+void
+DeviceStatusRecorder::GetChangedStatuses (std::vector<DeviceStatusEntry> &statuses)
+{
+  NS_LOG_FUNCTION (this << m_changedDevices.size () << m_movingDevices.size ());
+
+  for (uint32_t device : m_movingDevices)
+    {
+      SetChanged (device);
+    }
+
+  statuses.clear ();
+  statuses.reserve (m_changedDevices.size ());
+  for (uint32_t device : m_changedDevices)
+    {
+      statuses.push_back (GetStatus (device));
+      m_changed[device] = false;
+    }
+  m_changedDevices.clear ();
+}
+
+} // namespace lorawan
+} // namespace ns3
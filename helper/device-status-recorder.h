@@ -0,0 +1,105 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef DEVICE_STATUS_RECORDER_H
+#define DEVICE_STATUS_RECORDER_H
+
+#include "ns3/lora-trace-file.h"
+#include "ns3/end-device-lorawan-mac.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+
+#include <set>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * Keep track of which end devices changed data rate, transmission power or
+ * position, so that periodic status snapshots only need to look at those.
+ *
+ * Changes are signalled by the DataRate and TxPower trace sources of the
+ * MACs and by the CourseChange trace source of the mobility models. Devices
+ * that are moving are considered to change at every snapshot.
+ */
+class DeviceStatusRecorder
+{
+public:
+  /**
+   * Start tracking the end devices of a container, whose first device must
+   * be a LoraNetDevice.
+   */
+  DeviceStatusRecorder (NodeContainer endDevices);
+
+  /**
+   * Disconnect from the trace sources of the devices.
+   */
+  ~DeviceStatusRecorder ();
+
+  /**
+   * Get the current status of every device, and forget their changes.
+   */
+  void GetStatuses (std::vector<DeviceStatusEntry> &statuses);
+
+  /**
+   * Get the current status of the devices that changed since the last call
+   * to GetStatuses or GetChangedStatuses, and forget their changes.
+   */
+  void GetChangedStatuses (std::vector<DeviceStatusEntry> &statuses);
+
+private:
+  /**
+   * What is needed to read the status of a device.
+   */
+  struct Device
+  {
+    uint32_t nodeId; //!< The node of the device
+    Ptr<MobilityModel> mobility; //!< Its mobility model
+    Ptr<EndDeviceLorawanMac> mac; //!< Its MAC
+  };
+
+  static void DataRateChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                               uint8_t oldValue, uint8_t newValue);
+  static void TxPowerChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                              double oldValue, double newValue);
+  static void CourseChanged (DeviceStatusRecorder *recorder, uint32_t device,
+                             Ptr<const MobilityModel> mobility);
+
+  /**
+   * Remember that a device changed.
+   */
+  void SetChanged (uint32_t device);
+
+  /**
+   * Read the current status of a device.
+   */
+  DeviceStatusEntry GetStatus (uint32_t device) const;
+
+  std::vector<Device> m_devices; //!< The tracked devices
+  std::vector<bool> m_changed; //!< Whether each device changed
+  std::vector<uint32_t> m_changedDevices; //!< The devices that changed
+  std::set<uint32_t> m_movingDevices; //!< The devices with a velocity
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* DEVICE_STATUS_RECORDER_H */
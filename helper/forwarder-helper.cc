@@ -21,17 +21,70 @@
 #include "ns3/forwarder-helper.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/forwarder.h"
+#include "ns3/network-server.h"
+#include "ns3/direct-backhaul-net-device.h"
+#include "ns3/channel.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
 #include "ns3/trace-source-accessor.h"
 #include "ns3/simulator.h"
 #include "ns3/log.h"
+#include "ns3/abort.h"
 
 namespace ns3 {
 namespace lorawan {
 
 NS_LOG_COMPONENT_DEFINE ("ForwarderHelper");
 
+/**
+ * Get the lowest device address managed by the NS at the other end of a
+ * backhaul link.
+ *
+ * \return False if there is no NS there, or if it manages no device.
+ */
+static bool
+GetFirstManagedAddress (Ptr<NetDevice> backhaulNetDevice,
+                        LoraDeviceAddress &address)
+{
+  // Find the node at the other end of the link
+  Ptr<Node> nsNode;
+  Ptr<DirectBackhaulNetDevice> directNetDevice =
+    backhaulNetDevice->GetObject<DirectBackhaulNetDevice> ();
+  if (directNetDevice != 0)
+    {
+      nsNode = directNetDevice->GetPeer ()->GetNode ();
+    }
+  Ptr<Channel> channel = backhaulNetDevice->GetChannel ();
+  for (uint32_t i = 0; !nsNode && channel && i < channel->GetNDevices (); i++)
+    {
+      if (channel->GetDevice (i) != backhaulNetDevice)
+        {
+          nsNode = channel->GetDevice (i)->GetNode ();
+        }
+    }
+  if (!nsNode)
+    {
+      return false;
+    }
+
+  for (uint32_t i = 0; i < nsNode->GetNApplications (); i++)
+    {
+      Ptr<NetworkServer> ns = nsNode->GetApplication (i)->GetObject<NetworkServer> ();
+      if (ns != 0)
+        {
+          const std::map<LoraDeviceAddress, Ptr<EndDeviceStatus> > &statuses =
+            ns->GetNetworkStatus ()->m_endDeviceStatuses;
+          if (statuses.empty ())
+            {
+              return false;
+            }
+          address = statuses.begin ()->first;
+          return true;
+        }
+    }
+  return false;
+}
+
 ForwarderHelper::ForwarderHelper ()
 {
   m_factory.SetTypeId ("ns3::Forwarder");
@@ -47,6 +100,12 @@ ForwarderHelper::SetAttribute (std::string name, const AttributeValue &value)
   m_factory.Set (name, value);
 }
 
+void
+ForwarderHelper::SetShardBoundaries (std::vector<LoraDeviceAddress> shardBoundaries)
+{
+  m_shardBoundaries = shardBoundaries;
+}
+
 ApplicationContainer
 ForwarderHelper::Install (Ptr<Node> node) const
 {
@@ -75,7 +134,9 @@ ForwarderHelper::InstallPriv (Ptr<Node> node) const
   app->SetNode (node);
   node->AddApplication (app);
 
-  // Link the Forwarder to the NetDevices
+  // Link the Forwarder to the NetDevices. If the NS is sharded, the gateway
+  // has one backhaul link per shard, created in shard order.
+  std::vector<Ptr<NetDevice> > backhaulNetDevices;
   for (uint32_t i = 0; i < node->GetNDevices (); i++)
     {
       Ptr<NetDevice> currentNetDevice = node->GetDevice (i);
@@ -92,18 +153,46 @@ ForwarderHelper::InstallPriv (Ptr<Node> node) const
           Ptr<PointToPointNetDevice> pointToPointNetDevice =
             currentNetDevice->GetObject<PointToPointNetDevice> ();
 
-          app->SetPointToPointNetDevice (pointToPointNetDevice);
+          app->AddPointToPointNetDevice (pointToPointNetDevice);
+          backhaulNetDevices.push_back (pointToPointNetDevice);
 
           pointToPointNetDevice->SetReceiveCallback (MakeCallback
                                                        (&Forwarder::ReceiveFromPointToPoint,
                                                        app));
         }
+      else if (currentNetDevice->GetObject<DirectBackhaulNetDevice> () != 0)
+        {
+          Ptr<DirectBackhaulNetDevice> directBackhaulNetDevice =
+            currentNetDevice->GetObject<DirectBackhaulNetDevice> ();
+
+          app->AddDirectBackhaulNetDevice (directBackhaulNetDevice);
+          backhaulNetDevices.push_back (directBackhaulNetDevice);
+
+          directBackhaulNetDevice->SetReceiveCallback (MakeCallback
+                                                         (&Forwarder::ReceiveFromPointToPoint,
+                                                         app));
+        }
       else
         {
           NS_LOG_ERROR ("Potential error: NetDevice is neither Lora nor PointToPoint");
         }
     }
 
+  // Unless they were given, ask each shard where its address range starts
+  std::vector<LoraDeviceAddress> shardBoundaries = m_shardBoundaries;
+  if (shardBoundaries.empty ())
+    {
+      for (uint32_t i = 1; i < backhaulNetDevices.size (); i++)
+        {
+          LoraDeviceAddress address;
+          NS_ABORT_MSG_UNLESS (GetFirstManagedAddress (backhaulNetDevices[i], address),
+                               "Can't find the devices of NS shard " << i <<
+                               ": use ForwarderHelper::SetShardBoundaries");
+          shardBoundaries.push_back (address);
+        }
+    }
+  app->SetShardBoundaries (shardBoundaries);
+
   return app;
 }
 }
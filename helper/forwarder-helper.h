@@ -51,10 +51,23 @@ public:
 
   ApplicationContainer Install (Ptr<Node> node) const;
 
+  /**
+   * Set the address ranges of the shards of a sharded NS, so that
+   * forwarders route uplinks to the right shard.
+   *
+   * If they are not set, each forwarder asks the shards it is connected to
+   * for the devices they manage, which needs the NS to be installed first.
+   *
+   * \see NetworkServerHelper::GetShardBoundaries
+   */
+  void SetShardBoundaries (std::vector<LoraDeviceAddress> shardBoundaries);
+
 private:
   Ptr<Application> InstallPriv (Ptr<Node> node) const;
 
   ObjectFactory m_factory;
+
+  std::vector<LoraDeviceAddress> m_shardBoundaries;
 };
 
 } // namespace ns3
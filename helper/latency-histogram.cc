@@ -0,0 +1,229 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/latency-histogram.h"
+#include "ns3/log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("LatencyHistogram");
+
+static const uint64_t HALF_SUB_BUCKETS = 1 << (LatencyHistogram::SUB_BUCKET_BITS - 1);
+
+LatencyHistogram::LatencyHistogram () :
+  m_firstIndex (0),
+  m_count (0),
+  m_min (0),
+  m_max (0)
+{
+}
+
+uint32_t
+LatencyHistogram::GetIndex (uint64_t value)
+{
+  if (value < 2 * HALF_SUB_BUCKETS)
+    {
+      return value;
+    }
+
+  // Keep the SUB_BUCKET_BITS most significant bits of the value
+  uint32_t msb = 63 - __builtin_clzll (value);
+  uint32_t shift = msb - SUB_BUCKET_BITS + 1;
+  return shift * HALF_SUB_BUCKETS + (value >> shift);
+}
+
+uint64_t
+LatencyHistogram::GetHighestValue (uint32_t index)
+{
+  if (index < 2 * HALF_SUB_BUCKETS)
+    {
+      return index;
+    }
+
+  uint32_t shift = index / HALF_SUB_BUCKETS - 1;
+  uint64_t top = index - shift * HALF_SUB_BUCKETS;
+  return ((top + 1) << shift) - 1;
+}
+
+void
+LatencyHistogram::Add (uint64_t value, uint64_t count)
+{
+  if (count == 0)
+    {
+      return;
+    }
+
+  uint32_t index = GetIndex (value);
+  if (m_counts.empty ())
+    {
+      m_firstIndex = index;
+      m_counts.push_back (0);
+      m_min = value;
+      m_max = value;
+    }
+  else if (index < m_firstIndex)
+    {
+      m_counts.insert (m_counts.begin (), m_firstIndex - index, 0);
+      m_firstIndex = index;
+    }
+  else if (index - m_firstIndex >= m_counts.size ())
+    {
+      m_counts.resize (index - m_firstIndex + 1, 0);
+    }
+
+  m_counts[index - m_firstIndex] += count;
+  m_count += count;
+  m_min = std::min (m_min, value);
+  m_max = std::max (m_max, value);
+}
+
+void
+LatencyHistogram::Merge (const LatencyHistogram &other)
+{
+  if (other.m_counts.empty ())
+    {
+      return;
+    }
+
+  if (m_counts.empty ())
+    {
+      *this = other;
+      return;
+    }
+
+  // Make room for the buckets of the other histogram first
+  uint32_t first = std::min (m_firstIndex, other.m_firstIndex);
+  uint32_t end = std::max<uint32_t> (m_firstIndex + m_counts.size (),
+                                     other.m_firstIndex + other.m_counts.size ());
+  m_counts.insert (m_counts.begin (), m_firstIndex - first, 0);
+  m_counts.resize (end - first, 0);
+  m_firstIndex = first;
+
+  for (uint32_t i = 0; i < other.m_counts.size (); i++)
+    {
+      m_counts[other.m_firstIndex + i - m_firstIndex] += other.m_counts[i];
+    }
+  m_count += other.m_count;
+  m_min = std::min (m_min, other.m_min);
+  m_max = std::max (m_max, other.m_max);
+}
+
+uint64_t
+LatencyHistogram::GetCount (void) const
+{
+  return m_count;
+}
+
+uint64_t
+LatencyHistogram::GetMin (void) const
+{
+  return m_min;
+}
+
+uint64_t
+LatencyHistogram::GetMax (void) const
+{
+  return m_max;
+}
+
+uint64_t
+LatencyHistogram::GetValueAtQuantile (double quantile) const
+{
+  if (m_count == 0)
+    {
+      return 0;
+    }
+
+  // The rank of the value, counting from 1
+  double rank = std::ceil (std::min (std::max (quantile, 0.0), 1.0) * m_count);
+  uint64_t target = std::max<uint64_t> (rank, 1);
+
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+    {
+      seen += m_counts[i];
+      if (seen >= target)
+        {
+          uint64_t value = GetHighestValue (m_firstIndex + i);
+          return std::max (m_min, std::min (m_max, value));
+        }
+    }
+  return m_max;
+}
+
+std::string
+LatencyHistogram::Serialize (void) const
+{
+  // The layout, then the non-empty buckets
+  std::ostringstream os;
+  os << SUB_BUCKET_BITS << " " << m_min << " " << m_max;
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+    {
+      if (m_counts[i])
+        {
+          os << " " << m_firstIndex + i << ":" << m_counts[i];
+        }
+    }
+  return os.str ();
+}
+
+bool
+LatencyHistogram::Deserialize (const std::string &text,
+                               LatencyHistogram &histogram)
+{
+  std::istringstream is (text);
+  uint32_t subBucketBits;
+  uint64_t min, max;
+  if (!(is >> subBucketBits >> min >> max) || subBucketBits != SUB_BUCKET_BITS)
+    {
+      NS_LOG_ERROR ("Not a histogram with " << SUB_BUCKET_BITS <<
+                    " sub-bucket bits: " << text);
+      return false;
+    }
+
+  histogram = LatencyHistogram ();
+  uint32_t index;
+  char colon;
+  uint64_t count;
+  while (is >> index >> colon >> count)
+    {
+      if (colon != ':')
+        {
+          return false;
+        }
+      // Any value of the bucket does, min and max are set below
+      histogram.Add (GetHighestValue (index), count);
+    }
+  if (histogram.m_count)
+    {
+      histogram.m_min = min;
+      histogram.m_max = max;
+    }
+  return is.eof ();
+}
+
+} // namespace lorawan
+
+} // namespace ns3
@@ -0,0 +1,119 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * A streaming histogram of non-negative integer values, for latency
+ * quantiles.
+ *
+ * Values below 2^SUB_BUCKET_BITS are counted exactly. Larger values fall in
+ * buckets that split each power of two in 2^(SUB_BUCKET_BITS - 1) equal
+ * parts, so that a quantile is off by at most 1 / 2^(SUB_BUCKET_BITS - 1) of
+ * its value. Adding a value takes constant time, and only the range of
+ * buckets between the smallest and the largest value is stored, which keeps
+ * histograms of similar values small.
+ *
+ * Histograms have the same layout everywhere, so that they can be merged
+ * exactly, including when they come from different runs through Serialize
+ * and Deserialize.
+ */
+class LatencyHistogram
+{
+public:
+  static const uint32_t SUB_BUCKET_BITS = 6; //!< About 3% precision
+
+  LatencyHistogram ();
+
+  /**
+   * Count a value.
+   */
+  void Add (uint64_t value, uint64_t count = 1);
+
+  /**
+   * Add the counts of another histogram to this one.
+   */
+  void Merge (const LatencyHistogram &other);
+
+  /**
+   * Get the number of values counted.
+   */
+  uint64_t GetCount (void) const;
+
+  /**
+   * Get the smallest value counted, or 0 if the histogram is empty.
+   */
+  uint64_t GetMin (void) const;
+
+  /**
+   * Get the largest value counted, or 0 if the histogram is empty.
+   */
+  uint64_t GetMax (void) const;
+
+  /**
+   * Get the value below which a fraction of the counted values are, as the
+   * largest value of its bucket, or 0 if the histogram is empty.
+   *
+   * \param quantile The fraction, between 0 and 1 (e.g., 0.99 for p99).
+   */
+  uint64_t GetValueAtQuantile (double quantile) const;
+
+  /**
+   * Render the histogram as a single line of text.
+   */
+  std::string Serialize (void) const;
+
+  /**
+   * Read a histogram written by Serialize.
+   *
+   * \returns False if the text is not a histogram with this layout.
+   */
+  static bool Deserialize (const std::string &text, LatencyHistogram &histogram);
+
+private:
+  /**
+   * Get the bucket of a value.
+   */
+  static uint32_t GetIndex (uint64_t value);
+
+  /**
+   * Get the largest value of a bucket.
+   */
+  static uint64_t GetHighestValue (uint32_t index);
+
+  uint32_t m_firstIndex; //!< Bucket of m_counts[0]
+  std::vector<uint64_t> m_counts; //!< Counts, from m_firstIndex on
+  uint64_t m_count; //!< Sum of m_counts
+  uint64_t m_min; //!< Smallest value counted
+  uint64_t m_max; //!< Largest value counted
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* LATENCY_HISTOGRAM_H */
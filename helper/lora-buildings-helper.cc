@@ -0,0 +1,475 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/lora-buildings-helper.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/lora-utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("LoraBuildingsHelper");
+
+/**
+ * The magic number and version of building files.
+ *
+ * A building file is a 24 bytes header (magic, version, 64 bit scenario key,
+ * number of buildings and number of attachments), followed by the
+ * BuildingRecords and then by the AttachmentRecords, in host byte order.
+ */
+static const uint32_t BUILDING_FILE_MAGIC = 0x4c424c44; // "LBLD"
+static const uint32_t BUILDING_FILE_VERSION = 2;
+
+/**
+ * A building, as written to the file.
+ */
+struct BuildingRecord
+{
+  double xMin;
+  double xMax;
+  double yMin;
+  double yMax;
+  double zMin;
+  double zMax;
+  uint32_t buildingType;
+  uint32_t extWallsType;
+  uint32_t nFloors;
+  uint32_t nRoomsX;
+  uint32_t nRoomsY;
+  uint32_t padding;
+};
+
+/**
+ * Where a node is, as written to the file.
+ */
+struct AttachmentRecord
+{
+  uint32_t nodeId;
+  int32_t building;
+  uint32_t floor;
+  uint32_t roomX;
+  uint32_t roomY;
+  uint32_t padding;
+  double x;
+  double y;
+  double z;
+};
+
+LoraBuildingsHelper::LoraBuildingsHelper () :
+  m_cellSize (0),
+  m_xMin (0),
+  m_yMin (0),
+  m_gridCellSize (1),
+  m_nCellsX (0),
+  m_nCellsY (0)
+{
+}
+
+void
+LoraBuildingsHelper::SetCellSize (double cellSize)
+{
+  m_cellSize = cellSize;
+}
+
+void
+LoraBuildingsHelper::SetBuildings (BuildingContainer buildings)
+{
+  NS_LOG_FUNCTION (this << buildings.GetN ());
+
+  m_buildings.assign (buildings.Begin (), buildings.End ());
+  m_cellStart.clear ();
+  m_cellBuildings.clear ();
+  m_nCellsX = 0;
+  m_nCellsY = 0;
+  if (m_buildings.empty ())
+    {
+      return;
+    }
+
+  // Bounds of the grid, and typical size of a building
+  Box first = m_buildings.front ()->GetBoundaries ();
+  m_xMin = first.xMin;
+  m_yMin = first.yMin;
+  double xMax = first.xMax;
+  double yMax = first.yMax;
+  double extent = 0;
+  for (const Ptr<Building> &building : m_buildings)
+    {
+      Box boundaries = building->GetBoundaries ();
+      m_xMin = std::min (m_xMin, boundaries.xMin);
+      m_yMin = std::min (m_yMin, boundaries.yMin);
+      xMax = std::max (xMax, boundaries.xMax);
+      yMax = std::max (yMax, boundaries.yMax);
+      extent += std::max (boundaries.xMax - boundaries.xMin,
+                          boundaries.yMax - boundaries.yMin);
+    }
+
+  m_gridCellSize = m_cellSize;
+  if (m_cellSize <= 0)
+    {
+      // Keep the number of cells in the order of the number of buildings,
+      // even when buildings are small and far apart
+      m_gridCellSize = std::max (extent / m_buildings.size (),
+                                 std::sqrt ((xMax - m_xMin) * (yMax - m_yMin)
+                                            / (4.0 * m_buildings.size ())));
+    }
+  if (!(m_gridCellSize > 0))
+    {
+      m_gridCellSize = 1;
+    }
+  m_nCellsX = std::floor ((xMax - m_xMin) / m_gridCellSize) + 1;
+  m_nCellsY = std::floor ((yMax - m_yMin) / m_gridCellSize) + 1;
+  uint64_t nCells = uint64_t (m_nCellsX) * m_nCellsY;
+  NS_LOG_DEBUG ("Indexing " << m_buildings.size () << " buildings in " <<
+                m_nCellsX << "x" << m_nCellsY << " cells of " << m_gridCellSize << " m");
+
+  // Count the buildings of each cell, then fill the cells in building order
+  m_cellStart.assign (nCells + 1, 0);
+  for (uint32_t pass = 0; pass < 2; pass++)
+    {
+      std::vector<uint32_t> next (m_cellStart.begin (), m_cellStart.end () - 1);
+      for (uint32_t i = 0; i < m_buildings.size (); i++)
+        {
+          Box boundaries = m_buildings[i]->GetBoundaries ();
+          uint32_t xFirst = GetCell (boundaries.xMin, m_xMin, m_nCellsX);
+          uint32_t xLast = GetCell (boundaries.xMax, m_xMin, m_nCellsX);
+          uint32_t yFirst = GetCell (boundaries.yMin, m_yMin, m_nCellsY);
+          uint32_t yLast = GetCell (boundaries.yMax, m_yMin, m_nCellsY);
+          for (uint32_t y = yFirst; y <= yLast; y++)
+            {
+              for (uint32_t x = xFirst; x <= xLast; x++)
+                {
+                  uint64_t cell = uint64_t (y) * m_nCellsX + x;
+                  if (pass == 0)
+                    {
+                      m_cellStart[cell + 1]++;
+                    }
+                  else
+                    {
+                      m_cellBuildings[next[cell]++] = i;
+                    }
+                }
+            }
+        }
+      if (pass == 0)
+        {
+          for (uint64_t cell = 0; cell < nCells; cell++)
+            {
+              m_cellStart[cell + 1] += m_cellStart[cell];
+            }
+          m_cellBuildings.resize (m_cellStart.back ());
+        }
+    }
+}
+
+BuildingContainer
+LoraBuildingsHelper::GetBuildings (void) const
+{
+  BuildingContainer buildings;
+  for (const Ptr<Building> &building : m_buildings)
+    {
+      buildings.Add (building);
+    }
+  return buildings;
+}
+
+uint32_t
+LoraBuildingsHelper::GetCell (double coordinate, double min, uint32_t nCells) const
+{
+  double cell = std::floor ((coordinate - min) / m_gridCellSize);
+  if (!(cell >= 0))
+    {
+      return 0;
+    }
+  return std::min (double (nCells - 1), cell);
+}
+
+int32_t
+LoraBuildingsHelper::FindBuilding (Vector position) const
+{
+  if (m_cellStart.empty ())
+    {
+      return -1;
+    }
+
+  uint64_t cell = uint64_t (GetCell (position.y, m_yMin, m_nCellsY)) * m_nCellsX
+    + GetCell (position.x, m_xMin, m_nCellsX);
+
+  // Like BuildingsHelper, a position can't be in two buildings
+  int32_t found = -1;
+  for (uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+    {
+      uint32_t building = m_cellBuildings[i];
+      if (m_buildings[building]->IsInside (position))
+        {
+          NS_ABORT_MSG_UNLESS (found == -1, "Position " << position <<
+                               " is inside more than one building");
+          found = building;
+        }
+    }
+  return found;
+}
+
+Ptr<Building>
+LoraBuildingsHelper::GetBuilding (Vector position) const
+{
+  int32_t building = FindBuilding (position);
+  if (building < 0)
+    {
+      return 0;
+    }
+  return m_buildings[building];
+}
+
+Ptr<MobilityBuildingInfo>
+LoraBuildingsHelper::GetBuildingInfo (Ptr<Node> node) const
+{
+  Ptr<MobilityModel> mobility = node->GetObject<MobilityModel> ();
+  NS_ABORT_MSG_UNLESS (mobility != 0, "Node " << node->GetId () <<
+                       " does not have a MobilityModel");
+  Ptr<MobilityBuildingInfo> buildingInfo = mobility->GetObject<MobilityBuildingInfo> ();
+  if (buildingInfo == 0)
+    {
+      buildingInfo = CreateObject<MobilityBuildingInfo> ();
+      mobility->AggregateObject (buildingInfo);
+    }
+  return buildingInfo;
+}
+
+void
+LoraBuildingsHelper::Install (NodeContainer c) const
+{
+  NS_LOG_FUNCTION (this << c.GetN ());
+
+  for (NodeContainer::Iterator it = c.Begin (); it != c.End (); ++it)
+    {
+      Install (*it);
+    }
+}
+
+void
+LoraBuildingsHelper::Install (Ptr<Node> node) const
+{
+  Ptr<MobilityBuildingInfo> buildingInfo = GetBuildingInfo (node);
+  Vector position = node->GetObject<MobilityModel> ()->GetPosition ();
+
+  int32_t index = FindBuilding (position);
+  if (index < 0)
+    {
+      NS_LOG_LOGIC ("Node " << node->GetId () << " is outdoor");
+      buildingInfo->SetOutdoor ();
+      return;
+    }
+  Ptr<Building> building = m_buildings[index];
+  NS_LOG_LOGIC ("Node " << node->GetId () << " is inside building " <<
+                building->GetId ());
+  buildingInfo->SetIndoor (building, building->GetFloor (position),
+                           building->GetRoomX (position),
+                           building->GetRoomY (position));
+}
+
+uint64_t
+LoraBuildingsHelper::GetScenarioKey (Ptr<Object> allocator, uint32_t nBuildings)
+{
+  uint64_t hash = HASH_OFFSET_BASIS;
+  HashAttributes (hash, allocator);
+  HashBytes (hash, &nBuildings, sizeof (nBuildings));
+  return hash;
+}
+
+bool
+LoraBuildingsHelper::Save (std::string filename, NodeContainer c,
+                           uint64_t key) const
+{
+  NS_LOG_FUNCTION (this << filename << c.GetN () << key);
+
+  std::string tmpFilename = filename + ".tmp";
+  std::ofstream file (tmpFilename.c_str (), std::ios::binary | std::ios::trunc);
+  uint32_t nBuildings = m_buildings.size ();
+  uint32_t nAttachments = c.GetN ();
+  file.write (reinterpret_cast<const char *> (&BUILDING_FILE_MAGIC), 4);
+  file.write (reinterpret_cast<const char *> (&BUILDING_FILE_VERSION), 4);
+  file.write (reinterpret_cast<const char *> (&key), 8);
+  file.write (reinterpret_cast<const char *> (&nBuildings), 4);
+  file.write (reinterpret_cast<const char *> (&nAttachments), 4);
+
+  for (const Ptr<Building> &building : m_buildings)
+    {
+      Box boundaries = building->GetBoundaries ();
+      BuildingRecord record;
+      record.xMin = boundaries.xMin;
+      record.xMax = boundaries.xMax;
+      record.yMin = boundaries.yMin;
+      record.yMax = boundaries.yMax;
+      record.zMin = boundaries.zMin;
+      record.zMax = boundaries.zMax;
+      record.buildingType = building->GetBuildingType ();
+      record.extWallsType = building->GetExtWallsType ();
+      record.nFloors = building->GetNFloors ();
+      record.nRoomsX = building->GetNRoomsX ();
+      record.nRoomsY = building->GetNRoomsY ();
+      record.padding = 0;
+      file.write (reinterpret_cast<const char *> (&record), sizeof (record));
+    }
+
+  for (NodeContainer::Iterator it = c.Begin (); it != c.End (); ++it)
+    {
+      Ptr<MobilityModel> mobility = (*it)->GetObject<MobilityModel> ();
+      NS_ABORT_MSG_UNLESS (mobility != 0, "Node " << (*it)->GetId () <<
+                           " does not have a MobilityModel");
+      Vector position = mobility->GetPosition ();
+      AttachmentRecord record;
+      record.nodeId = (*it)->GetId ();
+      record.building = FindBuilding (position);
+      record.floor = 0;
+      record.roomX = 0;
+      record.roomY = 0;
+      if (record.building >= 0)
+        {
+          Ptr<Building> building = m_buildings[record.building];
+          record.floor = building->GetFloor (position);
+          record.roomX = building->GetRoomX (position);
+          record.roomY = building->GetRoomY (position);
+        }
+      record.padding = 0;
+      record.x = position.x;
+      record.y = position.y;
+      record.z = position.z;
+      file.write (reinterpret_cast<const char *> (&record), sizeof (record));
+    }
+
+  file.close ();
+  if (!file || std::rename (tmpFilename.c_str (), filename.c_str ()) != 0)
+    {
+      NS_LOG_ERROR ("Can't write building file " << filename);
+      std::remove (tmpFilename.c_str ());
+      return false;
+    }
+
+  NS_LOG_INFO ("Wrote " << nBuildings << " buildings and " << nAttachments <<
+               " nodes to " << filename);
+  return true;
+}
+
+bool
+LoraBuildingsHelper::Load (std::string filename, NodeContainer c, uint64_t key)
+{
+  NS_LOG_FUNCTION (this << filename << c.GetN () << key);
+
+  std::ifstream file (filename.c_str (), std::ios::binary);
+  uint32_t magic = 0, version = 0, nBuildings = 0, nAttachments = 0;
+  uint64_t fileKey = 0;
+  file.read (reinterpret_cast<char *> (&magic), 4);
+  file.read (reinterpret_cast<char *> (&version), 4);
+  file.read (reinterpret_cast<char *> (&fileKey), 8);
+  file.read (reinterpret_cast<char *> (&nBuildings), 4);
+  file.read (reinterpret_cast<char *> (&nAttachments), 4);
+  if (!file || magic != BUILDING_FILE_MAGIC || version != BUILDING_FILE_VERSION)
+    {
+      NS_LOG_INFO ("Can't read building file " << filename);
+      return false;
+    }
+  if (fileKey != key)
+    {
+      NS_LOG_INFO (filename << " holds the buildings of another scenario");
+      return false;
+    }
+
+  std::vector<BuildingRecord> buildings (nBuildings);
+  std::vector<AttachmentRecord> attachments (nAttachments);
+  file.read (reinterpret_cast<char *> (buildings.data ()),
+             buildings.size () * sizeof (BuildingRecord));
+  file.read (reinterpret_cast<char *> (attachments.data ()),
+             attachments.size () * sizeof (AttachmentRecord));
+  if (!file)
+    {
+      NS_LOG_ERROR ("Building file " << filename << " is truncated");
+      return false;
+    }
+
+  // Buildings get the same ids as when they were saved, if they are created
+  // at the same point of the scenario
+  BuildingContainer container;
+  for (const BuildingRecord &record : buildings)
+    {
+      Ptr<Building> building = CreateObject<Building> ();
+      building->SetBoundaries (Box (record.xMin, record.xMax, record.yMin,
+                                    record.yMax, record.zMin, record.zMax));
+      building->SetBuildingType (Building::BuildingType_t (record.buildingType));
+      building->SetExtWallsType (Building::ExtWallsType_t (record.extWallsType));
+      building->SetNFloors (record.nFloors);
+      building->SetNRoomsX (record.nRoomsX);
+      building->SetNRoomsY (record.nRoomsY);
+      container.Add (building);
+    }
+  SetBuildings (container);
+
+  std::unordered_map<uint32_t, const AttachmentRecord *> attachmentOf;
+  for (const AttachmentRecord &record : attachments)
+    {
+      attachmentOf[record.nodeId] = &record;
+    }
+
+  uint32_t reused = 0;
+  for (NodeContainer::Iterator it = c.Begin (); it != c.End (); ++it)
+    {
+      Ptr<MobilityBuildingInfo> buildingInfo = GetBuildingInfo (*it);
+      Vector position = (*it)->GetObject<MobilityModel> ()->GetPosition ();
+      auto attachment = attachmentOf.find ((*it)->GetId ());
+      if (attachment == attachmentOf.end ()
+          || attachment->second->x != position.x
+          || attachment->second->y != position.y
+          || attachment->second->z != position.z
+          || attachment->second->building >= int32_t (m_buildings.size ()))
+        {
+          Install (*it);
+          continue;
+        }
+
+      const AttachmentRecord &record = *attachment->second;
+      if (record.building < 0)
+        {
+          buildingInfo->SetOutdoor ();
+        }
+      else
+        {
+          buildingInfo->SetIndoor (m_buildings[record.building], record.floor,
+                                   record.roomX, record.roomY);
+        }
+      reused++;
+    }
+
+  NS_LOG_INFO ("Loaded " << nBuildings << " buildings from " << filename <<
+               ", reused the attachments of " << reused << " nodes out of " <<
+               c.GetN ());
+  return true;
+}
+
+} // namespace lorawan
+} // namespace ns3
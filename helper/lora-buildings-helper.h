@@ -0,0 +1,170 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef LORA_BUILDINGS_HELPER_H
+#define LORA_BUILDINGS_HELPER_H
+
+#include "ns3/building.h"
+#include "ns3/building-container.h"
+#include "ns3/mobility-building-info.h"
+#include "ns3/node-container.h"
+#include "ns3/vector.h"
+#include "ns3/object.h"
+
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * Attach MobilityBuildingInfo to nodes, like BuildingsHelper::Install, but
+ * find the building containing each node through a uniform grid over the
+ * buildings instead of going through the whole BuildingList.
+ *
+ * Only the buildings given to SetBuildings are considered. The building
+ * layout and the attachments of a set of nodes can be saved to a file, and
+ * loaded back by a later run of the same scenario.
+ */
+class LoraBuildingsHelper
+{
+public:
+  LoraBuildingsHelper ();
+
+  /**
+   * Set the side of the cells of the grid, in meters.
+   *
+   * If it is not set, or set to 0, cells are about as large as the
+   * buildings.
+   */
+  void SetCellSize (double cellSize);
+
+  /**
+   * Index a set of buildings.
+   */
+  void SetBuildings (BuildingContainer buildings);
+
+  /**
+   * Get the indexed buildings.
+   */
+  BuildingContainer GetBuildings (void) const;
+
+  /**
+   * Get the building containing a position, or 0 if it is outdoor.
+   */
+  Ptr<Building> GetBuilding (Vector position) const;
+
+  /**
+   * Aggregate a MobilityBuildingInfo to the mobility model of each node, if
+   * it doesn't have one yet, and set whether the node is indoor.
+   */
+  void Install (NodeContainer c) const;
+
+  /**
+   * \copydoc Install
+   */
+  void Install (Ptr<Node> node) const;
+
+  /**
+   * Get a key identifying the buildings that an allocator creates, out of its
+   * type, its attribute values and the number of buildings it is asked for.
+   *
+   * Attributes the allocator gives to the buildings themselves (e.g. through
+   * GridBuildingAllocator::SetBuildingAttribute) are not part of the key.
+   */
+  static uint64_t GetScenarioKey (Ptr<Object> allocator, uint32_t nBuildings);
+
+  /**
+   * Write the indexed buildings, and where each node is, to a file.
+   *
+   * \param key The scenario key (see GetScenarioKey) of the buildings.
+   * \returns False if the file can't be written.
+   */
+  bool Save (std::string filename, NodeContainer c, uint64_t key) const;
+
+  /**
+   * Create the buildings saved in a file, index them and install building
+   * information on the nodes.
+   *
+   * Nodes that were saved at the same position reuse the saved attachment,
+   * the others are looked up in the index. Nothing is created if the file
+   * can't be read, or was saved with another key.
+   *
+   * \param key The scenario key (see GetScenarioKey) of the buildings.
+   * \returns False if the file can't be read or holds another scenario.
+   */
+  bool Load (std::string filename, NodeContainer c, uint64_t key);
+
+private:
+  /**
+   * Where a node is, as saved to the file.
+   */
+  struct Attachment
+  {
+    uint32_t nodeId; //!< The node
+    Vector position; //!< Its position when it was saved
+    int32_t building; //!< Index of its building, or -1 if it is outdoor
+    uint32_t floor; //!< Floor of the node in the building
+    uint32_t roomX; //!< Room of the node along x
+    uint32_t roomY; //!< Room of the node along y
+  };
+
+  /**
+   * Get the MobilityBuildingInfo of a node, aggregating one if needed.
+   */
+  Ptr<MobilityBuildingInfo> GetBuildingInfo (Ptr<Node> node) const;
+
+  /**
+   * Get the index of the building containing a position, or -1.
+   */
+  int32_t FindBuilding (Vector position) const;
+
+  /**
+   * Get the cell of the grid a coordinate falls in, clamped to the grid.
+   */
+  uint32_t GetCell (double coordinate, double min, uint32_t nCells) const;
+
+  double m_cellSize; //!< The side of the cells, 0 to choose it
+
+  std::vector<Ptr<Building> > m_buildings; //!< The indexed buildings
+
+  double m_xMin; //!< Lower x of the grid
+  double m_yMin; //!< Lower y of the grid
+  double m_gridCellSize; //!< The side of the cells of the current grid
+  uint32_t m_nCellsX; //!< The number of cells along x
+  uint32_t m_nCellsY; //!< The number of cells along y
+
+  /**
+   * Where the buildings of each cell start in m_cellBuildings. Cell c holds
+   * the buildings from m_cellStart[c] to m_cellStart[c + 1].
+   */
+  std::vector<uint32_t> m_cellStart;
+
+  /**
+   * The indices of the buildings overlapping each cell, in the order of
+   * m_buildings.
+   */
+  std::vector<uint32_t> m_cellBuildings;
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* LORA_BUILDINGS_HELPER_H */
@@ -20,9 +20,14 @@
 
 #include "ns3/lora-helper.h"
 #include "ns3/log.h"
+#include "ns3/node-list.h"
+#include "ns3/global-value.h"
+#include "ns3/string.h"
 
 #include <fstream>
 
+#include <unistd.h>
+
 namespace ns3 {
 namespace lorawan {
 
@@ -36,6 +41,10 @@ NS_LOG_COMPONENT_DEFINE ("LoraHelper");
 
   LoraHelper::~LoraHelper ()
   {
+    if (m_traceFile)
+      {
+        CloseBinaryTrace ();
+      }
   }
 
   NetDeviceContainer
@@ -47,6 +56,46 @@ NS_LOG_COMPONENT_DEFINE ("LoraHelper");
 
     NetDeviceContainer devices;
 
+    // The trace sources to connect the tracker to are the same for all
+    // devices: they are resolved on the first one only
+    std::vector<TrackerConnection> phyConnections;
+    std::vector<TrackerConnection> macConnections;
+    if (m_packetTracker)
+      {
+        if (phyHelper.GetDeviceType () == SimpleEndDeviceLoraPhy::GetTypeId ())
+          {
+            phyConnections = {
+              {"StartSending",
+               MakeCallback (&LoraPacketTracker::TransmissionCallback, m_packetTracker), 0}};
+            macConnections = {
+              {"SentNewPacket",
+               MakeCallback (&LoraPacketTracker::MacTransmissionCallback, m_packetTracker), 0},
+              {"RequiredTransmissions",
+               MakeCallback (&LoraPacketTracker::RequiredTransmissionsCallback, m_packetTracker), 0}};
+          }
+        else if (phyHelper.GetDeviceType () == SimpleGatewayLoraPhy::GetTypeId ())
+          {
+            phyConnections = {
+              {"StartSending",
+               MakeCallback (&LoraPacketTracker::TransmissionCallback, m_packetTracker), 0},
+              {"ReceivedPacket",
+               MakeCallback (&LoraPacketTracker::PacketReceptionCallback, m_packetTracker), 0},
+              {"LostPacketBecauseInterference",
+               MakeCallback (&LoraPacketTracker::InterferenceCallback, m_packetTracker), 0},
+              {"LostPacketBecauseNoMoreReceivers",
+               MakeCallback (&LoraPacketTracker::NoMoreReceiversCallback, m_packetTracker), 0},
+              {"LostPacketBecauseUnderSensitivity",
+               MakeCallback (&LoraPacketTracker::UnderSensitivityCallback, m_packetTracker), 0},
+              {"NoReceptionBecauseTransmitting",
+               MakeCallback (&LoraPacketTracker::LostBecauseTxCallback, m_packetTracker), 0}};
+            macConnections = {
+              {"SentNewPacket",
+               MakeCallback (&LoraPacketTracker::MacTransmissionCallback, m_packetTracker), 0},
+              {"ReceivedPacket",
+               MakeCallback (&LoraPacketTracker::MacGwReceptionCallback, m_packetTracker), 0}};
+          }
+      }
+
     // Go over the various nodes in which to install the NetDevice
     for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
       {
@@ -62,88 +111,39 @@ NS_LOG_COMPONENT_DEFINE ("LoraHelper");
         NS_LOG_DEBUG ("Done creating the PHY");
 
         // Connect Trace Sources if necessary
-        if (m_packetTracker)
-          {
-            if (phyHelper.GetDeviceType () ==
-                TypeId::LookupByName ("ns3::SimpleEndDeviceLoraPhy"))
-              {
-                phy->TraceConnectWithoutContext ("StartSending",
-                                                 MakeCallback
-                                                 (&LoraPacketTracker::TransmissionCallback,
-                                                  m_packetTracker));
-              }
-            else if (phyHelper.GetDeviceType () ==
-                     TypeId::LookupByName ("ns3::SimpleGatewayLoraPhy"))
-            {
-              phy->TraceConnectWithoutContext ("StartSending",
-                                               MakeCallback
-                                               (&LoraPacketTracker::TransmissionCallback,
-                                                m_packetTracker));
-              phy->TraceConnectWithoutContext ("ReceivedPacket",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::PacketReceptionCallback,
-                                                 m_packetTracker));
-              phy->TraceConnectWithoutContext ("LostPacketBecauseInterference",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::InterferenceCallback,
-                                                 m_packetTracker));
-              phy->TraceConnectWithoutContext ("LostPacketBecauseNoMoreReceivers",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::NoMoreReceiversCallback,
-                                                 m_packetTracker));
-              phy->TraceConnectWithoutContext ("LostPacketBecauseUnderSensitivity",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::UnderSensitivityCallback,
-                                                 m_packetTracker));
-              phy->TraceConnectWithoutContext ("NoReceptionBecauseTransmitting",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::LostBecauseTxCallback,
-                                                 m_packetTracker));
-            }
-        }
-
-      // Create the MAC
-      Ptr<LorawanMac> mac = macHelper.Create (node, device);
-      NS_ASSERT (mac != 0);
-      mac->SetPhy (phy);
-      NS_LOG_DEBUG ("Done creating the MAC");
-      device->SetMac (mac);
+        ConnectTracker (phy, phyConnections);
+
+        // Create the MAC
+        Ptr<LorawanMac> mac = macHelper.Create (node, device);
+        NS_ASSERT (mac != 0);
+        mac->SetPhy (phy);
+        NS_LOG_DEBUG ("Done creating the MAC");
+        device->SetMac (mac);
+
+        ConnectTracker (mac, macConnections);
+
+        node->AddDevice (device);
+        devices.Add (device);
+        NS_LOG_DEBUG ("node=" << node << ", mob=" << node->GetObject<MobilityModel> ()->GetPosition ());
+      }
+    return devices;
+  }
 
-      if (m_packetTracker)
+void
+LoraHelper::ConnectTracker (Ptr<Object> object,
+                            std::vector<TrackerConnection> &connections) const
+{
+  for (TrackerConnection &connection : connections)
+    {
+      if (connection.accessor == 0)
         {
-          if (phyHelper.GetDeviceType () ==
-              TypeId::LookupByName ("ns3::SimpleEndDeviceLoraPhy"))
-            {
-              mac->TraceConnectWithoutContext ("SentNewPacket",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::MacTransmissionCallback,
-                                                 m_packetTracker));
-
-              mac->TraceConnectWithoutContext ("RequiredTransmissions",
-                                               MakeCallback
-                                                 (&LoraPacketTracker::RequiredTransmissionsCallback,
-                                                 m_packetTracker));
-            }
-          else if (phyHelper.GetDeviceType () ==
-                   TypeId::LookupByName ("ns3::SimpleGatewayLoraPhy"))
-            {
-              mac->TraceConnectWithoutContext ("SentNewPacket",
-                                               MakeCallback
-                                               (&LoraPacketTracker::MacTransmissionCallback,
-                                                m_packetTracker));
-
-              mac->TraceConnectWithoutContext ("ReceivedPacket",
-                                               MakeCallback
-                                               (&LoraPacketTracker::MacGwReceptionCallback,
-                                                m_packetTracker));
-            }
+          connection.accessor =
+            object->GetInstanceTypeId ().LookupTraceSourceByName (connection.traceSource);
+          NS_ASSERT_MSG (connection.accessor != 0,
+                         "No trace source " << connection.traceSource);
         }
-
-      node->AddDevice (device);
-      devices.Add (device);
-      NS_LOG_DEBUG ("node=" << node << ", mob=" << node->GetObject<MobilityModel> ()->GetPosition ());
+      connection.accessor->ConnectWithoutContext (PeekPointer (object), connection.callback);
     }
-  return devices;
 }
 
 NetDeviceContainer
@@ -171,6 +171,29 @@ LoraHelper::GetPacketTracker (void)
   return *m_packetTracker;
 }
 
+void
+LoraHelper::EnableBinaryTrace (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  NS_ASSERT (!m_traceFile);
+  m_traceFile.reset (new LoraTraceFileWriter (filename));
+}
+
+void
+LoraHelper::CloseBinaryTrace (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  NS_ASSERT (m_traceFile);
+  if (m_packetTracker)
+    {
+      m_packetTracker->WriteRecords (*m_traceFile);
+    }
+  m_traceFile->Close ();
+  m_traceFile.reset ();
+}
+
 void
 LoraHelper::EnableSimulationTimePrinting (Time interval)
 {
@@ -179,6 +202,24 @@ LoraHelper::EnableSimulationTimePrinting (Time interval)
                        interval);
 }
 
+void
+LoraHelper::EnableProgressTelemetry (Time interval, Time stopTime,
+                                     std::string jsonFilename)
+{
+  NS_LOG_FUNCTION (this << interval << stopTime << jsonFilename);
+
+  m_progressStopTime = stopTime;
+  m_progressFilename = jsonFilename;
+
+  // Only the default simulator numbers events in the order they are
+  // scheduled
+  StringValue simulatorType;
+  GlobalValue::GetValueByName ("SimulatorImplementationType", simulatorType);
+  m_countPendingEvents = simulatorType.Get () == "ns3::DefaultSimulatorImpl";
+  Simulator::Schedule (Seconds (0), &LoraHelper::DoPrintProgress, this,
+                       interval);
+}
+
 void
 LoraHelper::EnablePeriodicDeviceStatusPrinting (NodeContainer endDevices,
                                                 NodeContainer gateways,
@@ -199,36 +240,39 @@ void
 LoraHelper::DoPrintDeviceStatus (NodeContainer endDevices, NodeContainer gateways,
                                  std::string filename)
 {
-  const char * c = filename.c_str ();
-  std::ofstream outputFile;
-  if (Simulator::Now () == Seconds (0))
+  std::vector<DeviceStatusEntry> statuses;
+  if (!m_statusRecorder)
     {
-      // Delete contents of the file as it is opened
-      outputFile.open (c, std::ofstream::out | std::ofstream::trunc);
+      m_statusRecorder.reset (new DeviceStatusRecorder (endDevices));
+      m_statusRecorder->GetStatuses (statuses);
+      if (m_traceFile)
+        {
+          m_traceFile->WriteDeviceStatusBlock (statuses);
+          return;
+        }
+    }
+  else if (m_traceFile)
+    {
+      // Only the devices that changed since the previous snapshot
+      m_statusRecorder->GetChangedStatuses (statuses);
+      m_traceFile->WriteDeviceStatusDeltaBlock (statuses);
+      return;
     }
   else
     {
-      // Only append to the file
-      outputFile.open (c, std::ofstream::out | std::ofstream::app);
+      m_statusRecorder->GetStatuses (statuses);
     }
 
+  uint32_t file = OpenOutputFile (filename);
+  std::ostream &outputFile = m_output->GetStream (file);
+
   Time currentTime = Simulator::Now();
-  for (NodeContainer::Iterator j = endDevices.Begin (); j != endDevices.End (); ++j)
+  for (const DeviceStatusEntry &status : statuses)
     {
-      Ptr<Node> object = *j;
-      Ptr<MobilityModel> position = object->GetObject<MobilityModel> ();
-      NS_ASSERT (position != 0);
-      Ptr<NetDevice> netDevice = object->GetDevice (0);
-      Ptr<LoraNetDevice> loraNetDevice = netDevice->GetObject<LoraNetDevice> ();
-      NS_ASSERT (loraNetDevice != 0);
-      Ptr<ClassAEndDeviceLorawanMac> mac = loraNetDevice->GetMac ()->GetObject<ClassAEndDeviceLorawanMac> ();
-      int dr = int(mac->GetDataRate ());
-      double txPower = mac->GetTransmissionPower ();
-      Vector pos = position->GetPosition ();
       outputFile << currentTime.GetSeconds () << " "
-                 << object->GetId () <<  " "
-                 << pos.x << " " << pos.y << " " << dr << " "
-                 << unsigned(txPower) << std::endl;
+                 << status.nodeId <<  " "
+                 << status.x << " " << status.y << " " << int (status.dataRate) << " "
+                 << unsigned(status.txPower) << '\n';
     }
   // for (NodeContainer::Iterator j = gateways.Begin (); j != gateways.End (); ++j)
   //   {
@@ -239,7 +283,7 @@ LoraHelper::DoPrintDeviceStatus (NodeContainer endDevices, NodeContainer gateway
   //                << object->GetId () <<  " "
   //                << pos.x << " " << pos.y << " " << "-1 -1" << std::endl;
   //   }
-  outputFile.close ();
+  m_output->Commit (file);
 }
 
 
@@ -264,32 +308,32 @@ LoraHelper::DoPrintPhyPerformance (NodeContainer gateways,
 {
   NS_LOG_FUNCTION (this);
 
-  const char * c = filename.c_str ();
-  std::ofstream outputFile;
-  if (Simulator::Now () == Seconds (0))
-    {
-      // Delete contents of the file as it is opened
-      outputFile.open (c, std::ofstream::out | std::ofstream::trunc);
-    }
-  else
+  uint32_t file = OpenOutputFile (filename);
+  std::ostream &outputFile = m_output->GetStream (file);
+
+  // Count the packets of all gateways at once
+  std::vector<uint32_t> gwIds;
+  for (auto it = gateways.Begin (); it != gateways.End (); ++it)
     {
-      // Only append to the file
-      outputFile.open (c, std::ofstream::out | std::ofstream::app);
+      gwIds.push_back ((*it)->GetId ());
     }
+  std::map<uint32_t, std::vector<int> > packetCounts =
+    m_packetTracker->CountPhyPacketsPerGw (m_lastPhyPerformanceUpdate,
+                                           Simulator::Now (), gwIds);
 
-  for (auto it = gateways.Begin (); it != gateways.End (); ++it)
+  for (uint32_t systemId : gwIds)
     {
-      int systemId = (*it)->GetId ();
-      outputFile << Simulator::Now ().GetSeconds () << " " <<
-        std::to_string(systemId) << " " <<
-        m_packetTracker->PrintPhyPacketsPerGw(m_lastPhyPerformanceUpdate,
-                                              Simulator::Now (),
-                                              systemId) << std::endl;
+      outputFile << Simulator::Now ().GetSeconds () << " " << systemId << " ";
+      for (int count : packetCounts[systemId])
+        {
+          outputFile << count << " ";
+        }
+      outputFile << '\n';
     }
 
   m_lastPhyPerformanceUpdate = Simulator::Now ();
 
-  outputFile.close();
+  m_output->Commit (file);
 }
 
 void
@@ -311,27 +355,149 @@ LoraHelper::DoPrintGlobalPerformance (std::string filename)
 {
   NS_LOG_FUNCTION (this);
 
-  const char * c = filename.c_str ();
-  std::ofstream outputFile;
-  if (Simulator::Now () == Seconds (0))
-    {
-      // Delete contents of the file as it is opened
-      outputFile.open (c, std::ofstream::out | std::ofstream::trunc);
-    }
-  else
-    {
-      // Only append to the file
-      outputFile.open (c, std::ofstream::out | std::ofstream::app);
-    }
+  uint32_t file = OpenOutputFile (filename);
+  std::ostream &outputFile = m_output->GetStream (file);
 
   outputFile << Simulator::Now ().GetSeconds () << " " <<
     m_packetTracker->CountMacPacketsGlobally (m_lastGlobalPerformanceUpdate,
                                               Simulator::Now ()) <<
-    std::endl;
+    '\n';
 
   m_lastGlobalPerformanceUpdate = Simulator::Now ();
 
-  outputFile.close();
+  m_output->Commit (file);
+}
+
+uint32_t
+LoraHelper::OpenOutputFile (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  if (!m_output)
+    {
+      m_output.reset (new LoraOutputWriter ());
+    }
+  // A file first printed to after the start of the simulation is appended
+  // to, as it was when files were reopened at every print
+  return m_output->Open (filename, Simulator::Now () != Seconds (0));
+}
+
+void
+LoraHelper::DoPrintProgress (Time interval)
+{
+  NS_LOG_FUNCTION (this << interval);
+
+  Clock::time_point now = Clock::now ();
+  Time simTime = Simulator::Now ();
+  uint64_t events = Simulator::GetEventCount ();
+  if (!m_progressStarted)
+    {
+      // Everything is installed by the time the first report runs
+      m_progressStarted = true;
+      m_progressStart = now;
+      m_lastProgress = now;
+      m_progressStartTime = simTime;
+      m_lastProgressTime = simTime;
+      m_lastProgressEvents = events;
+      for (NodeList::Iterator n = NodeList::Begin (); n != NodeList::End (); ++n)
+        {
+          for (uint32_t i = 0; i < (*n)->GetNDevices (); i++)
+            {
+              Ptr<LoraNetDevice> device = DynamicCast<LoraNetDevice> ((*n)->GetDevice (i));
+              if (device && device->GetPhy ())
+                {
+                  m_progressPhys.push_back (device->GetPhy ());
+                }
+            }
+        }
+    }
+
+  EventId next = Simulator::Schedule (interval, &LoraHelper::DoPrintProgress,
+                                      this, interval);
+
+  double wallInterval = std::chrono::duration<double> (now - m_lastProgress).count ();
+  double wallElapsed = std::chrono::duration<double> (now - m_progressStart).count ();
+  double simInterval = (simTime - m_lastProgressTime).GetSeconds ();
+  double speedRatio = wallInterval > 0 ? simInterval / wallInterval : 0;
+  double eventsPerSecond = wallInterval > 0 ?
+    (events - m_lastProgressEvents) / wallInterval : 0;
+  // The default simulator gives event ids in sequence, starting from 4, to
+  // every event that is scheduled. Those that weren't executed yet are
+  // pending, or were cancelled, so this is only an upper bound.
+  uint64_t pendingEventsUpperBound = 0;
+  if (m_countPendingEvents)
+    {
+      uint64_t scheduledEvents = next.GetUid () - 3;
+      pendingEventsUpperBound =
+        scheduledEvents > events ? scheduledEvents - events : 0;
+    }
+  uint64_t residentMemory = GetResidentMemory ();
+  uint64_t trackerRecords = m_packetTracker ? m_packetTracker->GetNRecords () : 0;
+  uint64_t interferenceEvents = 0;
+  for (const Ptr<LoraPhy> &phy : m_progressPhys)
+    {
+      interferenceEvents += phy->GetNInterferenceEvents ();
+    }
+  // Extrapolate from the average speed so far
+  double eta = -1;
+  double simElapsed = (simTime - m_progressStartTime).GetSeconds ();
+  if (m_progressStopTime > simTime && simElapsed > 0)
+    {
+      eta = (m_progressStopTime - simTime).GetSeconds () * wallElapsed / simElapsed;
+    }
+
+  std::cout << "Progress at " << simTime.GetHours () << " hours: " <<
+    speedRatio << "x, " << eventsPerSecond << " events/s, ";
+  if (m_countPendingEvents)
+    {
+      std::cout << "at most " << pendingEventsUpperBound <<
+        " pending events (estimate), ";
+    }
+  std::cout << residentMemory / 1048576.0 << " MiB resident, " <<
+    trackerRecords << " tracker records, " << interferenceEvents <<
+    " interference events";
+  if (eta >= 0)
+    {
+      std::cout << ", " << eta << " seconds left";
+    }
+  std::cout << std::endl;
+
+  if (m_progressFilename != "")
+    {
+      uint32_t file = OpenOutputFile (m_progressFilename);
+      std::ostream &outputFile = m_output->GetStream (file);
+      outputFile << "{\"simTime\":" << simTime.GetSeconds () <<
+        ",\"wallTime\":" << wallElapsed <<
+        ",\"speedRatio\":" << speedRatio <<
+        ",\"eventsPerSecond\":" << eventsPerSecond <<
+        ",\"pendingEventsUpperBound\":";
+      if (m_countPendingEvents)
+        {
+          outputFile << pendingEventsUpperBound;
+        }
+      else
+        {
+          outputFile << "null";
+        }
+      outputFile << ",\"residentBytes\":" << residentMemory <<
+        ",\"trackerRecords\":" << trackerRecords <<
+        ",\"interferenceEvents\":" << interferenceEvents <<
+        ",\"etaSeconds\":";
+      if (eta >= 0)
+        {
+          outputFile << eta;
+        }
+      else
+        {
+          outputFile << "null";
+        }
+      outputFile << "}\n";
+      m_output->Commit (file);
+    }
+
+  m_lastProgress = now;
+  m_lastProgressTime = simTime;
+  m_lastProgressEvents = events;
 }
 
 void
@@ -344,5 +510,18 @@ LoraHelper::DoPrintSimulationTime (Time interval)
   Simulator::Schedule (interval, &LoraHelper::DoPrintSimulationTime, this, interval);
 }
 
+uint64_t
+LoraHelper::GetResidentMemory (void)
+{
+  // The second field of statm is the number of resident pages
+  std::ifstream statm ("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  if (!(statm >> size >> resident))
+    {
+      return 0;
+    }
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
 }
 }
@@ -28,8 +28,14 @@
 #include "ns3/net-device.h"
 #include "ns3/lora-net-device.h"
 #include "ns3/lora-packet-tracker.h"
+#include "ns3/lora-trace-file.h"
+#include "ns3/lora-output-writer.h"
+#include "ns3/device-status-recorder.h"
+#include "ns3/trace-source-accessor.h"
 
+#include <chrono>
 #include <ctime>
+#include <memory>
 
 namespace ns3 {
 namespace lorawan {
@@ -47,9 +53,21 @@ public:
 
   LoraHelper ();
 
+  /**
+   * A helper owns its output writer and trace file, so it can't be copied.
+   * It can be moved before its outputs are enabled.
+   */
+  LoraHelper (const LoraHelper &) = delete;
+  LoraHelper &operator= (const LoraHelper &) = delete;
+  LoraHelper (LoraHelper &&) = default;
+
   /**
    * Install LoraNetDevices on a list of nodes
    *
+   * Everything that is the same for all the devices, like the trace sources
+   * the packet tracker connects to, is resolved once for the whole list, so
+   * installing on all nodes at once is faster than node by node.
+   *
    * \param phy the PHY helper to create PHY objects
    * \param mac the MAC helper to create MAC objects
    * \param c the set of nodes on which a lora device must be created
@@ -86,8 +104,35 @@ public:
    */
   void EnableSimulationTimePrinting (Time interval);
 
+  /**
+   * Periodically report the progress of the simulation to the standard
+   * output: the ratio of simulated time to wall clock time, the events
+   * executed per second of wall clock time, an upper bound on the events
+   * pending, the resident memory of the process, the records held by the
+   * packet tracker, the events kept by the interference helpers of all PHYs
+   * and, if the stop time is known, the wall clock time left.
+   *
+   * The pending events are estimated from the event ids of
+   * ns3::DefaultSimulatorImpl, and count the cancelled events that are
+   * still scheduled. They aren't reported under other simulator
+   * implementations.
+   *
+   * \param interval The simulated time between reports.
+   * \param stopTime The time the simulation is stopped at, or zero if it
+   * isn't known.
+   * \param jsonFilename A file to also write each report to as a line of
+   * JSON, or an empty string.
+   */
+  void EnableProgressTelemetry (Time interval, Time stopTime = Seconds (0),
+                                std::string jsonFilename = "");
+
   /**
    * Periodically prints the status of devices in the network to a file.
+   *
+   * With a binary trace, only the first snapshot holds every device. Later
+   * ones hold the devices whose data rate, transmission power or position
+   * changed since the previous snapshot (see
+   * LoraTraceFileReader::GetDeviceStatuses).
    */
   void EnablePeriodicDeviceStatusPrinting (NodeContainer endDevices,
                                            NodeContainer gateways,
@@ -113,6 +158,20 @@ public:
 
   LoraPacketTracker& GetPacketTracker (void);
 
+  /**
+   * Write results to a columnar binary trace file (see lora-trace-file.h)
+   * instead of text. Periodic device status printing appends its snapshots
+   * to this file rather than to its text file.
+   */
+  void EnableBinaryTrace (std::string filename);
+
+  /**
+   * Append the records of the packet tracker to the binary trace file, if
+   * packet tracking is enabled, and close the file. This should be called
+   * once the simulation is over.
+   */
+  void CloseBinaryTrace (void);
+
   LoraPacketTracker* m_packetTracker = 0;
 
   time_t m_oldtime;
@@ -124,14 +183,67 @@ public:
                             std::string filename);
 
 private:
+  /**
+   * A trace source of the PHYs or MACs created by Install, and the packet
+   * tracker callback to connect to it.
+   */
+  struct TrackerConnection
+  {
+    std::string traceSource; //!< The name of the trace source
+    CallbackBase callback; //!< The callback of the tracker
+    Ptr<const TraceSourceAccessor> accessor; //!< Resolved on the first object
+  };
+
+  /**
+   * Connect the packet tracker to the trace sources of an object, resolving
+   * them if this is the first object.
+   */
+  void ConnectTracker (Ptr<Object> object,
+                       std::vector<TrackerConnection> &connections) const;
+
   /**
    * Actually print the simulation time and re-schedule execution of this
    * function.
    */
   void DoPrintSimulationTime (Time interval);
 
+  /**
+   * Actually print the progress telemetry and re-schedule execution of this
+   * function.
+   */
+  void DoPrintProgress (Time interval);
+
+  /**
+   * Get the resident memory of the process in bytes, or 0 if it can't be
+   * read.
+   */
+  static uint64_t GetResidentMemory (void);
+
+  /**
+   * Open a periodic output file, starting the output writer if needed.
+   *
+   * \return The identifier of the file in m_output
+   */
+  uint32_t OpenOutputFile (std::string filename);
+
   Time m_lastPhyPerformanceUpdate;
   Time m_lastGlobalPerformanceUpdate;
+
+  std::unique_ptr<LoraTraceFileWriter> m_traceFile; //!< The binary trace file, if enabled
+  std::unique_ptr<LoraOutputWriter> m_output; //!< Writes the periodic text outputs
+  std::unique_ptr<DeviceStatusRecorder> m_statusRecorder; //!< Tracks device status changes
+
+  typedef std::chrono::steady_clock Clock; //!< The wall clock of the telemetry
+  bool m_progressStarted = false; //!< Whether the first report ran
+  Clock::time_point m_progressStart; //!< Wall clock time of the first report
+  Clock::time_point m_lastProgress; //!< Wall clock time of the last report
+  Time m_progressStartTime; //!< Simulated time of the first report
+  Time m_lastProgressTime; //!< Simulated time of the last report
+  uint64_t m_lastProgressEvents = 0; //!< Events executed by the last report
+  bool m_countPendingEvents = false; //!< Whether event ids count events
+  Time m_progressStopTime; //!< When the simulation stops, or zero
+  std::string m_progressFilename; //!< The JSON lines file, if any
+  std::vector<Ptr<LoraPhy> > m_progressPhys; //!< The PHYs to report on
 };
 
 } //namespace ns3
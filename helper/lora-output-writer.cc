@@ -0,0 +1,233 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/lora-output-writer.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("LoraOutputWriter");
+
+LoraOutputWriter::OutputBuffer::int_type
+LoraOutputWriter::OutputBuffer::overflow (int_type c)
+{
+  if (!traits_type::eq_int_type (c, traits_type::eof ()))
+    {
+      data.push_back (traits_type::to_char_type (c));
+    }
+  return traits_type::not_eof (c);
+}
+
+std::streamsize
+LoraOutputWriter::OutputBuffer::xsputn (const char *s, std::streamsize n)
+{
+  data.append (s, n);
+  return n;
+}
+
+LoraOutputWriter::OutputFile::OutputFile () :
+  stream (&buffer)
+{
+}
+
+LoraOutputWriter::LoraOutputWriter (uint32_t queueSize) :
+  m_queue (queueSize),
+  m_head (0),
+  m_tail (0),
+  m_stopping (false)
+{
+  NS_LOG_FUNCTION (this << queueSize);
+  NS_ASSERT (queueSize > 0);
+}
+
+LoraOutputWriter::~LoraOutputWriter ()
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_thread.joinable ())
+    {
+      Close ();
+    }
+}
+
+uint32_t
+LoraOutputWriter::Open (std::string filename, bool append)
+{
+  NS_LOG_FUNCTION (this << filename << append);
+
+  for (uint32_t i = 0; i < m_files.size (); i++)
+    {
+      if (m_files[i]->filename == filename)
+        {
+          return i;
+        }
+    }
+
+  std::unique_ptr<OutputFile> file (new OutputFile ());
+  file->filename = filename;
+  file->file.open (filename.c_str (), std::ofstream::out |
+                   (append ? std::ofstream::app : std::ofstream::trunc));
+  if (!file->file.is_open ())
+    {
+      NS_LOG_ERROR ("Can't open " << filename);
+    }
+  m_files.push_back (std::move (file));
+
+  if (!m_thread.joinable ())
+    {
+      m_stopping = false;
+      m_thread = std::thread (&LoraOutputWriter::DoWrite, this);
+      m_destroyEvent = Simulator::ScheduleDestroy (&LoraOutputWriter::DoClose,
+                                                   this);
+    }
+
+  return m_files.size () - 1;
+}
+
+std::ostream &
+LoraOutputWriter::GetStream (uint32_t file)
+{
+  NS_ASSERT (file < m_files.size ());
+
+  return m_files[file]->stream;
+}
+
+void
+LoraOutputWriter::Commit (uint32_t file)
+{
+  NS_LOG_FUNCTION (this << file);
+  NS_ASSERT (file < m_files.size ());
+
+  OutputFile &output = *m_files[file];
+  if (output.buffer.data.empty ())
+    {
+      return;
+    }
+
+  uint32_t tail = m_tail.load (std::memory_order_relaxed);
+  if (tail - m_head.load (std::memory_order_acquire) == m_queue.size ())
+    {
+      NS_LOG_DEBUG ("Output queue full, waiting for the writer thread");
+      std::unique_lock<std::mutex> lock (m_mutex);
+      m_condition.wait (lock, [this, tail] {
+        return tail - m_head.load (std::memory_order_acquire) < m_queue.size ();
+      });
+    }
+
+  // The slot is ours until m_tail moves past it: hand over the text and take
+  // back the emptied buffer the writer thread left there
+  Chunk &chunk = m_queue[tail % m_queue.size ()];
+  chunk.file = &output.file;
+  chunk.data.swap (output.buffer.data);
+  m_tail.store (tail + 1, std::memory_order_release);
+
+  // Taking the mutex makes sure the writer is either not yet checking the
+  // queue or already waiting, so that it can't miss the notification
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+  }
+  m_condition.notify_all ();
+}
+
+void
+LoraOutputWriter::Flush (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_condition.wait (lock, [this] {
+    return m_head.load (std::memory_order_acquire)
+    == m_tail.load (std::memory_order_relaxed);
+  });
+}
+
+void
+LoraOutputWriter::Close (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_thread.joinable ())
+    {
+      Simulator::Cancel (m_destroyEvent);
+      DoClose ();
+    }
+}
+
+void
+LoraOutputWriter::DoClose (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  NS_ASSERT (m_thread.joinable ());
+
+  // The writer thread only stops once the queue is empty
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all ();
+  m_thread.join ();
+
+  for (auto &file : m_files)
+    {
+      // Anything formatted but not committed is written as well
+      file->file << file->buffer.data;
+      file->file.close ();
+    }
+  m_files.clear ();
+}
+
+void
+LoraOutputWriter::DoWrite (void)
+{
+  while (true)
+    {
+      uint32_t head = m_head.load (std::memory_order_relaxed);
+      if (head == m_tail.load (std::memory_order_acquire))
+        {
+          std::unique_lock<std::mutex> lock (m_mutex);
+          m_condition.wait (lock, [this, head] {
+            return m_stopping || head != m_tail.load (std::memory_order_acquire);
+          });
+          if (head == m_tail.load (std::memory_order_acquire))
+            {
+              return;
+            }
+          continue;
+        }
+
+      Chunk &chunk = m_queue[head % m_queue.size ()];
+      chunk.file->write (chunk.data.data (), chunk.data.size ());
+      chunk.file->flush ();
+      chunk.data.clear ();
+      m_head.store (head + 1, std::memory_order_release);
+
+      {
+        std::lock_guard<std::mutex> lock (m_mutex);
+      }
+      m_condition.notify_all ();
+    }
+}
+
+} // namespace lorawan
+
+} // namespace ns3
@@ -0,0 +1,165 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef LORA_OUTPUT_WRITER_H
+#define LORA_OUTPUT_WRITER_H
+
+#include "ns3/event-id.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * Writes the periodic text outputs of a simulation (device status,
+ * performance, congestion...) from a background thread.
+ *
+ * Files are opened once and stay open until the writer is closed, which
+ * happens at the latest when Simulator::Destroy is called. Text is formatted
+ * on the simulator thread into a buffer belonging to its file; Commit hands
+ * the buffer to the writer thread through a fixed-size single-producer
+ * single-consumer queue and gets back an emptied buffer of the same
+ * capacity, so that no allocation nor I/O happens on the simulator thread
+ * once the buffers have grown to the size of a snapshot.
+ *
+ * All the methods must be called from the simulator thread.
+ */
+class LoraOutputWriter
+{
+public:
+  /**
+   * Create a writer whose queue can hold the given number of buffers. The
+   * writer thread is only started when the first file is opened.
+   */
+  LoraOutputWriter (uint32_t queueSize = 16);
+
+  /**
+   * Write everything that was committed and close the files.
+   */
+  ~LoraOutputWriter ();
+
+  /**
+   * Open a file, or get the identifier of the file if it is already open.
+   *
+   * \param filename The name of the file
+   * \param append Whether to append to the file rather than truncating it
+   * \return The identifier of the file
+   */
+  uint32_t Open (std::string filename, bool append = false);
+
+  /**
+   * Get the stream formatting into the buffer of a file.
+   */
+  std::ostream & GetStream (uint32_t file);
+
+  /**
+   * Queue what was formatted into the stream of a file for writing. This
+   * blocks only if the queue is full.
+   */
+  void Commit (uint32_t file);
+
+  /**
+   * Wait until everything committed so far is written to the files.
+   */
+  void Flush (void);
+
+  /**
+   * Write everything committed so far, stop the writer thread and close the
+   * files. The writer can be used again afterwards.
+   */
+  void Close (void);
+
+private:
+  LoraOutputWriter (const LoraOutputWriter &);
+  LoraOutputWriter &operator= (const LoraOutputWriter &);
+
+  /**
+   * A stream buffer appending to a string.
+   */
+  class OutputBuffer : public std::streambuf
+  {
+public:
+    std::string data; //!< The text formatted since the last commit
+
+protected:
+    virtual int_type overflow (int_type c);
+    virtual std::streamsize xsputn (const char *s, std::streamsize n);
+  };
+
+  /**
+   * An open file.
+   */
+  struct OutputFile
+  {
+    OutputFile ();
+
+    std::string filename; //!< The name of the file
+    std::ofstream file; //!< Only used by the writer thread while it runs
+    OutputBuffer buffer; //!< Where the simulator thread formats text
+    std::ostream stream; //!< Formats into buffer
+  };
+
+  /**
+   * A queue slot.
+   */
+  struct Chunk
+  {
+    std::ofstream *file; //!< The file to write to
+    std::string data; //!< The text to write, emptied once written
+  };
+
+  /**
+   * Close the writer at Simulator::Destroy.
+   */
+  void DoClose (void);
+
+  /**
+   * Loop run by the writer thread.
+   */
+  void DoWrite (void);
+
+  std::vector<std::unique_ptr<OutputFile> > m_files;
+
+  std::vector<Chunk> m_queue;
+  std::atomic<uint32_t> m_head; //!< Count of the chunks written
+  std::atomic<uint32_t> m_tail; //!< Count of the chunks committed
+
+  std::thread m_thread;
+  std::mutex m_mutex; //!< Only used to wait on m_condition
+  std::condition_variable m_condition;
+  bool m_stopping;
+
+  EventId m_destroyEvent;
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* LORA_OUTPUT_WRITER_H */
@@ -19,17 +19,30 @@
  */
 
 #include "lora-packet-tracker.h"
+#include "ns3/lora-trace-file.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/lorawan-mac-header.h"
+#include "ns3/lora-tag.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <thread>
 
 namespace ns3 {
 namespace lorawan {
 NS_LOG_COMPONENT_DEFINE ("LoraPacketTracker");
 
-LoraPacketTracker::LoraPacketTracker ()
+LoraPacketTracker::LoraPacketTracker () :
+  m_deadPhyOutcomes (0),
+  m_deadMacReceptions (0),
+  m_bucketWidth (Seconds (10)),
+  m_finalizationHorizon (Seconds (0)),
+  m_nextFinalization (Seconds (0)),
+  m_firstOpenBucket (0),
+  m_reportThreads (1),
+  m_deviceIndexEntries (0),
+  m_deadDeviceIndexEntries (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -39,6 +52,805 @@ LoraPacketTracker::~LoraPacketTracker ()
   NS_LOG_FUNCTION (this);
 }
 
+PacketRecord &
+LoraPacketTracker::GetRecord (Ptr<Packet const> packet)
+{
+  uint64_t uid = packet->GetUid ();
+  uint64_t chunk = uid >> CHUNK_BITS;
+
+  if (chunk >= m_records.size ())
+    {
+      m_records.resize (chunk + 1);
+      m_chunkLiveRecords.resize (chunk + 1, 0);
+    }
+  if (!m_records[chunk])
+    {
+      m_records[chunk].reset (new PacketRecord[1 << CHUNK_BITS] ());
+      for (uint32_t i = 0; i < (1 << CHUNK_BITS); i++)
+        {
+          m_records[chunk][i].firstOutcome = NO_ENTRY;
+          m_records[chunk][i].firstReception = NO_ENTRY;
+        }
+    }
+
+  PacketRecord &record = m_records[chunk][uid & ((1 << CHUNK_BITS) - 1)];
+  if (record.flags == 0)
+    {
+      // The caller is going to fill in the record
+      m_chunkLiveRecords[chunk]++;
+    }
+  return record;
+}
+
+PacketRecord *
+LoraPacketTracker::FindRecord (Ptr<Packet const> packet)
+{
+  return FindRecord (packet->GetUid ());
+}
+
+PacketRecord *
+LoraPacketTracker::FindRecord (uint64_t uid)
+{
+  uint64_t chunk = uid >> CHUNK_BITS;
+
+  if (chunk >= m_records.size () || !m_records[chunk])
+    {
+      return 0;
+    }
+
+  PacketRecord *record = &m_records[chunk][uid & ((1 << CHUNK_BITS) - 1)];
+  return record->flags ? record : 0;
+}
+
+void
+LoraPacketTracker::SetBucketWidth (Time width)
+{
+  NS_LOG_FUNCTION (this << width);
+  NS_ASSERT_MSG (m_buckets.empty (), "Packets are already being tracked");
+  NS_ASSERT (width.IsStrictlyPositive ());
+
+  m_bucketWidth = width;
+}
+
+uint64_t
+LoraPacketTracker::GetBucket (Time time) const
+{
+  return time.GetTimeStep () / m_bucketWidth.GetTimeStep ();
+}
+
+TimeBucket &
+LoraPacketTracker::GetTimeBucket (uint64_t bucket)
+{
+  if (bucket >= m_buckets.size ())
+    {
+      m_buckets.resize (bucket + 1);
+    }
+  return m_buckets[bucket];
+}
+
+void
+LoraPacketTracker::IndexRecord (uint64_t uid, const PacketRecord &record,
+                                Time time)
+{
+  uint64_t bucket = GetBucket (time);
+
+  if (((record.flags & PacketRecord::PHY_SENT)
+       && GetBucket (record.phySendTime) == bucket)
+      || ((record.flags & PacketRecord::MAC_SENT)
+          && GetBucket (record.macSendTime) == bucket)
+      || ((record.flags & PacketRecord::RETX_DONE)
+          && GetBucket (record.firstAttempt) == bucket))
+    {
+      return;
+    }
+
+  GetTimeBucket (bucket).uids.push_back (uid);
+}
+
+void
+LoraPacketTracker::GetWindowBuckets (Time start, Time stop, uint64_t &firstFull,
+                                     uint64_t &endFull,
+                                     std::vector<uint64_t> &edges) const
+{
+  firstFull = 0;
+  endFull = 0;
+  edges.clear ();
+
+  if (stop < start || stop.IsStrictlyNegative () || m_buckets.empty ())
+    {
+      return;
+    }
+  if (start.IsStrictlyNegative ())
+    {
+      start = Seconds (0);
+    }
+
+  // Bucket b covers [b * w, (b + 1) * w - 1] in time steps
+  int64_t width = m_bucketWidth.GetTimeStep ();
+  firstFull = (start.GetTimeStep () + width - 1) / width;
+  endFull = std::min<uint64_t> ((stop.GetTimeStep () + 1) / width,
+                                m_buckets.size ());
+  endFull = std::max (endFull, firstFull);
+
+  uint64_t last = std::min<uint64_t> (GetBucket (stop), m_buckets.size () - 1);
+  for (uint64_t b = GetBucket (start); b <= last && b < firstFull; b++)
+    {
+      edges.push_back (b);
+    }
+  for (uint64_t b = endFull; b <= last; b++)
+    {
+      edges.push_back (b);
+    }
+}
+
+template <typename F>
+void
+LoraPacketTracker::ForEachRecord (uint64_t bucket, bool includeSpilled, F f)
+{
+  for (uint64_t uid : m_buckets[bucket].uids)
+    {
+      // Records of released packets may still be listed
+      const PacketRecord *record = FindRecord (uid);
+      if (record)
+        {
+          f (uid, *record, m_phyOutcomes, m_macReceptions);
+        }
+    }
+
+  if (!includeSpilled)
+    {
+      return;
+    }
+  for (uint64_t offset : m_buckets[bucket].spillBlocks)
+    {
+      RecordBlock block;
+      ReadBlock (offset, block);
+      for (uint32_t i = 0; i < block.records.size (); i++)
+        {
+          f (block.uids[i], block.records[i], block.phyOutcomes,
+             block.macReceptions);
+        }
+    }
+}
+
+void
+LoraPacketTracker::FoldRecord (RetransmissionAggregate &aggregate,
+                               const PacketRecord &record,
+                               const std::vector<MacReceptionEntry> &receptions)
+{
+  // This runs on the report threads too: it must not log
+  bool received = record.firstReception != NO_ENTRY;
+  bool delayCounts = false;
+
+  if (!(record.flags & PacketRecord::RETX_DONE)
+      && !(record.flags & PacketRecord::CONFIRMED))
+    {
+      aggregate.totalUnconfirmedPackets++;
+
+      if (received)
+        {
+          aggregate.successfulUnconfirmedPackets++;
+          delayCounts = true;
+        }
+    }
+  else if (!(record.flags & PacketRecord::RETX_DONE))
+    {
+      aggregate.incompleteConfirmedPackets++;
+    }
+  else
+    {
+      aggregate.totalReTxAmounts.at (record.reTxAttempts - 1)++;
+
+      if (record.flags & PacketRecord::RETX_SUCCESSFUL)
+        {
+          aggregate.successfulReTxAmounts.at (record.reTxAttempts - 1)++;
+          // If this packet was successful at the ED, it means that it
+          // was also received at the GW
+          aggregate.successfullyExtractedConfirmedPackets++;
+          aggregate.successfullyAckedConfirmedPackets++;
+        }
+      else
+        {
+          aggregate.failedReTxAmounts.at (record.reTxAttempts - 1)++;
+          // Check if, despite failing to get an ACK at the ED, this
+          // packet was received at the GW
+          if (received)
+            {
+              aggregate.successfullyExtractedConfirmedPackets++;
+            }
+        }
+
+      // Confirmed packets that were never received don't count for delays
+      if (received)
+        {
+          aggregate.confirmedPackets++;
+          aggregate.ackDelaySum += record.finishTime - record.firstAttempt;
+          delayCounts = true;
+        }
+    }
+
+  if (delayCounts)
+    {
+      aggregate.receivedPackets++;
+      for (uint32_t i = record.firstReception; i != NO_ENTRY; i = receptions[i].next)
+        {
+          std::pair<int, Time> &delay = aggregate.delays[receptions[i].gwId];
+          delay.first++;
+          delay.second += receptions[i].receptionTime - record.macSendTime;
+        }
+    }
+}
+
+void
+LoraPacketTracker::AddAggregate (RetransmissionAggregate &aggregate,
+                                 const RetransmissionAggregate &other)
+{
+  for (int i = 0; i < 8; i++)
+    {
+      aggregate.totalReTxAmounts[i] += other.totalReTxAmounts[i];
+      aggregate.successfulReTxAmounts[i] += other.successfulReTxAmounts[i];
+      aggregate.failedReTxAmounts[i] += other.failedReTxAmounts[i];
+    }
+  aggregate.confirmedPackets += other.confirmedPackets;
+  aggregate.successfullyExtractedConfirmedPackets +=
+    other.successfullyExtractedConfirmedPackets;
+  aggregate.successfullyAckedConfirmedPackets +=
+    other.successfullyAckedConfirmedPackets;
+  aggregate.incompleteConfirmedPackets += other.incompleteConfirmedPackets;
+  aggregate.totalUnconfirmedPackets += other.totalUnconfirmedPackets;
+  aggregate.successfulUnconfirmedPackets += other.successfulUnconfirmedPackets;
+  aggregate.receivedPackets += other.receivedPackets;
+  aggregate.ackDelaySum += other.ackDelaySum;
+  for (auto it = other.delays.begin (); it != other.delays.end (); ++it)
+    {
+      std::pair<int, Time> &delay = aggregate.delays[it->first];
+      delay.first += it->second.first;
+      delay.second += it->second.second;
+    }
+}
+
+////////////////////////////
+// Finalization and spill //
+////////////////////////////
+
+void
+LoraPacketTracker::EnableFinalization (Time horizon, std::string spillFilename)
+{
+  NS_LOG_FUNCTION (this << horizon << spillFilename);
+  NS_ASSERT (horizon.IsStrictlyPositive ());
+
+  // Queries reaching into released buckets read the spill file to stay exact
+  NS_ABORT_MSG_IF (spillFilename.empty (),
+                   "Finalization needs a spill file");
+
+  m_finalizationHorizon = horizon;
+  m_spillFile.open (spillFilename.c_str (), std::ios::in | std::ios::out |
+                    std::ios::trunc | std::ios::binary);
+  NS_ABORT_MSG_IF (!m_spillFile.is_open (),
+                   "Can't open spill file " << spillFilename);
+}
+
+void
+LoraPacketTracker::CheckFinalization (void)
+{
+  if (m_finalizationHorizon.IsStrictlyPositive ()
+      && Simulator::Now () >= m_nextFinalization)
+    {
+      m_nextFinalization = Simulator::Now () + m_bucketWidth;
+      Finalize ();
+    }
+}
+
+bool
+LoraPacketTracker::IsSettled (const PacketRecord &record) const
+{
+  // Confirmed packets wait for the outcome of the retransmission procedure
+  return !((record.flags & PacketRecord::MAC_SENT)
+           && (record.flags & PacketRecord::CONFIRMED)
+           && !(record.flags & PacketRecord::RETX_DONE));
+}
+
+uint64_t
+LoraPacketTracker::GetLastBucket (const PacketRecord &record) const
+{
+  uint64_t last = 0;
+  if (record.flags & PacketRecord::PHY_SENT)
+    {
+      last = std::max (last, GetBucket (record.phySendTime));
+    }
+  if (record.flags & PacketRecord::MAC_SENT)
+    {
+      last = std::max (last, GetBucket (record.macSendTime));
+    }
+  if (record.flags & PacketRecord::RETX_DONE)
+    {
+      last = std::max (last, GetBucket (record.firstAttempt));
+    }
+  return last;
+}
+
+void
+LoraPacketTracker::Finalize (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  Time limit = Simulator::Now () - m_finalizationHorizon;
+  if (limit.IsStrictlyNegative ())
+    {
+      return;
+    }
+  uint64_t endBucket = std::min<uint64_t> (GetBucket (limit), m_buckets.size ());
+
+  RecordBlock spill;
+
+  // Old packets whose retransmission procedure may have ended since last time
+  std::vector<uint64_t> stillPending;
+  for (uint64_t uid : m_pendingRecords)
+    {
+      PacketRecord *record = FindRecord (uid);
+      if (!record)
+        {
+          continue;
+        }
+      if (IsSettled (*record) && GetLastBucket (*record) < endBucket)
+        {
+          ReleaseRecord (uid, *record, spill);
+        }
+      else
+        {
+          stillPending.push_back (uid);
+        }
+    }
+  m_pendingRecords.swap (stillPending);
+
+  for (uint64_t b = m_firstOpenBucket; b < endBucket; b++)
+    {
+      std::vector<uint64_t> kept;
+      for (uint64_t uid : m_buckets[b].uids)
+        {
+          PacketRecord *record = FindRecord (uid);
+          if (!record)
+            {
+              continue;
+            }
+          if (GetLastBucket (*record) > b)
+            {
+              // This will be dealt with together with its last bucket
+              kept.push_back (uid);
+            }
+          else if (!IsSettled (*record))
+            {
+              kept.push_back (uid);
+              m_pendingRecords.push_back (uid);
+            }
+          else
+            {
+              ReleaseRecord (uid, *record, spill);
+            }
+        }
+      kept.shrink_to_fit ();
+      m_buckets[b].uids.swap (kept);
+    }
+  m_firstOpenBucket = std::max (m_firstOpenBucket, endBucket);
+
+  if (!spill.records.empty ())
+    {
+      uint64_t offset = WriteBlock (spill);
+      for (const PacketRecord &record : spill.records)
+        {
+          Time times[3] = {record.phySendTime, record.macSendTime, record.firstAttempt};
+          uint8_t flags[3] = {PacketRecord::PHY_SENT, PacketRecord::MAC_SENT,
+                              PacketRecord::RETX_DONE};
+          for (int i = 0; i < 3; i++)
+            {
+              if (!(record.flags & flags[i]))
+                {
+                  continue;
+                }
+              std::vector<uint64_t> &blocks = m_buckets[GetBucket (times[i])].spillBlocks;
+              if (blocks.empty () || blocks.back () != offset)
+                {
+                  blocks.push_back (offset);
+                }
+            }
+        }
+    }
+
+  if (2 * m_deadPhyOutcomes > m_phyOutcomes.size ()
+      || 2 * m_deadMacReceptions > m_macReceptions.size ())
+    {
+      CompactPools ();
+    }
+  if (2 * m_deadDeviceIndexEntries > m_deviceIndexEntries)
+    {
+      CompactDeviceIndex ();
+    }
+}
+
+void
+LoraPacketTracker::ReleaseRecord (uint64_t uid, PacketRecord &record,
+                                  RecordBlock &spill)
+{
+  NS_LOG_DEBUG ("Releasing packet " << uid);
+
+  if (record.flags & (PacketRecord::PHY_SENT | PacketRecord::MAC_SENT))
+    {
+      m_deadDeviceIndexEntries++;
+    }
+
+  if (record.flags & PacketRecord::MAC_SENT)
+    {
+      std::unique_ptr<RetransmissionAggregate> &folded =
+        m_buckets[GetBucket (record.macSendTime)].folded;
+      if (!folded)
+        {
+          folded.reset (new RetransmissionAggregate ());
+        }
+      FoldRecord (*folded, record, m_macReceptions);
+    }
+  PacketRecord copy = record;
+  copy.firstOutcome = NO_ENTRY;
+  copy.firstReception = NO_ENTRY;
+  for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = m_phyOutcomes[i].next)
+    {
+      PhyOutcomeEntry entry = m_phyOutcomes[i];
+      entry.next = copy.firstOutcome;
+      copy.firstOutcome = spill.phyOutcomes.size ();
+      spill.phyOutcomes.push_back (entry);
+      m_deadPhyOutcomes++;
+    }
+  for (uint32_t i = record.firstReception; i != NO_ENTRY; i = m_macReceptions[i].next)
+    {
+      MacReceptionEntry entry = m_macReceptions[i];
+      entry.next = copy.firstReception;
+      copy.firstReception = spill.macReceptions.size ();
+      spill.macReceptions.push_back (entry);
+      m_deadMacReceptions++;
+    }
+  spill.uids.push_back (uid);
+  spill.records.push_back (copy);
+
+  // Free the record, and its chunk if it was the last one in use
+  record = PacketRecord ();
+  record.firstOutcome = NO_ENTRY;
+  record.firstReception = NO_ENTRY;
+  uint64_t chunk = uid >> CHUNK_BITS;
+  if (--m_chunkLiveRecords[chunk] == 0)
+    {
+      m_records[chunk].reset ();
+    }
+}
+
+void
+LoraPacketTracker::CompactPools (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<PhyOutcomeEntry> phyOutcomes;
+  std::vector<MacReceptionEntry> macReceptions;
+  phyOutcomes.reserve (m_phyOutcomes.size () - m_deadPhyOutcomes);
+  macReceptions.reserve (m_macReceptions.size () - m_deadMacReceptions);
+
+  for (uint64_t chunk = 0; chunk < m_records.size (); chunk++)
+    {
+      if (!m_records[chunk])
+        {
+          continue;
+        }
+      for (uint32_t j = 0; j < (1 << CHUNK_BITS); j++)
+        {
+          PacketRecord &record = m_records[chunk][j];
+          uint32_t head = NO_ENTRY;
+          for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = m_phyOutcomes[i].next)
+            {
+              PhyOutcomeEntry entry = m_phyOutcomes[i];
+              entry.next = head;
+              head = phyOutcomes.size ();
+              phyOutcomes.push_back (entry);
+            }
+          record.firstOutcome = head;
+          head = NO_ENTRY;
+          for (uint32_t i = record.firstReception; i != NO_ENTRY; i = m_macReceptions[i].next)
+            {
+              MacReceptionEntry entry = m_macReceptions[i];
+              entry.next = head;
+              head = macReceptions.size ();
+              macReceptions.push_back (entry);
+            }
+          record.firstReception = head;
+        }
+    }
+
+  m_phyOutcomes.swap (phyOutcomes);
+  m_macReceptions.swap (macReceptions);
+  m_deadPhyOutcomes = 0;
+  m_deadMacReceptions = 0;
+}
+
+void
+LoraPacketTracker::IndexDevicePacket (uint32_t deviceId, uint64_t uid)
+{
+  if (deviceId >= m_deviceIndex.size ())
+    {
+      m_deviceIndex.resize (deviceId + 1);
+    }
+
+  // Packets are sent in time order, so this keeps each list sorted
+  DeviceIndexEntry entry;
+  entry.uid = uid;
+  entry.sendTime = Simulator::Now ();
+  m_deviceIndex[deviceId].push_back (entry);
+  m_deviceIndexEntries++;
+}
+
+void
+LoraPacketTracker::CompactDeviceIndex (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (std::vector<DeviceIndexEntry> &entries : m_deviceIndex)
+    {
+      entries.erase (std::remove_if (entries.begin (), entries.end (),
+                                     [this] (const DeviceIndexEntry &entry)
+      {
+        return !FindRecord (entry.uid);
+      }), entries.end ());
+    }
+  m_deviceIndexEntries -= m_deadDeviceIndexEntries;
+  m_deadDeviceIndexEntries = 0;
+}
+
+template <typename F>
+void
+LoraPacketTracker::ForEachDeviceRecord (uint32_t deviceId, Time start,
+                                        Time stop, F f)
+{
+  if (deviceId >= m_deviceIndex.size ())
+    {
+      return;
+    }
+
+  const std::vector<DeviceIndexEntry> &entries = m_deviceIndex[deviceId];
+  auto it = std::lower_bound (entries.begin (), entries.end (), start,
+                              [] (const DeviceIndexEntry &entry, Time time)
+  {
+    return entry.sendTime < time;
+  });
+  for (; it != entries.end () && it->sendTime <= stop; ++it)
+    {
+      // Released packets may still be listed
+      const PacketRecord *record = FindRecord (it->uid);
+      if (record)
+        {
+          f (it->uid, *record);
+        }
+    }
+}
+
+std::vector<PacketFate>
+LoraPacketTracker::GetDevicePackets (uint32_t deviceId, Time start, Time stop)
+{
+  NS_LOG_FUNCTION (this << deviceId << start << stop);
+
+  std::vector<PacketFate> fates;
+  ForEachDeviceRecord (deviceId, start, stop,
+                       [&] (uint64_t uid, const PacketRecord &record)
+  {
+    PacketFate fate;
+    fate.uid = uid;
+    fate.record = record;
+    fate.record.firstOutcome = NO_ENTRY;
+    fate.record.firstReception = NO_ENTRY;
+    for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = m_phyOutcomes[i].next)
+      {
+        fate.phyOutcomes.push_back (std::make_pair (m_phyOutcomes[i].gwId,
+                                                    PhyPacketOutcome (m_phyOutcomes[i].outcome)));
+      }
+    for (uint32_t i = record.firstReception; i != NO_ENTRY; i = m_macReceptions[i].next)
+      {
+        fate.macReceptions.push_back (std::make_pair (m_macReceptions[i].gwId,
+                                                      m_macReceptions[i].receptionTime));
+      }
+    fates.push_back (fate);
+  });
+  return fates;
+}
+
+DevicePerformance
+LoraPacketTracker::GetDevicePerformance (uint32_t deviceId, Time start,
+                                         Time stop)
+{
+  NS_LOG_FUNCTION (this << deviceId << start << stop);
+
+  DevicePerformance performance = DevicePerformance ();
+  ForEachDeviceRecord (deviceId, start, stop,
+                       [&] (uint64_t, const PacketRecord &record)
+  {
+    if (record.flags & PacketRecord::MAC_SENT)
+      {
+        performance.macSent++;
+        if (record.firstReception != NO_ENTRY)
+          {
+            performance.macReceived++;
+          }
+      }
+    if (record.flags & PacketRecord::RETX_DONE)
+      {
+        std::array<int, 8> &amounts = record.flags & PacketRecord::RETX_SUCCESSFUL ?
+          performance.successfulReTxAmounts : performance.failedReTxAmounts;
+        amounts.at (record.reTxAttempts - 1)++;
+      }
+    for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = m_phyOutcomes[i].next)
+      {
+        if (m_phyOutcomes[i].outcome != UNSET)
+          {
+            performance.phyOutcomes[m_phyOutcomes[i].gwId]
+            .at (m_phyOutcomes[i].outcome - RECEIVED)++;
+          }
+      }
+  });
+  return performance;
+}
+
+uint64_t
+LoraPacketTracker::WriteBlock (const RecordBlock &block)
+{
+  NS_LOG_FUNCTION (this << block.records.size ());
+
+  m_spillFile.seekp (0, std::ios::end);
+  uint64_t offset = m_spillFile.tellp ();
+  SerializeRecordBlock (m_spillFile, block);
+  return offset;
+}
+
+void
+LoraPacketTracker::ReadBlock (uint64_t offset, RecordBlock &block)
+{
+  NS_LOG_FUNCTION (this << offset);
+
+  m_spillFile.seekg (offset);
+  NS_ABORT_MSG_IF (!DeserializeRecordBlock (m_spillFile, block),
+                   "Corrupted spill file block at offset " << offset);
+}
+
+uint64_t
+LoraPacketTracker::GetNRecords (void) const
+{
+  uint64_t records = 0;
+  for (uint32_t live : m_chunkLiveRecords)
+    {
+      records += live;
+    }
+  return records;
+}
+
+void
+LoraPacketTracker::WriteRecords (LoraTraceFileWriter &writer)
+{
+  NS_LOG_FUNCTION (this);
+
+  // Packets that were spilled to disk, once each
+  std::vector<uint64_t> offsets;
+  for (const TimeBucket &bucket : m_buckets)
+    {
+      offsets.insert (offsets.end (), bucket.spillBlocks.begin (),
+                      bucket.spillBlocks.end ());
+    }
+  std::sort (offsets.begin (), offsets.end ());
+  offsets.erase (std::unique (offsets.begin (), offsets.end ()), offsets.end ());
+  for (uint64_t offset : offsets)
+    {
+      RecordBlock block;
+      ReadBlock (offset, block);
+      writer.WritePacketBlock (block);
+    }
+
+  // Packets in memory, a chunk at a time
+  for (uint64_t chunk = 0; chunk < m_records.size (); chunk++)
+    {
+      if (!m_records[chunk])
+        {
+          continue;
+        }
+      RecordBlock block;
+      for (uint32_t j = 0; j < (1 << CHUNK_BITS); j++)
+        {
+          const PacketRecord &record = m_records[chunk][j];
+          if (!record.flags)
+            {
+              continue;
+            }
+          PacketRecord copy = record;
+          copy.firstOutcome = NO_ENTRY;
+          copy.firstReception = NO_ENTRY;
+          for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = m_phyOutcomes[i].next)
+            {
+              PhyOutcomeEntry entry = m_phyOutcomes[i];
+              entry.next = copy.firstOutcome;
+              copy.firstOutcome = block.phyOutcomes.size ();
+              block.phyOutcomes.push_back (entry);
+            }
+          for (uint32_t i = record.firstReception; i != NO_ENTRY; i = m_macReceptions[i].next)
+            {
+              MacReceptionEntry entry = m_macReceptions[i];
+              entry.next = copy.firstReception;
+              copy.firstReception = block.macReceptions.size ();
+              block.macReceptions.push_back (entry);
+            }
+          block.uids.push_back ((chunk << CHUNK_BITS) | j);
+          block.records.push_back (copy);
+        }
+      writer.WritePacketBlock (block);
+    }
+}
+
+void
+LoraPacketTracker::RecordPhyOutcome (Ptr<Packet const> packet, uint32_t gwId,
+                                     enum PhyPacketOutcome outcome)
+{
+  PacketRecord *record = FindRecord (packet);
+  if (!record)
+    {
+      // Only uplinks are tracked, from the moment they are sent
+      NS_ASSERT_MSG (!IsUplink (packet), "Packet not found in tracker");
+      return;
+    }
+  NS_ASSERT_MSG (record->flags & PacketRecord::PHY_SENT,
+                 "Packet not found in tracker");
+
+  // Only the first outcome at each gateway counts
+  if (GetPhyOutcome (*record, gwId, m_phyOutcomes) != UNSET)
+    {
+      return;
+    }
+
+  PhyOutcomeEntry entry;
+  entry.next = record->firstOutcome;
+  entry.gwId = gwId;
+  entry.outcome = outcome;
+  record->firstOutcome = m_phyOutcomes.size ();
+  m_phyOutcomes.push_back (entry);
+
+  std::vector<std::array<uint32_t, 5> > &counts = m_phyOutcomeCounts[gwId];
+  uint64_t bucket = GetBucket (record->phySendTime);
+  if (bucket >= counts.size ())
+    {
+      counts.resize (bucket + 1, std::array<uint32_t, 5> ());
+    }
+  counts[bucket][outcome - RECEIVED]++;
+}
+
+enum PhyPacketOutcome
+LoraPacketTracker::GetPhyOutcome (const PacketRecord &record, uint32_t gwId,
+                                  const std::vector<PhyOutcomeEntry> &pool)
+{
+  for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = pool[i].next)
+    {
+      if (pool[i].gwId == gwId)
+        {
+          return PhyPacketOutcome (pool[i].outcome);
+        }
+    }
+  return UNSET;
+}
+
+bool
+LoraPacketTracker::GetMacReceptionTime (const PacketRecord &record,
+                                        uint32_t gwId,
+                                        const std::vector<MacReceptionEntry> &pool,
+                                        Time &receptionTime)
+{
+  for (uint32_t i = record.firstReception; i != NO_ENTRY; i = pool[i].next)
+    {
+      if (pool[i].gwId == gwId)
+        {
+          receptionTime = pool[i].receptionTime;
+          return true;
+        }
+    }
+  return false;
+}
+
 /////////////////
 // MAC metrics //
 /////////////////
@@ -46,18 +858,22 @@ LoraPacketTracker::~LoraPacketTracker ()
 void
 LoraPacketTracker::MacTransmissionCallback (Ptr<Packet const> packet)
 {
-  if (IsUplink (packet))
+  CheckFinalization ();
+
+  PacketRecord *record = GetUplinkRecord (packet);
+  if (record && !(record->flags & PacketRecord::MAC_SENT))
     {
       NS_LOG_INFO ("A new packet was sent by the MAC layer");
 
-      MacPacketStatus status;
-      status.packet = packet;
-      status.sendTime = Simulator::Now ();
-      status.senderId = Simulator::GetContext ();
-      status.receivedTime = Time::Max ();
-
-      m_macPacketTracker.insert (std::pair<Ptr<Packet const>, MacPacketStatus>
-                                   (packet, status));
+      IndexRecord (packet->GetUid (), *record, Simulator::Now ());
+      if (!(record->flags & PacketRecord::PHY_SENT))
+        {
+          IndexDevicePacket (Simulator::GetContext (), packet->GetUid ());
+        }
+      GetTimeBucket (GetBucket (Simulator::Now ())).macSent++;
+      record->macSendTime = Simulator::Now ();
+      record->macSenderId = Simulator::GetContext ();
+      record->flags |= PacketRecord::MAC_SENT;
     }
 }
 
@@ -71,37 +887,87 @@ LoraPacketTracker::RequiredTransmissionsCallback (uint8_t reqTx, bool success,
                 ", succ: " << success << ", firstAttempt: " <<
                 firstAttempt.GetSeconds ());
 
-  RetransmissionStatus entry;
-  entry.firstAttempt = firstAttempt;
-  entry.finishTime = Simulator::Now ();
-  entry.reTxAttempts = reqTx;
-  entry.successful = success;
+  // The MAC frequently fires this trace with no packet: such calls don't
+  // describe any transmission, so we don't keep them
+  if (packet == 0)
+    {
+      return;
+    }
+
+  // Records are only created when uplinks are sent. A packet without one is
+  // a downlink, was released and settled already, or was sent before
+  // tracking began.
+  PacketRecord *record = FindRecord (packet);
+  if (!record)
+    {
+      NS_LOG_DEBUG ("Packet " << packet->GetUid () << " is not in memory");
+      return;
+    }
 
-  m_reTransmissionTracker.insert (std::pair<Ptr<Packet>, RetransmissionStatus>
-                                    (packet, entry));
+  if (!(record->flags & PacketRecord::RETX_DONE))
+    {
+      IndexRecord (packet->GetUid (), *record, firstAttempt);
+      TimeBucket &bucket = GetTimeBucket (GetBucket (firstAttempt));
+      bucket.retxDone++;
+      if (success)
+        {
+          bucket.retxSuccessful++;
+        }
+      record->firstAttempt = firstAttempt;
+      record->finishTime = Simulator::Now ();
+      record->reTxAttempts = reqTx;
+      record->flags |= PacketRecord::RETX_DONE;
+      if (success)
+        {
+          record->flags |= PacketRecord::RETX_SUCCESSFUL;
+        }
+
+      uint64_t b = GetBucket (firstAttempt);
+      AddToHistogram (m_reTxCounts[record->sf], b, reqTx);
+      if (success)
+        {
+          AddToHistogram (m_ackDelays[record->sf], b,
+                          (record->finishTime - firstAttempt).GetMicroSeconds ());
+        }
+    }
 }
 
 void
 LoraPacketTracker::MacGwReceptionCallback (Ptr<Packet const> packet)
 {
-  if (IsUplink (packet))
+  // Find the received packet among the ones sent by the MAC
+  PacketRecord *record = FindRecord (packet);
+  if (!record)
     {
-      NS_LOG_INFO ("A packet was successfully received" <<
-                   " at the MAC layer of gateway " <<
-                   Simulator::GetContext ());
+      // Only uplinks are tracked, from the moment they are sent
+      NS_ABORT_MSG_IF (IsUplink (packet), "Packet not found in tracker");
+      return;
+    }
+  NS_ABORT_MSG_IF (!(record->flags & PacketRecord::MAC_SENT),
+                   "Packet not found in tracker");
 
-      // Find the received packet in the m_macPacketTracker
-      auto it = m_macPacketTracker.find (packet);
-      if (it != m_macPacketTracker.end ())
-        {
-          (*it).second.receptionTimes.insert (std::pair<int, Time>
-                                                (Simulator::GetContext (),
-                                                Simulator::Now ()));
-        }
-      else
-        {
-          NS_ABORT_MSG ("Packet not found in tracker");
-        }
+  NS_LOG_INFO ("A packet was successfully received" <<
+               " at the MAC layer of gateway " <<
+               Simulator::GetContext ());
+
+  uint32_t gwId = Simulator::GetContext ();
+  Time receptionTime;
+  if (record->firstReception == NO_ENTRY)
+    {
+      m_buckets[GetBucket (record->macSendTime)].macReceived++;
+    }
+  if (!GetMacReceptionTime (*record, gwId, m_macReceptions, receptionTime))
+    {
+      MacReceptionEntry entry;
+      entry.next = record->firstReception;
+      entry.gwId = gwId;
+      entry.receptionTime = Simulator::Now ();
+      record->firstReception = m_macReceptions.size ();
+      m_macReceptions.push_back (entry);
+
+      Time delay = entry.receptionTime - record->macSendTime;
+      AddToHistogram (m_deliveryDelays[(gwId << 8) | record->sf],
+                      GetBucket (record->macSendTime), delay.GetMicroSeconds ());
     }
 }
 
@@ -112,94 +978,80 @@ LoraPacketTracker::MacGwReceptionCallback (Ptr<Packet const> packet)
 void
 LoraPacketTracker::TransmissionCallback (Ptr<Packet const> packet, uint32_t edId)
 {
-  if (IsUplink (packet))
+  CheckFinalization ();
+
+  PacketRecord *record = GetUplinkRecord (packet);
+  if (record && !(record->flags & PacketRecord::PHY_SENT))
     {
       NS_LOG_INFO ("PHY packet " << packet
                                  << " was transmitted by device "
                                  << edId);
-      // Create a packetStatus
-      PacketStatus status;
-      status.packet = packet;
-      status.sendTime = Simulator::Now ();
-      status.senderId = edId;
 
-      m_packetTracker.insert (std::pair<Ptr<Packet const>, PacketStatus> (packet, status));
+      IndexRecord (packet->GetUid (), *record, Simulator::Now ());
+      if (!(record->flags & PacketRecord::MAC_SENT))
+        {
+          IndexDevicePacket (edId, packet->GetUid ());
+        }
+      GetTimeBucket (GetBucket (Simulator::Now ())).phySent++;
+      record->phySendTime = Simulator::Now ();
+      record->phySenderId = edId;
+      LoraTag tag;
+      if (packet->PeekPacketTag (tag))
+        {
+          record->sf = tag.GetSpreadingFactor ();
+        }
+      record->flags |= PacketRecord::PHY_SENT;
     }
 }
 
 void
 LoraPacketTracker::PacketReceptionCallback (Ptr<Packet const> packet, uint32_t gwId)
 {
-  if (IsUplink (packet))
-    {
-      // Remove the successfully received packet from the list of sent ones
-      NS_LOG_INFO ("PHY packet " << packet
-                                 << " was successfully received at gateway "
-                                 << gwId);
+  NS_LOG_INFO ("PHY packet " << packet
+                             << " was successfully received at gateway "
+                             << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           RECEIVED));
-    }
+  RecordPhyOutcome (packet, gwId, RECEIVED);
 }
 
 void
 LoraPacketTracker::InterferenceCallback (Ptr<Packet const> packet, uint32_t gwId)
 {
-  if (IsUplink (packet))
-    {
-      NS_LOG_INFO ("PHY packet " << packet
-                                 << " was interfered at gateway "
-                                 << gwId);
+  NS_LOG_INFO ("PHY packet " << packet
+                             << " was interfered at gateway "
+                             << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           INTERFERED));
-    }
+  RecordPhyOutcome (packet, gwId, INTERFERED);
 }
 
 void
 LoraPacketTracker::NoMoreReceiversCallback (Ptr<Packet const> packet, uint32_t gwId)
 {
-  if (IsUplink (packet))
-    {
-      NS_LOG_INFO ("PHY packet " << packet
-                                 << " was lost because no more receivers at gateway "
-                                 << gwId);
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           NO_MORE_RECEIVERS));
-    }
+  NS_LOG_INFO ("PHY packet " << packet
+                             << " was lost because no more receivers at gateway "
+                             << gwId);
+
+  RecordPhyOutcome (packet, gwId, NO_MORE_RECEIVERS);
 }
 
 void
 LoraPacketTracker::UnderSensitivityCallback (Ptr<Packet const> packet, uint32_t gwId)
 {
-  if (IsUplink (packet))
-    {
-      NS_LOG_INFO ("PHY packet " << packet
-                                 << " was lost because under sensitivity at gateway "
-                                 << gwId);
+  NS_LOG_INFO ("PHY packet " << packet
+                             << " was lost because under sensitivity at gateway "
+                             << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           UNDER_SENSITIVITY));
-    }
+  RecordPhyOutcome (packet, gwId, UNDER_SENSITIVITY);
 }
 
 void
 LoraPacketTracker::LostBecauseTxCallback (Ptr<Packet const> packet, uint32_t gwId)
 {
-  if (IsUplink (packet))
-    {
-      NS_LOG_INFO ("PHY packet " << packet
-                                 << " was lost because of GW transmission at gateway "
-                                 << gwId);
+  NS_LOG_INFO ("PHY packet " << packet
+                             << " was lost because of GW transmission at gateway "
+                             << gwId);
 
-      std::map<Ptr<Packet const>, PacketStatus>::iterator it = m_packetTracker.find (packet);
-      (*it).second.outcomes.insert (std::pair<int, enum PhyPacketOutcome> (gwId,
-                                                                           LOST_BECAUSE_TX));
-    }
+  RecordPhyOutcome (packet, gwId, LOST_BECAUSE_TX);
 }
 
 bool
@@ -207,10 +1059,35 @@ LoraPacketTracker::IsUplink (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this);
 
-  LorawanMacHeader mHdr;
-  Ptr<Packet> copy = packet->Copy ();
-  copy->RemoveHeader (mHdr);
-  return mHdr.IsUplink ();
+  LorawanMacHeader mHdr;
+  packet->PeekHeader (mHdr);
+  return mHdr.IsUplink ();
+}
+
+PacketRecord *
+LoraPacketTracker::GetUplinkRecord (Ptr<Packet const> packet)
+{
+  PacketRecord *record = FindRecord (packet);
+  if (record)
+    {
+      return record;
+    }
+
+  // The tracker sees this packet for the first time: read its MAC header,
+  // once, to know its direction and type
+  LorawanMacHeader mHdr;
+  packet->PeekHeader (mHdr);
+  if (!mHdr.IsUplink ())
+    {
+      return 0;
+    }
+
+  record = &GetRecord (packet);
+  if (mHdr.GetMType () == LorawanMacHeader::CONFIRMED_DATA_UP)
+    {
+      record->flags |= PacketRecord::CONFIRMED;
+    }
+  return record;
 }
 
 ////////////////////////
@@ -225,60 +1102,103 @@ LoraPacketTracker::CountPhyPacketsPerGw (Time startTime, Time stopTime,
   // the function, the following fields: totPacketsSent receivedPackets
   // interferedPackets noMoreGwPackets underSensitivityPackets lostBecauseTxPackets
 
-  std::vector<int> packetCounts (6, 0);
+  return CountPhyPacketsPerGw (startTime, stopTime,
+                               std::vector<uint32_t> (1, gwId))[gwId];
+}
+
+std::map<uint32_t, std::vector<int> >
+LoraPacketTracker::CountPhyPacketsPerGw (Time startTime, Time stopTime,
+                                         std::vector<uint32_t> gateways)
+{
+  NS_LOG_FUNCTION (this << startTime << stopTime << gateways.size ());
 
-  for (auto itPhy = m_packetTracker.begin ();
-       itPhy != m_packetTracker.end ();
-       ++itPhy)
+  if (gateways.empty ())
     {
-      if ((*itPhy).second.sendTime >= startTime && (*itPhy).second.sendTime <= stopTime)
+      for (const auto &gwCounts : m_phyOutcomeCounts)
         {
-          packetCounts.at (0)++;
-
-          NS_LOG_DEBUG ("Dealing with packet " << (*itPhy).second.packet);
-          NS_LOG_DEBUG ("This packet was received by " <<
-                        (*itPhy).second.outcomes.size () << " gateways");
+          gateways.push_back (gwCounts.first);
+        }
+    }
 
-          if ((*itPhy).second.outcomes.count (gwId) > 0)
-            {
-              switch ((*itPhy).second.outcomes.at (gwId))
-                {
-                case RECEIVED:
-                  {
-                    packetCounts.at (1)++;
-                    break;
-                  }
-                case INTERFERED:
-                  {
-                    packetCounts.at (2)++;
-                    break;
-                  }
-                case NO_MORE_RECEIVERS:
-                  {
-                    packetCounts.at (3)++;
-                    break;
-                  }
-                case UNDER_SENSITIVITY:
-                  {
-                    packetCounts.at (4)++;
-                    break;
-                  }
-                case LOST_BECAUSE_TX:
-                  {
-                    packetCounts.at (5)++;
-                    break;
-                  }
-                case UNSET:
-                  {
-                    break;
-                  }
-                }
-            }
+  // The counters of each gateway, and where to add them
+  std::map<uint32_t, std::vector<int> > packetCounts;
+  std::vector<std::pair<std::vector<int> *,
+                        const std::vector<std::array<uint32_t, 5> > *> > gwCounts;
+  for (uint32_t gw : gateways)
+    {
+      std::vector<int> &counts = packetCounts[gw];
+      counts.assign (6, 0);
+      auto it = m_phyOutcomeCounts.find (gw);
+      if (it != m_phyOutcomeCounts.end ())
+        {
+          gwCounts.push_back (std::make_pair (&counts, &it->second));
         }
     }
 
+  int sent = 0;
+  auto addBucket = [&] (uint64_t b)
+  {
+    sent += m_buckets[b].phySent;
+    for (auto &counts : gwCounts)
+      {
+        if (b < counts.second->size ())
+          {
+            for (int i = 0; i < 5; i++)
+              {
+                counts.first->at (i + 1) += (*counts.second)[b][i];
+              }
+          }
+      }
+  };
+
+  uint64_t firstFull, endFull;
+  std::vector<uint64_t> edges;
+  GetWindowBuckets (startTime, stopTime, firstFull, endFull, edges);
+
+  // Buckets inside the window only need their counters
+  for (uint64_t b = firstFull; b < endFull; b++)
+    {
+      addBucket (b);
+    }
+
+  // Packets in the buckets at the edges need to be checked one by one
+  for (uint64_t b : edges)
+    {
+      ForEachRecord (b, true, [&] (uint64_t uid, const PacketRecord &record,
+                                   const std::vector<PhyOutcomeEntry> &outcomes,
+                                   const std::vector<MacReceptionEntry> &)
+      {
+        if (!(record.flags & PacketRecord::PHY_SENT)
+            || GetBucket (record.phySendTime) != b
+            || record.phySendTime < startTime || record.phySendTime > stopTime)
+          {
+            return;
+          }
+
+        sent++;
+
+        NS_LOG_DEBUG ("Dealing with packet " << uid);
+
+        // A packet has at most one outcome per gateway
+        for (uint32_t i = record.firstOutcome; i != NO_ENTRY; i = outcomes[i].next)
+          {
+            auto counts = packetCounts.find (outcomes[i].gwId);
+            if (counts != packetCounts.end () && outcomes[i].outcome != UNSET)
+              {
+                counts->second.at (outcomes[i].outcome - RECEIVED + 1)++;
+              }
+          }
+      });
+    }
+
+  for (auto &counts : packetCounts)
+    {
+      counts.second.at (0) = sent;
+    }
+
   return packetCounts;
 }
+
 std::string
 LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
                                          int gwId)
@@ -287,57 +1207,8 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
   // the function, the following fields: totPacketsSent receivedPackets
   // interferedPackets noMoreGwPackets underSensitivityPackets lostBecauseTxPackets
 
-  std::vector<int> packetCounts (6, 0);
-
-  for (auto itPhy = m_packetTracker.begin ();
-       itPhy != m_packetTracker.end ();
-       ++itPhy)
-    {
-      if ((*itPhy).second.sendTime >= startTime && (*itPhy).second.sendTime <= stopTime)
-        {
-          packetCounts.at (0)++;
-
-          NS_LOG_DEBUG ("Dealing with packet " << (*itPhy).second.packet);
-          NS_LOG_DEBUG ("This packet was received by " <<
-                        (*itPhy).second.outcomes.size () << " gateways");
-
-          if ((*itPhy).second.outcomes.count (gwId) > 0)
-            {
-              switch ((*itPhy).second.outcomes.at (gwId))
-                {
-                case RECEIVED:
-                  {
-                    packetCounts.at (1)++;
-                    break;
-                  }
-                case INTERFERED:
-                  {
-                    packetCounts.at (2)++;
-                    break;
-                  }
-                case NO_MORE_RECEIVERS:
-                  {
-                    packetCounts.at (3)++;
-                    break;
-                  }
-                case UNDER_SENSITIVITY:
-                  {
-                    packetCounts.at (4)++;
-                    break;
-                  }
-                case LOST_BECAUSE_TX:
-                  {
-                    packetCounts.at (5)++;
-                    break;
-                  }
-                case UNSET:
-                  {
-                    break;
-                  }
-                }
-            }
-        }
-    }
+  std::vector<int> packetCounts = CountPhyPacketsPerGw (startTime, stopTime,
+                                                        gwId);
 
   std::string output ("");
   for (int i = 0; i < 6; ++i)
@@ -355,18 +1226,34 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
 
     double sent = 0;
     double received = 0;
-    for (auto it = m_macPacketTracker.begin ();
-         it != m_macPacketTracker.end ();
-         ++it)
+
+    uint64_t firstFull, endFull;
+    std::vector<uint64_t> edges;
+    GetWindowBuckets (startTime, stopTime, firstFull, endFull, edges);
+
+    for (uint64_t b = firstFull; b < endFull; b++)
       {
-        if ((*it).second.sendTime >= startTime && (*it).second.sendTime <= stopTime)
-          {
-            sent++;
-            if ((*it).second.receptionTimes.size ())
-              {
-                received++;
-              }
-          }
+        sent += m_buckets[b].macSent;
+        received += m_buckets[b].macReceived;
+      }
+
+    for (uint64_t b : edges)
+      {
+        ForEachRecord (b, true, [&] (uint64_t, const PacketRecord &record,
+                                     const std::vector<PhyOutcomeEntry> &,
+                                     const std::vector<MacReceptionEntry> &)
+        {
+          if ((record.flags & PacketRecord::MAC_SENT)
+              && GetBucket (record.macSendTime) == b
+              && record.macSendTime >= startTime && record.macSendTime <= stopTime)
+            {
+              sent++;
+              if (record.firstReception != NO_ENTRY)
+                {
+                  received++;
+                }
+            }
+        });
       }
 
     return std::to_string (sent) + " " +
@@ -380,30 +1267,49 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
 
     double sent = 0;
     double received = 0;
-    for (auto it = m_reTransmissionTracker.begin ();
-         it != m_reTransmissionTracker.end ();
-         ++it)
+    CountCpsr (startTime, stopTime, sent, received);
+
+    return std::to_string (sent) + " " +
+      std::to_string (received);
+  }
+
+  void
+  LoraPacketTracker::CountCpsr (Time startTime, Time stopTime, double &sent,
+                                double &received)
+  {
+    sent = 0;
+    received = 0;
+
+    uint64_t firstFull, endFull;
+    std::vector<uint64_t> edges;
+    GetWindowBuckets (startTime, stopTime, firstFull, endFull, edges);
+
+    for (uint64_t b = firstFull; b < endFull; b++)
       {
-        if ((*it).second.firstAttempt >= startTime && (*it).second.firstAttempt <= stopTime)
-          {
+        sent += m_buckets[b].retxDone;
+        received += m_buckets[b].retxSuccessful;
+      }
 
-            if((*it).first != 0) //Check if Packet isn't 0. 
-            //RequiredTransmissionsCallback() frequently has a Packet: 0 call
+    for (uint64_t b : edges)
+      {
+        ForEachRecord (b, true, [&] (uint64_t uid, const PacketRecord &record,
+                                     const std::vector<PhyOutcomeEntry> &,
+                                     const std::vector<MacReceptionEntry> &)
+        {
+          if ((record.flags & PacketRecord::RETX_DONE)
+              && GetBucket (record.firstAttempt) == b
+              && record.firstAttempt >= startTime && record.firstAttempt <= stopTime)
             {
               sent++;
-              NS_LOG_DEBUG ("Found a packet" << (*it).first << ", sent " << (it->second.firstAttempt));
-              //NS_LOG_DEBUG ("Number of attempts: " << unsigned(it->second.reTxAttempts) <<
-              //             ", successful: " << it->second.successful);
-              if (it->second.successful)
+              NS_LOG_DEBUG ("Found a packet " << uid << ", sent " <<
+                            record.firstAttempt);
+              if (record.flags & PacketRecord::RETX_SUCCESSFUL)
                 {
                   received++;
                 }
-              }
-          }
+            }
+        });
       }
-
-    return std::to_string (sent) + " " +
-      std::to_string (received);
   }
 
   void
@@ -418,189 +1324,393 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
   std::string
   LoraPacketTracker::getPerformanceLegend()
   {
-     return   "Total unconfirmed Successful unconfirmed | Successfully extracted confirmed packets Successfully ACKed confirmed packets | Incomplete Confirmed | Successful with 1 Successful with 2 Successful with 3 Successful with 4 Successful with 5 Successful with 6 Successful with 7 Successful with 8 | Failed after 1 Failed after 2 Failed after 3 Failed after 4 Failed after 5 Failed after 6 Failed after 7 Failed after 8 | Average Delay Average ACK Delay | Total Retransmission amounts || PHY Total PHY Successful PHY Interfered PHY No More Receivers PHY Under Sensitivity PHY Lost Because TX ** CPSR confirmed sent CPSR confirmed ACKed\n";
+     return   "Total unconfirmed Successful unconfirmed | Successfully extracted confirmed packets Successfully ACKed confirmed packets | Incomplete Confirmed | Successful with 1 Successful with 2 Successful with 3 Successful with 4 Successful with 5 Successful with 6 Successful with 7 Successful with 8 | Failed after 1 Failed after 2 Failed after 3 Failed after 4 Failed after 5 Failed after 6 Failed after 7 Failed after 8 | Average Delay Average ACK Delay | Total Retransmission amounts || PHY Total PHY Successful PHY Interfered PHY No More Receivers PHY Under Sensitivity PHY Lost Because TX ** CPSR confirmed sent CPSR confirmed ACKed ** Packets received by the gateway\n";
   }
 
  std::string
   LoraPacketTracker::CountRetransmissionsPorted (Time startTime, Time stopTime, int gwId, int returnString)
   {
-    std::vector<int> totalReTxAmounts (8, 0);
-    std::vector<int> successfulReTxAmounts (8, 0);
-    std::vector<int> failedReTxAmounts (8, 0);
-    Time delaySum = Seconds (0);
-    Time ackDelaySum = Seconds(0);
+    PerformanceSnapshot snapshot = GetPerformanceSnapshot (startTime, stopTime, gwId);
+
+    if (returnString)
+      {
+        return FormatPerformance (snapshot);
+      }
 
-    int confirmedPacketsOutsideTransient = 0;
-    int confirmedMACpacketsOutsideTransient = 0;
-    int successfullyExtractedConfirmedPackets = 0;
+    // Print legend
+    std::cout << getPerformanceLegend() << std::endl;
+    std::cout << snapshot.totalUnconfirmedPackets << " " << snapshot.successfulUnconfirmedPackets << " | ";
+    std::cout << snapshot.successfullyExtractedConfirmedPackets << " ";
+    std::cout << snapshot.successfullyAckedConfirmedPackets << " | ";
+    std::cout << snapshot.incompleteConfirmedPackets << " | ";
+    PrintVector (std::vector<int> (snapshot.successfulReTxAmounts.begin (),
+                                   snapshot.successfulReTxAmounts.end ()));
+    std::cout << " | ";
+    PrintVector (std::vector<int> (snapshot.failedReTxAmounts.begin (),
+                                   snapshot.failedReTxAmounts.end ()));
+    std::cout << " | ";
+    std::cout << snapshot.averageDelay << " ";
+    std::cout << snapshot.averageAckDelay << " ";
+    std::cout << " | ";
+    std::cout << snapshot.totalReTxAmount;
+    std::cout << " || ";
+    for (int i = 0; i < 6; ++i)
+      {
+        std::cout << snapshot.phyCounts[i] << " ";
+      }
+    std::cout << " ** ";
+    std::cout << std::to_string (snapshot.cpsrSent) << " " <<
+      std::to_string (snapshot.cpsrReceived);
+    std::cout << " ** ";
+    std::cout << snapshot.delayPackets;
+    std::cout << std::endl;
+
+    return "";
+  }
 
-    int successfulUnconfirmedPackets = 0;
-    int incompleteConfirmedPackets = 0;
-    int totalUnconfirmedPackets = 0;
-    int successfullyAckedConfirmedPackets = 0;
+  PerformanceSnapshot
+  LoraPacketTracker::GetPerformanceSnapshot (Time startTime, Time stopTime, int gwId)
+  {
+    NS_LOG_FUNCTION (this << startTime << stopTime << gwId);
 
-    std::string returnValue="";
-  
-    for (auto itMac = m_macPacketTracker.begin (); itMac != m_macPacketTracker.end(); ++itMac)
-        {
+    return GetPerformanceSnapshots (startTime, stopTime,
+                                    std::vector<uint32_t> (1, gwId))[gwId];
+  }
+
+  std::map<uint32_t, PerformanceSnapshot>
+  LoraPacketTracker::GetPerformanceSnapshots (Time startTime, Time stopTime,
+                                              std::vector<uint32_t> gateways)
+  {
+    NS_LOG_FUNCTION (this << startTime << stopTime << gateways.size ());
+
+    if (gateways.empty ())
+      {
+        for (const auto &gwCounts : m_phyOutcomeCounts)
+          {
+            gateways.push_back (gwCounts.first);
+          }
+      }
+
+    // Everything but the delays and PHY outcomes is the same for all gateways
+    RetransmissionAggregate aggregate = AggregateWindow (startTime, stopTime);
+    double cpsrSent, cpsrReceived;
+    CountCpsr (startTime, stopTime, cpsrSent, cpsrReceived);
+    std::map<uint32_t, std::vector<int> > phyCounts =
+      CountPhyPacketsPerGw (startTime, stopTime, gateways);
+
+    std::map<uint32_t, PerformanceSnapshot> snapshots;
+    for (uint32_t gwId : gateways)
+      {
+        snapshots[gwId] = MakePerformanceSnapshot (aggregate, gwId,
+                                                   phyCounts[gwId],
+                                                   cpsrSent, cpsrReceived);
+      }
+    return snapshots;
+  }
+
+  void
+  LoraPacketTracker::SetReportThreads (uint32_t nThreads)
+  {
+    NS_LOG_FUNCTION (this << nThreads);
+    NS_ASSERT (nThreads > 0);
 
+    m_reportThreads = nThreads;
+  }
 
-          if ((*itMac).second.sendTime >= startTime && (*itMac).second.sendTime <= stopTime)
+  void
+  LoraPacketTracker::FoldBuckets (uint64_t first, uint64_t end,
+                                  RetransmissionAggregate &aggregate)
+  {
+    for (uint64_t b = first; b < end; b++)
+      {
+        if (m_buckets[b].folded)
+          {
+            AddAggregate (aggregate, *m_buckets[b].folded);
+          }
+        // The bucket lies inside the window: only look at the packets in memory
+        ForEachRecord (b, false, [&] (uint64_t, const PacketRecord &record,
+                                      const std::vector<PhyOutcomeEntry> &,
+                                      const std::vector<MacReceptionEntry> &receptions)
+        {
+          if ((record.flags & PacketRecord::MAC_SENT)
+              && GetBucket (record.macSendTime) == b)
             {
-              NS_LOG_DEBUG(" ");
-              NS_LOG_DEBUG ("Dealing with packet " << (*itMac).first);
-              NS_LOG_DEBUG("sendTime " << (*itMac).second.sendTime.GetSeconds());
-              NS_LOG_DEBUG("senderId " << (*itMac).second.senderId);
-              if((*itMac).second.receptionTimes.size() >0)
-                NS_LOG_DEBUG("receptionTimes " << (*itMac).second.receptionTimes.at(gwId).GetSeconds());
-              else
-              {
-                  NS_LOG_DEBUG("Packet sent but never received " << " stopTime was " << stopTime.GetSeconds());
-              }
-              
-
-              
-              // Count retransmissions
-              ////////////////////////
-              auto itRetx = m_reTransmissionTracker.find ((*itMac).first);
-        
-              if (itRetx == m_reTransmissionTracker.end() && CheckIfUnconfirmed((*itMac).first))
-                {
-                  NS_LOG_DEBUG("Packet was a unconfirmed packet");
-                  totalUnconfirmedPackets++;
-
- //                 if ((*itMac).second.receivedTime != Time::Max ()) // Received correctly
-                  if ((*itMac).second.receptionTimes.size() != 0) // Received correctly
-                    {
-                      NS_LOG_DEBUG ("Unconfirmed packet was received");
-                      successfulUnconfirmedPackets++;
-                      delaySum += ((*itMac).second.receptionTimes.at(gwId)) - (*itMac).second.sendTime;
-                    }
-                  else
-                  {
-                         NS_LOG_DEBUG("Unconfirmed packet sent but never received");
-                  }
-                  
-                  // NS_ABORT_MSG ("Searched packet was not found" << "Packet " <<
-                  //               (*itMac).first << " not found. Sent at " <<
-                  //               (*itMac).second.sendTime.GetSeconds());
-                }
-              else if(itRetx == m_reTransmissionTracker.end())
-                {
-                     NS_LOG_DEBUG("Confirmed packet sent but not yet logged in reTransmissionTracker.");
-                     NS_LOG_DEBUG("ACK was not yet received/max retrans attempts not yet reached.");
-                     incompleteConfirmedPackets++;
-                }
-              else 
-                {
-                  NS_LOG_DEBUG("Packet was a confirmed packet");
-                  confirmedPacketsOutsideTransient++;
-                  confirmedMACpacketsOutsideTransient++;
-
-                  totalReTxAmounts.at ((*itRetx).second.reTxAttempts - 1)++;
-
-                  if ((*itRetx).second.successful)
-                    {
-                      successfulReTxAmounts.at ((*itRetx).second.reTxAttempts - 1)++;
-                      // If this packet was successful at the ED, it means that it
-                      // was also received at the GW
-                      successfullyExtractedConfirmedPackets++;
-
-                      //Recording to say ED got ACK
-                      successfullyAckedConfirmedPackets++;
-                    }
-                  else
-                    {
-                      failedReTxAmounts.at ((*itRetx).second.reTxAttempts - 1)++;
-                      // Check if, despite failing to get an ACK at the ED, this
-                      // packet was received at the GW
-                      if ((*itMac).second.receptionTimes.size() != 0)
-                        {
-                          successfullyExtractedConfirmedPackets++;
-                        }
-                    }
-
-                  // Compute delays
-                  /////////////////
-                  if ((*itMac).second.receptionTimes.size() == 0)
-                    {
-                       NS_LOG_DEBUG ("Confirmed Packet never received, ignoring it");
-                      confirmedPacketsOutsideTransient--;
-                    }
-                  else
-                    {
-                      delaySum += (*itMac).second.receptionTimes.at(gwId) - (*itMac).second.sendTime;
-                      ackDelaySum += (*itRetx).second.finishTime - (*itRetx).second.firstAttempt;
-                    }
-                }
+              FoldRecord (aggregate, record, receptions);
             }
+        });
+      }
+  }
+
+  RetransmissionAggregate
+  LoraPacketTracker::AggregateWindow (Time startTime, Time stopTime)
+  {
+    // This needs the outcome of each packet. Released packets were already
+    // folded into their bucket's aggregate, so only the packets in memory and,
+    // at the edges of the window, the spilled ones need to be looked at.
+    RetransmissionAggregate aggregate = RetransmissionAggregate ();
+
+    uint64_t firstFull, endFull;
+    std::vector<uint64_t> edges;
+    GetWindowBuckets (startTime, stopTime, firstFull, endFull, edges);
+
+    // Buckets inside the window are split among the threads, each with its
+    // own aggregate. Aggregates hold integer counts and sums, so merging
+    // them gives the same result whatever the split.
+    uint64_t nBuckets = endFull - firstFull;
+    uint32_t nThreads = std::min<uint64_t> (m_reportThreads, nBuckets);
+    if (nThreads > 1)
+      {
+        std::vector<RetransmissionAggregate> partial (nThreads,
+                                                      RetransmissionAggregate ());
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < nThreads; t++)
+          {
+            threads.push_back (std::thread (&LoraPacketTracker::FoldBuckets, this,
+                                            firstFull + nBuckets * t / nThreads,
+                                            firstFull + nBuckets * (t + 1) / nThreads,
+                                            std::ref (partial[t])));
+          }
+        for (uint32_t t = 0; t < nThreads; t++)
+          {
+            threads[t].join ();
+            AddAggregate (aggregate, partial[t]);
+          }
+      }
+    else
+      {
+        FoldBuckets (firstFull, endFull, aggregate);
+      }
+
+    uint64_t b;
+    auto fold = [&] (uint64_t uid, const PacketRecord &record,
+                     const std::vector<PhyOutcomeEntry> &,
+                     const std::vector<MacReceptionEntry> &receptions)
+    {
+      if (!(record.flags & PacketRecord::MAC_SENT)
+          || GetBucket (record.macSendTime) != b
+          || record.macSendTime < startTime || record.macSendTime > stopTime)
+        {
+          return;
         }
 
-    // Sum PHY outcomes
+      NS_LOG_DEBUG (" ");
+      NS_LOG_DEBUG ("Dealing with packet " << uid);
+      NS_LOG_DEBUG ("sendTime " << record.macSendTime.GetSeconds ());
+      NS_LOG_DEBUG ("senderId " << record.macSenderId);
 
-    std::string PhyOutcomes = PrintPhyPacketsPerGw(startTime, stopTime, gwId);
+      FoldRecord (aggregate, record, receptions);
+    };
 
-    double avgDelay = 0;
-    double avgAckDelay = 0;
-    if (confirmedPacketsOutsideTransient)
+    for (uint64_t edge : edges)
       {
-        avgDelay = (delaySum / (confirmedPacketsOutsideTransient +
-                                successfulUnconfirmedPackets)).GetSeconds ();
-        avgAckDelay = ((ackDelaySum) / confirmedPacketsOutsideTransient).GetSeconds ();
+        b = edge;
+        ForEachRecord (b, true, fold);
       }
-    
-    if(returnString)
+
+    NS_LOG_DEBUG ("Window aggregate: " << aggregate.totalUnconfirmedPackets <<
+                  " unconfirmed, " << aggregate.incompleteConfirmedPackets <<
+                  " incomplete confirmed, " << aggregate.receivedPackets <<
+                  " received packets");
+
+    return aggregate;
+  }
+
+  PerformanceSnapshot
+  LoraPacketTracker::MakePerformanceSnapshot (const RetransmissionAggregate &aggregate,
+                                              int gwId,
+                                              const std::vector<int> &phyCounts,
+                                              double cpsrSent, double cpsrReceived)
+  {
+    PerformanceSnapshot snapshot;
+    snapshot.totalUnconfirmedPackets = aggregate.totalUnconfirmedPackets;
+    snapshot.successfulUnconfirmedPackets = aggregate.successfulUnconfirmedPackets;
+    snapshot.successfullyExtractedConfirmedPackets =
+      aggregate.successfullyExtractedConfirmedPackets;
+    snapshot.successfullyAckedConfirmedPackets =
+      aggregate.successfullyAckedConfirmedPackets;
+    snapshot.incompleteConfirmedPackets = aggregate.incompleteConfirmedPackets;
+    snapshot.successfulReTxAmounts = aggregate.successfulReTxAmounts;
+    snapshot.failedReTxAmounts = aggregate.failedReTxAmounts;
+    snapshot.totalReTxAmount = 0;
+    for (int i = 0; i < 8; i++)
+      {
+        snapshot.totalReTxAmount += aggregate.totalReTxAmounts[i] * (i + 1);
+      }
+
+    // Delays are measured at gwId, over the packets it received
+    Time delaySum = Seconds (0);
+    snapshot.delayPackets = 0;
+    auto gwDelays = aggregate.delays.find (gwId);
+    if (gwDelays != aggregate.delays.end ())
+      {
+        snapshot.delayPackets = gwDelays->second.first;
+        delaySum = gwDelays->second.second;
+      }
+    snapshot.averageDelay = 0;
+    snapshot.averageAckDelay = 0;
+    if (aggregate.confirmedPackets)
+      {
+        if (snapshot.delayPackets)
+          {
+            snapshot.averageDelay = (delaySum / snapshot.delayPackets).GetSeconds ();
+          }
+        snapshot.averageAckDelay = (aggregate.ackDelaySum / aggregate.confirmedPackets).GetSeconds ();
+      }
+
+    for (int i = 0; i < 6; i++)
+      {
+        snapshot.phyCounts[i] = phyCounts.at (i);
+      }
+    snapshot.cpsrSent = cpsrSent;
+    snapshot.cpsrReceived = cpsrReceived;
+    return snapshot;
+  }
+
+  std::string
+  LoraPacketTracker::FormatPerformance (const PerformanceSnapshot &snapshot)
+  {
+    std::string returnValue;
+    returnValue = std::to_string (snapshot.totalUnconfirmedPackets) + " " +
+      std::to_string (snapshot.successfulUnconfirmedPackets) + " | ";
+    returnValue += std::to_string (snapshot.successfullyExtractedConfirmedPackets) + " ";
+    returnValue += std::to_string (snapshot.successfullyAckedConfirmedPackets) + " | ";
+    returnValue += std::to_string (snapshot.incompleteConfirmedPackets);
+    returnValue += " | ";
+    for (int i = 0; i < 8; i++)
+      {
+        returnValue += std::to_string (snapshot.successfulReTxAmounts[i]) + " ";
+      }
+    returnValue += " | ";
+    for (int i = 0; i < 8; i++)
+      {
+        returnValue += std::to_string (snapshot.failedReTxAmounts[i]) + " ";
+      }
+    returnValue += " | ";
+    returnValue += std::to_string (snapshot.averageDelay) + " ";
+    returnValue += std::to_string (snapshot.averageAckDelay) + " ";
+    returnValue += " | ";
+    returnValue += std::to_string (snapshot.totalReTxAmount);
+    returnValue += " || ";
+    for (int i = 0; i < 6; ++i)
+      {
+        returnValue += std::to_string (snapshot.phyCounts[i]) + " ";
+      }
+    returnValue += " ** ";
+    returnValue += std::to_string (snapshot.cpsrSent) + " " +
+      std::to_string (snapshot.cpsrReceived);
+    returnValue += " ** ";
+    returnValue += std::to_string (snapshot.delayPackets);
+    return returnValue;
+  }
+
+void
+LoraPacketTracker::AddToHistogram (std::vector<LatencyHistogram> &histograms,
+                                   uint64_t bucket, uint64_t value)
+{
+  if (bucket >= histograms.size ())
     {
-     returnValue = std::to_string(totalUnconfirmedPackets) + " " + std::to_string(successfulUnconfirmedPackets) + " | ";
-     returnValue += std::to_string(successfullyExtractedConfirmedPackets) + " ";
-     returnValue += std::to_string(successfullyAckedConfirmedPackets) + " | ";
-     returnValue += std::to_string(incompleteConfirmedPackets);
-     returnValue += " | ";    
-     returnValue += PrintVector (successfulReTxAmounts, 1);
-     returnValue +=  " | ";
-     returnValue +=  PrintVector (failedReTxAmounts, 1);
-     returnValue += " | ";
-     returnValue += std::to_string(avgDelay) + " ";
-     returnValue += std::to_string(avgAckDelay) + " ";
-     returnValue += " | ";
-     returnValue += PrintSumRetransmissions (totalReTxAmounts, 1);
-     returnValue += " || ";
-     returnValue += PhyOutcomes;
-
-     std::string cpsr_result = CountMacPacketsGloballyCpsr(startTime, stopTime);
-     returnValue += " ** ";
-     returnValue += cpsr_result;
-     return returnValue;
+      histograms.resize (bucket + 1);
     }
+  histograms[bucket].Add (value);
+}
 
-    else
+void
+LoraPacketTracker::MergeHistograms (enum LatencyMetric metric, uint64_t bucket,
+                                    int gwId, int sf,
+                                    LatencyHistogram &histogram) const
+{
+  if (metric == DELIVERY_DELAY)
     {
-      // Print legend
-      std::cout << getPerformanceLegend() << std::endl;
-      std::cout << totalUnconfirmedPackets << " " << successfulUnconfirmedPackets << " | ";
-      std::cout << successfullyExtractedConfirmedPackets << " ";
-      std::cout << successfullyAckedConfirmedPackets << " | ";
-      std::cout << incompleteConfirmedPackets << " | ";
-      PrintVector (successfulReTxAmounts);
-      std::cout << " | ";
-      PrintVector (failedReTxAmounts);
-      std::cout << " | ";
-      std::cout << avgDelay << " ";
-      std::cout << avgAckDelay << " ";
-      std::cout << " | ";
-      PrintSumRetransmissions (totalReTxAmounts);
-      std::cout << " || ";
-      std::cout<< PhyOutcomes;
-      std::cout<< " ** ";
-      std::string cpsr_result = CountMacPacketsGloballyCpsr(startTime, stopTime);
-      std::cout<< cpsr_result;
-      std::cout << std::endl;
-  
+      for (const auto &series : m_deliveryDelays)
+        {
+          if ((gwId < 0 || int (series.first >> 8) == gwId)
+              && (sf < 0 || int (series.first & 0xff) == sf)
+              && bucket < series.second.size ())
+            {
+              histogram.Merge (series.second[bucket]);
+            }
+        }
+      return;
     }
-    return "";
 
+  const std::map<uint8_t, std::vector<LatencyHistogram> > &histograms =
+    metric == ACK_DELAY ? m_ackDelays : m_reTxCounts;
+  for (const auto &series : histograms)
+    {
+      if ((sf < 0 || series.first == sf) && bucket < series.second.size ())
+        {
+          histogram.Merge (series.second[bucket]);
+        }
+    }
+}
+
+LatencyHistogram
+LoraPacketTracker::GetLatencyHistogram (enum LatencyMetric metric, Time start,
+                                        Time stop, int gwId, int sf)
+{
+  NS_LOG_FUNCTION (this << metric << start << stop << gwId << sf);
 
-  }
+  LatencyHistogram histogram;
+
+  uint64_t firstFull, endFull;
+  std::vector<uint64_t> edges;
+  GetWindowBuckets (start, stop, firstFull, endFull, edges);
+
+  for (uint64_t b = firstFull; b < endFull; b++)
+    {
+      MergeHistograms (metric, b, gwId, sf, histogram);
+    }
+
+  for (uint64_t b : edges)
+    {
+      ForEachRecord (b, true, [&] (uint64_t, const PacketRecord &record,
+                                   const std::vector<PhyOutcomeEntry> &,
+                                   const std::vector<MacReceptionEntry> &receptions)
+      {
+        if (sf >= 0 && record.sf != sf)
+          {
+            return;
+          }
+
+        if (metric == DELIVERY_DELAY)
+          {
+            if (!(record.flags & PacketRecord::MAC_SENT)
+                || GetBucket (record.macSendTime) != b
+                || record.macSendTime < start || record.macSendTime > stop)
+              {
+                return;
+              }
+            for (uint32_t i = record.firstReception; i != NO_ENTRY;
+                 i = receptions[i].next)
+              {
+                if (gwId < 0 || int (receptions[i].gwId) == gwId)
+                  {
+                    Time delay = receptions[i].receptionTime - record.macSendTime;
+                    histogram.Add (delay.GetMicroSeconds ());
+                  }
+              }
+            return;
+          }
+
+        if (!(record.flags & PacketRecord::RETX_DONE)
+            || GetBucket (record.firstAttempt) != b
+            || record.firstAttempt < start || record.firstAttempt > stop)
+          {
+            return;
+          }
+        if (metric == RETX_COUNT)
+          {
+            histogram.Add (record.reTxAttempts);
+          }
+        else if (record.flags & PacketRecord::RETX_SUCCESSFUL)
+          {
+            histogram.Add ((record.finishTime - record.firstAttempt).GetMicroSeconds ());
+          }
+      });
+    }
+
+  return histogram;
+}
 
   bool LoraPacketTracker::CheckIfUnconfirmed(Ptr<const Packet> packet)
   {
@@ -609,8 +1719,7 @@ LoraPacketTracker::PrintPhyPacketsPerGw (Time startTime, Time stopTime,
     // Check whether the received packet requires an acknowledgment.
     LorawanMacHeader mHdr;
 
-    Ptr<Packet> myPacket = packet->Copy ();
-    myPacket->RemoveHeader (mHdr);
+    packet->PeekHeader (mHdr);
 
     //NS_LOG_INFO ("Received packet Mac Header: " << mHdr);
 
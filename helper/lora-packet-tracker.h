@@ -23,9 +23,14 @@
 
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
+#include "ns3/latency-histogram.h"
 
+#include <array>
+#include <fstream>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -40,35 +45,186 @@ enum PhyPacketOutcome
   UNSET
 };
 
-struct PacketStatus
+/**
+ * Everything the tracker knows about an uplink packet. Records are stored
+ * densely by packet UID, and per-gateway data lives in separate pools, so
+ * that a record has a fixed size.
+ */
+struct PacketRecord
 {
-  Ptr<Packet const> packet;
-  uint32_t senderId;
-  Time sendTime;
-  std::map<int, enum PhyPacketOutcome> outcomes;
+  /**
+   * Flags describing which parts of a PacketRecord are valid.
+   */
+  enum Flags
+  {
+    PHY_SENT = 1, //!< The PHY transmission was recorded
+    MAC_SENT = 2, //!< The MAC transmission was recorded
+    RETX_DONE = 4, //!< The retransmission procedure is over
+    RETX_SUCCESSFUL = 8, //!< The retransmission procedure was successful
+    CONFIRMED = 16 //!< The packet is a confirmed uplink
+  };
+
+  Time phySendTime; //!< Time of the PHY transmission
+  Time macSendTime; //!< Time of the MAC transmission
+  Time firstAttempt; //!< Time of the first transmission attempt
+  Time finishTime; //!< Time the retransmission procedure ended
+  uint32_t phySenderId; //!< Id of the device, from the PHY trace
+  uint32_t macSenderId; //!< Id of the device, from the MAC trace
+  uint32_t firstOutcome; //!< First entry in the PHY outcome pool
+  uint32_t firstReception; //!< First entry in the MAC reception pool
+  uint8_t reTxAttempts; //!< Transmissions needed by the retx procedure
+  uint8_t sf; //!< Spreading factor of the first PHY transmission
+  uint8_t flags; //!< Combination of Flags
 };
 
-struct MacPacketStatus
+/**
+ * The outcome of a packet at a gateway's PHY. Outcomes of the same packet
+ * form a list inside the tracker's outcome pool.
+ */
+struct PhyOutcomeEntry
 {
-  Ptr<Packet const> packet;
-  uint32_t senderId;
-  Time sendTime;
-  Time receivedTime;
-  std::map<int, Time> receptionTimes;
+  uint32_t next; //!< Next entry of the same packet
+  uint32_t gwId; //!< The gateway
+  uint8_t outcome; //!< The PhyPacketOutcome
 };
 
-struct RetransmissionStatus
+/**
+ * The reception of a packet at a gateway's MAC. Receptions of the same
+ * packet form a list inside the tracker's reception pool.
+ */
+struct MacReceptionEntry
 {
-  Time firstAttempt;
-  Time finishTime;
-  uint8_t reTxAttempts;
-  bool successful;
+  uint32_t next; //!< Next entry of the same packet
+  uint32_t gwId; //!< The gateway
+  Time receptionTime; //!< Time of the reception
 };
 
-typedef std::map<Ptr<Packet const>, MacPacketStatus> MacPacketData;
-typedef std::map<Ptr<Packet const>, PacketStatus> PhyPacketData;
-typedef std::map<Ptr<Packet const>, RetransmissionStatus> RetransmissionData;
+/**
+ * The contribution to CountRetransmissionsPorted of a set of packets.
+ */
+struct RetransmissionAggregate
+{
+  std::array<int, 8> totalReTxAmounts; //!< Procedures, by transmissions
+  std::array<int, 8> successfulReTxAmounts; //!< Successful procedures
+  std::array<int, 8> failedReTxAmounts; //!< Failed procedures
+  int confirmedPackets; //!< Finished confirmed packets that were received
+  int successfullyExtractedConfirmedPackets; //!< Confirmed packets received
+  //!by a gateway
+  int successfullyAckedConfirmedPackets; //!< Confirmed packets that were ACKed
+  int incompleteConfirmedPackets; //!< Confirmed packets still being retransmitted
+  int totalUnconfirmedPackets; //!< Unconfirmed packets
+  int successfulUnconfirmedPackets; //!< Unconfirmed packets that were received
+  int receivedPackets; //!< Packets contributing to the delay
+  Time ackDelaySum; //!< Sum of the ACK delays
+  std::map<uint32_t, std::pair<int, Time> > delays; //!< For each gateway,
+  //!the number of those packets it received, and the sum of their delays
+};
 
+/**
+ * The metrics of getPerformanceLegend for a time window and a gateway.
+ */
+struct PerformanceSnapshot
+{
+  int totalUnconfirmedPackets; //!< Unconfirmed packets sent by the MAC
+  int successfulUnconfirmedPackets; //!< Unconfirmed packets that were received
+  int successfullyExtractedConfirmedPackets; //!< Confirmed packets received
+  //!by a gateway
+  int successfullyAckedConfirmedPackets; //!< Confirmed packets that were ACKed
+  int incompleteConfirmedPackets; //!< Confirmed packets still being retransmitted
+  std::array<int, 8> successfulReTxAmounts; //!< Successful procedures, by
+  //!transmissions
+  std::array<int, 8> failedReTxAmounts; //!< Failed procedures, by transmissions
+  int totalReTxAmount; //!< Transmissions of the finished procedures
+  double averageDelay; //!< Average delay at the gateway, in seconds
+  int delayPackets; //!< Received packets that reached the gateway, over
+  //!which averageDelay is computed
+  double averageAckDelay; //!< Average ACK delay, in seconds
+  std::array<int, 6> phyCounts; //!< See CountPhyPacketsPerGw
+  double cpsrSent; //!< Confirmed packets whose first attempt is in the window
+  double cpsrReceived; //!< Those that were ACKed
+};
+
+/**
+ * Counters of the packets sent in a time interval, kept incrementally so that
+ * window queries don't need to look at every packet.
+ */
+struct TimeBucket
+{
+  uint32_t phySent; //!< Packets sent by the PHY
+  uint32_t macSent; //!< Packets sent by the MAC
+  uint32_t macReceived; //!< Packets received by at least one gateway MAC
+  uint32_t retxDone; //!< Retransmission procedures started in the bucket
+  uint32_t retxSuccessful; //!< Successful retransmission procedures
+  std::vector<uint64_t> uids; //!< UIDs of the packets with a time in the
+  //!bucket that are still in memory
+  std::unique_ptr<RetransmissionAggregate> folded; //!< Contribution of the
+  //!released packets sent by the MAC in the bucket
+  std::vector<uint64_t> spillBlocks; //!< Offsets of the spill file blocks
+  //!holding released packets with a time in the bucket
+};
+
+/**
+ * A set of records with their per-gateway data, as read from the spill file
+ * or waiting to be written to it.
+ */
+struct RecordBlock
+{
+  std::vector<uint64_t> uids; //!< UIDs of the records
+  std::vector<PacketRecord> records; //!< The records
+  std::vector<PhyOutcomeEntry> phyOutcomes; //!< Pool of PHY outcomes
+  std::vector<MacReceptionEntry> macReceptions; //!< Pool of MAC receptions
+};
+
+/**
+ * A packet in the per-device index of the tracker.
+ */
+struct DeviceIndexEntry
+{
+  uint64_t uid; //!< The packet
+  Time sendTime; //!< Time of its first transmission
+};
+
+/**
+ * Everything the tracker knows about a packet, as returned by
+ * LoraPacketTracker::GetDevicePackets.
+ */
+struct PacketFate
+{
+  uint64_t uid; //!< The packet
+  PacketRecord record; //!< Its record, without links to the pools
+  std::vector<std::pair<uint32_t, PhyPacketOutcome> > phyOutcomes; //!< The
+  //!outcome at each gateway's PHY
+  std::vector<std::pair<uint32_t, Time> > macReceptions; //!< The reception
+  //!time at each gateway's MAC
+};
+
+/**
+ * The performance of a device over a time window.
+ */
+struct DevicePerformance
+{
+  int macSent; //!< Packets sent by the MAC
+  int macReceived; //!< Those received by at least one gateway, for the PDR
+  std::array<int, 8> successfulReTxAmounts; //!< Successful retransmission
+  //!procedures, by transmissions
+  std::array<int, 8> failedReTxAmounts; //!< Failed procedures, by transmissions
+  std::map<uint32_t, std::array<int, 5> > phyOutcomes; //!< For each gateway,
+  //!the PHY outcomes of the packets, from RECEIVED to LOST_BECAUSE_TX
+};
+
+/**
+ * The latency metrics the tracker keeps histograms of.
+ */
+enum LatencyMetric
+{
+  DELIVERY_DELAY, //!< From the MAC transmission to the reception at a
+  //!gateway's MAC, in microseconds, for each gateway that received the packet
+  ACK_DELAY, //!< From the first attempt to the end of a successful
+  //!retransmission procedure, in microseconds
+  RETX_COUNT //!< Transmissions needed by a finished retransmission procedure
+};
+
+class LoraTraceFileWriter;
 
 class LoraPacketTracker
 {
@@ -76,6 +232,42 @@ public:
   LoraPacketTracker ();
   ~LoraPacketTracker ();
 
+  /**
+   * Set the width of the time buckets used to answer queries over a time
+   * window. Queries whose boundaries are multiples of the width are answered
+   * from counters only, while other ones also look at the packets in the
+   * buckets at the edges of the window.
+   *
+   * This must be called before any packet is tracked.
+   */
+  void SetBucketWidth (Time width);
+
+  /**
+   * Keep memory usage bounded by releasing the records of packets whose fate
+   * is settled and whose times are all older than the horizon. Released
+   * packets are folded into per-bucket aggregates, and appended to a
+   * columnar spill file.
+   *
+   * Queries over windows whose boundaries fall in released buckets read the
+   * spill file to stay exact.
+   *
+   * \param horizon How long to keep records in memory. This should be longer
+   * than the retransmission procedure and than the windows being queried.
+   * \param spillFilename The spill file, which is required.
+   */
+  void EnableFinalization (Time horizon, std::string spillFilename);
+
+  /**
+   * Write the records of all the packets, including the spilled ones, as
+   * packet blocks of a columnar trace file.
+   */
+  void WriteRecords (LoraTraceFileWriter &writer);
+
+  /**
+   * Get the number of packet records held in memory.
+   */
+  uint64_t GetNRecords (void) const;
+
   /////////////////////////
   // PHY layer callbacks //
   /////////////////////////
@@ -113,6 +305,17 @@ public:
    */
   std::vector<int> CountPhyPacketsPerGw (Time startTime, Time stopTime,
                                          int systemId);
+  /**
+   * Count packets to evaluate the performance at PHY level of several
+   * gateways at once, looking at each packet once.
+   *
+   * \param gateways The gateways, or an empty vector for all of those that
+   * saw a packet.
+   * \return The counts of CountPhyPacketsPerGw of each gateway.
+   */
+  std::map<uint32_t, std::vector<int> > CountPhyPacketsPerGw (Time startTime,
+                                                              Time stopTime,
+                                                              std::vector<uint32_t> gateways);
   /**
    * Count packets to evaluate the performance at PHY level of a specific
    * gateway.
@@ -175,6 +378,106 @@ public:
    */
   std::string CountRetransmissionsPorted (Time start, Time stop, int gwId, int returnString = 0);
 
+  /**
+   * Compute the metrics of getPerformanceLegend for the packets sent in a
+   * window, with delays and PHY outcomes at a gateway. Delays are averaged
+   * over the packets the gateway received.
+   */
+  PerformanceSnapshot GetPerformanceSnapshot (Time start, Time stop, int gwId);
+
+  /**
+   * Compute the PerformanceSnapshot of several gateways at once: the packets
+   * of the window are looked at once, rather than once per gateway.
+   *
+   * \param gateways The gateways, or an empty vector for all of those that
+   * saw a packet.
+   */
+  std::map<uint32_t, PerformanceSnapshot> GetPerformanceSnapshots (Time start,
+                                                                   Time stop,
+                                                                   std::vector<uint32_t> gateways);
+
+  /**
+   * Set the number of threads looking at the packets of the buckets that lie
+   * inside the window of a performance snapshot. Results don't depend on it.
+   * Threads only read the tracker, and don't log.
+   */
+  void SetReportThreads (uint32_t nThreads);
+
+  /**
+   * Build a PerformanceSnapshot out of its parts.
+   *
+   * \param aggregate The packets sent by the MAC in the window.
+   * \param gwId The gateway the delays and PHY outcomes refer to.
+   * \param phyCounts The result of CountPhyPacketsPerGw.
+   * \param cpsrSent Confirmed packets sent in the window.
+   * \param cpsrReceived Confirmed packets that were ACKed.
+   */
+  static PerformanceSnapshot MakePerformanceSnapshot (const RetransmissionAggregate &aggregate,
+                                                      int gwId,
+                                                      const std::vector<int> &phyCounts,
+                                                      double cpsrSent,
+                                                      double cpsrReceived);
+
+  /**
+   * Render a PerformanceSnapshot as the string returned by
+   * CountRetransmissionsPorted, whose fields are described by
+   * getPerformanceLegend.
+   */
+  static std::string FormatPerformance (const PerformanceSnapshot &snapshot);
+
+  /**
+   * Add the contribution of a packet to a RetransmissionAggregate.
+   */
+  static void FoldRecord (RetransmissionAggregate &aggregate,
+                          const PacketRecord &record,
+                          const std::vector<MacReceptionEntry> &receptions);
+
+  /**
+   * Add a RetransmissionAggregate to another one.
+   */
+  static void AddAggregate (RetransmissionAggregate &aggregate,
+                            const RetransmissionAggregate &other);
+
+
+  /**
+   * Get the histogram of a latency metric for the packets sent in a window,
+   * to read its quantiles. Packets are placed in the window by their MAC
+   * transmission for DELIVERY_DELAY, and by their first attempt otherwise.
+   *
+   * Histograms are kept per time bucket, gateway and spreading factor as
+   * packets are received or finish their retransmission procedure, so that
+   * only the packets in the buckets at the edges of the window are looked at
+   * one by one.
+   *
+   * \param metric The metric.
+   * \param start The start of the window.
+   * \param stop The end of the window.
+   * \param gwId The gateway, for DELIVERY_DELAY, or -1 for all of them.
+   * \param sf The spreading factor of the packets, or -1 for all of them.
+   */
+  LatencyHistogram GetLatencyHistogram (enum LatencyMetric metric, Time start,
+                                        Time stop, int gwId = -1, int sf = -1);
+
+  /**
+   * Get everything known about the packets a device transmitted for the
+   * first time in a window, in time order.
+   *
+   * Packets are found through a per-device index, so this only looks at the
+   * packets of the device. With finalization enabled, only the packets that
+   * are still in memory are returned.
+   */
+  std::vector<PacketFate> GetDevicePackets (uint32_t deviceId, Time start,
+                                            Time stop);
+
+  /**
+   * Get the PDR, the retransmission procedures and the PHY outcomes at each
+   * gateway of the packets a device transmitted for the first time in a
+   * window. Like GetDevicePackets, this only looks at the packets of the
+   * device that are still in memory.
+   */
+  DevicePerformance GetDevicePerformance (uint32_t deviceId, Time start,
+                                          Time stop);
+
   /**
    * Check's MAC header to see if MType is confirmed data up.
    * Based off network-controller-component.c
@@ -187,9 +490,206 @@ public:
   std::string PrintSumRetransmissions (std::vector<int> reTxVector, int returnString = 0);
 
 private:
-  PhyPacketData m_packetTracker;
-  MacPacketData m_macPacketTracker;
-  RetransmissionData m_reTransmissionTracker;
+  /**
+   * Get the record of a packet, creating it if needed.
+   */
+  PacketRecord & GetRecord (Ptr<Packet const> packet);
+
+  /**
+   * Get the record of a packet, or 0 if the packet was never seen.
+   */
+  PacketRecord * FindRecord (Ptr<Packet const> packet);
+  PacketRecord * FindRecord (uint64_t uid);
+
+  /**
+   * Get the record of an uplink packet, creating it if needed, or 0 if the
+   * packet is not an uplink.
+   *
+   * Only uplinks have records, so the MAC header is only read the first time
+   * a packet is seen; its direction and type are then kept in the record.
+   */
+  PacketRecord * GetUplinkRecord (Ptr<Packet const> packet);
+
+  /**
+   * Get the index of the bucket containing a time.
+   */
+  uint64_t GetBucket (Time time) const;
+
+  /**
+   * Get a bucket, creating it if needed.
+   */
+  TimeBucket & GetTimeBucket (uint64_t bucket);
+
+  /**
+   * List a packet in the bucket of one of its times, unless it's already
+   * there because of another one.
+   */
+  void IndexRecord (uint64_t uid, const PacketRecord &record, Time time);
+
+  /**
+   * Split a [start, stop] window in a range of buckets that lie completely
+   * inside it, and a list of the existing buckets that overlap it partially.
+   */
+  void GetWindowBuckets (Time start, Time stop, uint64_t &firstFull,
+                         uint64_t &endFull, std::vector<uint64_t> &edges) const;
+
+  /**
+   * Call f (uid, record, phyOutcomes, macReceptions) on the packets listed in
+   * a bucket, and optionally on the ones that were spilled to disk.
+   */
+  template <typename F>
+  void ForEachRecord (uint64_t bucket, bool includeSpilled, F f);
+
+  /**
+   * Count the confirmed packets whose first attempt is in a window, and the
+   * ones among them that were ACKed.
+   */
+  void CountCpsr (Time startTime, Time stopTime, double &sent,
+                  double &received);
+
+  /**
+   * Add a value to the histogram of a bucket, creating it if needed.
+   */
+  static void AddToHistogram (std::vector<LatencyHistogram> &histograms,
+                              uint64_t bucket, uint64_t value);
+
+  /**
+   * Add the histograms of a bucket matching a gateway and a spreading factor
+   * to a histogram.
+   */
+  void MergeHistograms (enum LatencyMetric metric, uint64_t bucket, int gwId,
+                        int sf, LatencyHistogram &histogram) const;
+
+  /**
+   * Fold the packets sent by the MAC in a window.
+   */
+  RetransmissionAggregate AggregateWindow (Time startTime, Time stopTime);
+
+  /**
+   * Fold the packets sent by the MAC in a range of buckets that lie inside a
+   * window, without looking at the spill file. This may run on any thread.
+   */
+  void FoldBuckets (uint64_t first, uint64_t end,
+                    RetransmissionAggregate &aggregate);
+
+  /**
+   * Add a packet, transmitted now for the first time, to the index of its
+   * device.
+   */
+  void IndexDevicePacket (uint32_t deviceId, uint64_t uid);
+
+  /**
+   * Remove the packets that were released from the per-device index.
+   */
+  void CompactDeviceIndex (void);
+
+  /**
+   * Call f (uid, record) on the packets in memory that a device transmitted
+   * for the first time in a window, in time order.
+   */
+  template <typename F>
+  void ForEachDeviceRecord (uint32_t deviceId, Time start, Time stop, F f);
+
+  /**
+   * Release old records, if finalization is enabled and it's time to do so.
+   */
+  void CheckFinalization (void);
+
+  /**
+   * Release the records that are older than the finalization horizon.
+   */
+  void Finalize (void);
+
+  /**
+   * Whether the tracker doesn't expect any further information on a packet.
+   */
+  bool IsSettled (const PacketRecord &record) const;
+
+  /**
+   * Get the most recent bucket containing one of the times of a packet.
+   */
+  uint64_t GetLastBucket (const PacketRecord &record) const;
+
+  /**
+   * Fold a record into the aggregates, add it to the block that is going to
+   * be spilled, and free it.
+   */
+  void ReleaseRecord (uint64_t uid, PacketRecord &record, RecordBlock &spill);
+
+  /**
+   * Remove the entries of released records from the pools.
+   */
+  void CompactPools (void);
+
+  /**
+   * Append a block of records to the spill file.
+   *
+   * \returns The offset of the block in the file.
+   */
+  uint64_t WriteBlock (const RecordBlock &block);
+
+  /**
+   * Read a block of records from the spill file.
+   */
+  void ReadBlock (uint64_t offset, RecordBlock &block);
+
+  /**
+   * Register the outcome of a packet at a gateway, unless one was already
+   * registered.
+   */
+  void RecordPhyOutcome (Ptr<Packet const> packet, uint32_t gwId,
+                         enum PhyPacketOutcome outcome);
+
+  /**
+   * Get the outcome of a packet at a gateway.
+   */
+  static enum PhyPacketOutcome GetPhyOutcome (const PacketRecord &record,
+                                              uint32_t gwId,
+                                              const std::vector<PhyOutcomeEntry> &pool);
+
+  /**
+   * Get the time a gateway's MAC received a packet.
+   *
+   * \returns False if the gateway didn't receive the packet.
+   */
+  static bool GetMacReceptionTime (const PacketRecord &record, uint32_t gwId,
+                                   const std::vector<MacReceptionEntry> &pool,
+                                   Time &receptionTime);
+
+  static const uint32_t CHUNK_BITS = 12; //!< Log2 of records per chunk
+  static const uint32_t NO_ENTRY = ~0u; //!< End of a pool list
+
+  std::vector<std::unique_ptr<PacketRecord[]> > m_records; //!< Records,
+  //!in chunks of 2^CHUNK_BITS consecutive UIDs, allocated when needed
+  std::vector<uint32_t> m_chunkLiveRecords; //!< Records in use, per chunk
+  std::vector<PhyOutcomeEntry> m_phyOutcomes; //!< Pool of PHY outcomes
+  std::vector<MacReceptionEntry> m_macReceptions; //!< Pool of MAC receptions
+  uint32_t m_deadPhyOutcomes; //!< Entries of released records in the pool
+  uint32_t m_deadMacReceptions; //!< Entries of released records in the pool
+
+  Time m_bucketWidth; //!< Width of the time buckets
+  std::vector<TimeBucket> m_buckets; //!< Counters, by PHY/MAC send time
+  std::map<uint32_t, std::vector<std::array<uint32_t, 5> > >
+  m_phyOutcomeCounts; //!< Per-gateway counters of PHY outcomes other than
+  //!UNSET, by bucket of the PHY send time
+  std::map<uint32_t, std::vector<LatencyHistogram> > m_deliveryDelays; //!<
+  //!Per gateway and SF ((gwId << 8) | sf), by bucket of the MAC send time
+  std::map<uint8_t, std::vector<LatencyHistogram> > m_ackDelays; //!< Per SF,
+  //!by bucket of the first attempt
+  std::map<uint8_t, std::vector<LatencyHistogram> > m_reTxCounts; //!< Per SF,
+  //!by bucket of the first attempt
+
+  Time m_finalizationHorizon; //!< Age of the records to release, or zero
+  Time m_nextFinalization; //!< When to look for records to release again
+  uint64_t m_firstOpenBucket; //!< First bucket not processed by Finalize
+  std::vector<uint64_t> m_pendingRecords; //!< Old records that are waiting
+  //!for the end of their retransmission procedure
+  std::fstream m_spillFile; //!< File released records are appended to
+  uint32_t m_reportThreads; //!< Threads used by AggregateWindow
+  std::vector<std::vector<DeviceIndexEntry> > m_deviceIndex; //!< Packets
+  //!of each device, by node id, in order of first transmission
+  uint64_t m_deviceIndexEntries; //!< Entries in m_deviceIndex
+  uint64_t m_deadDeviceIndexEntries; //!< Entries of released packets
   std::string performanceLegend;
 };
 }
@@ -77,8 +77,8 @@ LoraPhyHelper::Create (Ptr<Node> node, Ptr<NetDevice> device) const
   phy->SetChannel (m_channel);
 
   // Configuration is different based on the kind of device we have to create
-  std::string typeId = m_phy.GetTypeId ().GetName ();
-  if (typeId == "ns3::SimpleGatewayLoraPhy")
+  TypeId typeId = m_phy.GetTypeId ();
+  if (typeId == SimpleGatewayLoraPhy::GetTypeId ())
     {
       // Inform the channel of the presence of this PHY
       m_channel->Add (phy);
@@ -110,7 +110,7 @@ LoraPhyHelper::Create (Ptr<Node> node, Ptr<NetDevice> device) const
           receptionPaths++;
         }
     }
-  else if (typeId == "ns3::SimpleEndDeviceLoraPhy")
+  else if (typeId == SimpleEndDeviceLoraPhy::GetTypeId ())
     {
       // The line below can be commented to speed up uplink-only simulations.
       // This implies that the LoraChannel instance will only know about
@@ -0,0 +1,594 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/lora-trace-file.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("LoraTraceFile");
+
+static const uint32_t TRACE_FILE_VERSION = 3;
+
+// Readers refuse files whose tables don't look exactly like this
+static const std::string TRACE_SCHEMA =
+  "packets:uid/u64,phySendTime/i64,macSendTime/i64,firstAttempt/i64,"
+  "finishTime/i64,phySenderId/u32,macSenderId/u32,reTxAttempts/u8,sf/u8,"
+  "flags/u8;"
+  "outcomes:packet/u32,gwId/u32,outcome/u8;"
+  "receptions:packet/u32,gwId/u32,receptionTime/i64;"
+  "deviceStatus:time/i64,nodeId/u32,x/f64,y/f64,dataRate/u8,txPower/f64;"
+  "deviceStatusDelta:time/i64,nodeId/u32,x/f64,y/f64,dataRate/u8,txPower/f64";
+
+static const uint32_t NO_ENTRY = ~0u;
+
+template <typename T>
+static void
+WriteValue (std::ostream &os, T value)
+{
+  os.write (reinterpret_cast<const char *> (&value), sizeof (T));
+}
+
+template <typename T, typename F>
+static void
+WriteColumn (std::ostream &os, size_t n, F get)
+{
+  std::vector<T> column (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      column[i] = get (i);
+    }
+  os.write (reinterpret_cast<const char *> (column.data ()), n * sizeof (T));
+}
+
+template <typename T>
+static std::vector<T>
+ReadColumn (std::istream &is, size_t n)
+{
+  std::vector<T> column (n);
+  is.read (reinterpret_cast<char *> (column.data ()), n * sizeof (T));
+  return column;
+}
+
+// Get a column of a mapped block, and move past it
+template <typename T>
+static TraceColumn<T>
+MapColumn (const char *&data, size_t n)
+{
+  TraceColumn<T> column (data);
+  data += n * sizeof (T);
+  return column;
+}
+
+void
+SerializeRecordBlock (std::ostream &os, const RecordBlock &block)
+{
+  // Flatten the per-gateway lists, remembering the record of each entry
+  std::vector<uint32_t> outcomeRecords;
+  std::vector<uint32_t> outcomes;
+  std::vector<uint32_t> receptionRecords;
+  std::vector<uint32_t> receptions;
+  for (uint32_t r = 0; r < block.records.size (); r++)
+    {
+      for (uint32_t i = block.records[r].firstOutcome; i != NO_ENTRY;
+           i = block.phyOutcomes[i].next)
+        {
+          outcomeRecords.push_back (r);
+          outcomes.push_back (i);
+        }
+      for (uint32_t i = block.records[r].firstReception; i != NO_ENTRY;
+           i = block.macReceptions[i].next)
+        {
+          receptionRecords.push_back (r);
+          receptions.push_back (i);
+        }
+    }
+
+  WriteValue<uint32_t> (os, PACKET_BLOCK_MAGIC);
+  WriteValue<uint32_t> (os, block.records.size ());
+  WriteValue<uint32_t> (os, outcomes.size ());
+  WriteValue<uint32_t> (os, receptions.size ());
+
+  const std::vector<PacketRecord> &r = block.records;
+  size_t n = r.size ();
+  WriteColumn<uint64_t> (os, n, [&] (size_t i) { return block.uids[i]; });
+  WriteColumn<int64_t> (os, n, [&] (size_t i) { return r[i].phySendTime.GetTimeStep (); });
+  WriteColumn<int64_t> (os, n, [&] (size_t i) { return r[i].macSendTime.GetTimeStep (); });
+  WriteColumn<int64_t> (os, n, [&] (size_t i) { return r[i].firstAttempt.GetTimeStep (); });
+  WriteColumn<int64_t> (os, n, [&] (size_t i) { return r[i].finishTime.GetTimeStep (); });
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return r[i].phySenderId; });
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return r[i].macSenderId; });
+  WriteColumn<uint8_t> (os, n, [&] (size_t i) { return r[i].reTxAttempts; });
+  WriteColumn<uint8_t> (os, n, [&] (size_t i) { return r[i].sf; });
+  WriteColumn<uint8_t> (os, n, [&] (size_t i) { return r[i].flags; });
+
+  const std::vector<PhyOutcomeEntry> &o = block.phyOutcomes;
+  n = outcomes.size ();
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return outcomeRecords[i]; });
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return o[outcomes[i]].gwId; });
+  WriteColumn<uint8_t> (os, n, [&] (size_t i) { return o[outcomes[i]].outcome; });
+
+  const std::vector<MacReceptionEntry> &m = block.macReceptions;
+  n = receptions.size ();
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return receptionRecords[i]; });
+  WriteColumn<uint32_t> (os, n, [&] (size_t i) { return m[receptions[i]].gwId; });
+  WriteColumn<int64_t> (os, n, [&] (size_t i) { return m[receptions[i]].receptionTime.GetTimeStep (); });
+}
+
+bool
+DeserializeRecordBlock (std::istream &is, RecordBlock &block)
+{
+  uint32_t header[4];
+  is.read (reinterpret_cast<char *> (header), sizeof (header));
+  if (!is || header[0] != PACKET_BLOCK_MAGIC)
+    {
+      return false;
+    }
+
+  size_t n = header[1];
+  block.uids = ReadColumn<uint64_t> (is, n);
+  std::vector<int64_t> phySendTimes = ReadColumn<int64_t> (is, n);
+  std::vector<int64_t> macSendTimes = ReadColumn<int64_t> (is, n);
+  std::vector<int64_t> firstAttempts = ReadColumn<int64_t> (is, n);
+  std::vector<int64_t> finishTimes = ReadColumn<int64_t> (is, n);
+  std::vector<uint32_t> phySenderIds = ReadColumn<uint32_t> (is, n);
+  std::vector<uint32_t> macSenderIds = ReadColumn<uint32_t> (is, n);
+  std::vector<uint8_t> reTxAttempts = ReadColumn<uint8_t> (is, n);
+  std::vector<uint8_t> sfs = ReadColumn<uint8_t> (is, n);
+  std::vector<uint8_t> flags = ReadColumn<uint8_t> (is, n);
+
+  block.records.resize (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      PacketRecord &record = block.records[i];
+      record.phySendTime = TimeStep (phySendTimes[i]);
+      record.macSendTime = TimeStep (macSendTimes[i]);
+      record.firstAttempt = TimeStep (firstAttempts[i]);
+      record.finishTime = TimeStep (finishTimes[i]);
+      record.phySenderId = phySenderIds[i];
+      record.macSenderId = macSenderIds[i];
+      record.reTxAttempts = reTxAttempts[i];
+      record.sf = sfs[i];
+      record.flags = flags[i];
+      record.firstOutcome = NO_ENTRY;
+      record.firstReception = NO_ENTRY;
+    }
+
+  n = header[2];
+  std::vector<uint32_t> outcomeRecords = ReadColumn<uint32_t> (is, n);
+  std::vector<uint32_t> outcomeGws = ReadColumn<uint32_t> (is, n);
+  std::vector<uint8_t> outcomes = ReadColumn<uint8_t> (is, n);
+  block.phyOutcomes.resize (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      PacketRecord &record = block.records[outcomeRecords[i]];
+      block.phyOutcomes[i].next = record.firstOutcome;
+      block.phyOutcomes[i].gwId = outcomeGws[i];
+      block.phyOutcomes[i].outcome = outcomes[i];
+      record.firstOutcome = i;
+    }
+
+  n = header[3];
+  std::vector<uint32_t> receptionRecords = ReadColumn<uint32_t> (is, n);
+  std::vector<uint32_t> receptionGws = ReadColumn<uint32_t> (is, n);
+  std::vector<int64_t> receptionTimes = ReadColumn<int64_t> (is, n);
+  block.macReceptions.resize (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      PacketRecord &record = block.records[receptionRecords[i]];
+      block.macReceptions[i].next = record.firstReception;
+      block.macReceptions[i].gwId = receptionGws[i];
+      block.macReceptions[i].receptionTime = TimeStep (receptionTimes[i]);
+      record.firstReception = i;
+    }
+
+  return bool (is);
+}
+
+//////////////////////////
+// LoraTraceFileWriter //
+//////////////////////////
+
+LoraTraceFileWriter::LoraTraceFileWriter (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  m_file.open (filename.c_str (), std::ios::out | std::ios::trunc |
+               std::ios::binary);
+  NS_ABORT_MSG_IF (!m_file.is_open (), "Can't open trace file " << filename);
+
+  WriteValue<uint32_t> (m_file, TRACE_FILE_MAGIC);
+  WriteValue<uint32_t> (m_file, TRACE_FILE_VERSION);
+  WriteValue<uint32_t> (m_file, TRACE_SCHEMA.size ());
+  m_file.write (TRACE_SCHEMA.data (), TRACE_SCHEMA.size ());
+}
+
+LoraTraceFileWriter::~LoraTraceFileWriter ()
+{
+  NS_LOG_FUNCTION (this);
+
+  if (IsOpen ())
+    {
+      Close ();
+    }
+}
+
+void
+LoraTraceFileWriter::WritePacketBlock (const RecordBlock &block)
+{
+  NS_LOG_FUNCTION (this << block.records.size ());
+  NS_ASSERT (IsOpen ());
+
+  if (block.records.empty ())
+    {
+      return;
+    }
+
+  TraceBlockIndexEntry entry;
+  entry.offset = m_file.tellp ();
+  entry.magic = PACKET_BLOCK_MAGIC;
+  entry.rows = block.records.size ();
+  entry.minTime = std::numeric_limits<int64_t>::max ();
+  entry.maxTime = std::numeric_limits<int64_t>::min ();
+  for (const PacketRecord &record : block.records)
+    {
+      Time times[3] = {record.phySendTime, record.macSendTime, record.firstAttempt};
+      uint8_t flags[3] = {PacketRecord::PHY_SENT, PacketRecord::MAC_SENT,
+                          PacketRecord::RETX_DONE};
+      for (int i = 0; i < 3; i++)
+        {
+          if (record.flags & flags[i])
+            {
+              entry.minTime = std::min (entry.minTime, times[i].GetTimeStep ());
+              entry.maxTime = std::max (entry.maxTime, times[i].GetTimeStep ());
+            }
+        }
+    }
+
+  SerializeRecordBlock (m_file, block);
+  m_index.push_back (entry);
+}
+
+void
+LoraTraceFileWriter::WriteDeviceStatusBlock (const std::vector<DeviceStatusEntry> &statuses)
+{
+  WriteStatusBlock (statuses, DEVICE_STATUS_BLOCK_MAGIC);
+}
+
+void
+LoraTraceFileWriter::WriteDeviceStatusDeltaBlock (const std::vector<DeviceStatusEntry> &statuses)
+{
+  WriteStatusBlock (statuses, DEVICE_STATUS_DELTA_BLOCK_MAGIC);
+}
+
+void
+LoraTraceFileWriter::WriteStatusBlock (const std::vector<DeviceStatusEntry> &statuses,
+                                       uint32_t magic)
+{
+  NS_LOG_FUNCTION (this << statuses.size () << magic);
+  NS_ASSERT (IsOpen ());
+
+  if (statuses.empty ())
+    {
+      return;
+    }
+
+  TraceBlockIndexEntry entry;
+  entry.offset = m_file.tellp ();
+  entry.magic = magic;
+  entry.rows = statuses.size ();
+  entry.minTime = std::numeric_limits<int64_t>::max ();
+  entry.maxTime = std::numeric_limits<int64_t>::min ();
+  for (const DeviceStatusEntry &status : statuses)
+    {
+      entry.minTime = std::min (entry.minTime, status.time.GetTimeStep ());
+      entry.maxTime = std::max (entry.maxTime, status.time.GetTimeStep ());
+    }
+
+  const std::vector<DeviceStatusEntry> &s = statuses;
+  size_t n = s.size ();
+  WriteValue<uint32_t> (m_file, magic);
+  WriteValue<uint32_t> (m_file, n);
+  WriteColumn<int64_t> (m_file, n, [&] (size_t i) { return s[i].time.GetTimeStep (); });
+  WriteColumn<uint32_t> (m_file, n, [&] (size_t i) { return s[i].nodeId; });
+  WriteColumn<double> (m_file, n, [&] (size_t i) { return s[i].x; });
+  WriteColumn<double> (m_file, n, [&] (size_t i) { return s[i].y; });
+  WriteColumn<uint8_t> (m_file, n, [&] (size_t i) { return s[i].dataRate; });
+  WriteColumn<double> (m_file, n, [&] (size_t i) { return s[i].txPower; });
+
+  m_index.push_back (entry);
+}
+
+void
+LoraTraceFileWriter::Close (void)
+{
+  NS_LOG_FUNCTION (this << m_index.size ());
+  NS_ASSERT (IsOpen ());
+
+  uint64_t indexOffset = m_file.tellp ();
+  for (const TraceBlockIndexEntry &entry : m_index)
+    {
+      WriteValue<uint64_t> (m_file, entry.offset);
+      WriteValue<uint32_t> (m_file, entry.magic);
+      WriteValue<uint32_t> (m_file, entry.rows);
+      WriteValue<int64_t> (m_file, entry.minTime);
+      WriteValue<int64_t> (m_file, entry.maxTime);
+    }
+  WriteValue<uint64_t> (m_file, indexOffset);
+  WriteValue<uint32_t> (m_file, m_index.size ());
+  WriteValue<uint32_t> (m_file, TRACE_INDEX_MAGIC);
+
+  m_file.close ();
+}
+
+bool
+LoraTraceFileWriter::IsOpen (void) const
+{
+  return m_file.is_open ();
+}
+
+//////////////////////////
+// LoraTraceFileReader //
+//////////////////////////
+
+LoraTraceFileReader::LoraTraceFileReader () :
+  m_data (0),
+  m_size (0)
+{
+}
+
+LoraTraceFileReader::~LoraTraceFileReader ()
+{
+  Close ();
+}
+
+bool
+LoraTraceFileReader::Open (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  Close ();
+
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_LOG_ERROR ("Can't open " << filename);
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) < 0 || st.st_size == 0)
+    {
+      close (fd);
+      return false;
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_LOG_ERROR ("Can't map " << filename);
+      return false;
+    }
+  m_data = static_cast<const char *> (data);
+  m_size = st.st_size;
+
+  // Header
+  const size_t footerSize = 16;
+  const size_t indexEntrySize = 32;
+  uint32_t magic, version, schemaSize;
+  if (m_size < 12 + footerSize)
+    {
+      Close ();
+      return false;
+    }
+  std::memcpy (&magic, m_data, 4);
+  std::memcpy (&version, m_data + 4, 4);
+  std::memcpy (&schemaSize, m_data + 8, 4);
+  if (magic != TRACE_FILE_MAGIC || version != TRACE_FILE_VERSION
+      || 12 + schemaSize > m_size
+      || std::string (m_data + 12, schemaSize) != TRACE_SCHEMA)
+    {
+      NS_LOG_ERROR (filename << " is not a trace file of this version");
+      Close ();
+      return false;
+    }
+
+  // Footer and index
+  uint64_t indexOffset;
+  uint32_t nBlocks;
+  const char *footer = m_data + m_size - footerSize;
+  std::memcpy (&indexOffset, footer, 8);
+  std::memcpy (&nBlocks, footer + 8, 4);
+  std::memcpy (&magic, footer + 12, 4);
+  if (magic != TRACE_INDEX_MAGIC
+      || indexOffset + uint64_t (nBlocks) * indexEntrySize + footerSize != m_size)
+    {
+      NS_LOG_ERROR (filename << " is truncated");
+      Close ();
+      return false;
+    }
+
+  const char *index = m_data + indexOffset;
+  m_index.resize (nBlocks);
+  for (uint32_t i = 0; i < nBlocks; i++, index += indexEntrySize)
+    {
+      std::memcpy (&m_index[i].offset, index, 8);
+      std::memcpy (&m_index[i].magic, index + 8, 4);
+      std::memcpy (&m_index[i].rows, index + 12, 4);
+      std::memcpy (&m_index[i].minTime, index + 16, 8);
+      std::memcpy (&m_index[i].maxTime, index + 24, 8);
+    }
+
+  return true;
+}
+
+void
+LoraTraceFileReader::Close (void)
+{
+  if (m_data)
+    {
+      munmap (const_cast<char *> (m_data), m_size);
+    }
+  m_data = 0;
+  m_size = 0;
+  m_index.clear ();
+}
+
+const std::vector<TraceBlockIndexEntry> &
+LoraTraceFileReader::GetIndex (void) const
+{
+  return m_index;
+}
+
+PacketBlockView
+LoraTraceFileReader::GetPacketBlock (uint32_t block) const
+{
+  NS_ASSERT (m_index.at (block).magic == PACKET_BLOCK_MAGIC);
+
+  const char *data = m_data + m_index[block].offset;
+  uint32_t header[4];
+  std::memcpy (header, data, sizeof (header));
+  data += sizeof (header);
+
+  PacketBlockView view;
+  view.nPackets = header[1];
+  view.nOutcomes = header[2];
+  view.nReceptions = header[3];
+
+  size_t n = view.nPackets;
+  view.uids = MapColumn<uint64_t> (data, n);
+  view.phySendTimes = MapColumn<int64_t> (data, n);
+  view.macSendTimes = MapColumn<int64_t> (data, n);
+  view.firstAttempts = MapColumn<int64_t> (data, n);
+  view.finishTimes = MapColumn<int64_t> (data, n);
+  view.phySenderIds = MapColumn<uint32_t> (data, n);
+  view.macSenderIds = MapColumn<uint32_t> (data, n);
+  view.reTxAttempts = MapColumn<uint8_t> (data, n);
+  view.sfs = MapColumn<uint8_t> (data, n);
+  view.flags = MapColumn<uint8_t> (data, n);
+
+  n = view.nOutcomes;
+  view.outcomePackets = MapColumn<uint32_t> (data, n);
+  view.outcomeGateways = MapColumn<uint32_t> (data, n);
+  view.outcomes = MapColumn<uint8_t> (data, n);
+
+  n = view.nReceptions;
+  view.receptionPackets = MapColumn<uint32_t> (data, n);
+  view.receptionGateways = MapColumn<uint32_t> (data, n);
+  view.receptionTimes = MapColumn<int64_t> (data, n);
+
+  return view;
+}
+
+DeviceStatusBlockView
+LoraTraceFileReader::GetDeviceStatusBlock (uint32_t block) const
+{
+  NS_ASSERT (m_index.at (block).magic == DEVICE_STATUS_BLOCK_MAGIC
+             || m_index.at (block).magic == DEVICE_STATUS_DELTA_BLOCK_MAGIC);
+
+  const char *data = m_data + m_index[block].offset;
+  uint32_t header[2];
+  std::memcpy (header, data, sizeof (header));
+  data += sizeof (header);
+
+  DeviceStatusBlockView view;
+  view.nStatuses = header[1];
+
+  size_t n = view.nStatuses;
+  view.times = MapColumn<int64_t> (data, n);
+  view.nodeIds = MapColumn<uint32_t> (data, n);
+  view.xs = MapColumn<double> (data, n);
+  view.ys = MapColumn<double> (data, n);
+  view.dataRates = MapColumn<uint8_t> (data, n);
+  view.txPowers = MapColumn<double> (data, n);
+
+  return view;
+}
+
+bool
+LoraTraceFileReader::GetDeviceStatuses (Time time,
+                                        std::vector<DeviceStatusEntry> &statuses) const
+{
+  NS_LOG_FUNCTION (this << time);
+
+  // Blocks are in time order: start from the last full block by then
+  int64_t step = time.GetTimeStep ();
+  uint32_t first = m_index.size ();
+  for (uint32_t b = 0; b < m_index.size () && m_index[b].minTime <= step; b++)
+    {
+      if (m_index[b].magic == DEVICE_STATUS_BLOCK_MAGIC)
+        {
+          first = b;
+        }
+    }
+  statuses.clear ();
+  if (first == m_index.size ())
+    {
+      return false;
+    }
+
+  std::unordered_map<uint32_t, uint32_t> positions;
+  for (uint32_t b = first; b < m_index.size () && m_index[b].minTime <= step; b++)
+    {
+      if (b != first && m_index[b].magic != DEVICE_STATUS_DELTA_BLOCK_MAGIC)
+        {
+          continue;
+        }
+      DeviceStatusBlockView view = GetDeviceStatusBlock (b);
+      for (uint32_t i = 0; i < view.nStatuses; i++)
+        {
+          if (view.times[i] > step)
+            {
+              continue;
+            }
+          DeviceStatusEntry status;
+          status.time = TimeStep (view.times[i]);
+          status.nodeId = view.nodeIds[i];
+          status.x = view.xs[i];
+          status.y = view.ys[i];
+          status.dataRate = view.dataRates[i];
+          status.txPower = view.txPowers[i];
+          auto position = positions.find (status.nodeId);
+          if (position == positions.end ())
+            {
+              positions[status.nodeId] = statuses.size ();
+              statuses.push_back (status);
+            }
+          else
+            {
+              statuses[position->second] = status;
+            }
+        }
+    }
+  return true;
+}
+
+}
+}
@@ -0,0 +1,288 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef LORA_TRACE_FILE_H
+#define LORA_TRACE_FILE_H
+
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/nstime.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * \file
+ *
+ * Columnar binary trace files.
+ *
+ * A trace file starts with a header holding a magic number, a version and the
+ * schema of its tables as a string. Blocks of rows follow, each of a single
+ * table and laid out column by column, with fixed width little-endian
+ * columns. The file ends with an index of the blocks, giving their offset,
+ * table, number of rows and time span, and a footer pointing to the index, so
+ * that readers can skip the blocks outside the time window they look at.
+ *
+ * Packet blocks are the same as the blocks of the LoraPacketTracker spill
+ * file: a header with their number of packets, PHY outcomes and MAC
+ * receptions, the columns of the packets, and then the columns of the
+ * outcomes and receptions, which refer to their packet by its index in the
+ * block and are sorted by it.
+ *
+ * Device status blocks hold the status of every device, and device status
+ * delta blocks only the statuses that changed since the previous block. The
+ * status of all devices at some time is that of the last full block before
+ * it, updated by the delta blocks in between.
+ */
+
+/**
+ * The magic numbers of the file, of its footer and of each kind of block.
+ */
+enum LoraTraceMagic
+{
+  TRACE_FILE_MAGIC = 0x4c505446, //!< "LPTF"
+  TRACE_INDEX_MAGIC = 0x4c505449, //!< "LPTI"
+  PACKET_BLOCK_MAGIC = 0x4c505442, //!< "LPTB"
+  DEVICE_STATUS_BLOCK_MAGIC = 0x4c505444, //!< "LPTD"
+  DEVICE_STATUS_DELTA_BLOCK_MAGIC = 0x4c505455 //!< "LPTU"
+};
+
+/**
+ * The status of a device at some time, as printed by
+ * LoraHelper::DoPrintDeviceStatus.
+ */
+struct DeviceStatusEntry
+{
+  Time time; //!< The time of the snapshot
+  uint32_t nodeId; //!< The node of the device
+  double x; //!< The x coordinate of the device
+  double y; //!< The y coordinate of the device
+  uint8_t dataRate; //!< The data rate of the device
+  double txPower; //!< The transmission power of the device
+};
+
+/**
+ * An entry of the block index at the end of a trace file.
+ */
+struct TraceBlockIndexEntry
+{
+  uint64_t offset; //!< Offset of the block in the file
+  uint32_t magic; //!< The kind of block
+  uint32_t rows; //!< The number of packets or statuses in the block
+  int64_t minTime; //!< Earliest time in the block, in time steps
+  int64_t maxTime; //!< Latest time in the block, in time steps
+};
+
+/**
+ * Append a block of packet records to a stream.
+ */
+void SerializeRecordBlock (std::ostream &os, const RecordBlock &block);
+
+/**
+ * Read a block of packet records from a stream.
+ *
+ * \returns False if the stream didn't contain a valid block.
+ */
+bool DeserializeRecordBlock (std::istream &is, RecordBlock &block);
+
+/**
+ * Writes a columnar trace file.
+ */
+class LoraTraceFileWriter
+{
+public:
+  /**
+   * Create the file, aborting if that's not possible.
+   */
+  LoraTraceFileWriter (std::string filename);
+
+  /**
+   * Close the file, if Close wasn't called already.
+   */
+  ~LoraTraceFileWriter ();
+
+  /**
+   * Append a block of packets.
+   */
+  void WritePacketBlock (const RecordBlock &block);
+
+  /**
+   * Append a block of device statuses.
+   */
+  void WriteDeviceStatusBlock (const std::vector<DeviceStatusEntry> &statuses);
+
+  /**
+   * Append a block of the device statuses that changed since the previous
+   * device status block.
+   */
+  void WriteDeviceStatusDeltaBlock (const std::vector<DeviceStatusEntry> &statuses);
+
+  /**
+   * Write the block index, and close the file.
+   */
+  void Close (void);
+
+  /**
+   * Whether the file is still open for writing.
+   */
+  bool IsOpen (void) const;
+
+private:
+  /**
+   * Append a block of device statuses of some kind.
+   */
+  void WriteStatusBlock (const std::vector<DeviceStatusEntry> &statuses,
+                         uint32_t magic);
+
+  std::ofstream m_file; //!< The file
+  std::vector<TraceBlockIndexEntry> m_index; //!< The blocks written so far
+};
+
+/**
+ * A fixed width column of a memory-mapped trace file. Columns are not
+ * aligned, so values are copied out of the file.
+ */
+template <typename T>
+class TraceColumn
+{
+public:
+  TraceColumn () : m_data (0)
+  {
+  }
+  TraceColumn (const char *data) : m_data (data)
+  {
+  }
+  T operator[] (size_t i) const
+  {
+    T value;
+    std::memcpy (&value, m_data + i * sizeof (T), sizeof (T));
+    return value;
+  }
+
+private:
+  const char *m_data; //!< The first value of the column
+};
+
+/**
+ * The columns of a packet block.
+ */
+struct PacketBlockView
+{
+  uint32_t nPackets; //!< Rows of the packet columns
+  uint32_t nOutcomes; //!< Rows of the outcome columns
+  uint32_t nReceptions; //!< Rows of the reception columns
+
+  TraceColumn<uint64_t> uids; //!< Packet UIDs
+  TraceColumn<int64_t> phySendTimes; //!< See PacketRecord
+  TraceColumn<int64_t> macSendTimes; //!< See PacketRecord
+  TraceColumn<int64_t> firstAttempts; //!< See PacketRecord
+  TraceColumn<int64_t> finishTimes; //!< See PacketRecord
+  TraceColumn<uint32_t> phySenderIds; //!< See PacketRecord
+  TraceColumn<uint32_t> macSenderIds; //!< See PacketRecord
+  TraceColumn<uint8_t> reTxAttempts; //!< See PacketRecord
+  TraceColumn<uint8_t> sfs; //!< See PacketRecord
+  TraceColumn<uint8_t> flags; //!< See PacketRecord
+
+  TraceColumn<uint32_t> outcomePackets; //!< Packet of each outcome
+  TraceColumn<uint32_t> outcomeGateways; //!< Gateway of each outcome
+  TraceColumn<uint8_t> outcomes; //!< The PhyPacketOutcome
+
+  TraceColumn<uint32_t> receptionPackets; //!< Packet of each reception
+  TraceColumn<uint32_t> receptionGateways; //!< Gateway of each reception
+  TraceColumn<int64_t> receptionTimes; //!< Time of each reception
+};
+
+/**
+ * The columns of a device status block.
+ */
+struct DeviceStatusBlockView
+{
+  uint32_t nStatuses; //!< Rows of the columns
+  TraceColumn<int64_t> times; //!< See DeviceStatusEntry
+  TraceColumn<uint32_t> nodeIds; //!< See DeviceStatusEntry
+  TraceColumn<double> xs; //!< See DeviceStatusEntry
+  TraceColumn<double> ys; //!< See DeviceStatusEntry
+  TraceColumn<uint8_t> dataRates; //!< See DeviceStatusEntry
+  TraceColumn<double> txPowers; //!< See DeviceStatusEntry
+};
+
+/**
+ * Reads a columnar trace file by mapping it in memory.
+ */
+class LoraTraceFileReader
+{
+public:
+  LoraTraceFileReader ();
+  ~LoraTraceFileReader ();
+
+  /**
+   * Map a trace file and load its index.
+   *
+   * \returns False if the file can't be mapped or isn't a valid trace file.
+   */
+  bool Open (std::string filename);
+
+  /**
+   * Unmap the file.
+   */
+  void Close (void);
+
+  /**
+   * Get the index of the blocks of the file.
+   */
+  const std::vector<TraceBlockIndexEntry> & GetIndex (void) const;
+
+  /**
+   * Get the columns of a packet block.
+   *
+   * \param block The position of the block in the index.
+   */
+  PacketBlockView GetPacketBlock (uint32_t block) const;
+
+  /**
+   * Get the columns of a device status block or device status delta block.
+   *
+   * \param block The position of the block in the index.
+   */
+  DeviceStatusBlockView GetDeviceStatusBlock (uint32_t block) const;
+
+  /**
+   * Get the status of all devices at some time, as of the last device status
+   * block written at or before it. Each status has the time it was last
+   * written at.
+   *
+   * \returns False if no full device status block was written by then.
+   */
+  bool GetDeviceStatuses (Time time, std::vector<DeviceStatusEntry> &statuses) const;
+
+private:
+  const char *m_data; //!< The mapped file
+  size_t m_size; //!< The size of the file
+  std::vector<TraceBlockIndexEntry> m_index; //!< The block index
+};
+
+}
+}
+#endif /* LORA_TRACE_FILE_H */
@@ -24,6 +24,13 @@
 #include "ns3/lora-net-device.h"
 #include "ns3/log.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/pointer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
 
 namespace ns3 {
 namespace lorawan {
@@ -452,12 +459,19 @@ LorawanMacHelper::ApplyCommonSingleChannelConfigurations (Ptr<LorawanMac> lorawa
 
 std::vector<int>
 LorawanMacHelper::SetSpreadingFactorsUp (NodeContainer endDevices, NodeContainer gateways,
-                                         Ptr<LoraChannel> channel)
+                                         Ptr<LoraChannel> channel, uint32_t nThreads)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
+  std::vector<double> highestRxPowers;
+  if (IsDistanceOnlyLoss (channel))
+    {
+      highestRxPowers = GetHighestRxPowers (endDevices, gateways, channel, nThreads);
+    }
+
   std::vector<int> sfQuantity (7, 0);
-  for (NodeContainer::Iterator j = endDevices.Begin (); j != endDevices.End (); ++j)
+  uint32_t device = 0;
+  for (NodeContainer::Iterator j = endDevices.Begin (); j != endDevices.End (); ++j, ++device)
     {
       Ptr<Node> object = *j;
       Ptr<MobilityModel> position = object->GetObject<MobilityModel> ();
@@ -469,26 +483,34 @@ LorawanMacHelper::SetSpreadingFactorsUp (NodeContainer endDevices, NodeContainer
           loraNetDevice->GetMac ()->GetObject<ClassAEndDeviceLorawanMac> ();
       NS_ASSERT (mac != 0);
 
-      // Try computing the distance from each gateway and find the best one
-      Ptr<Node> bestGateway = gateways.Get (0);
-      Ptr<MobilityModel> bestGatewayPosition = bestGateway->GetObject<MobilityModel> ();
-
-      // Assume devices transmit at 14 dBm
-      double highestRxPower = channel->GetRxPower (14, position, bestGatewayPosition);
-
-      for (NodeContainer::Iterator currentGw = gateways.Begin () + 1; currentGw != gateways.End ();
-           ++currentGw)
+      double highestRxPower;
+      if (!highestRxPowers.empty ())
+        {
+          highestRxPower = highestRxPowers[device];
+        }
+      else
         {
-          // Compute the power received from the current gateway
-          Ptr<Node> curr = *currentGw;
-          Ptr<MobilityModel> currPosition = curr->GetObject<MobilityModel> ();
-          double currentRxPower = channel->GetRxPower (14, position, currPosition); // dBm
+          // Try computing the distance from each gateway and find the best one
+          Ptr<Node> bestGateway = gateways.Get (0);
+          Ptr<MobilityModel> bestGatewayPosition = bestGateway->GetObject<MobilityModel> ();
 
-          if (currentRxPower > highestRxPower)
+          // Assume devices transmit at 14 dBm
+          highestRxPower = channel->GetRxPower (14, position, bestGatewayPosition);
+
+          for (NodeContainer::Iterator currentGw = gateways.Begin () + 1; currentGw != gateways.End ();
+               ++currentGw)
             {
-              bestGateway = curr;
-              bestGatewayPosition = curr->GetObject<MobilityModel> ();
-              highestRxPower = currentRxPower;
+              // Compute the power received from the current gateway
+              Ptr<Node> curr = *currentGw;
+              Ptr<MobilityModel> currPosition = curr->GetObject<MobilityModel> ();
+              double currentRxPower = channel->GetRxPower (14, position, currPosition); // dBm
+
+              if (currentRxPower > highestRxPower)
+                {
+                  bestGateway = curr;
+                  bestGatewayPosition = curr->GetObject<MobilityModel> ();
+                  highestRxPower = currentRxPower;
+                }
             }
         }
 
@@ -593,6 +615,190 @@ LorawanMacHelper::SetSpreadingFactorsUp (NodeContainer endDevices, NodeContainer
 
 } //  end function
 
+bool
+LorawanMacHelper::IsDistanceOnlyLoss (Ptr<LoraChannel> channel)
+{
+  NS_LOG_FUNCTION (channel);
+
+  // The cache may hold budgets computed along another path
+  if (channel->IsLinkBudgetCacheEnabled ())
+    {
+      return false;
+    }
+
+  PointerValue lossValue;
+  channel->GetAttribute ("PropagationLossModel", lossValue);
+  Ptr<PropagationLossModel> loss = lossValue.Get<PropagationLossModel> ();
+  if (loss == 0)
+    {
+      return false;
+    }
+
+  // These models neither draw random values nor keep any state
+  for (; loss != 0; loss = loss->GetNext ())
+    {
+      std::string name = loss->GetInstanceTypeId ().GetName ();
+      if (name != "ns3::LogDistancePropagationLossModel"
+          && name != "ns3::ThreeLogDistancePropagationLossModel"
+          && name != "ns3::FriisPropagationLossModel"
+          && name != "ns3::RangePropagationLossModel"
+          && name != "ns3::FixedRssLossModel")
+        {
+          NS_LOG_DEBUG ("Evaluating every gateway because of " << name);
+          return false;
+        }
+    }
+  return true;
+}
+
+std::vector<double>
+LorawanMacHelper::GetHighestRxPowers (NodeContainer endDevices, NodeContainer gateways,
+                                      Ptr<LoraChannel> channel, uint32_t nThreads)
+{
+  NS_LOG_FUNCTION (nThreads);
+
+  uint32_t nDevices = endDevices.GetN ();
+  uint32_t nGateways = gateways.GetN ();
+  NS_ASSERT (nGateways > 0);
+
+  std::vector<Vector> devicePositions (nDevices);
+  for (uint32_t i = 0; i < nDevices; i++)
+    {
+      Ptr<MobilityModel> position = endDevices.Get (i)->GetObject<MobilityModel> ();
+      NS_ASSERT (position != 0);
+      devicePositions[i] = position->GetPosition ();
+    }
+  std::vector<Vector> gatewayPositions (nGateways);
+  for (uint32_t i = 0; i < nGateways; i++)
+    {
+      gatewayPositions[i] = gateways.Get (i)->GetObject<MobilityModel> ()->GetPosition ();
+    }
+
+  // Put the gateways in a grid of about one gateway per cell
+  double xMin = gatewayPositions[0].x;
+  double xMax = xMin;
+  double yMin = gatewayPositions[0].y;
+  double yMax = yMin;
+  for (const Vector &position : gatewayPositions)
+    {
+      xMin = std::min (xMin, position.x);
+      xMax = std::max (xMax, position.x);
+      yMin = std::min (yMin, position.y);
+      yMax = std::max (yMax, position.y);
+    }
+  double cellSize = std::max (xMax - xMin, yMax - yMin) / std::ceil (std::sqrt (nGateways));
+  cellSize = std::max (cellSize, 1.0);
+  int nx = int ((xMax - xMin) / cellSize) + 1;
+  int ny = int ((yMax - yMin) / cellSize) + 1;
+  std::vector<std::vector<uint32_t> > cells (nx * ny);
+  for (uint32_t i = 0; i < nGateways; i++)
+    {
+      int cx = std::min (int ((gatewayPositions[i].x - xMin) / cellSize), nx - 1);
+      int cy = std::min (int ((gatewayPositions[i].y - yMin) / cellSize), ny - 1);
+      cells[cy * nx + cx].push_back (i);
+    }
+
+  if (nThreads == 0)
+    {
+      nThreads = std::max (std::thread::hardware_concurrency (), 1u);
+    }
+  nThreads = std::max (std::min (nThreads, nDevices), 1u);
+
+  // Reference counts are not thread-safe: each thread evaluates the loss on
+  // mobility models of its own, which are created here
+  std::vector<Ptr<ConstantPositionMobilityModel> > deviceMobilities (nThreads);
+  std::vector<std::vector<Ptr<MobilityModel> > > gatewayMobilities (nThreads);
+  for (uint32_t t = 0; t < nThreads; t++)
+    {
+      deviceMobilities[t] = CreateObject<ConstantPositionMobilityModel> ();
+      for (const Vector &position : gatewayPositions)
+        {
+          Ptr<ConstantPositionMobilityModel> mobility =
+            CreateObject<ConstantPositionMobilityModel> ();
+          mobility->SetPosition (position);
+          gatewayMobilities[t].push_back (mobility);
+        }
+    }
+
+  std::vector<double> highestRxPowers (nDevices);
+  auto worker = [&] (uint32_t t, uint32_t first, uint32_t last)
+    {
+      // Gateways at the same distance as the nearest one, give or take
+      // rounding, may be received with the same power
+      const double margin = 1e-6;
+
+      std::vector<std::pair<double, uint32_t> > visited;
+      for (uint32_t i = first; i < last; i++)
+        {
+          const Vector &device = devicePositions[i];
+          int cx = std::max (std::min (int (std::floor ((device.x - xMin) / cellSize)), nx - 1), 0);
+          int cy = std::max (std::min (int (std::floor ((device.y - yMin) / cellSize)), ny - 1), 0);
+
+          // Visit rings of cells around the device until the nearest gateway
+          // found is closer than anything in the rings left
+          visited.clear ();
+          double nearest = std::numeric_limits<double>::infinity ();
+          for (int r = 0; r <= std::max (nx, ny); r++)
+            {
+              if (nearest * (1 + margin) < (r - 1) * cellSize)
+                {
+                  break;
+                }
+              for (int dy = -r; dy <= r; dy++)
+                {
+                  // Only the border of the ring
+                  int step = (dy == -r || dy == r) ? 1 : 2 * r;
+                  for (int dx = -r; dx <= r; dx += std::max (step, 1))
+                    {
+                      int x = cx + dx;
+                      int y = cy + dy;
+                      if (x < 0 || x >= nx || y < 0 || y >= ny)
+                        {
+                          continue;
+                        }
+                      for (uint32_t gw : cells[y * nx + x])
+                        {
+                          double distance = CalculateDistance (device, gatewayPositions[gw]);
+                          nearest = std::min (nearest, distance);
+                          visited.push_back (std::make_pair (distance, gw));
+                        }
+                    }
+                }
+            }
+
+          // Assume devices transmit at 14 dBm
+          deviceMobilities[t]->SetPosition (device);
+          double highestRxPower = -std::numeric_limits<double>::infinity ();
+          for (const std::pair<double, uint32_t> &gw : visited)
+            {
+              if (gw.first <= nearest * (1 + margin))
+                {
+                  highestRxPower =
+                    std::max (highestRxPower,
+                              channel->GetRxPower (14, deviceMobilities[t],
+                                                   gatewayMobilities[t][gw.second]));
+                }
+            }
+          highestRxPowers[i] = highestRxPower;
+        }
+    };
+
+  std::vector<std::thread> threads;
+  uint32_t perThread = (nDevices + nThreads - 1) / nThreads;
+  for (uint32_t t = 1; t < nThreads; t++)
+    {
+      threads.push_back (std::thread (worker, t, std::min (t * perThread, nDevices),
+                                      std::min ((t + 1) * perThread, nDevices)));
+    }
+  worker (0, 0, std::min (perThread, nDevices));
+  for (std::thread &thread : threads)
+    {
+      thread.join ();
+    }
+
+  return highestRxPowers;
+}
+
 std::vector<int>
 LorawanMacHelper::SetSpreadingFactorsGivenDistribution (NodeContainer endDevices,
                                                         NodeContainer gateways,
@@ -107,9 +107,16 @@ public:
    * SF10 -> DR2
    * SF11 -> DR1
    * SF12 -> DR0
+   *
+   * If the loss only depends on the distance between nodes (see
+   * IsDistanceOnlyLoss), the nearest gateway to each device is found with a
+   * grid and the devices are split across nThreads threads, or as many as
+   * the hardware supports if 0. Otherwise, every pair of device and gateway
+   * is evaluated in order, on this thread. Both give the same assignment.
    */
   static std::vector<int> SetSpreadingFactorsUp (NodeContainer endDevices, NodeContainer gateways,
-                                                 Ptr<LoraChannel> channel);
+                                                 Ptr<LoraChannel> channel,
+                                                 uint32_t nThreads = 0);
   /**
    * Set up the end device's data rates according to the given distribution.
    */
@@ -118,6 +125,23 @@ public:
                                                                 std::vector<double> distribution);
 
 private:
+  /**
+   * Whether the loss of a channel is a function of the distance between the
+   * nodes that never increases with it, and can be evaluated from several
+   * threads at once. This is the case if it only chains loss models of
+   * known deterministic types, and the link budget cache is not used.
+   */
+  static bool IsDistanceOnlyLoss (Ptr<LoraChannel> channel);
+
+  /**
+   * Get the highest power each device is received with by a gateway, when
+   * transmitting at 14 dBm, for a loss that IsDistanceOnlyLoss.
+   */
+  static std::vector<double> GetHighestRxPowers (NodeContainer endDevices,
+                                                 NodeContainer gateways,
+                                                 Ptr<LoraChannel> channel,
+                                                 uint32_t nThreads);
+
   /**
    * Perform region-specific configurations for the 868 MHz EU band.
    */
@@ -22,18 +22,24 @@
 #include "ns3/network-controller-components.h"
 #include "ns3/adr-component.h"
 #include "ns3/congestion-component.h"
+#include "ns3/direct-backhaul-net-device.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
 #include "ns3/trace-source-accessor.h"
 #include "ns3/simulator.h"
 #include "ns3/log.h"
 
+#include <algorithm>
+
 namespace ns3 {
 namespace lorawan {
 
 NS_LOG_COMPONENT_DEFINE ("NetworkServerHelper");
 
-NetworkServerHelper::NetworkServerHelper ()
+NetworkServerHelper::NetworkServerHelper () :
+  m_directBackhaulEnabled (false),
+  m_directBackhaulLatency (MilliSeconds (2)),
+  m_shardingEnabled (false)
 {
   m_factory.SetTypeId ("ns3::NetworkServer");
   p2pHelper.SetDeviceAttribute ("DataRate", StringValue ("5Mbps"));
@@ -66,23 +72,125 @@ NetworkServerHelper::SetEndDevices (NodeContainer endDevices)
 ApplicationContainer
 NetworkServerHelper::Install (Ptr<Node> node)
 {
-  return ApplicationContainer (InstallPriv (node));
+  std::map<uint32_t, Ptr<GatewayStatus> > gatewayStatuses;
+  return ApplicationContainer (InstallPriv (node, m_endDevices, true,
+                                            gatewayStatuses));
 }
 
 ApplicationContainer
 NetworkServerHelper::Install (NodeContainer c)
 {
   ApplicationContainer apps;
+
+  if (m_shardingEnabled && c.GetN () > 1)
+    {
+      // Shards book the gateways in a single registry, so that they don't
+      // send overlapping downlinks through the same gateway
+      std::vector<NodeContainer> shards = PartitionEndDevices (c.GetN ());
+      std::map<uint32_t, Ptr<GatewayStatus> > gatewayStatuses;
+      for (uint32_t i = 0; i < c.GetN (); i++)
+        {
+          // Congestion is monitored network-wide, so only the first shard
+          // takes care of it
+          apps.Add (InstallPriv (c.Get (i), shards[i], i == 0,
+                                 gatewayStatuses));
+        }
+      return apps;
+    }
+
   for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
     {
-      apps.Add (InstallPriv (*i));
+      std::map<uint32_t, Ptr<GatewayStatus> > gatewayStatuses;
+      apps.Add (InstallPriv (*i, m_endDevices, true, gatewayStatuses));
     }
 
   return apps;
 }
 
+std::vector<NodeContainer>
+NetworkServerHelper::PartitionEndDevices (uint32_t nShards)
+{
+  NS_LOG_FUNCTION (this << nShards);
+
+  // Get the address of each end device
+  std::vector<std::pair<LoraDeviceAddress, Ptr<Node> > > devices;
+  for (NodeContainer::Iterator i = m_endDevices.Begin ();
+       i != m_endDevices.End ();
+       i++)
+    {
+      Ptr<LoraNetDevice> loraNetDevice;
+      for (uint32_t j = 0; j < (*i)->GetNDevices (); j++)
+        {
+          loraNetDevice = (*i)->GetDevice (j)->GetObject<LoraNetDevice> ();
+          if (loraNetDevice != 0)
+            {
+              break;
+            }
+        }
+      NS_ASSERT (loraNetDevice != 0);
+      Ptr<EndDeviceLorawanMac> mac =
+        loraNetDevice->GetMac ()->GetObject<EndDeviceLorawanMac> ();
+      devices.push_back (std::make_pair (mac->GetDeviceAddress (), *i));
+    }
+
+  // Sort by address, so that NwkID and NwkAddr ranges end up on the same
+  // shard, and split in ranges of (nearly) equal size
+  std::stable_sort (devices.begin (), devices.end (),
+                    [] (const std::pair<LoraDeviceAddress, Ptr<Node> > &a,
+                        const std::pair<LoraDeviceAddress, Ptr<Node> > &b)
+                    {
+                      return a.first < b.first;
+                    });
+
+  std::vector<NodeContainer> shards (nShards);
+  m_shardBoundaries.clear ();
+  uint32_t nDevices = devices.size ();
+  for (uint32_t shard = 0; shard < nShards; shard++)
+    {
+      uint32_t begin = (uint64_t) shard * nDevices / nShards;
+      uint32_t end = (uint64_t) (shard + 1) * nDevices / nShards;
+      if (shard > 0 && nDevices > 0)
+        {
+          m_shardBoundaries.push_back (devices[begin].first);
+        }
+      for (uint32_t i = begin; i < end; i++)
+        {
+          shards[shard].Add (devices[i].second);
+        }
+      NS_LOG_DEBUG ("Shard " << shard << " manages " << end - begin <<
+                    " devices");
+    }
+
+  return shards;
+}
+
+std::vector<LoraDeviceAddress>
+NetworkServerHelper::GetShardBoundaries (void) const
+{
+  return m_shardBoundaries;
+}
+
+void
+NetworkServerHelper::EnableSharding (bool enableSharding)
+{
+  NS_LOG_FUNCTION (this << enableSharding);
+
+  m_shardingEnabled = enableSharding;
+}
+
+void
+NetworkServerHelper::EnableDirectBackhaul (Time latency)
+{
+  NS_LOG_FUNCTION (this << latency);
+
+  m_directBackhaulEnabled = true;
+  m_directBackhaulLatency = latency;
+}
+
 Ptr<Application>
-NetworkServerHelper::InstallPriv (Ptr<Node> node)
+NetworkServerHelper::InstallPriv (Ptr<Node> node, NodeContainer endDevices,
+                                  bool installCongestion,
+                                  std::map<uint32_t, Ptr<GatewayStatus> > &gatewayStatuses)
 {
   NS_LOG_FUNCTION (this << node);
 
@@ -97,11 +205,39 @@ NetworkServerHelper::InstallPriv (Ptr<Node> node)
        i++)
     {
       // Add the connections with the gateway
-      // Create a PointToPoint link between gateway and NS
-      NetDeviceContainer container = p2pHelper.Install (node, *i);
+      Ptr<NetDevice> nsNetDevice;
+      if (m_directBackhaulEnabled)
+        {
+          // Create an in-process link between gateway and NS
+          Ptr<DirectBackhaulNetDevice> nsDevice =
+            CreateObject<DirectBackhaulNetDevice> ();
+          Ptr<DirectBackhaulNetDevice> gwDevice =
+            CreateObject<DirectBackhaulNetDevice> ();
+          nsDevice->SetLatency (m_directBackhaulLatency);
+          gwDevice->SetLatency (m_directBackhaulLatency);
+          node->AddDevice (nsDevice);
+          (*i)->AddDevice (gwDevice);
+          DirectBackhaulNetDevice::Connect (nsDevice, gwDevice);
+          nsNetDevice = nsDevice;
+        }
+      else
+        {
+          // Create a PointToPoint link between gateway and NS
+          NetDeviceContainer container = p2pHelper.Install (node, *i);
+          nsNetDevice = container.Get (0);
+        }
 
       // Add the gateway to the NS list
-      app->AddGateway (*i, container.Get (0));
+      Ptr<GatewayStatus> gwStatus = app->AddGateway (*i, nsNetDevice);
+      auto shared = gatewayStatuses.find ((*i)->GetId ());
+      if (shared != gatewayStatuses.end ())
+        {
+          gwStatus->ShareBookings (shared->second);
+        }
+      else
+        {
+          gatewayStatuses[(*i)->GetId ()] = gwStatus;
+        }
     }
 
   // Link the NetworkServer to its NetDevices
@@ -114,10 +250,10 @@ NetworkServerHelper::InstallPriv (Ptr<Node> node)
     }
 
   // Add the end devices
-  app->AddNodes (m_endDevices);
+  app->AddNodes (endDevices);
 
   // Add components to the NetworkServer
-  InstallComponents (app);
+  InstallComponents (app, installCongestion);
 
   return app;
 }
@@ -164,7 +300,8 @@ NetworkServerHelper::SetCongestionTrackingPeriod(Time period)
 
 
 void
-NetworkServerHelper::InstallComponents (Ptr<NetworkServer> netServer)
+NetworkServerHelper::InstallComponents (Ptr<NetworkServer> netServer,
+                                        bool installCongestion)
 {
   NS_LOG_FUNCTION (this << netServer);
 
@@ -184,9 +321,16 @@ NetworkServerHelper::InstallComponents (Ptr<NetworkServer> netServer)
     }
 
   // Add Congestion reporting support
+  if (!installCongestion)
+    {
+      return;
+    }
   Ptr<CongestionComponent> congestionComp = m_congestionSupportFactory.Create<CongestionComponent> ();
   congestionComp->SetGateways(m_gateways);
-  congestionComp->SetTracker(*m_packetTracker);
+  if (m_packetTracker)
+    {
+      congestionComp->SetTracker(*m_packetTracker);
+    }
   congestionComp->SetCongestionPeriod(m_congestionPeriod);
   congestionComp->EnablePeriodicNetworkCongestionStatusPrinting(m_gateways,"congestion.txt");
   netServer->AddComponent (congestionComp);
@@ -31,7 +31,9 @@
 #include "ns3/lora-packet-tracker.h"
 #include "ns3/network-server.h"
 #include <stdint.h>
+#include <map>
 #include <string>
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -93,10 +95,53 @@ public:
    */
   void SetCongestionTrackingPeriod(Time period);
 
+  /**
+   * Enable (true) or disable (false) sharding. When enabled, installing on a
+   * container of K nodes creates K NS shards, each managing a contiguous
+   * range of device addresses, instead of K independent servers. Gateways
+   * are connected to every shard, which share their downlink bookings.
+   */
+  void EnableSharding (bool enableSharding);
+
+  /**
+   * Get the first device address managed by each shard after the first one,
+   * as computed by the last sharded Install call.
+   *
+   * ForwarderHelper finds them out by itself when they are not given.
+   *
+   * \see ForwarderHelper::SetShardBoundaries
+   */
+  std::vector<LoraDeviceAddress> GetShardBoundaries (void) const;
+
+  /**
+   * Connect gateways to the NS with an in-process link that delivers packets
+   * after a fixed latency, instead of a PointToPoint link. This is meant for
+   * simulations that do not study the backhaul, since it skips the device
+   * queues and avoids copying packets.
+   *
+   * \param latency The one-way latency of the link.
+   */
+  void EnableDirectBackhaul (Time latency);
+
 
 private:
-  void InstallComponents (Ptr<NetworkServer> netServer);
-  Ptr<Application> InstallPriv (Ptr<Node> node);
+  void InstallComponents (Ptr<NetworkServer> netServer, bool installCongestion);
+  /**
+   * Install a NS, or a shard of it, on a node.
+   *
+   * \param gatewayStatuses The status of each gateway, by node id, that was
+   * created by the previous shards of the same NS. Statuses created here are
+   * added to it.
+   */
+  Ptr<Application> InstallPriv (Ptr<Node> node, NodeContainer endDevices,
+                                bool installCongestion,
+                                std::map<uint32_t, Ptr<GatewayStatus> > &gatewayStatuses);
+
+  /**
+   * Split the end devices in contiguous address ranges, one per shard, and
+   * update m_shardBoundaries accordingly.
+   */
+  std::vector<NodeContainer> PartitionEndDevices (uint32_t nShards);
 
   ObjectFactory m_factory;
 
@@ -106,12 +151,22 @@ private:
 
   PointToPointHelper p2pHelper; //!< Helper to create PointToPoint links
 
+  bool m_directBackhaulEnabled; //!< Whether to use DirectBackhaulNetDevices
+  //!instead of PointToPoint links
+
+  Time m_directBackhaulLatency; //!< Latency of the direct backhaul links
+
   bool m_adrEnabled;
 
   Time m_congestionPeriod;
   
   ObjectFactory m_adrSupportFactory;
   ObjectFactory m_congestionSupportFactory;  
+
+  bool m_shardingEnabled;
+
+  std::vector<LoraDeviceAddress> m_shardBoundaries; //!< First address of
+  //!each shard but the first one
 };
 
 } // namespace ns3
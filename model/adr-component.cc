@@ -20,6 +20,8 @@
 
 #include "ns3/adr-component.h"
 
+#include <algorithm>
+
 namespace ns3 {
 namespace lorawan {
 
@@ -86,7 +88,9 @@ void AdrComponent::OnReceivedPacket (Ptr<const Packet> packet,
   NS_LOG_FUNCTION (this->GetTypeId () << packet << networkStatus);
 
   // We will only act just before reply, when all Gateways will have received
-  // the packet, since we need their respective received power.
+  // the packet, since we need their respective received power. Here we just
+  // keep the SNR statistics of the device up to date.
+  UpdateSnrHistory (GetDeviceIndex (status->m_endDeviceAddress), status);
 }
 
 void
@@ -95,19 +99,14 @@ AdrComponent::BeforeSendingReply (Ptr<EndDeviceStatus> status,
 {
   NS_LOG_FUNCTION (this << status << networkStatus);
 
-  Ptr<Packet> myPacket = status->GetLastPacketReceivedFromDevice ()->Copy ();
-  LorawanMacHeader mHdr;
-  LoraFrameHeader fHdr;
-  fHdr.SetAsUplink ();
-  myPacket->RemoveHeader (mHdr);
-  myPacket->RemoveHeader (fHdr);
+  uint32_t index = GetDeviceIndex (status->m_endDeviceAddress);
 
   //Execute the ADR algotithm only if the request bit is set
-  if (fHdr.GetAdr ())
+  if (m_adrRequested[index])
     {
-      if (int(status->GetReceivedPacketList ().size ()) < historyRange)
+      if (int(m_packetCount[index]) < historyRange)
         {
-          NS_LOG_ERROR ("Not enough packets received by this device (" << status->GetReceivedPacketList ().size () << ") for the algorithm to work (need " << historyRange << ")");
+          NS_LOG_ERROR ("Not enough packets received by this device (" << m_packetCount[index] << ") for the algorithm to work (need " << historyRange << ")");
         }
       else
         {
@@ -179,21 +178,7 @@ void AdrComponent::AdrImplementation (uint8_t *newDataRate,
                                       Ptr<EndDeviceStatus> status)
 {
   //Compute the maximum or median SNR, based on the boolean value historyAveraging
-  double m_SNR = 0;
-  switch (historyAveraging)
-    {
-    case AdrComponent::AVERAGE:
-      m_SNR = GetAverageSNR (status->GetReceivedPacketList (),
-                             historyRange);
-      break;
-    case AdrComponent::MAXIMUM:
-      m_SNR = GetMaxSNR (status->GetReceivedPacketList (),
-                         historyRange);
-      break;
-    case AdrComponent::MINIMUM:
-      m_SNR = GetMinSNR (status->GetReceivedPacketList (),
-                         historyRange);
-    }
+  double m_SNR = GetHistorySNR (GetDeviceIndex (status->m_endDeviceAddress));
 
   NS_LOG_DEBUG ("m_SNR = " << m_SNR);
 
@@ -288,9 +273,9 @@ double AdrComponent::RxPowerToSNR (double transmissionPower)
 }
 
 //Get the maximum received power (it considers the values in dB!)
-double AdrComponent::GetMinTxFromGateways (EndDeviceStatus::GatewayList gwList)
+double AdrComponent::GetMinTxFromGateways (const EndDeviceStatus::GatewayList &gwList)
 {
-  EndDeviceStatus::GatewayList::iterator it = gwList.begin ();
+  EndDeviceStatus::GatewayList::const_iterator it = gwList.begin ();
   double min = it->second.rxPower;
 
   for (; it != gwList.end (); it++)
@@ -305,9 +290,9 @@ double AdrComponent::GetMinTxFromGateways (EndDeviceStatus::GatewayList gwList)
 }
 
 //Get the maximum received power (it considers the values in dB!)
-double AdrComponent::GetMaxTxFromGateways (EndDeviceStatus::GatewayList gwList)
+double AdrComponent::GetMaxTxFromGateways (const EndDeviceStatus::GatewayList &gwList)
 {
-  EndDeviceStatus::GatewayList::iterator it = gwList.begin ();
+  EndDeviceStatus::GatewayList::const_iterator it = gwList.begin ();
   double max = it->second.rxPower;
 
   for (; it != gwList.end (); it++)
@@ -322,11 +307,11 @@ double AdrComponent::GetMaxTxFromGateways (EndDeviceStatus::GatewayList gwList)
 }
 
 //Get the maximum received power
-double AdrComponent::GetAverageTxFromGateways (EndDeviceStatus::GatewayList gwList)
+double AdrComponent::GetAverageTxFromGateways (const EndDeviceStatus::GatewayList &gwList)
 {
   double sum = 0;
 
-  for (EndDeviceStatus::GatewayList::iterator it = gwList.begin (); it != gwList.end (); it++)
+  for (EndDeviceStatus::GatewayList::const_iterator it = gwList.begin (); it != gwList.end (); it++)
     {
       NS_LOG_DEBUG ("Gateway at " << it->first << " has TP " << it->second.rxPower);
       sum += it->second.rxPower;
@@ -340,7 +325,7 @@ double AdrComponent::GetAverageTxFromGateways (EndDeviceStatus::GatewayList gwLi
 }
 
 double
-AdrComponent::GetReceivedPower (EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetReceivedPower (const EndDeviceStatus::GatewayList &gwList)
 {
   switch (tpAveraging)
     {
@@ -355,84 +340,205 @@ AdrComponent::GetReceivedPower (EndDeviceStatus::GatewayList gwList)
     }
 }
 
-// TODO Make this more elegant
-double AdrComponent::GetMinSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                int historyRange)
+uint32_t
+AdrComponent::GetDeviceIndex (LoraDeviceAddress address)
 {
-  double m_SNR;
-
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  double min = RxPowerToSNR (GetReceivedPower (it->second.gwList));
-
-  for (int i = 0; i < historyRange; i++, it++)
+  auto it = m_deviceIndexes.find (address);
+  if (it != m_deviceIndexes.end ())
     {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
-
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
-      NS_LOG_DEBUG ("m_SNR = " << m_SNR);
+      return it->second;
+    }
 
-      if (m_SNR < min)
-        {
-          min = m_SNR;
-        }
+  // The ring buffers are sized on the first device, so that changes to the
+  // HistoryRange attribute after construction are taken into account
+  if (m_deviceIndexes.empty ())
+    {
+      m_historyCapacity = std::max (historyRange, 1);
     }
+  NS_ASSERT_MSG (historyRange <= int(m_historyCapacity),
+                 "HistoryRange can't grow once devices are being tracked");
 
-  NS_LOG_DEBUG ("SNR (min) = " << min);
+  uint32_t index = m_deviceIndexes.size ();
+  m_deviceIndexes.insert (std::pair<LoraDeviceAddress, uint32_t> (address, index));
 
-  return min;
+  m_snrHistory.resize (m_snrHistory.size () + m_historyCapacity, 0);
+  m_packetCount.push_back (0);
+  m_adrRequested.push_back (false);
+  m_windowStart.push_back (0);
+  m_snrSum.push_back (0);
+  m_snrMinQueue.push_back (std::deque<uint32_t> ());
+  m_snrMaxQueue.push_back (std::deque<uint32_t> ());
+
+  return index;
 }
 
-double AdrComponent::GetMaxSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                int historyRange)
+uint32_t
+AdrComponent::GetHistoryWindow (void) const
 {
-  double m_SNR;
+  return std::max<uint32_t> (1, std::min<uint32_t> (historyRange, m_historyCapacity));
+}
 
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  double max = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+void
+AdrComponent::UpdateSnrHistory (uint32_t index, Ptr<EndDeviceStatus> status)
+{
+  NS_LOG_FUNCTION (this << index);
 
-  for (int i = 0; i < historyRange; i++, it++)
-    {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+  const uint32_t capacity = m_historyCapacity;
+  double *ring = &m_snrHistory[index * capacity];
 
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
-      NS_LOG_DEBUG ("m_SNR = " << m_SNR);
+  // The entry this packet was added to, or the one it updated if it's another
+  // gateway's copy of a packet that was already received
+  const EndDeviceStatus::ReceivedPacketInfo &info =
+    status->GetLastInsertedPacketInfo ();
+  double snr = RxPowerToSNR (GetReceivedPower (info.gwList));
+  NS_LOG_DEBUG ("m_SNR = " << snr);
 
-      if (m_SNR > max)
+  if (status->IsLastInsertionNew ())
+    {
+      // No more copies are expected for the previous packet, which joins the
+      // older packets of the window
+      uint32_t packet = m_packetCount[index];
+      if (packet > 0)
         {
-          max = m_SNR;
+          PushSnr (index, packet - 1);
         }
+      uint32_t window = GetHistoryWindow ();
+      TrimSnrWindow (index, packet + 1 > window ? packet + 1 - window : 0);
+
+      ring[packet % capacity] = snr;
+      m_packetCount[index] = packet + 1;
+      m_adrRequested[index] = info.adr;
+      return;
     }
 
-  NS_LOG_DEBUG ("SNR (max) = " << max);
+  // Find how many packets ago the updated one was received
+  const EndDeviceStatus::ReceivedPacketList &packetList =
+    status->GetReceivedPacketList ();
+  uint32_t age = 0;
+  auto it = packetList.rbegin ();
+  while (it != packetList.rend () && &it->second != &info)
+    {
+      ++it;
+      ++age;
+    }
+  if (age >= m_packetCount[index] || age >= GetHistoryWindow ())
+    {
+      // The packet is out of the window
+      return;
+    }
 
-  return max;
+  ring[(m_packetCount[index] - 1 - age) % capacity] = snr;
+  if (age > 0)
+    {
+      // The queues only hold older packets, and can't update one in place
+      RebuildSnrWindow (index);
+    }
 }
 
-double AdrComponent::GetAverageSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                                    int historyRange)
+void
+AdrComponent::PushSnr (uint32_t index, uint32_t packet)
 {
-  double sum = 0;
-  double m_SNR;
+  const double *ring = &m_snrHistory[index * m_historyCapacity];
+  double snr = ring[packet % m_historyCapacity];
 
-  //Take elements from the list starting at the end
-  auto it = packetList.rbegin ();
-  for (int i = 0; i < historyRange; i++, it++)
+  m_snrSum[index] += snr;
+
+  // Drop the packets that can't be the minimum (or the maximum) any more,
+  // since this one is both newer and lower (or higher)
+  std::deque<uint32_t> &minQueue = m_snrMinQueue[index];
+  while (!minQueue.empty () && ring[minQueue.back () % m_historyCapacity] >= snr)
     {
-      m_SNR = RxPowerToSNR (GetReceivedPower (it->second.gwList));
+      minQueue.pop_back ();
+    }
+  minQueue.push_back (packet);
+
+  std::deque<uint32_t> &maxQueue = m_snrMaxQueue[index];
+  while (!maxQueue.empty () && ring[maxQueue.back () % m_historyCapacity] <= snr)
+    {
+      maxQueue.pop_back ();
+    }
+  maxQueue.push_back (packet);
+}
 
-      NS_LOG_DEBUG ("Received power: " << GetReceivedPower (it->second.gwList));
-      NS_LOG_DEBUG ("m_SNR = " << m_SNR);
+void
+AdrComponent::TrimSnrWindow (uint32_t index, uint32_t first)
+{
+  const double *ring = &m_snrHistory[index * m_historyCapacity];
 
-      sum += m_SNR;
+  while (m_windowStart[index] < first)
+    {
+      m_snrSum[index] -= ring[m_windowStart[index] % m_historyCapacity];
+      m_windowStart[index]++;
     }
 
-  double average = sum / historyRange;
+  std::deque<uint32_t> &minQueue = m_snrMinQueue[index];
+  while (!minQueue.empty () && minQueue.front () < first)
+    {
+      minQueue.pop_front ();
+    }
+  std::deque<uint32_t> &maxQueue = m_snrMaxQueue[index];
+  while (!maxQueue.empty () && maxQueue.front () < first)
+    {
+      maxQueue.pop_front ();
+    }
+}
 
-  NS_LOG_DEBUG ("SNR (average) = " << average);
+void
+AdrComponent::RebuildSnrWindow (uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
 
-  return average;
+  uint32_t newest = m_packetCount[index] - 1;
+  uint32_t window = GetHistoryWindow ();
+  uint32_t first = newest + 1 > window ? newest + 1 - window : 0;
+
+  m_windowStart[index] = first;
+  m_snrSum[index] = 0;
+  m_snrMinQueue[index].clear ();
+  m_snrMaxQueue[index].clear ();
+  for (uint32_t packet = first; packet < newest; packet++)
+    {
+      PushSnr (index, packet);
+    }
+}
+
+double
+AdrComponent::GetHistorySNR (uint32_t index)
+{
+  if (m_packetCount[index] == 0)
+    {
+      return 0;
+    }
+
+  // The newest packet is kept out of the queues, since its SNR changes as
+  // more gateways report it
+  const double *ring = &m_snrHistory[index * m_historyCapacity];
+  double newest = ring[(m_packetCount[index] - 1) % m_historyCapacity];
+  const std::deque<uint32_t> &minQueue = m_snrMinQueue[index];
+  const std::deque<uint32_t> &maxQueue = m_snrMaxQueue[index];
+
+  switch (historyAveraging)
+    {
+    case AdrComponent::AVERAGE:
+      NS_LOG_DEBUG ("SNR (average) = " << (m_snrSum[index] + newest) / historyRange);
+      return (m_snrSum[index] + newest) / historyRange;
+    case AdrComponent::MAXIMUM:
+      {
+        double max = maxQueue.empty () ? newest
+          : std::max (newest, ring[maxQueue.front () % m_historyCapacity]);
+        NS_LOG_DEBUG ("SNR (max) = " << max);
+        return max;
+      }
+    case AdrComponent::MINIMUM:
+      {
+        double min = minQueue.empty () ? newest
+          : std::min (newest, ring[minQueue.front () % m_historyCapacity]);
+        NS_LOG_DEBUG ("SNR (min) = " << min);
+        return min;
+      }
+    default:
+      return 0;
+    }
 }
 
 int AdrComponent::GetTxPowerIndex (int txPower)
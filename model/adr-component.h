@@ -27,6 +27,10 @@
 #include "ns3/network-status.h"
 #include "ns3/network-controller-components.h"
 
+#include <deque>
+#include <map>
+#include <vector>
+
 namespace ns3 {
 namespace lorawan {
 
@@ -60,6 +64,7 @@ public:
 
   void OnFailedReply (Ptr<EndDeviceStatus> status,
                       Ptr<NetworkStatus> networkStatus);
+
 private:
   void AdrImplementation (uint8_t *newDataRate,
                           uint8_t *newTxPower,
@@ -69,22 +74,54 @@ private:
 
   double RxPowerToSNR (double transmissionPower);
 
-  double GetMinTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  double GetMinTxFromGateways (const EndDeviceStatus::GatewayList &gwList);
+
+  double GetMaxTxFromGateways (const EndDeviceStatus::GatewayList &gwList);
+
+  double GetAverageTxFromGateways (const EndDeviceStatus::GatewayList &gwList);
 
-  double GetMaxTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  double GetReceivedPower (const EndDeviceStatus::GatewayList &gwList);
 
-  double GetAverageTxFromGateways (EndDeviceStatus::GatewayList gwList);
+  /**
+   * Get the index of a device in the per-device statistics, adding it if
+   * it's not there yet.
+   */
+  uint32_t GetDeviceIndex (LoraDeviceAddress address);
 
-  double GetReceivedPower (EndDeviceStatus::GatewayList gwList);
+  /**
+   * Get the number of packets the SNR history is combined over.
+   */
+  uint32_t GetHistoryWindow (void) const;
 
-  double GetMinSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                    int historyRange);
+  /**
+   * Update the SNR history of a device with the packet that was just
+   * inserted in its status, which is either a new packet or another
+   * gateway's copy of a known one.
+   */
+  void UpdateSnrHistory (uint32_t index, Ptr<EndDeviceStatus> status);
 
-  double GetMaxSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                    int historyRange);
+  /**
+   * Add a packet, whose SNR is in the ring buffer, to the sum and to the
+   * min and max queues of a device.
+   */
+  void PushSnr (uint32_t index, uint32_t packet);
 
-  double GetAverageSNR (EndDeviceStatus::ReceivedPacketList packetList,
-                        int historyRange);
+  /**
+   * Remove the packets older than first from the sum and the queues of a
+   * device.
+   */
+  void TrimSnrWindow (uint32_t index, uint32_t first);
+
+  /**
+   * Recompute the sum and the queues of a device from its ring buffer.
+   */
+  void RebuildSnrWindow (uint32_t index);
+
+  /**
+   * Get the SNR of a device, combined over the last historyRange packets
+   * according to historyAveraging.
+   */
+  double GetHistorySNR (uint32_t index);
 
   int GetTxPowerIndex (int txPower);
 
@@ -120,6 +157,23 @@ private:
   double treshold[6] = {-20.0, -17.5, -15.0, -12.5, -10.0, -7.5};
 
   bool m_toggleTxPower;
+
+  // Per-device state, kept as structure of arrays indexed by GetDeviceIndex.
+  // SNR values of the last packets of each device are stored in consecutive
+  // ring buffers of m_historyCapacity elements in m_snrHistory, packet number
+  // p of a device going to position p % m_historyCapacity. The packets of
+  // the window before the newest one are summed in m_snrSum, and queued in
+  // m_snrMinQueue (m_snrMaxQueue) by increasing (decreasing) SNR, keeping
+  // only those that are lower (higher) than all the packets after them.
+  std::map<LoraDeviceAddress, uint32_t> m_deviceIndexes;
+  uint32_t m_historyCapacity = 0;
+  std::vector<double> m_snrHistory;
+  std::vector<uint32_t> m_packetCount;    //!< Packets received from the device
+  std::vector<uint8_t> m_adrRequested;    //!< ADR bit of the newest packet
+  std::vector<uint32_t> m_windowStart;    //!< Oldest packet in m_snrSum
+  std::vector<double> m_snrSum;
+  std::vector<std::deque<uint32_t> > m_snrMinQueue;
+  std::vector<std::deque<uint32_t> > m_snrMaxQueue;
 };
 }
 }
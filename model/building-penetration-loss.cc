@@ -19,6 +19,7 @@
 #include "ns3/building-penetration-loss.h"
 #include "ns3/mobility-building-info.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
 #include "ns3/log.h"
 #include <cmath>
 
@@ -36,6 +37,20 @@ BuildingPenetrationLoss::GetTypeId (void)
     .SetParent<PropagationLossModel> ()
     .SetGroupName ("Lora")
     .AddConstructor<BuildingPenetrationLoss> ()
+    .AddAttribute ("CacheBuildingInfo",
+                   "Whether the indoor status and the building of each node "
+                   "are only read the first time the node is seen. This is "
+                   "only correct if nodes don't move in or out of buildings.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&BuildingPenetrationLoss::m_cacheBuildingInfo),
+                   MakeBooleanChecker ())
+    .AddAttribute ("FreezeLinkDraws",
+                   "Whether the random terms of the loss of a link are drawn "
+                   "the first time the link is evaluated only, so that each "
+                   "link always sees the same loss",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&BuildingPenetrationLoss::m_freezeLinkDraws),
+                   MakeBooleanChecker ())
   ;
   return tid;
 }
@@ -60,8 +75,20 @@ BuildingPenetrationLoss::DoCalcRxPower (double txPowerDbm,
 {
   NS_LOG_FUNCTION (this << txPowerDbm << a << b);
 
-  Ptr<MobilityBuildingInfo> a1 = a->GetObject<MobilityBuildingInfo> ();
-  Ptr<MobilityBuildingInfo> b1 = b->GetObject<MobilityBuildingInfo> ();
+  std::pair<const MobilityModel *, const MobilityModel *> link (PeekPointer (a),
+                                                              PeekPointer (b));
+  if (m_freezeLinkDraws)
+    {
+      auto it = m_linkLosses.find (link);
+      if (it != m_linkLosses.end ())
+        {
+          NS_LOG_DEBUG ("Frozen loss due to building penetration: " << it->second);
+          return txPowerDbm - it->second;
+        }
+    }
+
+  NodeInfo &a1 = GetNodeInfo (a);
+  NodeInfo &b1 = GetNodeInfo (b);
 
   // These are the components of the loss due to building penetration
   double externalWallLoss = 0;
@@ -70,47 +97,47 @@ BuildingPenetrationLoss::DoCalcRxPower (double txPowerDbm,
   double gfh = 0;
 
   // Go through various cases in which a and b are indoors or outdoors
-  if ((b1->IsIndoor () && !a1->IsIndoor ()))
+  if ((b1.indoor && !a1.indoor))
     {
       NS_LOG_INFO ("Tx is outdoors and Rx is indoors");
 
-      externalWallLoss = GetWallLoss (b);     // External wall loss due to b
-      tor1 = GetTor1 (b);     // Internal wall loss due to b
+      externalWallLoss = GetWallLoss (b1);     // External wall loss due to b
+      tor1 = GetTor1 (b1);     // Internal wall loss due to b
       tor3 = 0.6 * m_uniformRV->GetValue (0, 15);
       gfh = 0;
 
     }
-  else if ((!b1->IsIndoor () && a1->IsIndoor ()))
+  else if ((!b1.indoor && a1.indoor))
     {
       NS_LOG_INFO ("Rx is outdoors and Tx is indoors");
 
       // These are the components of the loss due to building penetration
-      externalWallLoss = GetWallLoss (a);
-      tor1 = GetTor1 (a);
+      externalWallLoss = GetWallLoss (a1);
+      tor1 = GetTor1 (a1);
       tor3 = 0.6 * m_uniformRV->GetValue (0, 15);
       gfh = 0;
 
     }
-  else if (!a1->IsIndoor ()&& !b1->IsIndoor ())
+  else if (!a1.indoor && !b1.indoor)
     {
       NS_LOG_DEBUG ("No penetration loss since both devices are outside");
     }
-  else if (a1->IsIndoor ()&& b1->IsIndoor ())
+  else if (a1.indoor && b1.indoor)
     {
       // They are in the same building
-      if (a1->GetBuilding () == b1->GetBuilding ())
+      if (a1.building == b1.building)
         {
           NS_LOG_INFO ("Devices are in the same building");
           // Only internal wall loss
-          tor1 = GetTor1 (b);
+          tor1 = GetTor1 (b1);
           tor3 = 0.6 * m_uniformRV->GetValue (0, 15);
         }
       // They are in different buildings
       else
         {
           // These are the components of the loss due to building penetration
-          externalWallLoss = GetWallLoss (b) + GetWallLoss (a);
-          tor1 = GetTor1 (b) + GetTor1 (a);
+          externalWallLoss = GetWallLoss (b1) + GetWallLoss (a1);
+          tor1 = GetTor1 (b1) + GetTor1 (a1);
           tor3 = 0.6 * m_uniformRV->GetValue (0, 15);
           gfh = 0;
         }
@@ -127,6 +154,11 @@ BuildingPenetrationLoss::DoCalcRxPower (double txPowerDbm,
 
   NS_LOG_DEBUG ("Total loss due to building penetration: " << loss);
 
+  if (m_freezeLinkDraws)
+    {
+      m_linkLosses[link] = loss;
+    }
+
   return txPowerDbm - loss;
 }
 
@@ -187,24 +219,45 @@ BuildingPenetrationLoss::GetWallLossValue (void) const
     }
 }
 
-double
-BuildingPenetrationLoss::GetWallLoss (Ptr<MobilityModel> b) const
+BuildingPenetrationLoss::NodeInfo &
+BuildingPenetrationLoss::GetNodeInfo (Ptr<MobilityModel> mobility) const
 {
-  NS_LOG_FUNCTION (this << b);
+  NodeInfo &info = m_nodeInfo[PeekPointer (mobility)];
+  if (info.mobility == 0)
+    {
+      info.mobility = mobility;
+      info.wallLossValue = -1;
+      info.pValue = -1;
+    }
+  else if (m_cacheBuildingInfo)
+    {
+      return info;
+    }
 
-  std::map<Ptr<MobilityModel>, int>::const_iterator it;
+  Ptr<MobilityBuildingInfo> buildingInfo = mobility->GetObject<MobilityBuildingInfo> ();
+  info.indoor = buildingInfo->IsIndoor ();
+  info.building = 0;
+  if (info.indoor)
+    {
+      info.building = buildingInfo->GetBuilding ();
+    }
+  return info;
+}
 
-  // Check whether the b device already has a wall loss value
-  it = m_wallLossMap.find (b);
-  if (it == m_wallLossMap.end ())
+double
+BuildingPenetrationLoss::GetWallLoss (NodeInfo &info) const
+{
+  NS_LOG_FUNCTION (this << info.mobility);
+
+  // Check whether the device already has a wall loss value
+  if (info.wallLossValue < 0)
     {
-      // Create a random value and insert it on the map
-      m_wallLossMap[b] = GetWallLossValue ();
-      NS_LOG_DEBUG ("Inserted a new wall loss value: " <<
-                    m_wallLossMap.find (b)->second);
+      // Create a random value
+      info.wallLossValue = GetWallLossValue ();
+      NS_LOG_DEBUG ("Inserted a new wall loss value: " << info.wallLossValue);
     }
 
-  switch (m_wallLossMap.find (b)->second)
+  switch (info.wallLossValue)
     {
     case 0:
       return m_uniformRV->GetValue (4, 11);
@@ -219,21 +272,26 @@ BuildingPenetrationLoss::GetWallLoss (Ptr<MobilityModel> b) const
 }
 
 double
-BuildingPenetrationLoss::GetTor1 (Ptr<MobilityModel> b) const
+BuildingPenetrationLoss::GetTor1 (NodeInfo &info) const
 {
-  NS_LOG_FUNCTION (this << b);
-
-  std::map<Ptr<MobilityModel>, int>::const_iterator it;
+  NS_LOG_FUNCTION (this << info.mobility);
 
-  // Check whether the b device already has a p value
-  it = m_pMap.find (b);
-  if (it == m_pMap.end ())
+  // Check whether the device already has a p value
+  if (info.pValue < 0)
     {
-      // Create a random p value and insert it on the map
-      m_pMap[b] = GetPValue ();
-      NS_LOG_DEBUG ("Inserted a new p value: " << m_pMap.find (b)->second);
+      // Create a random p value
+      info.pValue = GetPValue ();
+      NS_LOG_DEBUG ("Inserted a new p value: " << info.pValue);
     }
-  return m_uniformRV->GetValue (4, 10) * m_pMap.find (b)->second;
+  return m_uniformRV->GetValue (4, 10) * info.pValue;
+}
+
+size_t
+BuildingPenetrationLoss::LinkHash::operator() (const std::pair<const MobilityModel *,
+                                                               const MobilityModel *> &link) const
+{
+  std::hash<const MobilityModel *> hash;
+  return hash (link.first) * 31 + hash (link.second);
 }
 }
 }
@@ -23,6 +23,9 @@
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/building.h"
+
+#include <unordered_map>
 
 namespace ns3 {
 class MobilityModel;
@@ -67,33 +70,64 @@ private:
   int GetWallLossValue (void) const;
 
   /**
-   * Compute the wall loss associated to this mobility model
-   * \param b The mobility model associated to the node whose wall loss we need
-   * to compute.
+   * What the loss model knows about a node.
+   */
+  struct NodeInfo
+  {
+    Ptr<MobilityModel> mobility; //!< Keeps the key of this entry alive
+    bool indoor; //!< Whether the node is inside a building
+    Ptr<Building> building; //!< The building the node is in, if any
+    int wallLossValue; //!< The type of external wall, or -1 if not drawn yet
+    int pValue; //!< The p value, or -1 if not drawn yet
+  };
+
+  /**
+   * Get the information about a node, reading its MobilityBuildingInfo the
+   * first time (or every time, if CacheBuildingInfo is false).
+   */
+  NodeInfo &GetNodeInfo (Ptr<MobilityModel> mobility) const;
+
+  /**
+   * Compute the wall loss associated to a node
+   * \param info The information about the node whose wall loss we need to
+   * compute.
    * \returns The power loss due to external walls.
    */
-  double GetWallLoss (Ptr<MobilityModel> b) const;
+  double GetWallLoss (NodeInfo &info) const;
 
   /**
    * Get the Tor1 value used in the TR 45.820 standard to account for internal
    * wall loss.
-   * \param b The mobility model of the node we want to compute the value for.
+   * \param info The information about the node we want to compute the value
+   * for.
    * \returns The tor1 value.
    */
-  double GetTor1 (Ptr<MobilityModel> b) const;
+  double GetTor1 (NodeInfo &info) const;
 
   Ptr<UniformRandomVariable> m_uniformRV;     //!< An uniform RV
 
+  bool m_cacheBuildingInfo; //!< Whether the indoor status of nodes is cached
+  bool m_freezeLinkDraws; //!< Whether each link keeps its first loss
+
+  /**
+   * The information about each node, keyed by its mobility model.
+   */
+  mutable std::unordered_map<const MobilityModel *, NodeInfo> m_nodeInfo;
+
   /**
-   * A map linking each mobility model to a p value
+   * Hash of a link, i.e., of a pair of mobility models.
    */
-  mutable std::map<Ptr<MobilityModel>, int> m_pMap;
+  struct LinkHash
+  {
+    size_t operator() (const std::pair<const MobilityModel *,
+                                       const MobilityModel *> &link) const;
+  };
 
   /**
-   * A map linking each mobility model to a value deciding its external wall
-   * loss.
+   * The loss of each link, when FreezeLinkDraws is true.
    */
-  mutable std::map<Ptr<MobilityModel>, int> m_wallLossMap;
+  mutable std::unordered_map<std::pair<const MobilityModel *, const MobilityModel *>,
+                             double, LinkHash> m_linkLosses;
 };
 }
 }
@@ -0,0 +1,104 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/component-worker-pool.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("ComponentWorkerPool");
+
+ComponentWorkerPool::ComponentWorkerPool (uint32_t nThreads) :
+  m_stopping (false)
+{
+  NS_LOG_FUNCTION (this << nThreads);
+  NS_ASSERT (nThreads > 0);
+
+  for (uint32_t i = 0; i < nThreads; i++)
+    {
+      m_workers.push_back (std::thread (&ComponentWorkerPool::DoWork, this));
+    }
+}
+
+ComponentWorkerPool::~ComponentWorkerPool ()
+{
+  NS_LOG_FUNCTION (this);
+
+  {
+    std::unique_lock<std::mutex> lock (m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all ();
+
+  // Workers exit only once the queue is empty
+  for (auto it = m_workers.begin (); it != m_workers.end (); ++it)
+    {
+      it->join ();
+    }
+}
+
+void
+ComponentWorkerPool::Submit (std::function<void (void)> job)
+{
+  {
+    std::unique_lock<std::mutex> lock (m_mutex);
+    NS_ASSERT (!m_stopping);
+    m_jobs.push_back (job);
+  }
+  m_condition.notify_one ();
+}
+
+uint32_t
+ComponentWorkerPool::GetNThreads (void) const
+{
+  return m_workers.size ();
+}
+
+void
+ComponentWorkerPool::DoWork (void)
+{
+  while (true)
+    {
+      std::function<void (void)> job;
+      {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        while (!m_stopping && m_jobs.empty ())
+          {
+            m_condition.wait (lock);
+          }
+        if (m_jobs.empty ())
+          {
+            // We are stopping and there is nothing left to do
+            return;
+          }
+        job = m_jobs.front ();
+        m_jobs.pop_front ();
+      }
+
+      // Run the job outside of the lock. Note that logging is not used
+      // here, since it is not thread safe.
+      job ();
+    }
+}
+
+} // namespace lorawan
+} // namespace ns3
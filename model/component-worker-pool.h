@@ -0,0 +1,85 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef COMPONENT_WORKER_POOL_H
+#define COMPONENT_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * A small pool of worker threads used by the NetworkController to run
+ * side-effect-free NetworkControllerComponents off the simulator thread.
+ *
+ * Jobs are executed in submission order by the first available worker. The
+ * pool knows nothing about ns-3 objects: jobs must only touch data that is
+ * not shared with the simulator thread while they run, and report their
+ * results through the mechanism chosen by the caller (e.g., a std::future).
+ */
+class ComponentWorkerPool
+{
+public:
+  /**
+   * Create a pool with the given number of worker threads.
+   */
+  ComponentWorkerPool (uint32_t nThreads);
+
+  /**
+   * Wait for all submitted jobs to complete and stop the workers.
+   */
+  ~ComponentWorkerPool ();
+
+  /**
+   * Queue a job for execution on one of the workers.
+   */
+  void Submit (std::function<void (void)> job);
+
+  /**
+   * Get the number of worker threads of this pool.
+   */
+  uint32_t GetNThreads (void) const;
+
+private:
+  ComponentWorkerPool (const ComponentWorkerPool &);
+  ComponentWorkerPool &operator= (const ComponentWorkerPool &);
+
+  /**
+   * Loop run by each worker thread.
+   */
+  void DoWork (void);
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void (void)> > m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping;
+};
+
+} // namespace lorawan
+
+} // namespace ns3
+#endif /* COMPONENT_WORKER_POOL_H */
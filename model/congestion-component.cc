@@ -19,8 +19,13 @@
  */
 
 #include "ns3/congestion-component.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/lora-tag.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/abort.h"
 //#include <iostream>
-#include <fstream>
 #include <math.h>
 #include <algorithm>
 namespace ns3 {
@@ -34,12 +39,71 @@ NS_LOG_COMPONENT_DEFINE ("CongestionComponent");
 
 NS_OBJECT_ENSURE_REGISTERED (CongestionComponent);
 
+CongestionEstimate::CongestionEstimate ()
+{
+  rates.fill (0);
+  windowCounts.fill (0);
+}
+
+double
+CongestionEstimate::GetWindowLossRatio (void) const
+{
+  uint32_t total = 0;
+  for (uint32_t count : windowCounts)
+    {
+      total += count;
+    }
+  if (total == 0)
+    {
+      return 0;
+    }
+  return 1 - double (windowCounts[CONGESTION_RECEIVED]) / total;
+}
+
+double
+CongestionEstimate::GetRateLossRatio (void) const
+{
+  double total = 0;
+  for (double rate : rates)
+    {
+      total += rate;
+    }
+  if (total == 0)
+    {
+      return 0;
+    }
+  return 1 - rates[CONGESTION_RECEIVED] / total;
+}
+
 TypeId CongestionComponent::GetTypeId (void)
 {
   static TypeId tid = TypeId ("ns3::CongestionComponent")
     .SetGroupName ("lorawan")
     .AddConstructor<CongestionComponent> ()
     .SetParent<NetworkControllerComponent> ()
+    .AddAttribute ("EwmaTimeConstant",
+                   "Time constant of the exponentially weighted outcome rates",
+                   TimeValue (Seconds (600)),
+                   MakeTimeAccessor (&CongestionComponent::m_ewmaTimeConstant),
+                   MakeTimeChecker (MicroSeconds (1)))
+    .AddAttribute ("WindowLength",
+                   "Length of the sliding window the outcomes are counted over",
+                   TimeValue (Seconds (600)),
+                   MakeTimeAccessor (&CongestionComponent::m_windowLength),
+                   MakeTimeChecker (MicroSeconds (1)))
+    .AddAttribute ("WindowSlots",
+                   "Number of slots the sliding window is made of: the window "
+                   "moves forward one slot at a time",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&CongestionComponent::m_windowSlots),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("UseTracker",
+                   "Whether the periodic congestion status comes from the "
+                   "LoraPacketTracker, which must then be set, rather than "
+                   "from the online estimates",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&CongestionComponent::m_useTracker),
+                   MakeBooleanChecker ())
   ;
   return tid;
 }
@@ -78,7 +142,212 @@ void CongestionComponent::OnFailedReply (Ptr<EndDeviceStatus> status,
 
 void CongestionComponent::SetGateways (NodeContainer gateways)
 {
+  NS_LOG_FUNCTION (this);
+
   m_gateways = gateways;
+
+  for (auto it = gateways.Begin (); it != gateways.End (); ++it)
+    {
+      Ptr<LoraNetDevice> loraNetDevice;
+      for (uint32_t j = 0; j < (*it)->GetNDevices (); j++)
+        {
+          loraNetDevice = (*it)->GetDevice (j)->GetObject<LoraNetDevice> ();
+          if (loraNetDevice != 0)
+            {
+              break;
+            }
+        }
+      NS_ASSERT (loraNetDevice != 0);
+
+      Ptr<LoraPhy> phy = loraNetDevice->GetPhy ();
+      phy->TraceConnectWithoutContext ("ReceivedPacket",
+                                       MakeCallback (&CongestionComponent::ReceivedCallback,
+                                                     this));
+      phy->TraceConnectWithoutContext ("LostPacketBecauseInterference",
+                                       MakeCallback (&CongestionComponent::InterferenceCallback,
+                                                     this));
+      phy->TraceConnectWithoutContext ("LostPacketBecauseNoMoreReceivers",
+                                       MakeCallback (&CongestionComponent::NoMoreReceiversCallback,
+                                                     this));
+      phy->TraceConnectWithoutContext ("LostPacketBecauseUnderSensitivity",
+                                       MakeCallback (&CongestionComponent::UnderSensitivityCallback,
+                                                     this));
+      phy->TraceConnectWithoutContext ("NoReceptionBecauseTransmitting",
+                                       MakeCallback (&CongestionComponent::LostBecauseTxCallback,
+                                                     this));
+    }
+}
+
+void
+CongestionComponent::ReceivedCallback (Ptr<const Packet> packet, uint32_t gwId)
+{
+  RecordOutcome (packet, gwId, CONGESTION_RECEIVED);
+}
+
+void
+CongestionComponent::InterferenceCallback (Ptr<const Packet> packet, uint32_t gwId)
+{
+  RecordOutcome (packet, gwId, CONGESTION_INTERFERED);
+}
+
+void
+CongestionComponent::NoMoreReceiversCallback (Ptr<const Packet> packet, uint32_t gwId)
+{
+  RecordOutcome (packet, gwId, CONGESTION_NO_MORE_RECEIVERS);
+}
+
+void
+CongestionComponent::UnderSensitivityCallback (Ptr<const Packet> packet, uint32_t gwId)
+{
+  RecordOutcome (packet, gwId, CONGESTION_UNDER_SENSITIVITY);
+}
+
+void
+CongestionComponent::LostBecauseTxCallback (Ptr<const Packet> packet, uint32_t gwId)
+{
+  RecordOutcome (packet, gwId, CONGESTION_LOST_BECAUSE_TX);
+}
+
+uint64_t
+CongestionComponent::GetCountersKey (uint32_t gwId, uint8_t sf, uint32_t frequencyKhz)
+{
+  // Channel frequencies in kHz fit in 24 bits
+  return (uint64_t (gwId) << 32) | (uint64_t (sf) << 24) | (frequencyKhz & 0xffffff);
+}
+
+void
+CongestionComponent::RecordOutcome (Ptr<const Packet> packet, uint32_t gwId,
+                                    CongestionOutcome outcome)
+{
+  NS_LOG_FUNCTION (this << packet << gwId << outcome);
+
+  // Gateways also hear the downlinks of other gateways: like the tracker,
+  // only count uplinks
+  LorawanMacHeader mHdr;
+  packet->PeekHeader (mHdr);
+  if (!mHdr.IsUplink ())
+    {
+      return;
+    }
+
+  // The end device PHY tags the packet with its SF and channel
+  LoraTag tag;
+  packet->PeekPacketTag (tag);
+  uint32_t frequencyKhz = uint32_t (tag.GetFrequency () * 1000 + 0.5);
+
+  OutcomeCounters &counters =
+    m_counters[GetCountersKey (gwId, tag.GetSpreadingFactor (), frequencyKhz)];
+  if (counters.slotNumbers.empty ())
+    {
+      counters.rates.fill (0);
+      counters.slotNumbers.assign (m_windowSlots, -1);
+      counters.slotCounts.resize (m_windowSlots);
+    }
+
+  // Decay the rates to now, then add the event
+  Time now = Simulator::Now ();
+  double tau = m_ewmaTimeConstant.GetSeconds ();
+  double decay = exp (-(now - counters.lastUpdate).GetSeconds () / tau);
+  for (double &rate : counters.rates)
+    {
+      rate *= decay;
+    }
+  counters.rates[outcome] += 1 / tau;
+  counters.lastUpdate = now;
+
+  // Claim the slot of now if it still holds an older one
+  int64_t slotNumber = GetSlotNumber (now);
+  uint32_t slot = slotNumber % m_windowSlots;
+  if (counters.slotNumbers[slot] != slotNumber)
+    {
+      counters.slotNumbers[slot] = slotNumber;
+      counters.slotCounts[slot].fill (0);
+    }
+  counters.slotCounts[slot][outcome]++;
+}
+
+int64_t
+CongestionComponent::GetSlotNumber (Time time) const
+{
+  // A window shorter than its number of slots gets one time step per slot
+  int64_t slotLength = std::max<int64_t> (1, m_windowLength.GetTimeStep () / m_windowSlots);
+  return time.GetTimeStep () / slotLength;
+}
+
+void
+CongestionComponent::AddCounters (const OutcomeCounters &counters,
+                                  CongestionEstimate &estimate) const
+{
+  Time now = Simulator::Now ();
+  double decay = exp (-(now - counters.lastUpdate).GetSeconds () /
+                           m_ewmaTimeConstant.GetSeconds ());
+  int64_t slotNumber = GetSlotNumber (now);
+
+  for (int i = 0; i < N_CONGESTION_OUTCOMES; i++)
+    {
+      estimate.rates[i] += counters.rates[i] * decay;
+    }
+  for (uint32_t slot = 0; slot < counters.slotNumbers.size (); slot++)
+    {
+      if (counters.slotNumbers[slot] > slotNumber - m_windowSlots)
+        {
+          for (int i = 0; i < N_CONGESTION_OUTCOMES; i++)
+            {
+              estimate.windowCounts[i] += counters.slotCounts[slot][i];
+            }
+        }
+    }
+}
+
+CongestionEstimate
+CongestionComponent::GetCongestionEstimate (uint32_t gwId, int sf, double frequency) const
+{
+  NS_LOG_FUNCTION (this << gwId << sf << frequency);
+
+  CongestionEstimate estimate;
+  if (sf >= 0 && frequency >= 0)
+    {
+      auto it = m_counters.find (GetCountersKey (gwId, sf, uint32_t (frequency * 1000 + 0.5)));
+      if (it != m_counters.end ())
+        {
+          AddCounters (it->second, estimate);
+        }
+      return estimate;
+    }
+
+  // There are only a few SFs and channels per gateway
+  for (const auto &counters : m_counters)
+    {
+      uint64_t key = counters.first;
+      if ((key >> 32) == gwId
+          && (sf < 0 || int ((key >> 24) & 0xff) == sf)
+          && (frequency < 0 || (key & 0xffffff) == uint32_t (frequency * 1000 + 0.5)))
+        {
+          AddCounters (counters.second, estimate);
+        }
+    }
+  return estimate;
+}
+
+void
+CongestionComponent::PrintCongestionEstimates (std::ostream &os) const
+{
+  for (auto it = m_gateways.Begin (); it != m_gateways.End (); ++it)
+    {
+      uint32_t gwId = (*it)->GetId ();
+      CongestionEstimate estimate = GetCongestionEstimate (gwId);
+      os << Simulator::Now ().GetSeconds () << " " << gwId;
+      for (uint32_t count : estimate.windowCounts)
+        {
+          os << " " << count;
+        }
+      for (double rate : estimate.rates)
+        {
+          os << " " << rate;
+        }
+      os << " " << estimate.GetWindowLossRatio () << " "
+         << estimate.GetRateLossRatio () << '\n';
+    }
 }
 
 void CongestionComponent::SetTracker(LoraPacketTracker & tracker)
@@ -102,23 +371,24 @@ CongestionComponent::EnablePeriodicNetworkCongestionStatusPrinting (NodeContaine
 
   if(m_legendPrinted == false)
   {
+    NS_ABORT_MSG_IF (m_useTracker && !m_packetTracker,
+                     "UseTracker is set, but no LoraPacketTracker was given");
+
     //Going to first print the legend (only want to this once)
-    const char * c = filename.c_str ();
-    std::ofstream outputFile;
-    if (Simulator::Now () == Seconds (0))
+    uint32_t file = m_output.Open (filename, Simulator::Now () != Seconds (0));
+    if (m_useTracker)
       {
-        // Delete contents of the file as it is opened
-        outputFile.open (c, std::ofstream::out | std::ofstream::trunc);
+        m_output.GetStream (file) << m_packetTracker->getPerformanceLegend();
       }
     else
       {
-        // Only append to the file
-        outputFile.open (c, std::ofstream::out | std::ofstream::app);
+        m_output.GetStream (file) << "time gwId received interfered "
+          "noMoreReceivers underSensitivity lostBecauseTx receivedRate "
+          "interferedRate noMoreReceiversRate underSensitivityRate "
+          "lostBecauseTxRate windowLossRatio rateLossRatio\n";
       }
-
-      outputFile << m_packetTracker->getPerformanceLegend();
-      outputFile.close();   
-      m_legendPrinted = true;
+    m_output.Commit (file);
+    m_legendPrinted = true;
   }
 
   DoPrintNetworkCongestionStatus (gateways, filename);
@@ -136,6 +406,15 @@ CongestionComponent::DoPrintNetworkCongestionStatus (NodeContainer gateways,
 
   NS_LOG_FUNCTION (this);
 
+  // The online estimates are up to date: no need to lag
+  if (!m_useTracker)
+    {
+      uint32_t file = m_output.Open (filename, true);
+      PrintCongestionEstimates (m_output.GetStream (file));
+      m_output.Commit (file);
+      return;
+    }
+
   if( Simulator::Now () == 0)
   {
     NS_LOG_INFO("Skipping printing as this is the 0th interval (0s - 0s)");
@@ -158,53 +437,54 @@ CongestionComponent::DoPrintNetworkCongestionStatus (NodeContainer gateways,
     NS_LOG_INFO("Skipping printing as this is the end of the 3rd interval (" << m_lastNetworkCongestionUpdate.GetSeconds() <<  "s -  " << 3*m_congestionInterval.GetSeconds() << "s)");
     return;
   }
-    const char * c = filename.c_str ();
-    std::ofstream outputFile;
-
-    // Only append to the file
-    outputFile.open (c, std::ofstream::out | std::ofstream::app);
+    // The file stays open from the legend on
+    uint32_t file = m_output.Open (filename, true);
+    std::ostream &outputFile = m_output.GetStream (file);
     NS_LOG_INFO ("Congestion tracking the interval " 
                  << m_lastNetworkCongestionUpdate.GetSeconds() << 
                    "s to " << ((Simulator::Now () - 3*m_congestionInterval).GetSeconds())  << "s");
 
-    std::string performanceStats;   //Will only take stats from last gateway (basically only supports 1 GW networks)                           
+    // All gateways are looked at in a single pass over the packets
+    std::vector<uint32_t> gwIds;
     for (auto it = gateways.Begin (); it != gateways.End (); ++it)
       {
-         int gwId = (*it)->GetId ();
-         performanceStats = m_packetTracker->CountRetransmissionsPorted(m_lastNetworkCongestionUpdate,
-                                                 (Simulator::Now () - 3*m_congestionInterval),
-                                                 gwId, 1);
-           outputFile << performanceStats  << std::endl;            
+        gwIds.push_back ((*it)->GetId ());
+      }
+    std::map<uint32_t, PerformanceSnapshot> snapshots;
+    if (!gwIds.empty ())
+      {
+        snapshots = m_packetTracker->GetPerformanceSnapshots (m_lastNetworkCongestionUpdate,
+                                                              (Simulator::Now () - 3*m_congestionInterval),
+                                                              gwIds);
+      }
+
+    PerformanceSnapshot performanceStats;   //Will only take stats from last gateway (basically only supports 1 GW networks)
+    for (uint32_t gwId : gwIds)
+      {
+        performanceStats = snapshots[gwId];
+        outputFile << LoraPacketTracker::FormatPerformance (performanceStats) << '\n';
       }
     m_lastNetworkCongestionUpdate = Simulator::Now () - 3*m_congestionInterval;
 
-    outputFile.close();
-    CalculateCongestion(performanceStats);
+    m_output.Commit (file);
+    if (gateways.GetN () > 0)
+      {
+        CalculateCongestion(performanceStats);
+      }
 }
 
 void
-CongestionComponent::CalculateCongestion (std::string performanceStats)
+CongestionComponent::CalculateCongestion (const PerformanceSnapshot &performanceStats)
 {
   NS_LOG_FUNCTION (this);
   NS_LOG_INFO(m_packetTracker->getPerformanceLegend());
-  NS_LOG_INFO(performanceStats);
-
-  performanceStats.erase(std::remove(performanceStats.begin(), performanceStats.end(), '|'), performanceStats.end()); //remove |
-  performanceStats.erase(std::remove(performanceStats.begin(), performanceStats.end(), '*'), performanceStats.end()); //remove *
-  NS_LOG_INFO(performanceStats);
-
-  std::stringstream iss(performanceStats);
-  float number;
-  std::vector<float> asNumbers;
-  while ( iss >> number )
-    asNumbers.push_back( number );
-
+  NS_LOG_INFO(LoraPacketTracker::FormatPerformance (performanceStats));
 
-  float totalUnconfirmed = asNumbers[0];
-  float succUnconfirmed = asNumbers[1];
-  float succConfirmed = asNumbers[2];
-  float succAcked = asNumbers[3];
-  float totalConfirmed = asNumbers.end()[-2]; //get second last element (cspr confirmed sent)
+  float totalUnconfirmed = performanceStats.totalUnconfirmedPackets;
+  float succUnconfirmed = performanceStats.successfulUnconfirmedPackets;
+  float succConfirmed = performanceStats.successfullyExtractedConfirmedPackets;
+  float succAcked = performanceStats.successfullyAckedConfirmedPackets;
+  float totalConfirmed = performanceStats.cpsrSent;
 
   double unconfirmedULPDR = ceil(succUnconfirmed/totalUnconfirmed*10000)/100; //rounding to two decimals by adding (*100 and /100)
   double confirmedULPDR = ceil(succConfirmed/totalConfirmed*10000)/100; 
@@ -29,6 +29,10 @@
 #include "ns3/network-controller-components.h"
 #include "ns3/lora-helper.h"
 #include "ns3/lora-packet-tracker.h"
+#include "ns3/lora-output-writer.h"
+
+#include <array>
+#include <unordered_map>
 
 namespace ns3 {
 namespace lorawan {
@@ -37,6 +41,51 @@ namespace lorawan {
 // Congestion detection and management //
 ////////////////////////////////////////
 
+/**
+ * What happened to a packet arriving at a gateway, as counted by the online
+ * congestion estimator of CongestionComponent.
+ */
+enum CongestionOutcome
+{
+  CONGESTION_RECEIVED,
+  CONGESTION_INTERFERED,
+  CONGESTION_NO_MORE_RECEIVERS,
+  CONGESTION_UNDER_SENSITIVITY,
+  CONGESTION_LOST_BECAUSE_TX,
+  N_CONGESTION_OUTCOMES
+};
+
+/**
+ * The state of a gateway (or of one of its SFs or channels) as seen by the
+ * online congestion estimator.
+ */
+struct CongestionEstimate
+{
+  /**
+   * Exponentially weighted rate of each outcome, in packets per second.
+   */
+  std::array<double, N_CONGESTION_OUTCOMES> rates;
+
+  /**
+   * Number of packets with each outcome in the sliding window.
+   */
+  std::array<uint32_t, N_CONGESTION_OUTCOMES> windowCounts;
+
+  CongestionEstimate ();
+
+  /**
+   * Fraction of the packets in the sliding window that were not received,
+   * or 0 if there were none.
+   */
+  double GetWindowLossRatio (void) const;
+
+  /**
+   * Fraction of the weighted rate that was not received, or 0 if there is
+   * no traffic.
+   */
+  double GetRateLossRatio (void) const;
+};
+
 class CongestionComponent : public NetworkControllerComponent
 {
 
@@ -65,7 +114,8 @@ public:
                       Ptr<NetworkStatus> networkStatus);
 
   /**
-   * Sets the number of gateways.
+   * Sets the gateways to monitor, and connects the online estimator to the
+   * reception trace sources of their PHYs.
    */
   void SetGateways (NodeContainer gateways);
 
@@ -96,13 +146,72 @@ public:
   /**
    * Calculate the amount of congestion of all devices in the network.
    */
-  void CalculateCongestion (std::string performanceStats);
+  void CalculateCongestion (const PerformanceSnapshot &performanceStats);
 
   std::string
   PrintVector (std::vector<float> vector, int returnString);
 
+  /**
+   * Get the current estimate of the online estimator for a gateway.
+   *
+   * \param gwId The id of the gateway node.
+   * \param sf Only count packets with this spreading factor, or all of them
+   * if negative.
+   * \param frequency Only count packets on this channel (in MHz), or all of
+   * them if negative.
+   */
+  CongestionEstimate GetCongestionEstimate (uint32_t gwId, int sf = -1,
+                                            double frequency = -1) const;
+
+  /**
+   * Trace sinks for the reception outcomes of the gateway PHYs.
+   */
+  void ReceivedCallback (Ptr<const Packet> packet, uint32_t gwId);
+  void InterferenceCallback (Ptr<const Packet> packet, uint32_t gwId);
+  void NoMoreReceiversCallback (Ptr<const Packet> packet, uint32_t gwId);
+  void UnderSensitivityCallback (Ptr<const Packet> packet, uint32_t gwId);
+  void LostBecauseTxCallback (Ptr<const Packet> packet, uint32_t gwId);
+
 private:
 
+  /**
+   * Counters of the online estimator for a gateway, SF and channel.
+   *
+   * The sliding window is a ring of slots, each covering a fixed stretch of
+   * simulation time; a slot is cleared when the window moves past it.
+   */
+  struct OutcomeCounters
+  {
+    std::array<double, N_CONGESTION_OUTCOMES> rates; //!< Weighted rates at lastUpdate
+    Time lastUpdate; //!< When the rates were last decayed
+    std::vector<int64_t> slotNumbers; //!< Time slot held by each ring entry
+    std::vector<std::array<uint32_t, N_CONGESTION_OUTCOMES> > slotCounts;
+  };
+
+  /**
+   * Count an outcome of a packet at a gateway.
+   */
+  void RecordOutcome (Ptr<const Packet> packet, uint32_t gwId,
+                      CongestionOutcome outcome);
+
+  /**
+   * Get the number of the sliding window slot a time falls in.
+   */
+  int64_t GetSlotNumber (Time time) const;
+
+  /**
+   * Add the state of a set of counters, brought forward to now, to an
+   * estimate.
+   */
+  void AddCounters (const OutcomeCounters &counters,
+                    CongestionEstimate &estimate) const;
+
+  /**
+   * Print the estimates of the gateways, one line per gateway.
+   */
+  void PrintCongestionEstimates (std::ostream &os) const;
+
+
   bool m_legendPrinted = false;
 
   NodeContainer m_gateways;   //!< Set of gateways to monitor with this congestion component
@@ -113,6 +222,21 @@ private:
 
   LoraPacketTracker* m_packetTracker = 0;
 
+  bool m_useTracker; //!< Whether to report from the tracker
+
+  LoraOutputWriter m_output; //!< Writes the congestion status file
+
+  Time m_ewmaTimeConstant; //!< Time constant of the weighted rates
+  Time m_windowLength; //!< Length of the sliding window
+  uint32_t m_windowSlots; //!< Number of slots the sliding window is made of
+
+  /**
+   * The counters, keyed by gateway id, SF and channel frequency in kHz (see
+   * GetCountersKey).
+   */
+  std::unordered_map<uint64_t, OutcomeCounters> m_counters;
+
+  static uint64_t GetCountersKey (uint32_t gwId, uint8_t sf, uint32_t frequencyKhz);
 
 };
 }
@@ -20,6 +20,7 @@
 #include "ns3/double.h"
 #include "ns3/log.h"
 #include <cmath>
+#include <limits>
 
 namespace ns3 {
 namespace lorawan {
@@ -47,6 +48,34 @@ CorrelatedShadowingPropagationLossModel::GetTypeId (void)
 
 CorrelatedShadowingPropagationLossModel::CorrelatedShadowingPropagationLossModel ()
 {
+  m_shadowingValue = CreateObject<NormalRandomVariable> ();
+  m_shadowingValue->SetAttribute ("Mean", DoubleValue (0.0));
+  m_shadowingValue->SetAttribute ("Variance", DoubleValue (16.0));
+}
+
+void
+CorrelatedShadowingPropagationLossModel::SetCorrelationDistance (double distance)
+{
+  m_correlationDistance = distance;
+}
+
+double
+CorrelatedShadowingPropagationLossModel::GetCorrelationDistance (void)
+{
+  return m_correlationDistance;
+}
+
+int
+CorrelatedShadowingPropagationLossModel::GetSquareCoordinate (double x) const
+{
+  // Round the raw position: (x > 0) - (x < 0) is the sign function
+  return ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
+}
+
+uint64_t
+CorrelatedShadowingPropagationLossModel::GetKey (int x, int y)
+{
+  return (uint64_t (uint32_t (x)) << 32) | uint32_t (y);
 }
 
 double
@@ -65,60 +94,70 @@ CorrelatedShadowingPropagationLossModel::DoCalcRxPower (double txPowerDbm,
   double x = position.x;
   double y = position.y;
 
-  // Compute the coordinates of the grid square (i.e., round the raw position)
-  // (x > 0) - (x < 0) is the sign function
-  int xcoord =
-    ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
-  int ycoord =
-    ((y > 0) - (y < 0)) * ((std::fabs (y) + m_correlationDistance / 2) / m_correlationDistance);
-
-  // Wrap coordinates up in a pair
-  std::pair<int, int> coordinates (xcoord, ycoord);
+  // Compute the coordinates of the grid square
+  int xcoord = GetSquareCoordinate (x);
+  int ycoord = GetSquareCoordinate (y);
 
   NS_LOG_DEBUG ("x " << x << ", y " << y);
   NS_LOG_DEBUG ("xcoord " << xcoord << ", ycoord " << ycoord);
 
-  // Look for the computed coordinates in the shadowingGrid
-  std::map<std::pair<int,int>, Ptr<ShadowingMap> >::const_iterator it;
-
-  it = m_shadowingGrid.find (coordinates);
-
-  if (it == m_shadowingGrid.end ())     // Did not find the coordinates
+  // Look for the computed coordinates in the shadowingGrid, creating the
+  // shadowing map of this square if it isn't there
+  Ptr<ShadowingMap> &shadowingMap = m_shadowingGrid[GetKey (xcoord, ycoord)];
+  if (shadowingMap == 0)
     {
-      // If this shadowing grid was not found, create it
       NS_LOG_DEBUG ("Creating a new shadowing map to be used at coordinates "
-                    << coordinates.first << " " << coordinates.second);
-
-      Ptr<ShadowingMap> shadowingMap =
-        Create<CorrelatedShadowingPropagationLossModel::ShadowingMap> ();
+                    << xcoord << " " << ycoord);
 
-      m_shadowingGrid[coordinates] = shadowingMap;
-    }
-  else
-    {
-      NS_LOG_DEBUG ("This square already has its shadowingMap!");
+      shadowingMap = Create<CorrelatedShadowingPropagationLossModel::ShadowingMap>
+          (m_correlationDistance, m_shadowingValue);
     }
 
-  // Place the iterator on the coordinates
-  it = m_shadowingGrid.find (coordinates);
-
   // Get b's position in a's ShadowingMap
-  CorrelatedShadowingPropagationLossModel::Position bPosition
-    (b->GetPosition ().x, b->GetPosition ().y);
+  Vector bVector = b->GetPosition ();
+  CorrelatedShadowingPropagationLossModel::Position bPosition (bVector.x, bVector.y);
 
   // Use the map of the a MobilityModel to determine the value of shadowing
   // that corresponds to the position of the MobilityModel b.
-  double loss = it->second->GetLoss (bPosition);
+  double loss = shadowingMap->GetLoss (bPosition);
 
   NS_LOG_INFO ("Shadowing loss: " << loss);
 
   return txPowerDbm - loss;
 }
 
+void
+CorrelatedShadowingPropagationLossModel::PreGenerate (Box bounds)
+{
+  NS_LOG_FUNCTION (this << bounds);
+
+  int xMin = GetSquareCoordinate (bounds.xMin);
+  int xMax = GetSquareCoordinate (bounds.xMax);
+  int yMin = GetSquareCoordinate (bounds.yMin);
+  int yMax = GetSquareCoordinate (bounds.yMax);
+
+  // Squares are visited row by row, and so are the vertices of each, so that
+  // the values drawn don't depend on which links are evaluated first
+  for (int ycoord = yMin; ycoord <= yMax; ycoord++)
+    {
+      for (int xcoord = xMin; xcoord <= xMax; xcoord++)
+        {
+          Ptr<ShadowingMap> &shadowingMap = m_shadowingGrid[GetKey (xcoord, ycoord)];
+          if (shadowingMap == 0)
+            {
+              shadowingMap = Create<CorrelatedShadowingPropagationLossModel::ShadowingMap>
+                  (m_correlationDistance, m_shadowingValue);
+            }
+          shadowingMap->Generate (xMin, yMin, xMax + 1, yMax + 1);
+        }
+    }
+}
+
 int64_t
 CorrelatedShadowingPropagationLossModel::DoAssignStreams (int64_t stream)
 {
-  return 0;
+  m_shadowingValue->SetStream (stream);
+  return 1;
 }
 
 /*********************************
@@ -134,16 +173,17 @@ const double CorrelatedShadowingPropagationLossModel::ShadowingMap::m_kInv[4][4]
   {-0.366414485833771, -0.0415206295795327, -0.366414485833771, 1.27968707244633}
 };
 
-CorrelatedShadowingPropagationLossModel::ShadowingMap::ShadowingMap () :
-  m_correlationDistance (110)
+const int CorrelatedShadowingPropagationLossModel::ShadowingMap::TILE_SIZE;
+
+CorrelatedShadowingPropagationLossModel::ShadowingMap::ShadowingMap
+  (double correlationDistance, Ptr<NormalRandomVariable> shadowingValue) :
+  m_correlationDistance (correlationDistance),
+  m_shadowingValue (shadowingValue)
 {
   NS_LOG_FUNCTION_NOARGS ();
 
   // The generation of new variables and positions along the grid is handled
-  // by the GetLoss function. Here, we only create the normal random variable.
-  m_shadowingValue = CreateObject<NormalRandomVariable> ();
-  m_shadowingValue->SetAttribute ("Mean", DoubleValue (0.0));
-  m_shadowingValue->SetAttribute ("Variance", DoubleValue (16.0));
+  // by the GetLoss and Generate functions.
 }
 
 CorrelatedShadowingPropagationLossModel::ShadowingMap::~ShadowingMap ()
@@ -151,110 +191,130 @@ CorrelatedShadowingPropagationLossModel::ShadowingMap::~ShadowingMap ()
   NS_LOG_FUNCTION_NOARGS ();
 }
 
+std::vector<double> &
+CorrelatedShadowingPropagationLossModel::ShadowingMap::GetTile (int i, int j,
+                                                                uint32_t &index)
+{
+  // Floor division, so that negative vertices get tiles of their own
+  int tileX = (i >= 0 ? i : i - TILE_SIZE + 1) / TILE_SIZE;
+  int tileY = (j >= 0 ? j : j - TILE_SIZE + 1) / TILE_SIZE;
+  index = (j - tileY * TILE_SIZE) * TILE_SIZE + (i - tileX * TILE_SIZE);
+
+  std::vector<double> &tile =
+    m_tiles[CorrelatedShadowingPropagationLossModel::GetKey (tileX, tileY)];
+  if (tile.empty ())
+    {
+      tile.assign (TILE_SIZE * TILE_SIZE, std::numeric_limits<double>::quiet_NaN ());
+    }
+  return tile;
+}
+
+double
+CorrelatedShadowingPropagationLossModel::ShadowingMap::GetVertexValue (int i, int j)
+{
+  uint32_t index;
+  std::vector<double> &tile = GetTile (i, j, index);
+  if (std::isnan (tile[index]))
+    {
+      tile[index] = m_shadowingValue->GetValue ();
+      NS_LOG_DEBUG ("Vertex " << i << " " << j << ": " << tile[index]);
+    }
+  return tile[index];
+}
+
+void
+CorrelatedShadowingPropagationLossModel::ShadowingMap::Generate (int xMin, int yMin,
+                                                                 int xMax, int yMax)
+{
+  NS_LOG_FUNCTION (this << xMin << yMin << xMax << yMax);
+
+  for (int j = yMin; j <= yMax; j++)
+    {
+      for (int i = xMin; i <= xMax; i++)
+        {
+          GetVertexValue (i, j);
+        }
+    }
+}
+
 double
 CorrelatedShadowingPropagationLossModel::ShadowingMap::GetLoss
   (CorrelatedShadowingPropagationLossModel::Position position)
 {
   NS_LOG_FUNCTION (this << position.x << position.y);
 
-  // Verify whether this position is already in the shadowingMap. Since the
-  // Position implementation overloads the == operator, this comparison
-  // between doubles is ok and we can use std::map's find function.
-  std::map<CorrelatedShadowingPropagationLossModel::Position,
-           double>::const_iterator it;
-  it = m_shadowingMap.find (position);
-
-  // If it's not found (i.e, if find returns the end of the map), we need to
-  // generate the value at the specified position.
-  if (it == m_shadowingMap.end ())
+  // Positions closer than 10 cm share the same value
+  uint64_t key = CorrelatedShadowingPropagationLossModel::GetKey
+      (std::lround (position.x * 10), std::lround (position.y * 10));
+  std::unordered_map<uint64_t, double>::const_iterator it = m_losses.find (key);
+  if (it != m_losses.end ())
     {
-      // Get the coordinates of the position
-      double x = position.x;
-      double y = position.y;
-      int xcoord =
-        ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
-      int ycoord =
-        ((y > 0) - (y < 0)) * ((std::fabs (y) + m_correlationDistance / 2) / m_correlationDistance);
-
-      // Verify whether there already are the 4 surrounding positions in the
-      // map
-      double xmin = xcoord * m_correlationDistance - m_correlationDistance / 2;
-      double xmax = xcoord * m_correlationDistance + m_correlationDistance / 2;
-      double ymin = ycoord * m_correlationDistance - m_correlationDistance / 2;
-      double ymax = ycoord * m_correlationDistance + m_correlationDistance / 2;
-
-      CorrelatedShadowingPropagationLossModel::Position lowerLeft (xmin, ymin);
-      CorrelatedShadowingPropagationLossModel::Position upperLeft (xmin, ymax);
-      CorrelatedShadowingPropagationLossModel::Position lowerRight (xmax, ymin);
-      CorrelatedShadowingPropagationLossModel::Position upperRight (xmax, ymax);
-
-      NS_LOG_DEBUG ("Generating a new shadowing value in the following quadrant:");
-      NS_LOG_DEBUG ("xmin " << xmin << ", xmax " << xmax <<
-                    ", ymin " << ymin << ", ymax " << ymax);
-
-      // Use the map's insert method to insert the coordinates of the 4
-      // surrounding positions (if they are already there, they won't be
-      // substituted thanks to the map's implementation).
-      // TODO: Avoid useless generation of ShadowingMap values. This can be
-      // done by performing some checks (and not leveraging the map
-      // implementation)
-      double q11 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Lower left corner: " << q11);
-      m_shadowingMap[lowerLeft] = q11;
-      double q12 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Upper left corner: " << q12);
-      m_shadowingMap[upperLeft] = q12;
-      double q21 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Lower right corner: " << q21);
-      m_shadowingMap[lowerRight] = q21;
-      double q22 = m_shadowingValue->GetValue ();
-      NS_LOG_DEBUG ("Upper right corner: " << q22);
-      m_shadowingMap[upperRight] = q22;
-
-      NS_LOG_DEBUG (q11 << " " << q12 << " " << q21 << " " << q22 << " ");
-
-      // The c matrix contains the positions of the 4 vertices
-      double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
-
-      // For the following procedure, reference:
-      // S. Schlegel et al., "On the Interpolation of Data with Normally
-      // Distributed Uncertainty for Visualization", IEEE Transactions on
-      // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
-
-      // Compute the phi coefficients
-      double phi1 = 0;
-      double phi2 = 0;
-      double phi3 = 0;
-      double phi4 = 0;
-
-      for (int j = 0; j < 4; j++)
-        {
-          double distance = sqrt ((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
+      NS_LOG_DEBUG ("Shadowing map for this location already exists");
+      return it->second;
+    }
 
-          NS_LOG_DEBUG ("Distance: " << distance);
+  // Get the coordinates of the position
+  double x = position.x;
+  double y = position.y;
+  int xcoord =
+    ((x > 0) - (x < 0)) * ((std::fabs (x) + m_correlationDistance / 2) / m_correlationDistance);
+  int ycoord =
+    ((y > 0) - (y < 0)) * ((std::fabs (y) + m_correlationDistance / 2) / m_correlationDistance);
 
-          double k = std::exp (-distance / m_correlationDistance);
-          phi1 = phi1 + m_kInv[0][j] * k;
-          phi2 = phi2 + m_kInv[1][j] * k;
-          phi3 = phi3 + m_kInv[2][j] * k;
-          phi4 = phi4 + m_kInv[3][j] * k;
-        }
+  // The 4 surrounding vertices
+  double xmin = xcoord * m_correlationDistance - m_correlationDistance / 2;
+  double xmax = xcoord * m_correlationDistance + m_correlationDistance / 2;
+  double ymin = ycoord * m_correlationDistance - m_correlationDistance / 2;
+  double ymax = ycoord * m_correlationDistance + m_correlationDistance / 2;
 
-      NS_LOG_DEBUG ("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " <<
-                    phi4 << " ");
+  NS_LOG_DEBUG ("Generating a new shadowing value in the following quadrant:");
+  NS_LOG_DEBUG ("xmin " << xmin << ", xmax " << xmax <<
+                ", ymin " << ymin << ", ymax " << ymax);
 
-      double shadowing = q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+  double q11 = GetVertexValue (xcoord, ycoord);
+  double q12 = GetVertexValue (xcoord, ycoord + 1);
+  double q21 = GetVertexValue (xcoord + 1, ycoord);
+  double q22 = GetVertexValue (xcoord + 1, ycoord + 1);
 
-      // Add the newly computed shadowing value to the shadowing map
-      m_shadowingMap[position] = shadowing;
-      NS_LOG_DEBUG ("Created new shadowing map: " << shadowing);
-    }
-  else
+  NS_LOG_DEBUG (q11 << " " << q12 << " " << q21 << " " << q22 << " ");
+
+  // The c matrix contains the positions of the 4 vertices
+  double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
+
+  // For the following procedure, reference:
+  // S. Schlegel et al., "On the Interpolation of Data with Normally
+  // Distributed Uncertainty for Visualization", IEEE Transactions on
+  // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
+
+  // Compute the phi coefficients
+  double phi1 = 0;
+  double phi2 = 0;
+  double phi3 = 0;
+  double phi4 = 0;
+
+  for (int j = 0; j < 4; j++)
     {
-      NS_LOG_DEBUG ("Shadowing map for this location already exists");
+      double distance = sqrt ((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
+
+      NS_LOG_DEBUG ("Distance: " << distance);
+
+      double k = std::exp (-distance / m_correlationDistance);
+      phi1 = phi1 + m_kInv[0][j] * k;
+      phi2 = phi2 + m_kInv[1][j] * k;
+      phi3 = phi3 + m_kInv[2][j] * k;
+      phi4 = phi4 + m_kInv[3][j] * k;
     }
 
-  return m_shadowingMap[position];
+  NS_LOG_DEBUG ("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " <<
+                phi4 << " ");
+
+  double shadowing = q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+
+  // Add the newly computed shadowing value to the shadowing map
+  m_losses[key] = shadowing;
+  NS_LOG_DEBUG ("Created new shadowing map: " << shadowing);
+
+  return shadowing;
 }
 
 /*****************************
@@ -23,6 +23,9 @@
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/box.h"
+
+#include <unordered_map>
 
 namespace ns3 {
 class MobilityModel;
@@ -51,7 +54,7 @@ public:
     /**
      * Constructor.
      * This initializes the shadowing map with a grid of independent
-     * shadowing values, one m_correlationDistance meters apart from the next
+     * shadowing values, one correlationDistance meters apart from the next
      * one. The result is something like:
      *  o---o---o---o---o
      *  |   |   |   |   |
@@ -67,8 +70,12 @@ public:
      *  twice. Also, since interpolation is a deterministic operation, we are
      *  guaranteed that, as long as the grid doesn't change, also two values
      *  generated in the same square will be correlated.
+     *
+     *  The values at the vertices are drawn from shadowingValue when they
+     *  are first needed, unless Generate was called for them beforehand.
      */
-    ShadowingMap ();
+    ShadowingMap (double correlationDistance,
+                  Ptr<NormalRandomVariable> shadowingValue);
 
     ~ShadowingMap ();
 
@@ -79,14 +86,43 @@ public:
      */
     double GetLoss (CorrelatedShadowingPropagationLossModel::Position position);
 
+    /**
+     * Draw the values of all the vertices in a rectangle of the grid that
+     * don't have one yet, row by row.
+     *
+     * Vertex (i, j) is at ((i - 1/2) * correlationDistance, (j - 1/2) *
+     * correlationDistance), so that the square of coordinates (x, y) is
+     * bounded by vertices x and x + 1 along the x axis.
+     */
+    void Generate (int xMin, int yMin, int xMax, int yMax);
+
 private:
     /**
-     * For each Position, this map gives a corresponding loss.
-     * The map contains a basic grid that is initialized at construction
-     * time, and then newly computed values are added as they are created.
+     * Get the value at a vertex of the grid, drawing it if needed.
+     */
+    double GetVertexValue (int i, int j);
+
+    /**
+     * Get the tile of the raster holding a vertex, creating it if needed,
+     * and the index of the vertex in it.
+     */
+    std::vector<double> &GetTile (int i, int j, uint32_t &index);
+
+    /**
+     * Vertices are stored in square tiles of TILE_SIZE x TILE_SIZE values,
+     * row by row; values that were not drawn yet are NaN.
+     */
+    static const int TILE_SIZE = 16;
+
+    /**
+     * The tiles of the raster, keyed by their packed integer coordinates.
+     */
+    std::unordered_map<uint64_t, std::vector<double> > m_tiles;
+
+    /**
+     * The losses already computed, keyed by position rounded to 10 cm.
      */
-    std::map<CorrelatedShadowingPropagationLossModel::Position, double>
-    m_shadowingMap;
+    std::unordered_map<uint64_t, double> m_losses;
 
     /**
      * The distance after which two samples are to be considered almost
@@ -124,6 +160,24 @@ private:
    */
   double GetCorrelationDistance (void);
 
+  /**
+   * Generate the shadowing of every square in a region, for receivers in
+   * that same region.
+   *
+   * Values are then independent of the order in which links are evaluated,
+   * and only depend on the stream assigned to the model.
+   *
+   * Every square gets the vertices of the whole region, so the memory needed
+   * grows with the fourth power of the size of the region over the
+   * correlation distance: n^2 squares of (n + 1)^2 values of 8 bytes, for a
+   * region n correlation distances wide. With the default 110 m, the 6.3 km
+   * disc of the congestion-tracking example is about 115 squares wide, and
+   * needs about 115^2 x 115^2 x 8 B, i.e. 1.4 GB. Smaller regions, e.g. the
+   * surroundings of the gateways, or a larger correlation distance, keep it
+   * manageable.
+   */
+  void PreGenerate (Box bounds);
+
 private:
   virtual double DoCalcRxPower (double txPowerDbm,
                                 Ptr<MobilityModel> a,
@@ -133,6 +187,23 @@ private:
 
   double m_correlationDistance;     //!< The correlation distance for the ShadowingMap
 
+  /**
+   * The normal random variable all ShadowingMap instances draw their vertex
+   * values from.
+   */
+  Ptr<NormalRandomVariable> m_shadowingValue;
+
+  /**
+   * Get the coordinates of the square a position is in, as described for
+   * m_shadowingGrid.
+   */
+  int GetSquareCoordinate (double x) const;
+
+  /**
+   * Pack two integer coordinates in a key.
+   */
+  static uint64_t GetKey (int x, int y);
+
   /**
    * Map linking a square to a ShadowingMap.
    * Each square of the shadowing grid has a corresponding ShadowingMap, and a
@@ -170,7 +241,7 @@ private:
    *  a to points b and c, the shadowing experienced by b and c will be similar
    *  if they are close (ideally, within a correlation distance).
    */
-  mutable std::map<std::pair<int, int>, Ptr<ShadowingMap> > m_shadowingGrid;
+  mutable std::unordered_map<uint64_t, Ptr<ShadowingMap> > m_shadowingGrid;
 };
 
 }
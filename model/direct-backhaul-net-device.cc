@@ -0,0 +1,324 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#include "ns3/direct-backhaul-net-device.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+
+namespace ns3 {
+namespace lorawan {
+
+NS_LOG_COMPONENT_DEFINE ("DirectBackhaulNetDevice");
+
+NS_OBJECT_ENSURE_REGISTERED (DirectBackhaulNetDevice);
+
+TypeId
+DirectBackhaulNetDevice::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::DirectBackhaulNetDevice")
+    .SetParent<NetDevice> ()
+    .AddConstructor<DirectBackhaulNetDevice> ()
+    .SetGroupName ("lorawan")
+    .AddAttribute ("Latency",
+                   "The fixed time it takes a packet to reach the peer device",
+                   TimeValue (MilliSeconds (2)),
+                   MakeTimeAccessor (&DirectBackhaulNetDevice::m_latency),
+                   MakeTimeChecker ())
+    .AddAttribute ("Mtu", "The MAC-level Maximum Transmission Unit",
+                   UintegerValue (1500),
+                   MakeUintegerAccessor (&DirectBackhaulNetDevice::SetMtu,
+                                         &DirectBackhaulNetDevice::GetMtu),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddTraceSource ("MacTx",
+                     "Trace source indicating a packet has arrived "
+                     "for transmission by this device",
+                     MakeTraceSourceAccessor
+                       (&DirectBackhaulNetDevice::m_macTxTrace),
+                     "ns3::Packet::TracedCallback")
+    .AddTraceSource ("MacRx",
+                     "Trace source indicating a packet has been "
+                     "delivered to the upper layers by this device",
+                     MakeTraceSourceAccessor
+                       (&DirectBackhaulNetDevice::m_macRxTrace),
+                     "ns3::Packet::TracedCallback");
+  return tid;
+}
+
+DirectBackhaulNetDevice::DirectBackhaulNetDevice () :
+  m_node (0),
+  m_peer (0),
+  m_address (Mac48Address::Allocate ()),
+  m_ifIndex (0),
+  m_mtu (1500),
+  m_latency (MilliSeconds (2))
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DirectBackhaulNetDevice::~DirectBackhaulNetDevice ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+DirectBackhaulNetDevice::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  // Break the reference cycle between the two ends of the link
+  m_node = 0;
+  m_peer = 0;
+  m_receiveCallback = NetDevice::ReceiveCallback ();
+  NetDevice::DoDispose ();
+}
+
+void
+DirectBackhaulNetDevice::Connect (Ptr<DirectBackhaulNetDevice> a,
+                                  Ptr<DirectBackhaulNetDevice> b)
+{
+  NS_LOG_FUNCTION (a << b);
+
+  a->m_peer = b;
+  b->m_peer = a;
+}
+
+Ptr<DirectBackhaulNetDevice>
+DirectBackhaulNetDevice::GetPeer (void) const
+{
+  return m_peer;
+}
+
+void
+DirectBackhaulNetDevice::SetLatency (Time latency)
+{
+  NS_LOG_FUNCTION (this << latency);
+
+  m_latency = latency;
+}
+
+Time
+DirectBackhaulNetDevice::GetLatency (void) const
+{
+  return m_latency;
+}
+
+bool
+DirectBackhaulNetDevice::Send (Ptr<Packet> packet, const Address& dest,
+                               uint16_t protocolNumber)
+{
+  NS_LOG_FUNCTION (this << packet << dest << protocolNumber);
+
+  if (m_peer == 0)
+    {
+      NS_LOG_WARN ("Device is not connected, dropping packet");
+      return false;
+    }
+
+  m_macTxTrace (packet);
+
+  // Hand the packet itself to the peer: nobody modifies it on the way
+  Simulator::ScheduleWithContext (m_peer->GetNode ()->GetId (), m_latency,
+                                  &DirectBackhaulNetDevice::Receive, m_peer,
+                                  packet, protocolNumber, GetAddress ());
+
+  return true;
+}
+
+void
+DirectBackhaulNetDevice::Receive (Ptr<Packet> packet, uint16_t protocol,
+                                  Address from)
+{
+  NS_LOG_FUNCTION (this << packet << protocol << from);
+
+  m_macRxTrace (packet);
+
+  if (!m_receiveCallback.IsNull ())
+    {
+      m_receiveCallback (this, packet, protocol, from);
+    }
+}
+
+/******************************************
+ *    Methods inherited from NetDevice    *
+ ******************************************/
+
+void
+DirectBackhaulNetDevice::SetIfIndex (const uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
+
+  m_ifIndex = index;
+}
+
+uint32_t
+DirectBackhaulNetDevice::GetIfIndex (void) const
+{
+  return m_ifIndex;
+}
+
+Ptr<Channel>
+DirectBackhaulNetDevice::GetChannel (void) const
+{
+  // There is no channel between the two ends of the link
+  return 0;
+}
+
+void
+DirectBackhaulNetDevice::SetAddress (Address address)
+{
+  NS_LOG_FUNCTION (this << address);
+
+  m_address = Mac48Address::ConvertFrom (address);
+}
+
+Address
+DirectBackhaulNetDevice::GetAddress (void) const
+{
+  return m_address;
+}
+
+bool
+DirectBackhaulNetDevice::SetMtu (const uint16_t mtu)
+{
+  NS_LOG_FUNCTION (this << mtu);
+
+  m_mtu = mtu;
+  return true;
+}
+
+uint16_t
+DirectBackhaulNetDevice::GetMtu (void) const
+{
+  return m_mtu;
+}
+
+bool
+DirectBackhaulNetDevice::IsLinkUp (void) const
+{
+  return m_peer != 0;
+}
+
+void
+DirectBackhaulNetDevice::AddLinkChangeCallback (Callback<void> callback)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+bool
+DirectBackhaulNetDevice::IsBroadcast (void) const
+{
+  return true;
+}
+
+Address
+DirectBackhaulNetDevice::GetBroadcast (void) const
+{
+  return Mac48Address::GetBroadcast ();
+}
+
+bool
+DirectBackhaulNetDevice::IsMulticast (void) const
+{
+  return false;
+}
+
+Address
+DirectBackhaulNetDevice::GetMulticast (Ipv4Address multicastGroup) const
+{
+  NS_ABORT_MSG ("Unsupported");
+
+  return Address ();
+}
+
+Address
+DirectBackhaulNetDevice::GetMulticast (Ipv6Address addr) const
+{
+  NS_ABORT_MSG ("Unsupported");
+
+  return Address ();
+}
+
+bool
+DirectBackhaulNetDevice::IsBridge (void) const
+{
+  return false;
+}
+
+bool
+DirectBackhaulNetDevice::IsPointToPoint (void) const
+{
+  return true;
+}
+
+bool
+DirectBackhaulNetDevice::SendFrom (Ptr<Packet> packet, const Address& source,
+                                   const Address& dest, uint16_t protocolNumber)
+{
+  NS_ABORT_MSG ("Unsupported");
+
+  return false;
+}
+
+Ptr<Node>
+DirectBackhaulNetDevice::GetNode (void) const
+{
+  return m_node;
+}
+
+void
+DirectBackhaulNetDevice::SetNode (Ptr<Node> node)
+{
+  NS_LOG_FUNCTION (this << node);
+
+  m_node = node;
+}
+
+bool
+DirectBackhaulNetDevice::NeedsArp (void) const
+{
+  return false;
+}
+
+void
+DirectBackhaulNetDevice::SetReceiveCallback (ReceiveCallback cb)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  m_receiveCallback = cb;
+}
+
+void
+DirectBackhaulNetDevice::SetPromiscReceiveCallback (PromiscReceiveCallback cb)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+}
+
+bool
+DirectBackhaulNetDevice::SupportsSendFrom (void) const
+{
+  return false;
+}
+
+}
+}
@@ -0,0 +1,132 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2021 University of Pretoria
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Jaco Marais <jaco.marais@tuks.co.za>
+ */
+
+#ifndef DIRECT_BACKHAUL_NET_DEVICE_H
+#define DIRECT_BACKHAUL_NET_DEVICE_H
+
+#include "ns3/net-device.h"
+#include "ns3/mac48-address.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-callback.h"
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * A NetDevice that connects a gateway to the NS in-process, as a lightweight
+ * replacement of a PointToPoint link in simulations that do not study the
+ * backhaul.
+ *
+ * Packets are handed to the peer device by reference after a fixed latency:
+ * there is no queue, no serialization delay and no framing, so packets are
+ * never copied or modified along the way.
+ */
+class DirectBackhaulNetDevice : public NetDevice
+{
+public:
+  static TypeId GetTypeId (void);
+
+  DirectBackhaulNetDevice ();
+  virtual ~DirectBackhaulNetDevice ();
+
+  /**
+   * Connect two devices to each other.
+   */
+  static void Connect (Ptr<DirectBackhaulNetDevice> a,
+                       Ptr<DirectBackhaulNetDevice> b);
+
+  /**
+   * Get the device at the other end of the link.
+   */
+  Ptr<DirectBackhaulNetDevice> GetPeer (void) const;
+
+  /**
+   * Set the fixed latency packets experience on this device.
+   */
+  void SetLatency (Time latency);
+
+  /**
+   * Get the latency packets experience on this device.
+   */
+  Time GetLatency (void) const;
+
+  /**
+   * Deliver a packet sent by the peer device.
+   */
+  void Receive (Ptr<Packet> packet, uint16_t protocol, Address from);
+
+  // From class NetDevice
+  virtual void SetIfIndex (const uint32_t index);
+  virtual uint32_t GetIfIndex (void) const;
+  virtual Ptr<Channel> GetChannel (void) const;
+  virtual void SetAddress (Address address);
+  virtual Address GetAddress (void) const;
+  virtual bool SetMtu (const uint16_t mtu);
+  virtual uint16_t GetMtu (void) const;
+  virtual bool IsLinkUp (void) const;
+  virtual void AddLinkChangeCallback (Callback<void> callback);
+  virtual bool IsBroadcast (void) const;
+  virtual Address GetBroadcast (void) const;
+  virtual bool IsMulticast (void) const;
+  virtual Address GetMulticast (Ipv4Address multicastGroup) const;
+  virtual Address GetMulticast (Ipv6Address addr) const;
+  virtual bool IsBridge (void) const;
+  virtual bool IsPointToPoint (void) const;
+  virtual bool Send (Ptr<Packet> packet, const Address& dest,
+                     uint16_t protocolNumber);
+  virtual bool SendFrom (Ptr<Packet> packet, const Address& source,
+                         const Address& dest, uint16_t protocolNumber);
+  virtual Ptr<Node> GetNode (void) const;
+  virtual void SetNode (Ptr<Node> node);
+  virtual bool NeedsArp (void) const;
+  virtual void SetReceiveCallback (NetDevice::ReceiveCallback cb);
+  virtual void SetPromiscReceiveCallback (PromiscReceiveCallback cb);
+  virtual bool SupportsSendFrom (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  Ptr<Node> m_node; //!< The Node this NetDevice is installed on
+  Ptr<DirectBackhaulNetDevice> m_peer; //!< The device at the other end
+  Mac48Address m_address; //!< The address of this device
+  uint32_t m_ifIndex; //!< The index of this device on its node
+  uint16_t m_mtu; //!< The MTU of this device
+  Time m_latency; //!< The latency of packets sent by this device
+
+  NetDevice::ReceiveCallback m_receiveCallback;
+
+  /**
+   * Trace source fired when a packet is handed to this device for
+   * transmission. Named after the PointToPointNetDevice one, so that
+   * existing trace sinks keep working.
+   */
+  TracedCallback<Ptr<const Packet> > m_macTxTrace;
+
+  /**
+   * Trace source fired when a packet is delivered to the upper layers.
+   */
+  TracedCallback<Ptr<const Packet> > m_macRxTrace;
+};
+
+} //namespace ns3
+
+}
+#endif /* DIRECT_BACKHAUL_NET_DEVICE_H */
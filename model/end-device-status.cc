@@ -31,6 +31,7 @@
 #include "ns3/lora-tag.h"
 
 #include <algorithm>
+#include <iterator>
 
 namespace ns3 {
 namespace lorawan {
@@ -55,6 +56,8 @@ EndDeviceStatus::EndDeviceStatus (LoraDeviceAddress endDeviceAddress,
       m_mac (endDeviceMac)
 {
   NS_LOG_FUNCTION (endDeviceAddress);
+
+  m_lastInserted = m_receivedPacketList.end ();
 }
 
 EndDeviceStatus::EndDeviceStatus ()
@@ -64,6 +67,7 @@ EndDeviceStatus::EndDeviceStatus ()
   // Initialize data structure
   m_reply = EndDeviceStatus::Reply ();
   m_receivedPacketList = ReceivedPacketList ();
+  m_lastInserted = m_receivedPacketList.end ();
 }
 
 EndDeviceStatus::~EndDeviceStatus ()
@@ -178,7 +182,7 @@ EndDeviceStatus::GetMac (void)
   return m_mac;
 }
 
-EndDeviceStatus::ReceivedPacketList
+const EndDeviceStatus::ReceivedPacketList &
 EndDeviceStatus::GetReceivedPacketList ()
 {
   NS_LOG_FUNCTION_NOARGS ();
@@ -265,6 +269,7 @@ EndDeviceStatus::InsertReceivedPacket (Ptr<Packet const> receivedPacket, const A
   info.sf = tag.GetSpreadingFactor ();
   info.frequency = tag.GetFrequency ();
   info.packet = receivedPacket;
+  info.adr = frameHdr.GetAdr ();
 
   double rcvPower = tag.GetReceivePower ();
 
@@ -304,6 +309,8 @@ EndDeviceStatus::InsertReceivedPacket (Ptr<Packet const> receivedPacket, const A
 
           NS_LOG_DEBUG ("Size of gateway list: " << gwList.size ());
 
+          m_lastInserted = std::prev (it.base ());
+          m_lastInsertionNew = false;
           break; // Exit from the cycle
         }
     }
@@ -317,10 +324,26 @@ EndDeviceStatus::InsertReceivedPacket (Ptr<Packet const> receivedPacket, const A
       info.gwList.insert (std::pair<Address, PacketInfoPerGw> (gwAddress, gwInfo));
       m_receivedPacketList.push_back (
           std::pair<Ptr<Packet const>, ReceivedPacketInfo> (receivedPacket, info));
+      m_lastInserted = std::prev (m_receivedPacketList.end ());
+      m_lastInsertionNew = true;
     }
   NS_LOG_DEBUG (*this);
 }
 
+bool
+EndDeviceStatus::IsLastInsertionNew (void) const
+{
+  return m_lastInsertionNew;
+}
+
+const EndDeviceStatus::ReceivedPacketInfo &
+EndDeviceStatus::GetLastInsertedPacketInfo (void) const
+{
+  NS_ASSERT_MSG (m_lastInserted != m_receivedPacketList.end (),
+                 "No packet was inserted yet");
+  return m_lastInserted->second;
+}
+
 EndDeviceStatus::ReceivedPacketInfo
 EndDeviceStatus::GetLastReceivedPacketInfo (void)
 {
@@ -171,6 +171,7 @@ public:
     GatewayList gwList;      //!< List of gateways that received this packet.
     uint8_t sf;
     double frequency;
+    bool adr = false;        //!< Whether the ADR bit of the packet was set
   };
 
   typedef std::list<std::pair<Ptr<Packet const>, ReceivedPacketInfo> >
@@ -217,9 +218,9 @@ public:
   /**
    * Get the received packet list.
    *
-   * \return The received packet list.
+   * \return A reference to the received packet list.
    */
-  ReceivedPacketList GetReceivedPacketList (void);
+  const ReceivedPacketList & GetReceivedPacketList (void);
 
   /**
    * Set the spreading factor this device is using in the first receive window.
@@ -268,6 +269,19 @@ public:
   void InsertReceivedPacket (Ptr<Packet const> receivedPacket,
                              const Address& gwAddress);
 
+  /**
+   * Whether the packet given to the last InsertReceivedPacket call was
+   * received for the first time, rather than being another gateway's copy of
+   * a packet that was already in the list.
+   */
+  bool IsLastInsertionNew (void) const;
+
+  /**
+   * Get the entry of the received packet list that the last
+   * InsertReceivedPacket call added or updated.
+   */
+  const ReceivedPacketInfo & GetLastInsertedPacketInfo (void) const;
+
   /**
    * Return the last packet that was received from this device.
    */
@@ -313,6 +327,8 @@ private:
   double m_secondReceiveWindowFrequency = 869.525;
 
   ReceivedPacketList m_receivedPacketList;   //<! List of received packets
+  ReceivedPacketList::iterator m_lastInserted;   //<! Entry of the last insertion
+  bool m_lastInsertionNew = false;   //<! Whether the last insertion added an entry
 
   // NOTE Using this attribute is 'cheating', since we are assuming perfect
   // synchronization between the info at the device and at the network server
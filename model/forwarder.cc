@@ -20,6 +20,11 @@
 
 #include "ns3/forwarder.h"
 #include "ns3/log.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/abort.h"
+
+#include <algorithm>
 
 namespace ns3 {
 namespace lorawan {
@@ -38,7 +43,8 @@ Forwarder::GetTypeId (void)
   return tid;
 }
 
-Forwarder::Forwarder ()
+Forwarder::Forwarder () :
+  m_directBackhaul (false)
 {
   NS_LOG_FUNCTION_NOARGS ();
 }
@@ -54,7 +60,75 @@ Forwarder::SetPointToPointNetDevice (Ptr<PointToPointNetDevice>
 {
   NS_LOG_FUNCTION (this << pointToPointNetDevice);
 
-  m_pointToPointNetDevice = pointToPointNetDevice;
+  m_backhaulNetDevices.clear ();
+  m_backhaulNetDevices.push_back (pointToPointNetDevice);
+  m_directBackhaul = false;
+}
+
+void
+Forwarder::AddPointToPointNetDevice (Ptr<PointToPointNetDevice>
+                                     pointToPointNetDevice)
+{
+  NS_LOG_FUNCTION (this << pointToPointNetDevice);
+
+  NS_ASSERT_MSG (!m_directBackhaul, "Can't mix P2P and direct backhaul devices");
+
+  m_backhaulNetDevices.push_back (pointToPointNetDevice);
+}
+
+void
+Forwarder::AddDirectBackhaulNetDevice (Ptr<DirectBackhaulNetDevice>
+                                       directBackhaulNetDevice)
+{
+  NS_LOG_FUNCTION (this << directBackhaulNetDevice);
+  NS_ASSERT_MSG (m_directBackhaul || m_backhaulNetDevices.empty (),
+                 "Can't mix P2P and direct backhaul devices");
+
+  m_backhaulNetDevices.push_back (directBackhaulNetDevice);
+  m_directBackhaul = true;
+}
+
+void
+Forwarder::SetShardBoundaries (std::vector<LoraDeviceAddress> shardBoundaries)
+{
+  NS_LOG_FUNCTION (this << shardBoundaries.size ());
+
+  m_shardBoundaries = shardBoundaries;
+}
+
+Ptr<NetDevice>
+Forwarder::GetShardNetDevice (Ptr<const Packet> packet)
+{
+  NS_ASSERT (!m_backhaulNetDevices.empty ());
+
+  // Avoid parsing the headers if there is a single NS
+  if (m_backhaulNetDevices.size () == 1)
+    {
+      return m_backhaulNetDevices.front ();
+    }
+  NS_ABORT_MSG_IF (m_shardBoundaries.size () + 1 != m_backhaulNetDevices.size (),
+                   "Connected to " << m_backhaulNetDevices.size () <<
+                   " NS shards, but given " << m_shardBoundaries.size () <<
+                   " shard boundaries: use ForwarderHelper::SetShardBoundaries");
+
+  Ptr<Packet> packetCopy = packet->Copy ();
+  LorawanMacHeader mHdr;
+  LoraFrameHeader fHdr;
+  fHdr.SetAsUplink ();
+  packetCopy->RemoveHeader (mHdr);
+  packetCopy->RemoveHeader (fHdr);
+
+  // The shard index is the number of boundaries not above the address
+  uint32_t shard = std::upper_bound (m_shardBoundaries.begin (),
+                                     m_shardBoundaries.end (),
+                                     fHdr.GetAddress ())
+    - m_shardBoundaries.begin ();
+
+  NS_LOG_DEBUG ("Routing packet from " << fHdr.GetAddress () <<
+                " to shard " << shard);
+  NS_ASSERT (shard < m_backhaulNetDevices.size ());
+
+  return m_backhaulNetDevices[shard];
 }
 
 void
@@ -71,11 +145,16 @@ Forwarder::ReceiveFromLora (Ptr<NetDevice> loraNetDevice, Ptr<const Packet>
 {
   NS_LOG_FUNCTION (this << packet << protocol << sender);
 
-  Ptr<Packet> packetCopy = packet->Copy ();
+  Ptr<NetDevice> backhaulNetDevice = GetShardNetDevice (packet);
+
+  // The gateway MAC already gave us a private copy of the packet, and a
+  // direct backhaul never modifies it, so there's no need for another one
+  Ptr<Packet> packetCopy = m_directBackhaul ? ConstCast<Packet> (packet) :
+    packet->Copy ();
 
-  m_pointToPointNetDevice->Send (packetCopy,
-                                 m_pointToPointNetDevice->GetBroadcast (),
-                                 0x800);
+  backhaulNetDevice->Send (packetCopy,
+                           backhaulNetDevice->GetBroadcast (),
+                           0x800);
 
   return true;
 }
@@ -87,7 +166,10 @@ Forwarder::ReceiveFromPointToPoint (Ptr<NetDevice> pointToPointNetDevice,
 {
   NS_LOG_FUNCTION (this << packet << protocol << sender);
 
-  Ptr<Packet> packetCopy = packet->Copy ();
+  // Replies coming through a direct backhaul are built by the NS for this
+  // transmission only, so we can send them as they are
+  Ptr<Packet> packetCopy = m_directBackhaul ? ConstCast<Packet> (packet) :
+    packet->Copy ();
 
   m_loraNetDevice->Send (packetCopy);
 
@@ -24,8 +24,12 @@
 #include "ns3/application.h"
 #include "ns3/lora-net-device.h"
 #include "ns3/point-to-point-net-device.h"
+#include "ns3/direct-backhaul-net-device.h"
 #include "ns3/nstime.h"
 #include "ns3/attribute.h"
+#include "ns3/lora-device-address.h"
+
+#include <vector>
 
 namespace ns3 {
 namespace lorawan {
@@ -33,6 +37,9 @@ namespace lorawan {
 /**
  * This application forwards packets between NetDevices:
  * LoraNetDevice -> PointToPointNetDevice and vice versa.
+ *
+ * The NS can also be reached through DirectBackhaulNetDevices, in which case
+ * packets are forwarded without being copied.
  */
 class Forwarder : public Application
 {
@@ -56,6 +63,30 @@ public:
    */
   void SetPointToPointNetDevice (Ptr<PointToPointNetDevice> pointToPointNetDevice);
 
+  /**
+   * Adds a P2P device to use to communicate with a further shard of a
+   * sharded NS. Devices must be added in shard order.
+   *
+   * \param pointToPointNetDevice The P2PNetDevice connected to the shard.
+   */
+  void AddPointToPointNetDevice (Ptr<PointToPointNetDevice> pointToPointNetDevice);
+
+  /**
+   * Adds an in-process device to use to communicate with the NS (or with a
+   * further shard of a sharded NS). Devices must be added in shard order.
+   *
+   * \param directBackhaulNetDevice The DirectBackhaulNetDevice on this node.
+   */
+  void AddDirectBackhaulNetDevice (Ptr<DirectBackhaulNetDevice> directBackhaulNetDevice);
+
+  /**
+   * Set the address ranges handled by the shards of a sharded NS.
+   *
+   * \param shardBoundaries The first device address managed by each shard,
+   * starting from the second one, in increasing order.
+   */
+  void SetShardBoundaries (std::vector<LoraDeviceAddress> shardBoundaries);
+
   /**
    * Receive a packet from the LoraNetDevice.
    *
@@ -86,11 +117,22 @@ public:
   void StopApplication (void);
 
 private:
+  /**
+   * Get the backhaul device leading to the NS shard that manages the device
+   * that sent an uplink packet.
+   */
+  Ptr<NetDevice> GetShardNetDevice (Ptr<const Packet> packet);
+
   Ptr<LoraNetDevice> m_loraNetDevice; //!< Pointer to the node's LoraNetDevice
 
-  Ptr<PointToPointNetDevice> m_pointToPointNetDevice; //!< Pointer to the
-  //!P2PNetDevice we use to
-  //!communicate with the NS
+  std::vector<Ptr<NetDevice> > m_backhaulNetDevices; //!< NetDevices we use
+  //!to communicate with the NS, one per shard
+
+  bool m_directBackhaul; //!< Whether the backhaul devices are
+  //!DirectBackhaulNetDevices, which don't need us to copy packets
+
+  std::vector<LoraDeviceAddress> m_shardBoundaries; //!< First address of
+  //!each shard but the first one
 };
 
 } //namespace ns3
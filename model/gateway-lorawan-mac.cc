@@ -75,14 +75,7 @@ GatewayLorawanMac::Send (Ptr<Packet> packet)
       return;
     }
 
-  LoraTxParameters params;
-  params.sf = GetSfFromDataRate (dataRate);
-  params.headerDisabled = false;
-  params.codingRate = 1;
-  params.bandwidthHz = GetBandwidthFromDataRate (dataRate);
-  params.nPreamble = 8;
-  params.crcEnabled = 1;
-  params.lowDataRateOptimizationEnabled = 0;
+  LoraTxParameters params = GetTxParameters (dataRate);
 
   // Get the duration
   Time duration = m_phy->GetOnAirTime (packet, params);
@@ -103,6 +96,30 @@ GatewayLorawanMac::Send (Ptr<Packet> packet)
   m_sentNewPacket (packet);
 }
 
+Time
+GatewayLorawanMac::GetOnAirTime (Ptr<Packet> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  LoraTag tag;
+  packet->PeekPacketTag (tag);
+  return m_phy->GetOnAirTime (packet, GetTxParameters (tag.GetDataRate ()));
+}
+
+LoraTxParameters
+GatewayLorawanMac::GetTxParameters (uint8_t dataRate)
+{
+  LoraTxParameters params;
+  params.sf = GetSfFromDataRate (dataRate);
+  params.headerDisabled = false;
+  params.codingRate = 1;
+  params.bandwidthHz = GetBandwidthFromDataRate (dataRate);
+  params.nPreamble = 8;
+  params.crcEnabled = 1;
+  params.lowDataRateOptimizationEnabled = 0;
+  return params;
+}
+
 bool
 GatewayLorawanMac::IsTransmitting (void)
 {
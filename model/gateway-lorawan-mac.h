@@ -56,7 +56,17 @@ public:
    * \return The next transmission time.
    */
   Time GetWaitingTime (double frequency);
+
+  /**
+   * Return how long the transmission of a packet would last, with the data
+   * rate of its LoraTag.
+   */
+  Time GetOnAirTime (Ptr<Packet> packet);
 private:
+  /**
+   * Get the transmission parameters the gateway uses for a data rate.
+   */
+  LoraTxParameters GetTxParameters (uint8_t dataRate);
 protected:
 };
 
@@ -20,6 +20,7 @@
 
 #include "ns3/gateway-status.h"
 #include "ns3/log.h"
+#include "ns3/simulator.h"
 
 namespace ns3 {
 namespace lorawan {
@@ -36,7 +37,10 @@ GatewayStatus::GetTypeId (void)
 }
 
 
-GatewayStatus::GatewayStatus ()
+GatewayStatus::GatewayStatus () :
+  m_nextTransmissionTime (std::make_shared<Time> (Seconds (0))),
+  m_bookingsShared (false),
+  m_backhaulDelay (Seconds (0))
 {
   NS_LOG_FUNCTION (this);
 }
@@ -51,7 +55,9 @@ GatewayStatus::GatewayStatus (Address address, Ptr<NetDevice> netDevice,
   m_address (address),
   m_netDevice (netDevice),
   m_gatewayMac (gwMac),
-  m_nextTransmissionTime (Seconds (0))
+  m_nextTransmissionTime (std::make_shared<Time> (Seconds (0))),
+  m_bookingsShared (false),
+  m_backhaulDelay (Seconds (0))
 {
   NS_LOG_FUNCTION (this);
 }
@@ -96,7 +102,7 @@ GatewayStatus::IsAvailableForTransmission (double frequency)
   // We can't send multiple packets at once, see SX1301 V2.01 page 29
 
   // Check that the gateway was not already "booked"
-  if (m_nextTransmissionTime > Simulator::Now () - MilliSeconds (1))
+  if (*m_nextTransmissionTime > Simulator::Now () - MilliSeconds (1))
     {
       NS_LOG_INFO ("This gateway is already booked for a transmission");
       return false;
@@ -126,7 +132,40 @@ GatewayStatus::IsAvailableForTransmission (double frequency)
 void
 GatewayStatus::SetNextTransmissionTime (Time nextTransmissionTime)
 {
-  m_nextTransmissionTime = nextTransmissionTime;
+  *m_nextTransmissionTime = nextTransmissionTime;
+}
+
+void
+GatewayStatus::ShareBookings (Ptr<GatewayStatus> other)
+{
+  NS_LOG_FUNCTION (this << other);
+
+  m_nextTransmissionTime = other->m_nextTransmissionTime;
+  m_bookingsShared = true;
+  other->m_bookingsShared = true;
+}
+
+bool
+GatewayStatus::AreBookingsShared (void) const
+{
+  return m_bookingsShared;
+}
+
+void
+GatewayStatus::SetBackhaulDelay (Time backhaulDelay)
+{
+  NS_LOG_FUNCTION (this << backhaulDelay);
+
+  m_backhaulDelay = backhaulDelay;
+}
+
+void
+GatewayStatus::BookTransmission (Ptr<Packet> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  *m_nextTransmissionTime = Simulator::Now () + m_backhaulDelay +
+    m_gatewayMac->GetOnAirTime (packet);
 }
 }
 }
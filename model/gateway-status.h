@@ -26,6 +26,8 @@
 #include "ns3/net-device.h"
 #include "ns3/gateway-lorawan-mac.h"
 
+#include <memory>
+
 namespace ns3 {
 namespace lorawan {
 
@@ -81,6 +83,32 @@ public:
   void SetNextTransmissionTime (Time nextTransmissionTime);
   // Time GetNextTransmissionTime (void);
 
+  /**
+   * Share the transmission bookings of another GatewayStatus of the same
+   * gateway, so that the shards of a sharded NS, which each keep their own
+   * GatewayStatus, don't book the gateway for overlapping transmissions.
+   */
+  void ShareBookings (Ptr<GatewayStatus> other);
+
+  /**
+   * Whether the bookings of this status are shared with other statuses of
+   * the same gateway.
+   */
+  bool AreBookingsShared (void) const;
+
+  /**
+   * Set the delay of the link from the server to this gateway.
+   */
+  void SetBackhaulDelay (Time backhaulDelay);
+
+  /**
+   * Book the gateway until the end of the transmission of a packet sent now,
+   * i.e. for the backhaul delay plus the time on air of the packet.
+   *
+   * \param packet The packet, tagged with the LoraTag it will be sent with.
+   */
+  void BookTransmission (Ptr<Packet> packet);
+
 private:
   Address m_address;   //!< The Address of the P2PNetDevice of this gateway
 
@@ -88,7 +116,12 @@ private:
 
   Ptr<GatewayLorawanMac> m_gatewayMac;     //!< The Mac layer of the gateway
 
-  Time m_nextTransmissionTime;   //!< This gateway's next transmission time
+  std::shared_ptr<Time> m_nextTransmissionTime;   //!< This gateway's next
+  //!transmission time, shared with the other statuses of the gateway
+
+  bool m_bookingsShared;   //!< Whether m_nextTransmissionTime is shared
+
+  Time m_backhaulDelay;   //!< The delay of the link to the gateway
 };
 }
 
@@ -19,6 +19,9 @@
 #include "ns3/log.h"
 #include "ns3/hex-grid-position-allocator.h"
 #include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include <cstdlib>
+#include <unordered_set>
 
 namespace ns3 {
 
@@ -36,44 +39,32 @@ namespace ns3 {
       .AddAttribute ("Radius", "The radius of a single hexagon",
                      DoubleValue (6000),
                      MakeDoubleAccessor (&HexGridPositionAllocator::m_radius),
-                     MakeDoubleChecker<double> ());
+                     MakeDoubleChecker<double> ())
+      .AddAttribute ("Sectors",
+                     "The number of angular sectors sites are assigned to",
+                     UintegerValue (6),
+                     MakeUintegerAccessor (&HexGridPositionAllocator::m_sectors),
+                     MakeUintegerChecker<uint32_t> (1));
 
     return tid;
   }
 
   HexGridPositionAllocator::HexGridPositionAllocator () :
+    m_sectors (6),
     m_radius (6000)
   {
     NS_LOG_FUNCTION_NOARGS ();
 
-    // Create the first position
-    m_positions.push_back (Vector (0.0,0.0,0.0));
-
-    // Add rings
-    for (int i = 0; i < 20; i++) {
-      m_positions = AddRing(m_positions);
-    }
-
-    // Set the iterator
-    m_next = m_positions.begin();
+    Reset ();
   }
 
   HexGridPositionAllocator::HexGridPositionAllocator (double radius) :
+    m_sectors (6),
     m_radius (radius)
   {
     NS_LOG_FUNCTION_NOARGS ();
 
-    // Create the first position
-    m_positions.push_back (Vector (0.0,0.0,0.0));
-
-    // Add a couple rings
-    // Add rings
-    for (int i = 0; i < 20; i++) {
-      m_positions = AddRing(m_positions);
-    }
-
-    // Set the iterator
-    m_next = m_positions.begin();
+    Reset ();
   }
 
   HexGridPositionAllocator::~HexGridPositionAllocator ()
@@ -93,15 +84,41 @@ namespace ns3 {
   HexGridPositionAllocator::SetRadius (double radius)
   {
     m_radius = radius;
+    Reset ();
+  }
+
+  void
+  HexGridPositionAllocator::Reset (void)
+  {
+    NS_LOG_FUNCTION (this);
+
+    // The first ring is the center of the grid
+    HexGridSite center;
+    center.position = Vector (0.0,0.0,0.0);
+    center.ring = 0;
+    center.q = 0;
+    center.r = 0;
+    center.sector = 0;
+
+    m_ring.assign (1, center);
+    m_next = 0;
   }
 
   Vector
   HexGridPositionAllocator::GetNext (void) const
   {
-    // TODO: Check that there is a next element
-    Vector position = *m_next;
-    m_next++;
-    return position;
+    return GetNextSite ().position;
+  }
+
+  HexGridSite
+  HexGridPositionAllocator::GetNextSite (void) const
+  {
+    if (m_next == m_ring.size ())
+      {
+        m_ring = AddRing (m_ring);
+        m_next = 0;
+      }
+    return m_ring[m_next++];
   }
 
   int64_t
@@ -110,52 +127,96 @@ namespace ns3 {
     return 0;
   }
 
-  std::vector<Vector>
-  HexGridPositionAllocator::AddRing (std::vector<Vector> positions)
+  std::vector<HexGridSite>
+  HexGridPositionAllocator::AddRing (const std::vector<HexGridSite> &ring) const
   {
     NS_LOG_FUNCTION (this);
 
-    // Make a copy of the vector
-    std::vector<Vector> copy = positions;
+    // Axial coordinates of the 6 surrounding positions, in the order of the
+    // angles below
+    const int32_t dq[6] = {1, 0, -1, -1, 0, 1};
+    const int32_t dr[6] = {0, 1, 1, 0, -1, -1};
 
-    // Iterate on the given vector
-    for (std::vector<Vector>::iterator it = positions.begin ();
-         it != positions.end (); it++)
+    // The angle is with respect to a vertical line
+    double dx[6];
+    double dy[6];
+    int n = 0;
+    for (double angle = 0; angle < 2*pi && n < 6; angle+=pi/3)
       {
-        // Get the current position
-        Vector currentPosition = *it;
-        NS_LOG_DEBUG ("Current position " << currentPosition);
-
-        // Iterate to create the 6 surrounding positions
-        // The angle is with respect to a vertical line
-        Vector newPosition;
-        for (double angle = 0; angle < 2*pi; angle+=pi/3)
+        dx[n] = 2*m_radius*std::sin(angle);
+        dy[n] = 2*m_radius*std::cos(angle);
+        n++;
+      }
+
+    uint32_t newRing = ring.front ().ring + 1;
+    std::vector<HexGridSite> next;
+    next.reserve (6 * newRing);
+    std::unordered_set<uint64_t> found;
+
+    // Sites of the outer ring are the neighbors of the current one that are
+    // one step further from the center, in the order they are met
+    for (const HexGridSite &current : ring)
+      {
+        NS_LOG_DEBUG ("Current position " << current.position);
+
+        for (int i = 0; i < 6; i++)
           {
-            newPosition = Vector (currentPosition.x+2*m_radius*std::sin(angle),
-                                  currentPosition.y+2*m_radius*std::cos(angle),
-                                  currentPosition.z);
-            NS_LOG_DEBUG ("New position: " << newPosition);
-
-            // If the newly created position is not already in the copy, add it
-            bool found = false;
-            for (std::vector<Vector>::iterator it = copy.begin ();
-                 it != copy.end (); it++)
+            int32_t q = current.q + dq[i];
+            int32_t r = current.r + dr[i];
+            if (uint32_t ((std::abs (q) + std::abs (r) + std::abs (q + r)) / 2)
+                != newRing)
               {
-                // If the vector is already in the vector
-                // 1 is an EPSILON used to determine whether two floats are equal
-                if (CalculateDistance(newPosition, *it) < 10)
-                  {
-                    found = true;
-                    break;
-                  }
+                continue;
               }
-            if (found == false)
+            uint64_t key = (uint64_t (uint32_t (q)) << 32) | uint32_t (r);
+            if (!found.insert (key).second)
               {
-                NS_LOG_DEBUG ("Adding position " << newPosition);
-                copy.push_back (newPosition);
+                continue;
               }
+
+            HexGridSite site;
+            site.position = Vector (current.position.x+dx[i],
+                                    current.position.y+dy[i],
+                                    current.position.z);
+            site.ring = newRing;
+            site.q = q;
+            site.r = r;
+            site.sector = GetSector (q, r, newRing);
+            NS_LOG_DEBUG ("Adding position " << site.position);
+            next.push_back (site);
+          }
+      }
+    return next;
+  }
+
+  uint32_t
+  HexGridPositionAllocator::GetSector (int32_t q, int32_t r, uint32_t ring) const
+  {
+    if (ring == 0)
+      {
+        return 0;
+      }
+
+    // Side i of the ring goes from corner ring * d(i) towards corner
+    // ring * d(i+1), one step of d(i+2) at a time
+    const int32_t dq[6] = {1, 0, -1, -1, 0, 1};
+    const int32_t dr[6] = {0, 1, 1, 0, -1, -1};
+    int32_t k = ring;
+    uint32_t index = 0;
+    for (int i = 0; i < 6; i++)
+      {
+        int32_t offsetQ = q - k * dq[i];
+        int32_t offsetR = r - k * dr[i];
+        int32_t sq = dq[(i + 2) % 6];
+        int32_t sr = dr[(i + 2) % 6];
+        // The step is never (0, 0), so one of its coordinates gives j
+        int32_t j = sq != 0 ? offsetQ / sq : offsetR / sr;
+        if (j >= 0 && j < k && offsetQ == j * sq && offsetR == j * sr)
+          {
+            index = i * ring + j;
+            break;
           }
       }
-    return copy;
+    return uint64_t (index) * m_sectors / (6 * ring);
   }
 } // namespace ns3
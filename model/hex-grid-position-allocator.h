@@ -21,9 +21,30 @@
 
 #include "ns3/position-allocator.h"
 #include <cmath>
+#include <vector>
 
 namespace ns3 {
 
+  /**
+   * A site of the hexagonal grid, with the metadata needed to split the grid
+   * among the shards of a simulation.
+   */
+  struct HexGridSite
+  {
+    Vector position; //!< The position of the site
+    uint32_t ring; //!< The ring the site is in, 0 being the center
+    int32_t q; //!< First axial coordinate of the site
+    int32_t r; //!< Second axial coordinate of the site
+    uint32_t sector; //!< The angular sector of the grid the site is in
+  };
+
+  /**
+   * Allocate positions on a hexagonal grid, starting from the origin and
+   * going outwards one ring at a time.
+   *
+   * Rings are generated when the previous one has been returned, so that
+   * there is no limit to the number of positions.
+   */
   class HexGridPositionAllocator : public PositionAllocator
   {
   public:
@@ -40,24 +61,57 @@ namespace ns3 {
 
     double GetRadius (void);
 
+    /**
+     * Set the radius of a cell, and start again from the center of the grid.
+     */
     void SetRadius (double radius);
 
+    /**
+     * Get the next site of the grid, together with its metadata.
+     *
+     * GetNext returns the position of the same site.
+     */
+    HexGridSite GetNextSite (void) const;
+
+    /**
+     * Start again from the center of the grid.
+     */
+    void Reset (void);
+
   private:
     /**
-     * This method adds to the given list of positions an outer ring of positions
-     * \param position the list of position around which to create the other positions
+     * Build the ring surrounding the given one.
+     *
+     * Positions are computed from the ones of the given ring, and new sites are
+     * told apart from the ones already returned by their axial coordinates.
+     *
+     * \param ring the sites of the current outer ring
+     * \return the sites of the next ring
+     */
+    std::vector<HexGridSite> AddRing (const std::vector<HexGridSite> &ring) const;
+
+    /**
+     * Compute the sector of a site.
+     *
+     * Sites of a ring are numbered going around it, and each sector takes the
+     * same share of every ring.
+     */
+    uint32_t GetSector (int32_t q, int32_t r, uint32_t ring) const;
+
+    /**
+     * The sites of the current outer ring
      */
-    std::vector<Vector> AddRing (std::vector<Vector> positions);
+    mutable std::vector<HexGridSite> m_ring;
 
     /**
-     * The list of current positions
+     * The index in m_ring of the next site to return
      */
-    std::vector<Vector> m_positions;
+    mutable uint32_t m_next;
 
     /**
-     * The iterator pointing to the next position to return
+     * The number of angular sectors the grid is split in
      */
-    mutable std::vector<Vector>::const_iterator m_next;
+    uint32_t m_sectors;
 
     /**
      * The radius of a cell (defined as the half the distance between two
@@ -70,4 +124,4 @@ namespace ns3 {
 
 } // namespace ns3
 
-#endif /* PERIODIC_SENDER_HELPER_H */
+#endif /* HEX_GRID_POSITION_ALLOCATOR_H */
@@ -26,7 +26,18 @@
 #include "ns3/simulator.h"
 #include "ns3/end-device-lora-phy.h"
 #include "ns3/gateway-lora-phy.h"
+#include "ns3/building-list.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/lora-utils.h"
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace ns3 {
 namespace lorawan {
@@ -35,6 +46,18 @@ NS_LOG_COMPONENT_DEFINE ("LoraChannel");
 
 NS_OBJECT_ENSURE_REGISTERED (LoraChannel);
 
+/**
+ * The magic number and version of link budget files.
+ *
+ * A link budget file is a 24 bytes header (magic, version, 64 bit key,
+ * number of PHYs and 4 bytes of padding), followed by the gains of all the
+ * links as doubles and then by their delays as 64 bit time steps, both
+ * indexed by sender * number of PHYs + receiver, in host byte order.
+ */
+static const uint32_t LINK_BUDGET_MAGIC = 0x4c4c4246; // "LLBF"
+static const uint32_t LINK_BUDGET_VERSION = 1;
+static const size_t LINK_BUDGET_HEADER_SIZE = 24;
+
 TypeId
 LoraChannel::GetTypeId (void)
 {
@@ -59,19 +82,30 @@ LoraChannel::GetTypeId (void)
   return tid;
 }
 
-LoraChannel::LoraChannel ()
+LoraChannel::LoraChannel () :
+  m_linkBudgetData (0),
+  m_linkBudgetSize (0),
+  m_linkBudgetPhys (0),
+  m_linkGains (0),
+  m_linkDelays (0)
 {
 }
 
 LoraChannel::~LoraChannel ()
 {
+  DisableLinkBudgetCache ();
   m_phyList.clear ();
 }
 
 LoraChannel::LoraChannel (Ptr<PropagationLossModel> loss,
                           Ptr<PropagationDelayModel> delay) :
   m_loss (loss),
-  m_delay (delay)
+  m_delay (delay),
+  m_linkBudgetData (0),
+  m_linkBudgetSize (0),
+  m_linkBudgetPhys (0),
+  m_linkGains (0),
+  m_linkDelays (0)
 {
 }
 
@@ -91,6 +125,9 @@ LoraChannel::Remove (Ptr<LoraPhy> phy)
 
   // Remove the phy from the vector
   m_phyList.erase (find (m_phyList.begin (), m_phyList.end (), phy));
+
+  // The cache is indexed by position in the vector
+  DisableLinkBudgetCache ();
 }
 
 std::size_t
@@ -121,6 +158,13 @@ LoraChannel::Send (Ptr< LoraPhy > sender, Ptr< Packet > packet,
   NS_LOG_INFO ("Starting cycle over all " << m_phyList.size () << " PHYs");
   NS_LOG_INFO ("Sender mobility: " << senderMobility->GetPosition ());
 
+  // The position of the sender in the link budget file, if it's there
+  uint32_t senderIndex = m_linkBudgetPhys;
+  if (m_linkBudgetData)
+    {
+      senderIndex = find (m_phyList.begin (), m_phyList.end (), sender) - m_phyList.begin ();
+    }
+
   // Cycle over all registered PHYs
   uint32_t j = 0;
   std::vector<Ptr<LoraPhy> >::const_iterator i;
@@ -136,12 +180,24 @@ LoraChannel::Send (Ptr< LoraPhy > sender, Ptr< Packet > packet,
           NS_LOG_INFO ("Receiver mobility: " <<
                        receiverMobility->GetPosition ());
 
-          // Compute delay using the delay model
-          Time delay = m_delay->GetDelay (senderMobility, receiverMobility);
+          Time delay;
+          double rxPowerDbm;
+          if (senderIndex < m_linkBudgetPhys && j < m_linkBudgetPhys)
+            {
+              // Use the stored link budget
+              uint64_t link = GetLinkIndex (senderIndex, j);
+              delay = TimeStep (m_linkDelays[link]);
+              rxPowerDbm = txPowerDbm + m_linkGains[link];
+            }
+          else
+            {
+              // Compute delay using the delay model
+              delay = m_delay->GetDelay (senderMobility, receiverMobility);
 
-          // Compute received power using the loss model
-          double rxPowerDbm = GetRxPower (txPowerDbm, senderMobility,
-                                          receiverMobility);
+              // Compute received power using the loss model
+              rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility,
+                                                receiverMobility);
+            }
 
           NS_LOG_DEBUG ("Propagation: txPower=" << txPowerDbm <<
                         "dbm, rxPower=" << rxPowerDbm << "dbm, " <<
@@ -195,9 +251,197 @@ double
 LoraChannel::GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
                          Ptr<MobilityModel> receiverMobility) const
 {
+  if (m_linkBudgetData)
+    {
+      auto sender = m_linkBudgetIndex.find (PeekPointer (senderMobility));
+      auto receiver = m_linkBudgetIndex.find (PeekPointer (receiverMobility));
+      if (sender != m_linkBudgetIndex.end () && receiver != m_linkBudgetIndex.end ())
+        {
+          return txPowerDbm + m_linkGains[GetLinkIndex (sender->second, receiver->second)];
+        }
+    }
   return m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
 }
 
+uint64_t
+LoraChannel::GetLinkIndex (uint32_t sender, uint32_t receiver) const
+{
+  return uint64_t (sender) * m_linkBudgetPhys + receiver;
+}
+
+uint64_t
+LoraChannel::GetLinkBudgetKey (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  uint64_t hash = HASH_OFFSET_BASIS;
+
+  uint32_t nPhys = m_phyList.size ();
+  HashBytes (hash, &nPhys, sizeof (nPhys));
+  for (uint32_t i = 0; i < nPhys; i++)
+    {
+      Vector position = m_phyList[i]->GetMobility ()->GetObject<MobilityModel> ()->GetPosition ();
+      HashBytes (hash, &position.x, sizeof (position.x));
+      HashBytes (hash, &position.y, sizeof (position.y));
+      HashBytes (hash, &position.z, sizeof (position.z));
+    }
+
+  for (BuildingList::Iterator it = BuildingList::Begin (); it != BuildingList::End (); ++it)
+    {
+      Box boundaries = (*it)->GetBoundaries ();
+      HashBytes (hash, &boundaries, sizeof (boundaries));
+      uint16_t floors = (*it)->GetNFloors ();
+      HashBytes (hash, &floors, sizeof (floors));
+    }
+
+  for (Ptr<PropagationLossModel> loss = m_loss; loss != 0; loss = loss->GetNext ())
+    {
+      HashAttributes (hash, loss);
+    }
+  HashAttributes (hash, m_delay);
+
+  uint32_t seed = RngSeedManager::GetSeed ();
+  uint64_t run = RngSeedManager::GetRun ();
+  int resolution = Time::GetResolution ();
+  HashBytes (hash, &seed, sizeof (seed));
+  HashBytes (hash, &run, sizeof (run));
+  HashBytes (hash, &resolution, sizeof (resolution));
+
+  return hash;
+}
+
+bool
+LoraChannel::MapLinkBudgets (std::string filename, uint64_t key)
+{
+  NS_LOG_FUNCTION (this << filename << key);
+
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) < 0 || size_t (st.st_size) < LINK_BUDGET_HEADER_SIZE)
+    {
+      close (fd);
+      return false;
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_LOG_ERROR ("Can't map " << filename);
+      return false;
+    }
+
+  const char *bytes = static_cast<const char *> (data);
+  uint32_t magic, version, nPhys;
+  uint64_t fileKey;
+  std::memcpy (&magic, bytes, 4);
+  std::memcpy (&version, bytes + 4, 4);
+  std::memcpy (&fileKey, bytes + 8, 8);
+  std::memcpy (&nPhys, bytes + 16, 4);
+  uint64_t nLinks = uint64_t (nPhys) * nPhys;
+  if (magic != LINK_BUDGET_MAGIC || version != LINK_BUDGET_VERSION
+      || fileKey != key || nPhys != m_phyList.size ()
+      || LINK_BUDGET_HEADER_SIZE + nLinks * 16 != uint64_t (st.st_size))
+    {
+      NS_LOG_INFO (filename << " holds the link budgets of another scenario");
+      munmap (data, st.st_size);
+      return false;
+    }
+
+  m_linkBudgetData = bytes;
+  m_linkBudgetSize = st.st_size;
+  m_linkBudgetPhys = nPhys;
+  m_linkGains = reinterpret_cast<const double *> (bytes + LINK_BUDGET_HEADER_SIZE);
+  m_linkDelays = reinterpret_cast<const int64_t *> (bytes + LINK_BUDGET_HEADER_SIZE
+                                                    + nLinks * 8);
+  m_linkBudgetIndex.clear ();
+  for (uint32_t i = 0; i < nPhys; i++)
+    {
+      m_linkBudgetIndex[PeekPointer (m_phyList[i]->GetMobility ()->GetObject<MobilityModel> ())] = i;
+    }
+  return true;
+}
+
+bool
+LoraChannel::EnableLinkBudgetCache (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  DisableLinkBudgetCache ();
+
+  uint64_t key = GetLinkBudgetKey ();
+  if (MapLinkBudgets (filename, key))
+    {
+      NS_LOG_INFO ("Loaded the link budgets of " << m_linkBudgetPhys <<
+                   " PHYs from " << filename);
+      return true;
+    }
+
+  // Compute the budgets of all the links, sender by sender
+  uint32_t nPhys = m_phyList.size ();
+  std::vector<double> gains (nPhys);
+  std::vector<int64_t> delays (uint64_t (nPhys) * nPhys);
+  std::string tmpFilename = filename + ".tmp";
+  std::ofstream file (tmpFilename.c_str (), std::ios::binary | std::ios::trunc);
+  uint32_t padding = 0;
+  file.write (reinterpret_cast<const char *> (&LINK_BUDGET_MAGIC), 4);
+  file.write (reinterpret_cast<const char *> (&LINK_BUDGET_VERSION), 4);
+  file.write (reinterpret_cast<const char *> (&key), 8);
+  file.write (reinterpret_cast<const char *> (&nPhys), 4);
+  file.write (reinterpret_cast<const char *> (&padding), 4);
+  for (uint32_t i = 0; i < nPhys; i++)
+    {
+      Ptr<MobilityModel> senderMobility = m_phyList[i]->GetMobility ()->GetObject<MobilityModel> ();
+      for (uint32_t j = 0; j < nPhys; j++)
+        {
+          Ptr<MobilityModel> receiverMobility =
+            m_phyList[j]->GetMobility ()->GetObject<MobilityModel> ();
+          gains[j] = m_loss->CalcRxPower (0, senderMobility, receiverMobility);
+          delays[uint64_t (i) * nPhys + j] =
+            m_delay->GetDelay (senderMobility, receiverMobility).GetTimeStep ();
+        }
+      file.write (reinterpret_cast<const char *> (gains.data ()), gains.size () * 8);
+    }
+  file.write (reinterpret_cast<const char *> (delays.data ()), delays.size () * 8);
+  file.close ();
+  if (!file || std::rename (tmpFilename.c_str (), filename.c_str ()) != 0)
+    {
+      NS_LOG_ERROR ("Can't write link budget file " << filename);
+      std::remove (tmpFilename.c_str ());
+      return false;
+    }
+
+  NS_LOG_INFO ("Wrote the link budgets of " << nPhys << " PHYs to " << filename);
+  MapLinkBudgets (filename, key);
+  return false;
+}
+
+bool
+LoraChannel::IsLinkBudgetCacheEnabled (void) const
+{
+  return m_linkBudgetData != 0;
+}
+
+void
+LoraChannel::DisableLinkBudgetCache (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_linkBudgetData)
+    {
+      munmap (const_cast<char *> (m_linkBudgetData), m_linkBudgetSize);
+    }
+  m_linkBudgetData = 0;
+  m_linkBudgetSize = 0;
+  m_linkBudgetPhys = 0;
+  m_linkGains = 0;
+  m_linkDelays = 0;
+  m_linkBudgetIndex.clear ();
+}
+
 std::ostream &operator << (std::ostream &os, const LoraChannelParameters &params)
 {
   os << "(rxPowerDbm: " << params.rxPowerDbm << ", SF: " << unsigned(params.sf) <<
@@ -25,6 +25,8 @@
 #define LORA_CHANNEL_H
 
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include "ns3/lora-phy.h"
 #include "ns3/mobility-model.h"
 #include "ns3/channel.h"
@@ -153,7 +155,78 @@ public:
   double GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
                      Ptr<MobilityModel> receiverMobility) const;
 
+  /**
+    * Keep the link budgets between the PHYs connected to the channel in a
+    * file, so that other runs of the same scenario can reuse them.
+    *
+    * The file is keyed by a hash of the positions of the PHYs, of the
+    * buildings, of the attributes of the loss and delay models, and of the
+    * RNG seed and run. If it holds the budgets of the same key, it is mapped
+    * in memory and used as is; otherwise, the budgets of all the pairs of
+    * PHYs are computed now and the file is written.
+    *
+    * From then on, transmissions between these PHYs and calls to GetRxPower
+    * use the stored gain and delay. This is only correct if nodes don't
+    * move, and it freezes the random terms of the loss models at their
+    * first draw, like BuildingPenetrationLoss::FreezeLinkDraws. Random
+    * variable streams must be assigned the same way in all runs, since they
+    * are not part of the key.
+    *
+    * Call this once all the PHYs are connected and all nodes and buildings
+    * are placed. PHYs added later are not cached; removing a PHY disables the
+    * cache.
+    *
+    * \param filename The file holding the link budgets.
+    * \returns True if the link budgets were loaded from the file.
+    */
+  bool EnableLinkBudgetCache (std::string filename);
+
+  /**
+    * Stop using the link budget cache, and unmap its file.
+    */
+  void DisableLinkBudgetCache (void);
+
+  /**
+    * Whether transmissions use the link budget cache.
+    */
+  bool IsLinkBudgetCacheEnabled (void) const;
+
 private:
+  /**
+    * Compute the key of the link budgets of the current scenario.
+    */
+  uint64_t GetLinkBudgetKey (void) const;
+
+  /**
+    * Map a link budget file, if it holds the budgets of a key.
+    *
+    * \returns False if the file can't be mapped or has another key.
+    */
+  bool MapLinkBudgets (std::string filename, uint64_t key);
+
+  /**
+    * Get the position of a link in the arrays of the link budget file.
+    */
+  uint64_t GetLinkIndex (uint32_t sender, uint32_t receiver) const;
+
+  /**
+    * The mapped link budget file, or 0 if the cache is disabled.
+    */
+  const char *m_linkBudgetData;
+
+  size_t m_linkBudgetSize; //!< The size of the link budget file
+
+  uint32_t m_linkBudgetPhys; //!< Number of PHYs in the link budget file
+
+  const double *m_linkGains; //!< Gain of each link in the file, in dB
+
+  const int64_t *m_linkDelays; //!< Delay of each link in the file, in time steps
+
+  /**
+    * Position of the cached PHYs in m_phyList, keyed by their mobility model.
+    */
+  std::unordered_map<const MobilityModel *, uint32_t> m_linkBudgetIndex;
+
   /**
     * Private method that is scheduled by LoraChannel's Send method to happen
     * after the channel delay, for each of the connected PHY layers.
@@ -233,6 +233,12 @@ LoraInterferenceHelper::GetInterferers ()
   return m_events;
 }
 
+uint32_t
+LoraInterferenceHelper::GetNEvents (void) const
+{
+  return m_events.size ();
+}
+
 void
 LoraInterferenceHelper::PrintEvents (std::ostream &stream)
 {
@@ -159,6 +159,12 @@ public:
    */
   std::list<Ptr<LoraInterferenceHelper::Event>> GetInterferers ();
 
+  /**
+   * Get the number of events currently registered at this
+   * LoraInterferenceHelper.
+   */
+  uint32_t GetNEvents (void) const;
+
   /**
    * Print the events that are saved in this helper in a human readable format.
    */
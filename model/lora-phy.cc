@@ -95,6 +95,12 @@ LoraPhy::SetDevice (Ptr<NetDevice> device)
   m_device = device;
 }
 
+uint32_t
+LoraPhy::GetNInterferenceEvents (void) const
+{
+  return m_interference.GetNEvents ();
+}
+
 Ptr<LoraChannel>
 LoraPhy::GetChannel (void) const
 {
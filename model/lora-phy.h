@@ -232,6 +232,12 @@ public:
    */
   void SetDevice (Ptr<NetDevice> device);
 
+  /**
+   * Get the number of events the LoraInterferenceHelper of this PHY is
+   * keeping track of.
+   */
+  uint32_t GetNInterferenceEvents (void) const;
+
   /**
    * Compute the time that a packet with certain characteristics will take to be
    * transmitted.
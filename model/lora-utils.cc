@@ -45,5 +45,51 @@ RatioToDb (double ratio)
   return 10.0 * std::log10 (ratio);
 }
 
+void
+HashBytes (uint64_t &hash, const void *data, size_t size)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *> (data);
+  for (size_t i = 0; i < size; i++)
+    {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+}
+
+void
+HashString (uint64_t &hash, std::string string)
+{
+  HashBytes (hash, string.c_str (), string.size () + 1);
+}
+
+void
+HashAttributes (uint64_t &hash, Ptr<Object> object)
+{
+  TypeId tid = object->GetInstanceTypeId ();
+  HashString (hash, tid.GetName ());
+  while (true)
+    {
+      for (uint32_t i = 0; i < tid.GetAttributeN (); i++)
+        {
+          struct TypeId::AttributeInformation info = tid.GetAttribute (i);
+          // Pointer values print as addresses, which change from run to run
+          if (!(info.flags & TypeId::ATTR_GET)
+              || info.checker->GetValueTypeName () == "ns3::PointerValue")
+            {
+              continue;
+            }
+          Ptr<AttributeValue> value = info.checker->Create ();
+          object->GetAttribute (info.name, *value);
+          HashString (hash, info.name);
+          HashString (hash, value->SerializeToString (info.checker));
+        }
+      if (!tid.HasParent () || tid.GetParent () == tid)
+        {
+          break;
+        }
+      tid = tid.GetParent ();
+    }
+}
+
 }
 } //namespace ns3
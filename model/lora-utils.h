@@ -18,6 +18,9 @@
 
 #include "ns3/nstime.h"
 #include "ns3/uinteger.h"
+#include "ns3/object.h"
+
+#include <string>
 
 namespace ns3 {
 namespace lorawan {
@@ -55,6 +58,27 @@ double WToDbm (double w);
  */
 double RatioToDb (double ratio);
 
+/**
+ * The initial value of a 64 bit FNV-1a hash.
+ */
+const uint64_t HASH_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+/**
+ * Add some bytes to a 64 bit FNV-1a hash.
+ */
+void HashBytes (uint64_t &hash, const void *data, size_t size);
+
+/**
+ * Add a string, terminator included, to a 64 bit FNV-1a hash.
+ */
+void HashString (uint64_t &hash, std::string string);
+
+/**
+ * Add the type and attribute values of an object to a 64 bit FNV-1a hash.
+ * Pointer attributes are left out.
+ */
+void HashAttributes (uint64_t &hash, Ptr<Object> object);
+
 }   // namespace ns3
 
 }
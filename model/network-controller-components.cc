@@ -45,6 +45,28 @@ NetworkControllerComponent::~NetworkControllerComponent ()
 {
 }
 
+void
+NetworkControllerComponent::BeforeReceiveWindows (const std::vector<Ptr<EndDeviceStatus> > &statuses,
+                                                  int window,
+                                                  Ptr<NetworkStatus> networkStatus)
+{
+  NS_LOG_FUNCTION (this << statuses.size () << window << networkStatus);
+}
+
+bool
+NetworkControllerComponent::IsSideEffectFree (void) const
+{
+  return false;
+}
+
+NetworkControllerComponent::AsyncResult
+NetworkControllerComponent::ProcessPacketAsync (const PacketSnapshot &snapshot)
+{
+  // Not reachable unless IsSideEffectFree is overridden, and logging from a
+  // worker thread is not safe
+  return AsyncResult ();
+}
+
 ////////////////////////////////
 // ConfirmedMessagesComponent //
 ////////////////////////////////
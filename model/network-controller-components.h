@@ -26,11 +26,29 @@
 #include "ns3/packet.h"
 #include "ns3/network-status.h"
 
+#include <functional>
+#include <vector>
+
 namespace ns3 {
 namespace lorawan {
 
 class NetworkStatus;
 
+/**
+ * A copy of a received packet and of its reception parameters that only holds
+ * plain data, and can therefore be safely read from a worker thread.
+ */
+struct PacketSnapshot
+{
+  std::vector<uint8_t> bytes;        //!< Serialized packet, headers included
+  LoraDeviceAddress deviceAddress;   //!< Address of the sender
+  uint8_t sf;                        //!< Spreading factor of the packet
+  double frequency;                  //!< Frequency of the packet
+  std::vector<double> rxPowers;      //!< Power at the gateways whose copy
+  //!reached the NS before the snapshot was taken, usually only the first one
+  Time receptionTime;                //!< Time of arrival at the NS
+};
+
 ////////////////
 // Base class //
 ////////////////
@@ -65,6 +83,54 @@ public:
   virtual void BeforeSendingReply (Ptr<EndDeviceStatus> status,
                                    Ptr<NetworkStatus> networkStatus) = 0;
 
+  /**
+   * Method that is called once for all the devices whose receive window
+   * with the same number opens at the same instant, before
+   * BeforeSendingReply is called for each of them. Components can use it to
+   * prepare their decisions in a single pass. Devices whose first receive
+   * window found no gateway are passed again for the second one. The default
+   * implementation does nothing.
+   *
+   * \param statuses The EndDeviceStatus of each device, in processing order
+   * \param window The number of the receive window (1 or 2)
+   * \param networkStatus A pointer to the NetworkStatus object
+   */
+  virtual void BeforeReceiveWindows (const std::vector<Ptr<EndDeviceStatus> > &statuses,
+                                     int window,
+                                     Ptr<NetworkStatus> networkStatus);
+
+  /**
+   * The action resulting from processing a packet on a worker thread. It is
+   * applied on the simulator thread, when the first receive window opens.
+   */
+  typedef std::function<void (Ptr<EndDeviceStatus>, Ptr<NetworkStatus>)> AsyncResult;
+
+  /**
+   * Whether this component can process new packets off the simulator thread.
+   *
+   * Components returning true must implement ProcessPacketAsync, which must
+   * only read the snapshot it is given and state that is private to the
+   * component and never touched by the simulator thread meanwhile. The
+   * default implementation returns false.
+   */
+  virtual bool IsSideEffectFree (void) const;
+
+  /**
+   * Process a newly received packet on a worker thread. This is called
+   * instead of OnReceivedPacket when the NetworkController runs components
+   * asynchronously and IsSideEffectFree returns true.
+   *
+   * Unlike OnReceivedPacket, which is called for every gateway that received
+   * the packet, this is called once per uplink, when the first copy reaches
+   * the NetworkServer. The copies of the other gateways arrive later, so the
+   * snapshot doesn't list them. The result is applied when the first receive
+   * window of the device opens, whether or not a reply is sent.
+   *
+   * \param snapshot A copy of the packet and of its reception parameters
+   * \return The action to apply to the device status, or an empty function
+   */
+  virtual AsyncResult ProcessPacketAsync (const PacketSnapshot &snapshot);
+
   /**
    * Method that is called when a packet cannot be sent in the downlink.
    *
@@ -19,6 +19,7 @@
  */
 
 #include "network-controller.h"
+#include "ns3/simulator.h"
 
 namespace ns3 {
 namespace lorawan {
@@ -68,12 +69,45 @@ NetworkController::OnNewPacket (Ptr<Packet const> packet)
   // callbacks and only be called in case a certain MAC command is contained.
   // For now, we call all components.
 
-  // Inform each component about the new packet
+  // Inform each component about the new packet. Synchronous components are
+  // called for each gateway that received it, while asynchronous ones only
+  // process each uplink once, when it first reaches the NS.
+  Ptr<EndDeviceStatus> status = m_status->GetEndDeviceStatus (packet);
+  std::shared_ptr<const PacketSnapshot> snapshot;
   for (auto it = m_components.begin (); it != m_components.end (); ++it)
     {
-      (*it)->OnReceivedPacket (packet,
-                               m_status->GetEndDeviceStatus (packet),
-                               m_status);
+      if (m_workerPool && (*it)->IsSideEffectFree ())
+        {
+          if (!status->IsLastInsertionNew ())
+            {
+              continue;
+            }
+          if (!snapshot)
+            {
+              DiscardStaleResults (status->m_endDeviceAddress);
+              snapshot = MakeSnapshot (packet, status);
+            }
+
+          // Only plain data and the component's raw pointer (which is kept
+          // alive by m_components) reach the worker
+          NetworkControllerComponent *component = PeekPointer (*it);
+          auto task = std::make_shared<std::packaged_task<NetworkControllerComponent::AsyncResult (void)> >
+              ([component, snapshot] ()
+               {
+                 return component->ProcessPacketAsync (*snapshot);
+               });
+
+          PendingResult pending;
+          pending.submissionTime = Simulator::Now ();
+          pending.result = task->get_future ();
+          m_pendingResults[status->m_endDeviceAddress].push_back (std::move (pending));
+
+          m_workerPool->Submit ([task] () { (*task) (); });
+        }
+      else
+        {
+          (*it)->OnReceivedPacket (packet, status, m_status);
+        }
     }
 }
 
@@ -89,5 +123,115 @@ NetworkController::BeforeSendingReply (Ptr<EndDeviceStatus> endDeviceStatus)
     }
 }
 
+void
+NetworkController::BeforeReceiveWindows (const std::vector<Ptr<EndDeviceStatus> > &endDeviceStatuses,
+                                         int window)
+{
+  NS_LOG_FUNCTION (this << endDeviceStatuses.size () << window);
+
+  // Let each component prepare for the whole group at once
+  for (auto it = m_components.begin (); it != m_components.end (); ++it)
+    {
+      (*it)->BeforeReceiveWindows (endDeviceStatuses, window, m_status);
+    }
+}
+
+void
+NetworkController::SetWorkerThreads (uint32_t nThreads)
+{
+  NS_LOG_FUNCTION (this << nThreads);
+
+  // Destroying the old pool waits for the jobs it's running
+  m_workerPool.reset ();
+  if (nThreads > 0)
+    {
+      m_workerPool.reset (new ComponentWorkerPool (nThreads));
+    }
+}
+
+uint32_t
+NetworkController::GetWorkerThreads (void) const
+{
+  return m_workerPool ? m_workerPool->GetNThreads () : 0;
+}
+
+std::shared_ptr<const PacketSnapshot>
+NetworkController::MakeSnapshot (Ptr<Packet const> packet,
+                                 Ptr<EndDeviceStatus> status)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  std::shared_ptr<PacketSnapshot> snapshot = std::make_shared<PacketSnapshot> ();
+
+  snapshot->bytes.resize (packet->GetSize ());
+  packet->CopyData (snapshot->bytes.data (), snapshot->bytes.size ());
+  snapshot->deviceAddress = status->m_endDeviceAddress;
+  snapshot->receptionTime = Simulator::Now ();
+
+  // The status was already updated with this packet
+  const EndDeviceStatus::ReceivedPacketInfo &info =
+    status->GetLastInsertedPacketInfo ();
+  snapshot->sf = info.sf;
+  snapshot->frequency = info.frequency;
+  for (auto it = info.gwList.begin (); it != info.gwList.end (); ++it)
+    {
+      snapshot->rxPowers.push_back (it->second.rxPower);
+    }
+
+  return snapshot;
+}
+
+void
+NetworkController::OnFirstReceiveWindow (Ptr<EndDeviceStatus> endDeviceStatus)
+{
+  NS_LOG_FUNCTION (this);
+
+  auto it = m_pendingResults.find (endDeviceStatus->m_endDeviceAddress);
+  if (it == m_pendingResults.end ())
+    {
+      return;
+    }
+
+  NS_LOG_DEBUG ("Merging " << it->second.size () << " results for device " <<
+                endDeviceStatus->m_endDeviceAddress);
+
+  for (auto result = it->second.begin (); result != it->second.end (); ++result)
+    {
+      NetworkControllerComponent::AsyncResult action = result->result.get ();
+      if (action)
+        {
+          action (endDeviceStatus, m_status);
+        }
+    }
+  m_pendingResults.erase (it);
+}
+
+void
+NetworkController::DiscardStaleResults (LoraDeviceAddress deviceAddress)
+{
+  auto it = m_pendingResults.find (deviceAddress);
+  if (it == m_pendingResults.end ())
+    {
+      return;
+    }
+
+  // Results are merged when the first receive window opens, 1 second after
+  // the uplink. Results older than the second window belong to an uplink
+  // whose windows never opened, e.g. a copy the scheduler took for a
+  // duplicate.
+  std::list<PendingResult> &results = it->second;
+  while (!results.empty ()
+         && results.front ().submissionTime + Seconds (2) <= Simulator::Now ())
+    {
+      NS_LOG_DEBUG ("Discarding a stale result for device " << deviceAddress);
+      results.front ().result.wait ();
+      results.pop_front ();
+    }
+  if (results.empty ())
+    {
+      m_pendingResults.erase (it);
+    }
+}
+
 }
 }
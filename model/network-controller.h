@@ -25,6 +25,12 @@
 #include "ns3/packet.h"
 #include "ns3/network-status.h"
 #include "ns3/network-controller-components.h"
+#include "ns3/component-worker-pool.h"
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
 
 namespace ns3 {
 namespace lorawan {
@@ -64,9 +70,71 @@ public:
    */
   void BeforeSendingReply (Ptr<EndDeviceStatus> endDeviceStatus);
 
+  /**
+   * Method that is called by the NetworkScheduler when the receive windows of
+   * a group of End Devices open at the same instant, before the replies to
+   * each of them are prepared. All the windows of the group have the same
+   * number.
+   */
+  void BeforeReceiveWindows (const std::vector<Ptr<EndDeviceStatus> > &endDeviceStatuses,
+                             int window);
+
+  /**
+   * Method that is called by the NetworkScheduler when the first receive
+   * window of an End Device opens, before any reply is prepared. It waits
+   * for the results of the components running on the workers that concern
+   * the device, and applies them to its status in submission order.
+   */
+  void OnFirstReceiveWindow (Ptr<EndDeviceStatus> endDeviceStatus);
+
+  /**
+   * Set the number of worker threads used to run components that declare
+   * themselves side-effect-free (see NetworkControllerComponent::
+   * IsSideEffectFree). They process each uplink once, and their results are
+   * merged when the first receive window of the device opens, in the order
+   * in which packets were received, so that simulation results do not depend
+   * on thread scheduling.
+   *
+   * \param nThreads The number of workers. 0, the default, runs all
+   * components synchronously on the simulator thread.
+   */
+  void SetWorkerThreads (uint32_t nThreads);
+
+  /**
+   * Get the number of worker threads used to run components.
+   */
+  uint32_t GetWorkerThreads (void) const;
+
 private:
+  /**
+   * The result of a component that is being computed by a worker.
+   */
+  struct PendingResult
+  {
+    Time submissionTime;
+    std::future<NetworkControllerComponent::AsyncResult> result;
+  };
+
+  /**
+   * Create a copy of a packet that can be handed to the workers. Only the
+   * gateways that delivered the packet so far are part of the snapshot.
+   */
+  std::shared_ptr<const PacketSnapshot> MakeSnapshot (Ptr<Packet const> packet,
+                                                      Ptr<EndDeviceStatus> status);
+
+  /**
+   * Wait for and drop the results concerning a device that belong to an
+   * uplink whose receive windows are over.
+   */
+  void DiscardStaleResults (LoraDeviceAddress deviceAddress);
+
   Ptr<NetworkStatus> m_status;
   std::list<Ptr<NetworkControllerComponent> > m_components;
+
+  // Declared after m_components, so that the workers are stopped before the
+  // components they use are released
+  std::unique_ptr<ComponentWorkerPool> m_workerPool;
+  std::map<LoraDeviceAddress, std::list<PendingResult> > m_pendingResults;
 };
 
 } /* namespace ns3 */
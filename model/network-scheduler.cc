@@ -17,18 +17,27 @@ NetworkScheduler::GetTypeId (void)
                      "Trace source that is fired when a receive window opportunity happens.",
                      MakeTraceSourceAccessor (&NetworkScheduler::m_receiveWindowOpened),
                      "ns3::Packet::TracedCallback")
+    .AddAttribute ("QueueReceiveWindows",
+                   "Whether to keep pending receive window opportunities in "
+                   "a queue drained by one event per instant, instead of "
+                   "scheduling one event each",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&NetworkScheduler::m_queueReceiveWindows),
+                   MakeBooleanChecker ())
     .SetGroupName ("lorawan");
   return tid;
 }
 
-NetworkScheduler::NetworkScheduler ()
+NetworkScheduler::NetworkScheduler () :
+  m_queueReceiveWindows (true)
 {
 }
 
 NetworkScheduler::NetworkScheduler (Ptr<NetworkStatus> status,
                                     Ptr<NetworkController> controller) :
   m_status (status),
-  m_controller (controller)
+  m_controller (controller),
+  m_queueReceiveWindows (true)
 {
 }
 
@@ -76,11 +85,9 @@ NetworkScheduler::OnReceivedPacket (Ptr<const Packet> packet)
   LoraDeviceAddress deviceAddress = receivedFrameHdr.GetAddress ();
 
   // Schedule OnReceiveWindowOpportunity event
-  Simulator::Schedule (Seconds (1),
-                       &NetworkScheduler::OnReceiveWindowOpportunity,
-                       this,
-                       deviceAddress,
-                       1);     // This will be the first receive window
+  ScheduleReceiveWindow (deviceAddress,
+                         1,      // This will be the first receive window
+                         Seconds (1));
 }
 
 void
@@ -91,6 +98,14 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
   NS_LOG_DEBUG ("Opening receive window nubmer " << window << " for device "
                                                  << deviceAddress);
 
+  // The results of the components running on the workers are due at the
+  // first receive window, whether a reply follows or not
+  if (window == 1)
+    {
+      m_controller->OnFirstReceiveWindow (m_status->GetEndDeviceStatus
+                                            (deviceAddress));
+    }
+
   // Check whether we can send a reply to the device, again by using
   // NetworkStatus
   Address gwAddress = m_status->GetBestGatewayForDevice (deviceAddress, window);
@@ -103,11 +118,9 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
 
       // No suitable GW was found
       // Schedule OnReceiveWindowOpportunity event
-      Simulator::Schedule (Seconds (1),
-                           &NetworkScheduler::OnReceiveWindowOpportunity,
-                           this,
-                           deviceAddress,
-                           2);     // This will be the second receive window
+      ScheduleReceiveWindow (deviceAddress,
+                             2,      // This will be the second receive window
+                             Seconds (1));
     }
   else if (gwAddress == Address () && window == 2)
     {
@@ -143,5 +156,86 @@ NetworkScheduler::OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, i
         }
     }
 }
+
+void
+NetworkScheduler::ScheduleReceiveWindow (LoraDeviceAddress deviceAddress,
+                                         int window, Time delay)
+{
+  NS_LOG_FUNCTION (this << deviceAddress << window << delay);
+
+  PendingWindow pending;
+  pending.expiry = Simulator::Now () + delay;
+  pending.deviceAddress = deviceAddress;
+  pending.window = window;
+
+  // Receive windows are always scheduled with the same delay, so they expire
+  // in the order they are queued. Opportunities that would break the order
+  // get their own event.
+  if (!m_queueReceiveWindows
+      || (!m_pending.empty () && pending.expiry < m_pending.back ().expiry))
+    {
+      Simulator::Schedule (delay,
+                           &NetworkScheduler::OnReceiveWindowOpportunity,
+                           this,
+                           deviceAddress,
+                           window);
+      return;
+    }
+
+  // The first opportunity of each instant schedules the event that drains
+  // them all now, and not when the previous instant is drained, so that the
+  // event keeps the place among those due at the same time that the
+  // opportunity would have had with an event of its own
+  if (m_pending.empty () || m_pending.back ().expiry < pending.expiry)
+    {
+      Simulator::Schedule (delay, &NetworkScheduler::OnQueueExpired, this);
+    }
+
+  m_pending.push_back (pending);
+
+  NS_LOG_DEBUG ("Window " << window << " for device " << deviceAddress <<
+                " queued (" << m_pending.size () << " pending)");
+}
+
+void
+NetworkScheduler::OnQueueExpired (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  Time now = Simulator::Now ();
+
+  // Move the opportunities that are due out of the queue before processing
+  // them, since processing can queue new ones
+  std::vector<PendingWindow> due;
+  while (!m_pending.empty () && m_pending.front ().expiry <= now)
+    {
+      due.push_back (m_pending.front ());
+      m_pending.pop_front ();
+    }
+
+  NS_LOG_DEBUG ("Processing " << due.size () <<
+                " receive window opportunities");
+
+  // Give the controller a chance to act on all devices at once, separately
+  // for each receive window number
+  std::vector<Ptr<EndDeviceStatus> > statuses[2];
+  for (auto it = due.begin (); it != due.end (); ++it)
+    {
+      statuses[it->window - 1].push_back (m_status->GetEndDeviceStatus
+                                            (it->deviceAddress));
+    }
+  for (int window = 1; window <= 2; window++)
+    {
+      if (!statuses[window - 1].empty ())
+        {
+          m_controller->BeforeReceiveWindows (statuses[window - 1], window);
+        }
+    }
+
+  for (auto it = due.begin (); it != due.end (); ++it)
+    {
+      OnReceiveWindowOpportunity (it->deviceAddress, it->window);
+    }
+}
 }
 }
@@ -30,6 +30,9 @@
 #include "ns3/network-controller.h"
 #include "ns3/network-status.h"
 
+#include <deque>
+#include <vector>
+
 namespace ns3 {
 namespace lorawan {
 
@@ -60,9 +63,40 @@ public:
   void OnReceiveWindowOpportunity (LoraDeviceAddress deviceAddress, int window);
 
 private:
+  /**
+   * A receive window opportunity waiting in the queue.
+   */
+  struct PendingWindow
+  {
+    Time expiry;                      //!< Time at which the window opens
+    LoraDeviceAddress deviceAddress;  //!< Device the window belongs to
+    int window;                       //!< Receive window number (1 or 2)
+  };
+
+  /**
+   * Schedule a receive window opportunity for a device, either through the
+   * queue or as an individual simulator event.
+   */
+  void ScheduleReceiveWindow (LoraDeviceAddress deviceAddress, int window,
+                              Time delay);
+
+  /**
+   * Process, in insertion order, all the queued receive window opportunities
+   * that expire at the current time.
+   *
+   * One such event is scheduled for each instant, by the first opportunity
+   * expiring then, so it runs where that opportunity's own event would have.
+   * The opportunities queued after it for the same instant are processed
+   * together with it, ahead of any event scheduled between their insertions.
+   */
+  void OnQueueExpired (void);
+
   TracedCallback<Ptr<const Packet> > m_receiveWindowOpened;
   Ptr<NetworkStatus> m_status;
   Ptr<NetworkController> m_controller;
+
+  bool m_queueReceiveWindows;          //!< Whether to use the queue
+  std::deque<PendingWindow> m_pending; //!< Opportunities, by expiry
 };
 
 } /* namespace ns3 */
@@ -22,6 +22,7 @@
 #include "ns3/network-server.h"
 #include "ns3/net-device.h"
 #include "ns3/point-to-point-net-device.h"
+#include "ns3/direct-backhaul-net-device.h"
 #include "ns3/packet.h"
 #include "ns3/lorawan-mac-header.h"
 #include "ns3/lora-frame-header.h"
@@ -31,6 +32,9 @@
 #include "ns3/node-container.h"
 #include "ns3/class-a-end-device-lorawan-mac.h"
 #include "ns3/mac-command.h"
+#include "ns3/uinteger.h"
+#include "ns3/pointer.h"
+#include "ns3/channel.h"
 
 namespace ns3 {
 namespace lorawan {
@@ -49,6 +53,19 @@ NetworkServer::GetTypeId (void)
                      "Trace source that is fired when a packet arrives at the Network Server",
                      MakeTraceSourceAccessor (&NetworkServer::m_receivedPacket),
                      "ns3::Packet::TracedCallback")
+    .AddAttribute ("ComponentWorkerThreads",
+                   "Number of worker threads used to run side-effect-free "
+                   "NetworkController components (0 runs them synchronously)",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&NetworkServer::SetComponentWorkerThreads,
+                                         &NetworkServer::GetComponentWorkerThreads),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Scheduler",
+                   "The scheduler of the receive window opportunities",
+                   TypeId::ATTR_GET,
+                   PointerValue (),
+                   MakePointerAccessor (&NetworkServer::GetScheduler),
+                   MakePointerChecker<NetworkScheduler> ())
     .SetGroupName ("lorawan");
   return tid;
 }
@@ -56,7 +73,7 @@ NetworkServer::GetTypeId (void)
 NetworkServer::NetworkServer () :
   m_status (Create<NetworkStatus> ()),
   m_controller (Create<NetworkController> (m_status)),
-  m_scheduler (Create<NetworkScheduler> (m_status, m_controller))
+  m_scheduler (CreateObject<NetworkScheduler> (m_status, m_controller))
 {
   NS_LOG_FUNCTION_NOARGS ();
 }
@@ -78,22 +95,43 @@ NetworkServer::StopApplication (void)
   NS_LOG_FUNCTION_NOARGS ();
 }
 
-void
+Ptr<GatewayStatus>
 NetworkServer::AddGateway (Ptr<Node> gateway, Ptr<NetDevice> netDevice)
 {
   NS_LOG_FUNCTION (this << gateway);
 
-  // Get the PointToPointNetDevice
-  Ptr<PointToPointNetDevice> p2pNetDevice;
-  for (uint32_t i = 0; i < gateway->GetNDevices (); i++)
+  // Get the gateway's NetDevice at the other end of the link. Gateways of a
+  // sharded NS have one link per shard, so we can't just pick the first one.
+  Ptr<NetDevice> gwNetDevice;
+  Ptr<DirectBackhaulNetDevice> directNetDevice =
+    netDevice->GetObject<DirectBackhaulNetDevice> ();
+  if (directNetDevice != 0)
+    {
+      gwNetDevice = directNetDevice->GetPeer ();
+    }
+  Ptr<Channel> channel = netDevice->GetChannel ();
+  Time backhaulDelay = Seconds (0);
+  if (directNetDevice != 0)
     {
-      p2pNetDevice = gateway->GetDevice (i)->GetObject<PointToPointNetDevice> ();
-      if (p2pNetDevice != 0)
+      backhaulDelay = directNetDevice->GetLatency ();
+    }
+  else if (channel != 0)
+    {
+      TimeValue delay;
+      if (channel->GetAttributeFailSafe ("Delay", delay))
         {
-          // We found a p2pNetDevice on the gateway
+          backhaulDelay = delay.Get ();
+        }
+    }
+  for (uint32_t i = 0; !gwNetDevice && channel && i < channel->GetNDevices (); i++)
+    {
+      if (channel->GetDevice (i)->GetNode () == gateway)
+        {
+          gwNetDevice = channel->GetDevice (i);
           break;
         }
     }
+  NS_ASSERT (gwNetDevice != 0);
 
   // Get the gateway's LoRa MAC layer (assumes gateway's MAC is configured as first device)
   Ptr<GatewayLorawanMac> gwMac = gateway->GetDevice (0)->GetObject<LoraNetDevice> ()->
@@ -101,14 +139,17 @@ NetworkServer::AddGateway (Ptr<Node> gateway, Ptr<NetDevice> netDevice)
   NS_ASSERT (gwMac != 0);
 
   // Get the Address
-  Address gatewayAddress = p2pNetDevice->GetAddress ();
+  Address gatewayAddress = gwNetDevice->GetAddress ();
 
   // Create new gatewayStatus
   Ptr<GatewayStatus> gwStatus = Create<GatewayStatus> (gatewayAddress,
                                                        netDevice,
                                                        gwMac);
+  gwStatus->SetBackhaulDelay (backhaulDelay);
 
   m_status->AddGateway (gatewayAddress, gwStatus);
+
+  return gwStatus;
 }
 
 void
@@ -155,9 +196,6 @@ NetworkServer::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet,
 {
   NS_LOG_FUNCTION (this << packet << protocol << address);
 
-  // Create a copy of the packet
-  Ptr<Packet> myPacket = packet->Copy ();
-
   // Fire the trace source
   m_receivedPacket (packet);
 
@@ -187,5 +225,25 @@ NetworkServer::GetNetworkStatus (void)
   return m_status;
 }
 
+Ptr<NetworkScheduler>
+NetworkServer::GetScheduler (void) const
+{
+  return m_scheduler;
+}
+
+void
+NetworkServer::SetComponentWorkerThreads (uint32_t nThreads)
+{
+  NS_LOG_FUNCTION (this << nThreads);
+
+  m_controller->SetWorkerThreads (nThreads);
+}
+
+uint32_t
+NetworkServer::GetComponentWorkerThreads (void) const
+{
+  return m_controller->GetWorkerThreads ();
+}
+
 }
 }
@@ -82,8 +82,11 @@ public:
   /**
    * Add this gateway to the list of gateways connected to this NS.
    * Each GW is identified by its Address in the NS-GWs network.
+   *
+   * \return The status of the gateway, whose bookings can be shared with the
+   * other shards of a sharded NS.
    */
-  void AddGateway (Ptr<Node> gateway, Ptr<NetDevice> netDevice);
+  Ptr<GatewayStatus> AddGateway (Ptr<Node> gateway, Ptr<NetDevice> netDevice);
 
   /**
    * A NetworkControllerComponent to this NetworkServer instance.
@@ -99,6 +102,22 @@ public:
 
   Ptr<NetworkStatus> GetNetworkStatus (void);
 
+  /**
+   * Get the scheduler of the receive window opportunities.
+   */
+  Ptr<NetworkScheduler> GetScheduler (void) const;
+
+  /**
+   * Set the number of worker threads used by the NetworkController to run
+   * side-effect-free components.
+   */
+  void SetComponentWorkerThreads (uint32_t nThreads);
+
+  /**
+   * Get the number of worker threads used by the NetworkController.
+   */
+  uint32_t GetComponentWorkerThreads (void) const;
+
 protected:
   Ptr<NetworkStatus> m_status;
   Ptr<NetworkController> m_controller;
@@ -170,9 +170,17 @@ NetworkStatus::SendThroughGateway (Ptr<Packet> packet, Address gwAddress)
 {
   NS_LOG_FUNCTION (packet << gwAddress);
 
-  m_gatewayStatuses.find (gwAddress)->second->GetNetDevice ()->Send (packet,
-                                                                      gwAddress,
-                                                                      0x0800);
+  Ptr<GatewayStatus> gwStatus = m_gatewayStatuses.find (gwAddress)->second;
+
+  // The gateway only starts transmitting after the backhaul delay, so the
+  // other shards of a sharded NS could pick it in the meantime. Book it
+  // until the end of the transmission.
+  if (gwStatus->AreBookingsShared ())
+    {
+      gwStatus->BookTransmission (packet);
+    }
+
+  gwStatus->GetNetDevice ()->Send (packet, gwAddress, 0x0800);
 }
 
 Ptr<Packet>
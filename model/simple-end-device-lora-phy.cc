@@ -73,10 +73,11 @@ SimpleEndDeviceLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams,
   // We can send the packet: switch to the TX state
   SwitchToTx (txPowerDbm);
 
-  // Tag the packet with information about its Spreading Factor
+  // Tag the packet with information about its Spreading Factor and channel
   LoraTag tag;
   packet->RemovePacketTag (tag);
   tag.SetSpreadingFactor (txParams.sf);
+  tag.SetFrequency (frequencyMHz);
   packet->AddPacketTag (tag);
 
   // Send the packet over the channel
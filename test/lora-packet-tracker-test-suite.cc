@@ -0,0 +1,359 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This file includes testing for the following components:
+ * - LoraPacketTracker window queries, with and without finalization
+ * - LoraPacketTracker spill file
+ */
+
+// Include headers of classes to test
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/lora-trace-file.h"
+#include "ns3/lorawan-mac-header.h"
+
+// An essential include is test.h
+#include "ns3/test.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+using namespace lorawan;
+
+NS_LOG_COMPONENT_DEFINE ("LoraPacketTrackerTestSuite");
+
+///////////////////////////////
+// LoraPacketTracker testing //
+///////////////////////////////
+
+/**
+ * What the test made happen to a packet.
+ */
+struct TestPacket
+{
+  Ptr<Packet> packet;
+  Time sendTime; //!< PHY and MAC transmission, and first attempt
+  bool confirmed;
+  bool acked;
+  uint8_t reqTx;
+  bool received[2]; //!< Whether each gateway's MAC received it
+  PhyPacketOutcome outcomes[2]; //!< Outcome at each gateway's PHY
+};
+
+class PacketTrackerWindowTest : public TestCase
+{
+public:
+  PacketTrackerWindowTest (bool finalize);
+  virtual ~PacketTrackerWindowTest ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Schedule the traces of the packets of the scenario.
+   */
+  void SchedulePackets (LoraPacketTracker &tracker);
+
+  /**
+   * Compare the answers of the tracker for a window with a count over all
+   * the packets.
+   */
+  void CheckWindow (LoraPacketTracker &tracker, Time start, Time stop);
+
+  /**
+   * Check that a trace file written by the tracker holds every packet once.
+   */
+  void CheckRecords (std::string filename);
+
+  bool m_finalize; //!< Whether to release old records to a spill file
+  std::vector<TestPacket> m_packets; //!< The packets of the scenario
+};
+
+PacketTrackerWindowTest::PacketTrackerWindowTest (bool finalize)
+  : TestCase (std::string ("Verify that window queries of the LoraPacketTracker"
+                           " match a brute-force count")
+              + (finalize ? ", with records released to a spill file" : "")),
+    m_finalize (finalize)
+{
+}
+
+PacketTrackerWindowTest::~PacketTrackerWindowTest ()
+{
+}
+
+void
+PacketTrackerWindowTest::SchedulePackets (LoraPacketTracker &tracker)
+{
+  typedef void (LoraPacketTracker::*OutcomeCallback) (Ptr<Packet const>, uint32_t);
+
+  // A packet every 2.5 s, so that some fall on the 10 s bucket boundaries
+  for (int i = 0; i < 40; i++)
+    {
+      TestPacket p;
+      p.sendTime = MilliSeconds (2500 * i);
+      p.confirmed = i % 4 == 1;
+      p.received[0] = i % 2 == 0;
+      p.received[1] = i % 3 == 0;
+      p.acked = p.confirmed && (p.received[0] || p.received[1]);
+      p.reqTx = p.acked ? 1 + i % 3 : 8;
+
+      LorawanMacHeader mHdr;
+      mHdr.SetMType (p.confirmed ? LorawanMacHeader::CONFIRMED_DATA_UP
+                     : LorawanMacHeader::UNCONFIRMED_DATA_UP);
+      p.packet = Create<Packet> (10);
+      p.packet->AddHeader (mHdr);
+
+      uint32_t deviceId = 10 + i % 3;
+      Simulator::ScheduleWithContext (deviceId, p.sendTime,
+                                      &LoraPacketTracker::MacTransmissionCallback,
+                                      &tracker, p.packet);
+      Simulator::Schedule (p.sendTime, &LoraPacketTracker::TransmissionCallback,
+                           &tracker, p.packet, deviceId);
+
+      for (uint32_t gw = 0; gw < 2; gw++)
+        {
+          OutcomeCallback callback;
+          if (p.received[gw])
+            {
+              p.outcomes[gw] = RECEIVED;
+              callback = &LoraPacketTracker::PacketReceptionCallback;
+            }
+          else if ((i + gw) % 2)
+            {
+              p.outcomes[gw] = INTERFERED;
+              callback = &LoraPacketTracker::InterferenceCallback;
+            }
+          else
+            {
+              p.outcomes[gw] = UNDER_SENSITIVITY;
+              callback = &LoraPacketTracker::UnderSensitivityCallback;
+            }
+          Simulator::Schedule (p.sendTime + Seconds (1), callback, &tracker,
+                               p.packet, gw);
+          if (p.received[gw])
+            {
+              Simulator::ScheduleWithContext (gw, p.sendTime + Seconds (1),
+                                              &LoraPacketTracker::MacGwReceptionCallback,
+                                              &tracker, p.packet);
+            }
+        }
+
+      if (p.confirmed)
+        {
+          Simulator::Schedule (p.sendTime + Seconds (3),
+                               &LoraPacketTracker::RequiredTransmissionsCallback,
+                               &tracker, p.reqTx, p.acked, p.sendTime, p.packet);
+        }
+
+      m_packets.push_back (p);
+    }
+}
+
+void
+PacketTrackerWindowTest::CheckWindow (LoraPacketTracker &tracker, Time start,
+                                      Time stop)
+{
+  NS_LOG_DEBUG ("Checking window [" << start.GetSeconds () << ", " <<
+                stop.GetSeconds () << "]");
+
+  int sent = 0, received = 0, confirmedSent = 0, confirmedAcked = 0;
+  int unconfirmed = 0, unconfirmedReceived = 0, confirmedExtracted = 0;
+  std::vector<int> phyCounts[2] = {std::vector<int> (6, 0), std::vector<int> (6, 0)};
+  int delayPackets[2] = {0, 0};
+  for (const TestPacket &p : m_packets)
+    {
+      // Windows include both of their ends
+      if (p.sendTime < start || p.sendTime > stop)
+        {
+          continue;
+        }
+      bool anyReceived = p.received[0] || p.received[1];
+      sent++;
+      received += anyReceived;
+      if (p.confirmed)
+        {
+          confirmedSent++;
+          confirmedAcked += p.acked;
+          confirmedExtracted += anyReceived;
+        }
+      else
+        {
+          unconfirmed++;
+          unconfirmedReceived += anyReceived;
+        }
+      for (int gw = 0; gw < 2; gw++)
+        {
+          phyCounts[gw][0]++;
+          phyCounts[gw][1 + p.outcomes[gw] - RECEIVED]++;
+          delayPackets[gw] += p.received[gw];
+        }
+    }
+
+  NS_TEST_EXPECT_MSG_EQ (tracker.CountMacPacketsGlobally (start, stop),
+                         std::to_string (double (sent)) + " " +
+                         std::to_string (double (received)),
+                         "Wrong MAC counts in [" << start << ", " << stop << "]");
+  NS_TEST_EXPECT_MSG_EQ (tracker.CountMacPacketsGloballyCpsr (start, stop),
+                         std::to_string (double (confirmedSent)) + " " +
+                         std::to_string (double (confirmedAcked)),
+                         "Wrong CPSR counts in [" << start << ", " << stop << "]");
+  for (int gw = 0; gw < 2; gw++)
+    {
+      std::vector<int> counts = tracker.CountPhyPacketsPerGw (start, stop, gw);
+      for (int i = 0; i < 6; i++)
+        {
+          NS_TEST_EXPECT_MSG_EQ (counts.at (i), phyCounts[gw][i],
+                                 "Wrong PHY count " << i << " at gateway " << gw <<
+                                 " in [" << start << ", " << stop << "]");
+        }
+
+      PerformanceSnapshot snapshot = tracker.GetPerformanceSnapshot (start, stop, gw);
+      NS_TEST_EXPECT_MSG_EQ (snapshot.totalUnconfirmedPackets, unconfirmed,
+                             "Wrong unconfirmed packets in [" << start << ", " << stop << "]");
+      NS_TEST_EXPECT_MSG_EQ (snapshot.successfulUnconfirmedPackets, unconfirmedReceived,
+                             "Wrong received unconfirmed packets in [" << start <<
+                             ", " << stop << "]");
+      NS_TEST_EXPECT_MSG_EQ (snapshot.successfullyExtractedConfirmedPackets,
+                             confirmedExtracted,
+                             "Wrong extracted confirmed packets in [" << start <<
+                             ", " << stop << "]");
+      NS_TEST_EXPECT_MSG_EQ (snapshot.successfullyAckedConfirmedPackets, confirmedAcked,
+                             "Wrong ACKed confirmed packets in [" << start << ", " <<
+                             stop << "]");
+      NS_TEST_EXPECT_MSG_EQ (snapshot.delayPackets, delayPackets[gw],
+                             "Wrong delay packets at gateway " << gw << " in [" <<
+                             start << ", " << stop << "]");
+    }
+}
+
+void
+PacketTrackerWindowTest::CheckRecords (std::string filename)
+{
+  std::map<uint64_t, const TestPacket *> packets;
+  for (const TestPacket &p : m_packets)
+    {
+      packets[p.packet->GetUid ()] = &p;
+    }
+
+  LoraTraceFileReader reader;
+  NS_TEST_ASSERT_MSG_EQ (reader.Open (filename), true, "Can't read " << filename);
+
+  std::map<uint64_t, int> seen;
+  const std::vector<TraceBlockIndexEntry> &index = reader.GetIndex ();
+  for (uint32_t b = 0; b < index.size (); b++)
+    {
+      if (index[b].magic != PACKET_BLOCK_MAGIC)
+        {
+          continue;
+        }
+      PacketBlockView block = reader.GetPacketBlock (b);
+      std::vector<int> receptions (block.nPackets, 0);
+      for (uint32_t r = 0; r < block.nReceptions; r++)
+        {
+          receptions.at (block.receptionPackets[r])++;
+        }
+      for (uint32_t j = 0; j < block.nPackets; j++)
+        {
+          auto it = packets.find (block.uids[j]);
+          NS_TEST_ASSERT_MSG_EQ ((it != packets.end ()), true,
+                                 "Unknown packet " << block.uids[j]);
+          const TestPacket &p = *it->second;
+          seen[block.uids[j]]++;
+          NS_TEST_EXPECT_MSG_EQ (block.macSendTimes[j], p.sendTime.GetTimeStep (),
+                                 "Wrong MAC send time of packet " << block.uids[j]);
+          NS_TEST_EXPECT_MSG_EQ (bool (block.flags[j] & PacketRecord::CONFIRMED),
+                                 p.confirmed,
+                                 "Wrong type of packet " << block.uids[j]);
+          NS_TEST_EXPECT_MSG_EQ (bool (block.flags[j] & PacketRecord::RETX_SUCCESSFUL),
+                                 p.acked,
+                                 "Wrong ACK of packet " << block.uids[j]);
+          NS_TEST_EXPECT_MSG_EQ (receptions[j], p.received[0] + p.received[1],
+                                 "Wrong receptions of packet " << block.uids[j]);
+        }
+    }
+  reader.Close ();
+
+  NS_TEST_EXPECT_MSG_EQ (seen.size (), m_packets.size (), "Packets are missing");
+  for (auto it = seen.begin (); it != seen.end (); ++it)
+    {
+      NS_TEST_EXPECT_MSG_EQ (it->second, 1, "Packet " << it->first <<
+                             " was written more than once");
+    }
+}
+
+void
+PacketTrackerWindowTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("PacketTrackerWindowTest");
+
+  LoraPacketTracker tracker;
+  tracker.SetBucketWidth (Seconds (10));
+  if (m_finalize)
+    {
+      tracker.EnableFinalization (Seconds (20),
+                                  CreateTempDirFilename ("tracker-spill.bin"));
+    }
+
+  SchedulePackets (tracker);
+  Simulator::Stop (Seconds (110));
+  Simulator::Run ();
+
+  if (m_finalize)
+    {
+      NS_TEST_ASSERT_MSG_LT (tracker.GetNRecords (), m_packets.size (),
+                             "No record was released");
+    }
+
+  // Whole buckets, bucket boundaries, windows starting and ending on packets
+  // inside buckets, single instants and empty windows
+  CheckWindow (tracker, Seconds (0), Seconds (110));
+  CheckWindow (tracker, Seconds (10), Seconds (20));
+  CheckWindow (tracker, Seconds (10), Seconds (20) - NanoSeconds (1));
+  CheckWindow (tracker, Seconds (10) + NanoSeconds (1), Seconds (20));
+  CheckWindow (tracker, Seconds (0), Seconds (10) - NanoSeconds (1));
+  CheckWindow (tracker, MilliSeconds (12500), MilliSeconds (37500));
+  CheckWindow (tracker, Seconds (3), Seconds (47));
+  CheckWindow (tracker, Seconds (20), Seconds (20));
+  CheckWindow (tracker, MilliSeconds (22500), MilliSeconds (22500));
+  CheckWindow (tracker, Seconds (21), Seconds (22));
+  CheckWindow (tracker, Seconds (95), Seconds (200));
+  CheckWindow (tracker, Seconds (30), Seconds (25));
+
+  // Spilled and in-memory records all make it to the trace file
+  std::string traceFilename = CreateTempDirFilename ("tracker-records.bin");
+  LoraTraceFileWriter writer (traceFilename);
+  tracker.WriteRecords (writer);
+  writer.Close ();
+  CheckRecords (traceFilename);
+
+  Simulator::Destroy ();
+}
+
+/**************
+ * Test Suite *
+ **************/
+
+class LoraPacketTrackerTestSuite : public TestSuite
+{
+public:
+  LoraPacketTrackerTestSuite ();
+};
+
+LoraPacketTrackerTestSuite::LoraPacketTrackerTestSuite ()
+  : TestSuite ("lora-packet-tracker", UNIT)
+{
+  LogComponentEnable ("LoraPacketTrackerTestSuite", LOG_LEVEL_DEBUG);
+
+  LogComponentEnableAll (LOG_PREFIX_FUNC);
+  LogComponentEnableAll (LOG_PREFIX_NODE);
+  LogComponentEnableAll (LOG_PREFIX_TIME);
+
+  // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
+  AddTestCase (new PacketTrackerWindowTest (false), TestCase::QUICK);
+  AddTestCase (new PacketTrackerWindowTest (true), TestCase::QUICK);
+}
+
+// Do not forget to allocate an instance of this TestSuite
+static LoraPacketTrackerTestSuite lorawanTestSuite;
@@ -2,12 +2,17 @@
 
 // Include headers of classes to test
 #include "ns3/log.h"
+#include "ns3/correlated-shadowing-propagation-loss-model.h"
 #include "ns3/lora-helper.h"
 #include "ns3/simple-end-device-lora-phy.h"
 #include "ns3/simple-gateway-lora-phy.h"
 #include "ns3/mobility-helper.h"
 #include "ns3/one-shot-sender-helper.h"
 #include "ns3/constant-position-mobility-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/hex-grid-position-allocator.h"
+#include "ns3/uinteger.h"
+#include "utilities.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -17,6 +22,110 @@ using namespace lorawan;
 
 NS_LOG_COMPONENT_DEFINE ("LorawanTestSuite");
 
+/*****************************
+ * CorrelatedShadowingTest *
+ *****************************/
+
+class CorrelatedShadowingTest : public TestCase
+{
+public:
+  CorrelatedShadowingTest ();
+  virtual ~CorrelatedShadowingTest ();
+
+private:
+  virtual void DoRun (void);
+
+  std::vector<double> GetLosses (int64_t stream, bool reverse);
+};
+
+// Add some help text to this case to describe what it is intended to test
+CorrelatedShadowingTest::CorrelatedShadowingTest ()
+    : TestCase ("Verify that pre-generated correlated shadowing doesn't depend "
+                "on the order of evaluation, and only on the assigned stream")
+{
+}
+
+// Reminder that the test case should clean up after itself
+CorrelatedShadowingTest::~CorrelatedShadowingTest ()
+{
+}
+
+// Get the shadowing of links between positions on a grid, evaluated in
+// order or in reverse order, but always returned in order
+std::vector<double>
+CorrelatedShadowingTest::GetLosses (int64_t stream, bool reverse)
+{
+  Ptr<CorrelatedShadowingPropagationLossModel> shadowing =
+    CreateObject<CorrelatedShadowingPropagationLossModel> ();
+  shadowing->AssignStreams (stream);
+  shadowing->PreGenerate (Box (-500, 500, -500, 500, 0, 0));
+
+  std::vector<Ptr<MobilityModel> > positions;
+  for (double x = -470; x < 500; x += 130)
+    {
+      for (double y = -430; y < 500; y += 170)
+        {
+          Ptr<ConstantPositionMobilityModel> position =
+            CreateObject<ConstantPositionMobilityModel> ();
+          position->SetPosition (Vector (x, y, 0));
+          positions.push_back (position);
+        }
+    }
+
+  uint32_t n = positions.size ();
+  std::vector<double> losses (n * n);
+  for (uint32_t k = 0; k < n * n; k++)
+    {
+      uint32_t link = reverse ? n * n - 1 - k : k;
+      losses[link] = -shadowing->CalcRxPower (0, positions[link / n],
+                                              positions[link % n]);
+    }
+  return losses;
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+CorrelatedShadowingTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("CorrelatedShadowingTest");
+
+  std::vector<double> losses = GetLosses (1, false);
+
+  // The order of evaluation doesn't matter
+  std::vector<double> reverseLosses = GetLosses (1, true);
+  for (uint32_t i = 0; i < losses.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (reverseLosses[i], losses[i],
+                             "Link " << i << " depends on the evaluation order");
+    }
+
+  // The same stream gives the same losses, another stream other ones
+  std::vector<double> sameStream = GetLosses (1, false);
+  std::vector<double> otherStream = GetLosses (2, false);
+  int nDifferent = 0;
+  for (uint32_t i = 0; i < losses.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (sameStream[i], losses[i],
+                             "Link " << i << " isn't reproducible");
+      nDifferent += otherStream[i] != losses[i];
+    }
+  NS_TEST_EXPECT_MSG_EQ (nDifferent, int (losses.size ()),
+                         "Another stream should give other losses");
+
+  // Nearby receivers are correlated: they share the vertices around them
+  Ptr<CorrelatedShadowingPropagationLossModel> shadowing =
+    CreateObject<CorrelatedShadowingPropagationLossModel> ();
+  shadowing->AssignStreams (1);
+  Ptr<ConstantPositionMobilityModel> sender = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> receiver = CreateObject<ConstantPositionMobilityModel> ();
+  receiver->SetPosition (Vector (20, 20, 0));
+  double loss = shadowing->CalcRxPower (0, sender, receiver);
+  receiver->SetPosition (Vector (20.5, 20, 0));
+  NS_TEST_EXPECT_MSG_EQ_TOL (shadowing->CalcRxPower (0, sender, receiver), loss, 0.5,
+                             "Receivers 50 cm apart should see about the same shadowing");
+}
+
 /********************
  * InterferenceTest *
  ********************/
@@ -1365,6 +1474,267 @@ PhyConnectivityTest::DoRun (void)
                          "State didn't switch to STANDBY as expected");
 }
 
+/***************************
+ * SpreadingFactorsUpTest *
+ ***************************/
+
+class SpreadingFactorsUpTest : public TestCase
+{
+public:
+  SpreadingFactorsUpTest ();
+  virtual ~SpreadingFactorsUpTest ();
+
+private:
+  virtual void DoRun (void);
+
+  std::vector<uint8_t> GetDataRates (NodeContainer endDevices);
+};
+
+// Add some help text to this case to describe what it is intended to test
+SpreadingFactorsUpTest::SpreadingFactorsUpTest ()
+    : TestCase ("Verify that SetSpreadingFactorsUp gives the same data rates "
+                "when it searches gateways on a grid and when it evaluates "
+                "every pair of device and gateway")
+{
+}
+
+// Reminder that the test case should clean up after itself
+SpreadingFactorsUpTest::~SpreadingFactorsUpTest ()
+{
+}
+
+std::vector<uint8_t>
+SpreadingFactorsUpTest::GetDataRates (NodeContainer endDevices)
+{
+  std::vector<uint8_t> dataRates;
+  for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+    {
+      dataRates.push_back ((*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetMac
+                             ()->GetObject<EndDeviceLorawanMac> ()->GetDataRate ());
+    }
+  return dataRates;
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+SpreadingFactorsUpTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("SpreadingFactorsUpTest");
+
+  Ptr<LoraChannel> channel = CreateChannel ();
+
+  // Gateways on a 3 km grid without its center, and one off the grid
+  MobilityHelper gatewayMobility;
+  Ptr<ListPositionAllocator> gatewayAllocator = CreateObject<ListPositionAllocator> ();
+  for (int x = -1; x <= 1; x++)
+    {
+      for (int y = -1; y <= 1; y++)
+        {
+          if (x != 0 || y != 0)
+            {
+              gatewayAllocator->Add (Vector (3000.0 * x, 3000.0 * y, 15.0));
+            }
+        }
+    }
+  gatewayAllocator->Add (Vector (1000.0, 2000.0, 15.0));
+  gatewayMobility.SetPositionAllocator (gatewayAllocator);
+  gatewayMobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer gateways = CreateGateways (9, gatewayMobility, channel);
+
+  // Devices on a grid that extends past the gateways on every side, and
+  // includes points at the same distance from several gateways, like the
+  // center or the middle of the sides of the squares. The last one is out of
+  // range of every gateway.
+  MobilityHelper deviceMobility;
+  Ptr<ListPositionAllocator> deviceAllocator = CreateObject<ListPositionAllocator> ();
+  int nDevices = 0;
+  for (int x = -10; x <= 10; x++)
+    {
+      for (int y = -10; y <= 10; y++)
+        {
+          deviceAllocator->Add (Vector (750.0 * x, 750.0 * y, 0.0));
+          nDevices++;
+        }
+    }
+  deviceAllocator->Add (Vector (50000.0, -50000.0, 0.0));
+  nDevices++;
+  deviceMobility.SetPositionAllocator (deviceAllocator);
+  deviceMobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer endDevices = CreateEndDevices (nDevices, deviceMobility, channel);
+
+  // The same loss, followed by a model that adds nothing but isn't known to
+  // only depend on the distance, so that every pair is evaluated
+  Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel> ();
+  loss->SetPathLossExponent (3.76);
+  loss->SetReference (1, 7.7);
+  Ptr<MatrixPropagationLossModel> noLoss = CreateObject<MatrixPropagationLossModel> ();
+  noLoss->SetDefaultLoss (0);
+  loss->SetNext (noLoss);
+  Ptr<LoraChannel> allPairsChannel =
+    CreateObject<LoraChannel> (loss, CreateObject<ConstantSpeedPropagationDelayModel> ());
+
+  std::vector<int> expectedQuantities =
+    LorawanMacHelper::SetSpreadingFactorsUp (endDevices, gateways, allPairsChannel);
+  std::vector<uint8_t> expected = GetDataRates (endDevices);
+
+  // Make sure the scenario has devices at several data rates
+  int nDataRates = 0;
+  for (int quantity : expectedQuantities)
+    {
+      nDataRates += quantity > 0;
+    }
+  NS_TEST_ASSERT_MSG_GT (nDataRates, 3, "Expected devices at more data rates");
+
+  for (uint32_t nThreads : {1u, 4u})
+    {
+      // Start from another assignment, to see every data rate being set
+      for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+        {
+          (*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetMac
+            ()->GetObject<EndDeviceLorawanMac> ()->SetDataRate (3);
+        }
+
+      std::vector<int> quantities =
+        LorawanMacHelper::SetSpreadingFactorsUp (endDevices, gateways, channel, nThreads);
+      std::vector<uint8_t> dataRates = GetDataRates (endDevices);
+
+      NS_TEST_EXPECT_MSG_EQ ((quantities == expectedQuantities), true,
+                             "Different numbers of devices per spreading factor "
+                             "with " << nThreads << " threads");
+      for (uint32_t i = 0; i < dataRates.size (); i++)
+        {
+          NS_TEST_EXPECT_MSG_EQ (unsigned (dataRates[i]), unsigned (expected[i]),
+                                 "Different data rate for device " << i <<
+                                 " with " << nThreads << " threads");
+        }
+    }
+
+  Simulator::Destroy ();
+}
+
+/***************
+ * HexGridTest *
+ ***************/
+
+class HexGridTest : public TestCase
+{
+public:
+  HexGridTest ();
+  virtual ~HexGridTest ();
+
+private:
+  virtual void DoRun (void);
+
+  std::vector<Vector> GetQuadraticPositions (double radius, int nRings);
+};
+
+// Add some help text to this case to describe what it is intended to test
+HexGridTest::HexGridTest ()
+    : TestCase ("Verify that HexGridPositionAllocator returns the positions "
+                "of the former quadratic algorithm, and the expected sectors")
+{
+}
+
+// Reminder that the test case should clean up after itself
+HexGridTest::~HexGridTest ()
+{
+}
+
+// The positions HexGridPositionAllocator used to compute, by adding the 6
+// neighbors of every position found so far at each ring
+std::vector<Vector>
+HexGridTest::GetQuadraticPositions (double radius, int nRings)
+{
+  const double pi = std::acos (-1);
+
+  std::vector<Vector> positions;
+  positions.push_back (Vector (0.0, 0.0, 0.0));
+  for (int ring = 0; ring < nRings; ring++)
+    {
+      std::vector<Vector> copy = positions;
+      for (const Vector &current : positions)
+        {
+          for (double angle = 0; angle < 2*pi; angle+=pi/3)
+            {
+              Vector newPosition = Vector (current.x+2*radius*std::sin(angle),
+                                           current.y+2*radius*std::cos(angle),
+                                           current.z);
+              bool found = false;
+              for (const Vector &position : copy)
+                {
+                  if (CalculateDistance (newPosition, position) < 10)
+                    {
+                      found = true;
+                      break;
+                    }
+                }
+              if (!found)
+                {
+                  copy.push_back (newPosition);
+                }
+            }
+        }
+      positions = copy;
+    }
+  return positions;
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+HexGridTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("HexGridTest");
+
+  // 11 rings around the center hold 397 positions
+  for (double radius : {6000.0, 1234.5})
+    {
+      std::vector<Vector> expected = GetQuadraticPositions (radius, 11);
+      Ptr<HexGridPositionAllocator> allocator = CreateObject<HexGridPositionAllocator> (radius);
+      for (uint32_t i = 0; i < expected.size (); i++)
+        {
+          Vector position = allocator->GetNext ();
+          NS_TEST_EXPECT_MSG_EQ ((position.x == expected[i].x
+                                  && position.y == expected[i].y
+                                  && position.z == expected[i].z), true,
+                                 "Position " << i << " is " << position <<
+                                 " instead of " << expected[i] <<
+                                 " with radius " << radius);
+        }
+    }
+
+  // The sites of a ring are split in sectors of the same angle, starting
+  // from the vertical and going clockwise
+  for (uint32_t sectors : {6u, 3u})
+    {
+      Ptr<HexGridPositionAllocator> allocator = CreateObject<HexGridPositionAllocator> ();
+      allocator->SetAttribute ("Sectors", UintegerValue (sectors));
+      HexGridSite site = allocator->GetNextSite ();
+      NS_TEST_EXPECT_MSG_EQ (site.sector, 0, "The center should be in sector 0");
+      for (uint32_t ring = 1; ring <= 3; ring++)
+        {
+          for (uint32_t i = 0; i < 6 * ring; i++)
+            {
+              site = allocator->GetNextSite ();
+              NS_TEST_ASSERT_MSG_EQ (site.ring, ring, "Unexpected ring");
+
+              // Sites on a sector boundary belong to the sector that starts
+              // there
+              double angle = std::atan2 (site.position.x, site.position.y) * 180 / M_PI;
+              if (angle < -1e-6)
+                {
+                  angle += 360;
+                }
+              uint32_t sector = std::floor ((angle + 1e-6) * sectors / 360);
+              NS_TEST_EXPECT_MSG_EQ (site.sector, sector,
+                                     "Site " << site.position << " of ring " <<
+                                     ring << " in the wrong sector of " << sectors);
+            }
+        }
+    }
+}
+
 /*****************
  * LorawanMacTest *
  *****************/
@@ -1416,6 +1786,7 @@ LorawanTestSuite::LorawanTestSuite () : TestSuite ("lorawan", UNIT)
 {
   LogComponentEnable ("LorawanTestSuite", LOG_LEVEL_DEBUG);
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
+  AddTestCase (new CorrelatedShadowingTest, TestCase::QUICK);
   AddTestCase (new InterferenceTest, TestCase::QUICK);
   AddTestCase (new AddressTest, TestCase::QUICK);
   AddTestCase (new HeaderTest, TestCase::QUICK);
@@ -1423,6 +1794,8 @@ LorawanTestSuite::LorawanTestSuite () : TestSuite ("lorawan", UNIT)
   AddTestCase (new LogicalLoraChannelTest, TestCase::QUICK);
   AddTestCase (new TimeOnAirTest, TestCase::QUICK);
   AddTestCase (new PhyConnectivityTest, TestCase::QUICK);
+  AddTestCase (new SpreadingFactorsUpTest, TestCase::QUICK);
+  AddTestCase (new HexGridTest, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
@@ -6,6 +6,11 @@
 // Include headers of classes to test
 #include "ns3/log.h"
 #include "ns3/network-scheduler.h"
+#include "ns3/network-server.h"
+#include "ns3/network-controller-components.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/boolean.h"
+#include "utilities.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -52,6 +57,232 @@ NetworkSchedulerTest::DoRun (void)
   // scheduled to happen 1 second after the reception.
 }
 
+//////////////////////////////////
+// Receive window queue testing //
+//////////////////////////////////
+
+/**
+ * A component that records when, and for which device, a receive window
+ * opens with a gateway available.
+ *
+ * For each new uplink of the marked device it also schedules, after the
+ * scheduler has scheduled its first receive window, a marker event at the
+ * same instant. Markers are recorded with an empty address.
+ */
+class ReceiveWindowRecorder : public NetworkControllerComponent
+{
+public:
+  ReceiveWindowRecorder (std::vector<std::pair<Time, LoraDeviceAddress> > *windows,
+                         LoraDeviceAddress markedDevice)
+    : m_windows (windows),
+    m_markedDevice (markedDevice)
+  {
+  }
+
+  void OnReceivedPacket (Ptr<const Packet> packet,
+                         Ptr<EndDeviceStatus> status,
+                         Ptr<NetworkStatus> networkStatus)
+  {
+    if (status->m_endDeviceAddress == m_markedDevice
+        && status->IsLastInsertionNew ())
+      {
+        Simulator::Schedule (Seconds (1), &ReceiveWindowRecorder::RecordMarker,
+                             this);
+      }
+  }
+
+  void RecordMarker (void)
+  {
+    m_windows->push_back (std::make_pair (Simulator::Now (),
+                                          LoraDeviceAddress ()));
+  }
+
+  void BeforeSendingReply (Ptr<EndDeviceStatus> status,
+                           Ptr<NetworkStatus> networkStatus)
+  {
+    m_windows->push_back (std::make_pair (Simulator::Now (),
+                                          status->m_endDeviceAddress));
+  }
+
+  void OnFailedReply (Ptr<EndDeviceStatus> status,
+                      Ptr<NetworkStatus> networkStatus)
+  {
+  }
+
+private:
+  std::vector<std::pair<Time, LoraDeviceAddress> > *m_windows;
+  LoraDeviceAddress m_markedDevice;
+};
+
+class ReceiveWindowQueueTest : public TestCase
+{
+public:
+  ReceiveWindowQueueTest ();
+  virtual ~ReceiveWindowQueueTest ();
+
+  void SendPacket (Ptr<Node> endDevice);
+
+  /**
+   * Get the address of an end device.
+   */
+  static LoraDeviceAddress GetAddress (Ptr<Node> endDevice);
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Run the same scenario with receive window opportunities queued or not,
+   * and return the receive windows that opened, together with the markers
+   * scheduled at the first receive windows of device 5.
+   */
+  std::vector<std::pair<Time, LoraDeviceAddress> > RunScenario (bool queue);
+
+  LoraDeviceAddress m_markedDevice; //!< Address of device 5
+};
+
+ReceiveWindowQueueTest::ReceiveWindowQueueTest ()
+  : TestCase ("Verify that receive windows open at the same times, and in "
+              "the same order with respect to other events, whether the "
+              "NetworkScheduler queues them or not")
+{
+}
+
+ReceiveWindowQueueTest::~ReceiveWindowQueueTest ()
+{
+}
+
+void
+ReceiveWindowQueueTest::SendPacket (Ptr<Node> endDevice)
+{
+  endDevice->GetDevice (0)->GetObject<LoraNetDevice> ()->GetMac
+    ()->GetObject<EndDeviceLorawanMac> ()->SetMType
+    (LorawanMacHeader::CONFIRMED_DATA_UP);
+  endDevice->GetDevice (0)->Send (Create<Packet> (20), Address (), 0);
+}
+
+LoraDeviceAddress
+ReceiveWindowQueueTest::GetAddress (Ptr<Node> endDevice)
+{
+  return endDevice->GetDevice (0)->GetObject<LoraNetDevice> ()->GetMac
+           ()->GetObject<EndDeviceLorawanMac> ()->GetDeviceAddress ();
+}
+
+std::vector<std::pair<Time, LoraDeviceAddress> >
+ReceiveWindowQueueTest::RunScenario (bool queue)
+{
+  Config::SetDefault ("ns3::NetworkScheduler::QueueReceiveWindows",
+                      BooleanValue (queue));
+
+  // Draw the same random numbers in both runs
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+  RngSeedManager::ResetNextStreamIndex ();
+
+  Ptr<LoraChannel> channel = CreateChannel ();
+
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                 "MinX", DoubleValue (-300.0),
+                                 "MinY", DoubleValue (-300.0),
+                                 "DeltaX", DoubleValue (150.0),
+                                 "DeltaY", DoubleValue (150.0),
+                                 "GridWidth", UintegerValue (5));
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer endDevices = CreateEndDevices (20, mobility, channel);
+
+  MobilityHelper gwMobility;
+  Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
+  allocator->Add (Vector (-100.0, 0.0, 15.0));
+  allocator->Add (Vector (100.0, 0.0, 15.0));
+  gwMobility.SetPositionAllocator (allocator);
+  gwMobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer gateways = CreateGateways (2, gwMobility, channel);
+
+  LorawanMacHelper ().SetSpreadingFactorsUp (endDevices, gateways, channel);
+
+  Ptr<Node> nsNode = CreateNetworkServer (endDevices, gateways);
+  Ptr<NetworkServer> ns = nsNode->GetApplication (0)->GetObject<NetworkServer> ();
+
+  // The default must have reached the scheduler
+  BooleanValue queueValue;
+  ns->GetScheduler ()->GetAttribute ("QueueReceiveWindows", queueValue);
+  NS_TEST_ASSERT_MSG_EQ (queueValue.Get (), queue,
+                         "The scheduler ignored its attribute defaults");
+
+  std::vector<std::pair<Time, LoraDeviceAddress> > windows;
+  m_markedDevice = GetAddress (endDevices.Get (5));
+  ns->AddComponent (Create<ReceiveWindowRecorder> (&windows, m_markedDevice));
+
+  // Devices send in groups of four, so that several receive windows open at
+  // the same instant and compete for the gateways
+  for (uint32_t i = 0; i < endDevices.GetN (); i++)
+    {
+      Simulator::Schedule (Seconds (1 + 5 * (i / 4)),
+                           &ReceiveWindowQueueTest::SendPacket, this,
+                           endDevices.Get (i));
+    }
+
+  // Device 5 then sends alone, while the first receive window of device 0
+  // is still pending, so that its own window is queued behind another
+  Simulator::Schedule (Seconds (50), &ReceiveWindowQueueTest::SendPacket,
+                       this, endDevices.Get (0));
+  Simulator::Schedule (Seconds (50.5), &ReceiveWindowQueueTest::SendPacket,
+                       this, endDevices.Get (5));
+
+  Simulator::Stop (Seconds (60));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  return windows;
+}
+
+void
+ReceiveWindowQueueTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("ReceiveWindowQueueTest");
+
+  std::vector<std::pair<Time, LoraDeviceAddress> > queued = RunScenario (true);
+  std::vector<std::pair<Time, LoraDeviceAddress> > direct = RunScenario (false);
+
+  Config::Reset ();
+
+  NS_TEST_ASSERT_MSG_GT (queued.size (), 0, "No receive window opened");
+  NS_TEST_ASSERT_MSG_EQ (queued.size (), direct.size (),
+                         "A different number of receive windows opened");
+  uint32_t markers = 0;
+  for (uint32_t i = 0; i < queued.size (); i++)
+    {
+      NS_LOG_DEBUG ("Window for " << queued[i].second << " at " <<
+                    queued[i].first.GetSeconds ());
+      NS_TEST_ASSERT_MSG_EQ (queued[i].first, direct[i].first,
+                             "Receive window " << i << " opened at a different time");
+      NS_TEST_ASSERT_MSG_EQ (queued[i].second, direct[i].second,
+                             "Receive window " << i << " belongs to a different device");
+      if (queued[i].second == LoraDeviceAddress ())
+        {
+          markers++;
+        }
+    }
+
+  // The window of device 5 sent alone was queued behind the one of device
+  // 0, and must still open before the marker scheduled after it
+  NS_TEST_ASSERT_MSG_GT (markers, 0, "No marker was recorded");
+  bool markerFollowsWindow = false;
+  for (uint32_t i = 1; i < queued.size (); i++)
+    {
+      if (queued[i].second == LoraDeviceAddress ()
+          && queued[i].first > Seconds (50)
+          && queued[i - 1].first == queued[i].first
+          && queued[i - 1].second == m_markedDevice)
+        {
+          markerFollowsWindow = true;
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (markerFollowsWindow, true,
+                         "The late window of device 5 opened after the "
+                         "marker scheduled after it");
+}
+
 /**************
  * Test Suite *
  **************/
@@ -72,6 +303,7 @@ NetworkSchedulerTestSuite::NetworkSchedulerTestSuite ()
   LogComponentEnable ("NetworkSchedulerTestSuite", LOG_LEVEL_DEBUG);
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new NetworkSchedulerTest, TestCase::QUICK);
+  AddTestCase (new ReceiveWindowQueueTest, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
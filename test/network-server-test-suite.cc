@@ -4,6 +4,8 @@
  * - EndDeviceServer
  * - GatewayServer
  * - NetworkServer
+ * - Sharded NetworkServer
+ * - Asynchronous NetworkController components
  *
  * Author: Davide Magrin <magrinda@dei.unipd.it>
  */
@@ -15,10 +17,15 @@
 #include "ns3/callback.h"
 #include "ns3/network-server.h"
 #include "ns3/network-server-helper.h"
+#include "ns3/forwarder-helper.h"
+#include "ns3/rng-seed-manager.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
 
+#include <algorithm>
+#include <atomic>
+
 using namespace ns3;
 using namespace lorawan;
 
@@ -267,6 +274,346 @@ LinkCheckTest::DoRun (void)
   NS_ASSERT (m_receivedPacketAtEd);
 }
 
+/////////////////////////////
+// ShardedNetworkServerTest //
+/////////////////////////////
+
+class ShardedNetworkServerTest : public TestCase
+{
+public:
+  ShardedNetworkServerTest ();
+  virtual ~ShardedNetworkServerTest ();
+
+  static void ReceivedPacketAtShard (std::vector<LoraDeviceAddress> *addresses,
+                                     Ptr<Packet const> packet);
+  void StartSendingAtGateway (Ptr<Packet const> packet, uint32_t systemId);
+  void ReceivedPacketAtEndDevice (uint8_t requiredTransmissions, bool success,
+                                  Time time, Ptr<Packet> packet);
+  void SendPacket (Ptr<Node> endDevice);
+
+private:
+  virtual void DoRun (void);
+
+  std::vector<Time> m_gatewayTransmissions;
+  int m_ackedPackets = 0;
+};
+
+ShardedNetworkServerTest::ShardedNetworkServerTest ()
+  : TestCase ("Verify that the shards of a sharded NetworkServer each get "
+              "the uplinks of their devices and don't double-book gateways")
+{
+}
+
+ShardedNetworkServerTest::~ShardedNetworkServerTest ()
+{
+}
+
+void
+ShardedNetworkServerTest::ReceivedPacketAtShard (std::vector<LoraDeviceAddress> *addresses,
+                                                 Ptr<Packet const> packet)
+{
+  Ptr<Packet> packetCopy = packet->Copy ();
+  LorawanMacHeader mHdr;
+  LoraFrameHeader fHdr;
+  fHdr.SetAsUplink ();
+  packetCopy->RemoveHeader (mHdr);
+  packetCopy->RemoveHeader (fHdr);
+  addresses->push_back (fHdr.GetAddress ());
+}
+
+void
+ShardedNetworkServerTest::StartSendingAtGateway (Ptr<Packet const> packet,
+                                                 uint32_t systemId)
+{
+  NS_LOG_DEBUG ("The gateway started a transmission");
+  m_gatewayTransmissions.push_back (Simulator::Now ());
+}
+
+void
+ShardedNetworkServerTest::ReceivedPacketAtEndDevice (uint8_t requiredTransmissions,
+                                                     bool success, Time time,
+                                                     Ptr<Packet> packet)
+{
+  NS_LOG_DEBUG ("Packet finished at the ED, success: " << success);
+  if (success)
+    {
+      m_ackedPackets++;
+    }
+}
+
+void
+ShardedNetworkServerTest::SendPacket (Ptr<Node> endDevice)
+{
+  endDevice->GetDevice (0)->GetObject<LoraNetDevice> ()->GetMac
+    ()->GetObject<EndDeviceLorawanMac> ()->SetMType
+    (LorawanMacHeader::CONFIRMED_DATA_UP);
+  endDevice->GetDevice (0)->Send (Create<Packet> (20), Address (), 0);
+}
+
+void
+ShardedNetworkServerTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("ShardedNetworkServerTest");
+
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+
+  Ptr<LoraChannel> channel = CreateChannel ();
+
+  // Two devices at the same distance from a single gateway
+  MobilityHelper mobility;
+  Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
+  allocator->Add (Vector (100.0, 0.0, 0.0));
+  allocator->Add (Vector (-100.0, 0.0, 0.0));
+  allocator->Add (Vector (0.0, 0.0, 15.0));
+  mobility.SetPositionAllocator (allocator);
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer endDevices = CreateEndDevices (2, mobility, channel);
+  NodeContainer gateways = CreateGateways (1, mobility, channel);
+  LorawanMacHelper ().SetSpreadingFactorsUp (endDevices, gateways, channel);
+
+  // Each device uplinks on its own channel, so that both packets arrive
+  // together and the receive windows of the two shards open at the same time
+  for (uint32_t i = 0; i < endDevices.GetN (); i++)
+    {
+      LogicalLoraChannelHelper channelHelper =
+        GetMacLayerFromNode<EndDeviceLorawanMac> (endDevices.Get (i))->GetLogicalLoraChannelHelper ();
+      for (uint32_t c = 0; c < 3; c++)
+        {
+          if (c != i)
+            {
+              channelHelper.DisableChannel (c);
+            }
+        }
+      GetMacLayerFromNode<EndDeviceLorawanMac> (endDevices.Get (i))->TraceConnectWithoutContext
+        ("RequiredTransmissions",
+        MakeCallback (&ShardedNetworkServerTest::ReceivedPacketAtEndDevice, this));
+    }
+
+  // Split the NS in two shards. Forwarders find the shard boundaries out by
+  // themselves.
+  NetworkServerHelper networkServerHelper;
+  networkServerHelper.SetEndDevices (endDevices);
+  networkServerHelper.SetGateways (gateways);
+  networkServerHelper.EnableSharding (true);
+  NodeContainer nsNodes;
+  nsNodes.Create (2);
+  ApplicationContainer shards = networkServerHelper.Install (nsNodes);
+  ForwarderHelper ().Install (gateways);
+
+  NS_TEST_ASSERT_MSG_EQ (shards.GetN (), 2, "Expected one application per shard");
+  std::vector<LoraDeviceAddress> boundaries = networkServerHelper.GetShardBoundaries ();
+  NS_TEST_ASSERT_MSG_EQ (boundaries.size (), 1, "Expected one shard boundary");
+
+  std::vector<std::vector<LoraDeviceAddress> > received (2);
+  for (uint32_t shard = 0; shard < 2; shard++)
+    {
+      shards.Get (shard)->TraceConnectWithoutContext
+        ("ReceivedPacket",
+        MakeBoundCallback (&ShardedNetworkServerTest::ReceivedPacketAtShard,
+                           &received[shard]));
+    }
+  gateways.Get (0)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ()->TraceConnectWithoutContext
+    ("StartSending",
+    MakeCallback (&ShardedNetworkServerTest::StartSendingAtGateway, this));
+
+  for (uint32_t i = 0; i < endDevices.GetN (); i++)
+    {
+      Simulator::Schedule (Seconds (1), &ShardedNetworkServerTest::SendPacket,
+                           this, endDevices.Get (i));
+    }
+
+  Simulator::Stop (Seconds (60));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  // Each shard only got the uplinks of its own address range
+  for (uint32_t shard = 0; shard < 2; shard++)
+    {
+      NS_TEST_ASSERT_MSG_GT (received[shard].size (), 0,
+                             "Shard " << shard << " received no packet");
+      for (const LoraDeviceAddress &address : received[shard])
+        {
+          NS_TEST_ASSERT_MSG_EQ (address < boundaries[0], shard == 0,
+                                 "Packet from " << address <<
+                                 " routed to shard " << shard);
+        }
+    }
+
+  // Both devices were acknowledged, by distinct gateway transmissions
+  NS_TEST_ASSERT_MSG_EQ (m_ackedPackets, 2, "A device wasn't acknowledged");
+  std::sort (m_gatewayTransmissions.begin (), m_gatewayTransmissions.end ());
+  NS_TEST_ASSERT_MSG_EQ (std::adjacent_find (m_gatewayTransmissions.begin (),
+                                             m_gatewayTransmissions.end ())
+                         == m_gatewayTransmissions.end (), true,
+                         "The gateway was booked twice for the same time");
+}
+
+////////////////////////
+// AsyncComponentTest //
+////////////////////////
+
+/**
+ * A component that runs on the workers of the NetworkController, and counts
+ * the packets it processes and the results that are applied.
+ */
+class AsyncCountingComponent : public NetworkControllerComponent
+{
+public:
+  bool IsSideEffectFree (void) const
+  {
+    return true;
+  }
+
+  AsyncResult ProcessPacketAsync (const PacketSnapshot &snapshot)
+  {
+    m_processed++;
+    LoraDeviceAddress address = snapshot.deviceAddress;
+    AsyncCountingComponent *component = this;
+    return [component, address] (Ptr<EndDeviceStatus> status,
+                                 Ptr<NetworkStatus> networkStatus)
+           {
+             component->m_applied++;
+             component->m_applyTimes.push_back (Simulator::Now ());
+             if (status->m_endDeviceAddress != address)
+               {
+                 component->m_wrongDevice++;
+               }
+           };
+  }
+
+  void OnReceivedPacket (Ptr<const Packet> packet,
+                         Ptr<EndDeviceStatus> status,
+                         Ptr<NetworkStatus> networkStatus)
+  {
+    m_synchronous++;
+  }
+
+  void BeforeSendingReply (Ptr<EndDeviceStatus> status,
+                           Ptr<NetworkStatus> networkStatus)
+  {
+  }
+
+  void OnFailedReply (Ptr<EndDeviceStatus> status,
+                      Ptr<NetworkStatus> networkStatus)
+  {
+  }
+
+  std::atomic<int> m_processed {0}; //!< Packets processed by the workers
+  int m_applied = 0; //!< Results applied on the simulator thread
+  std::vector<Time> m_applyTimes; //!< When the results were applied
+  int m_wrongDevice = 0; //!< Results applied to another device
+  int m_synchronous = 0; //!< Calls to OnReceivedPacket
+};
+
+class AsyncComponentTest : public TestCase
+{
+public:
+  AsyncComponentTest ();
+  virtual ~AsyncComponentTest ();
+
+  void ReceivedPacket (Ptr<Packet const> packet);
+  void SendPacket (Ptr<Node> endDevice);
+
+private:
+  virtual void DoRun (void);
+
+  int m_receptions = 0;
+  std::vector<Time> m_uplinkTimes;
+};
+
+AsyncComponentTest::AsyncComponentTest ()
+  : TestCase ("Verify that asynchronous NetworkController components process "
+              "each uplink once, however many gateways received it, and "
+              "that their results are applied at the first receive window")
+{
+}
+
+AsyncComponentTest::~AsyncComponentTest ()
+{
+}
+
+void
+AsyncComponentTest::ReceivedPacket (Ptr<Packet const> packet)
+{
+  m_receptions++;
+  if (m_uplinkTimes.empty () || m_uplinkTimes.back () != Simulator::Now ())
+    {
+      m_uplinkTimes.push_back (Simulator::Now ());
+    }
+}
+
+void
+AsyncComponentTest::SendPacket (Ptr<Node> endDevice)
+{
+  endDevice->GetDevice (0)->Send (Create<Packet> (20), Address (), 0);
+}
+
+void
+AsyncComponentTest::DoRun (void)
+{
+  NS_LOG_DEBUG ("AsyncComponentTest");
+
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+
+  Ptr<LoraChannel> channel = CreateChannel ();
+
+  // A device halfway between two gateways, which both receive its packets
+  MobilityHelper mobility;
+  Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
+  allocator->Add (Vector (0.0, 0.0, 0.0));
+  allocator->Add (Vector (100.0, 0.0, 15.0));
+  allocator->Add (Vector (-100.0, 0.0, 15.0));
+  mobility.SetPositionAllocator (allocator);
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  NodeContainer endDevices = CreateEndDevices (1, mobility, channel);
+  NodeContainer gateways = CreateGateways (2, mobility, channel);
+  LorawanMacHelper ().SetSpreadingFactorsUp (endDevices, gateways, channel);
+  Ptr<Node> nsNode = CreateNetworkServer (endDevices, gateways);
+
+  Ptr<NetworkServer> networkServer = nsNode->GetApplication (0)->GetObject<NetworkServer> ();
+  networkServer->SetAttribute ("ComponentWorkerThreads", UintegerValue (2));
+  Ptr<AsyncCountingComponent> component = Create<AsyncCountingComponent> ();
+  networkServer->AddComponent (component);
+  networkServer->TraceConnectWithoutContext
+    ("ReceivedPacket", MakeCallback (&AsyncComponentTest::ReceivedPacket, this));
+
+  // Leave enough time between packets for the duty cycle
+  int nPackets = 3;
+  for (int i = 0; i < nPackets; i++)
+    {
+      Simulator::Schedule (Seconds (1 + 60 * i), &AsyncComponentTest::SendPacket,
+                           this, endDevices.Get (0));
+    }
+
+  Simulator::Stop (Seconds (60 * nPackets));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_receptions, 2 * nPackets,
+                         "Both gateways should have received every packet");
+  NS_TEST_ASSERT_MSG_EQ (component->m_synchronous, 0,
+                         "The component was called synchronously");
+  NS_TEST_ASSERT_MSG_EQ (component->m_processed.load (), nPackets,
+                         "Each uplink should be processed exactly once");
+  NS_TEST_ASSERT_MSG_EQ (component->m_applied, nPackets,
+                         "Each result should be applied exactly once");
+  NS_TEST_ASSERT_MSG_EQ (component->m_wrongDevice, 0,
+                         "A result was applied to the wrong device");
+
+  // The uplinks are unconfirmed, so no reply is sent: results are still
+  // applied when the first receive window opens
+  NS_TEST_ASSERT_MSG_EQ (m_uplinkTimes.size (), component->m_applyTimes.size (),
+                         "Expected one applied result per uplink");
+  for (uint32_t i = 0; i < m_uplinkTimes.size () && i < component->m_applyTimes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (component->m_applyTimes[i], m_uplinkTimes[i] + Seconds (1),
+                             "Result " << i << " wasn't applied at the first "
+                             "receive window");
+    }
+}
+
 /**************
  * Test Suite *
  **************/
@@ -305,6 +652,8 @@ NetworkServerTestSuite::NetworkServerTestSuite ()
   AddTestCase (new UplinkPacketTest, TestCase::QUICK);
   AddTestCase (new DownlinkPacketTest, TestCase::QUICK);
   AddTestCase (new LinkCheckTest, TestCase::QUICK);
+  AddTestCase (new ShardedNetworkServerTest, TestCase::QUICK);
+  AddTestCase (new AsyncComponentTest, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite